@@ -13,6 +13,9 @@
 
 #define NODISCARD __attribute__((__warn_unused_result__))
 
+#define CONTAINER_OF(ptr, type, member)                                        \
+    ((type*)((uintptr_t)(ptr)-offsetof(type, member)))
+
 static inline uintptr_t round_up(uintptr_t x, size_t align) {
     return (x + (align - 1)) & ~(align - 1);
 }
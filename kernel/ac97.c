@@ -34,6 +34,7 @@
  */
 
 #include "api/err.h"
+#include "api/poll.h"
 #include "api/sound.h"
 #include "api/sys/sysmacros.h"
 #include "boot_defs.h"
@@ -99,6 +100,8 @@ static void pci_enumeration_callback(const struct pci_addr* addr, uint16_t vendo
 
 static atomic_bool dma_is_running = false;
 static atomic_bool buffer_descriptor_list_is_full = false;
+static spinlock lock;
+static struct inode* device_inode;
 
 static void irq_handler(registers* regs) {
     (void)regs;
@@ -111,10 +114,15 @@ static void irq_handler(registers* regs) {
     status |= TRANSFER_STATUS_FIFO_ERROR;
     out16(pcm_out_channel + CHANNEL_STATUS, status);
 
+    spinlock_lock(&lock);
     if (status & TRANSFER_STATUS_DMA_CONTROLLER)
         dma_is_running = false;
 
     buffer_descriptor_list_is_full = false;
+    spinlock_unlock(&lock);
+
+    if (device_inode)
+        inode_notify_poll(device_inode);
 }
 
 bool ac97_init(void) {
@@ -183,7 +191,7 @@ static void start_dma(void) {
 }
 
 static int write_single_buffer(file_description* desc, const void* buffer, size_t count) {
-    bool int_flag = push_cli();
+    spinlock_lock(&lock);
     do {
         uint8_t current_idx = in8(pcm_out_channel + CHANNEL_CURRENT_INDEX);
         uint8_t last_valid_idx =
@@ -203,13 +211,13 @@ static int write_single_buffer(file_description* desc, const void* buffer, size_
             break;
 
         buffer_descriptor_list_is_full = true;
+        spinlock_unlock(&lock);
         int rc = file_description_block(desc, write_should_unblock);
-        if (IS_ERR(rc)) {
-            pop_cli(int_flag);
+        if (IS_ERR(rc))
             return rc;
-        }
+        spinlock_lock(&lock);
     } while (dma_is_running);
-    pop_cli(int_flag);
+    spinlock_unlock(&lock);
 
     unsigned char* dest = output_buf + PAGE_SIZE * output_buf_page_idx;
     memcpy(dest, buffer, count);
@@ -276,17 +284,25 @@ static int ac97_device_ioctl(file_description* desc, int request, void* argp) {
     return -EINVAL;
 }
 
+static short ac97_device_poll(file_description* desc, short events) {
+    if ((events & POLLOUT) && write_should_unblock(desc))
+        return POLLOUT;
+    return 0;
+}
+
 struct inode* ac97_device_create(void) {
     struct inode* inode = kmalloc(sizeof(struct inode));
     if (!inode)
         return ERR_PTR(-ENOMEM);
 
     static file_ops fops = {.write = ac97_device_write,
-                            .ioctl = ac97_device_ioctl};
+                            .ioctl = ac97_device_ioctl,
+                            .poll = ac97_device_poll};
     *inode = (struct inode){.fops = &fops,
                             .mode = S_IFCHR,
                             .device_id = makedev(14, 3),
                             .ref_count = 1};
+    device_inode = inode;
     return inode;
 }
 #endif
\ No newline at end of file
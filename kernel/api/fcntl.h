@@ -38,6 +38,13 @@
 #define F_DUPFD 0
 #define F_GETFL 3
 #define F_SETFL 4
+#define F_SETPIPE_SZ 1031
+#define F_GETPIPE_SZ 1032
+
+#define SPLICE_F_MOVE 0x1
+#define SPLICE_F_NONBLOCK 0x2
+#define SPLICE_F_MORE 0x4
+#define SPLICE_F_GIFT 0x8
 
 #define O_RDONLY 0x1
 #define O_WRONLY 0x2
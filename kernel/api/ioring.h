@@ -0,0 +1,92 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "sys/types.h"
+
+// operations of struct ioring_sqe
+#define IORING_OP_NOP 0
+#define IORING_OP_READ 1      // read(fd, addr, len)
+#define IORING_OP_WRITE 2     // write(fd, addr, len)
+#define IORING_OP_ACCEPT 3    // accept(fd, addr, (socklen_t*)len)
+#define IORING_OP_NANOSLEEP 4 // sleep for the struct timespec at addr
+#define IORING_OP_POLL 5      // wait until fd is ready for poll_events
+
+#define IORING_MAX_ENTRIES 256
+
+// submission queue entry, filled in by userland
+struct ioring_sqe {
+    uint8_t opcode;
+    uint8_t reserved;
+    uint16_t poll_events;
+    int32_t fd;
+    uint32_t addr;
+    uint32_t len;
+    uint64_t user_data; // copied to the completion as is
+};
+
+// completion queue entry, filled in by the kernel
+struct ioring_cqe {
+    uint64_t user_data;
+    int32_t res; // return value of the operation, or a negative errno
+    uint32_t flags;
+};
+
+// Header of the memory obtained by mmap()ing an ioring file descriptor.
+// Userland produces SQEs at sq_tail and consumes CQEs at cq_head, and the
+// kernel consumes SQEs at sq_head and produces CQEs at cq_tail. The indices
+// wrap around freely and are masked with entries - 1.
+struct ioring {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    uint32_t sq_entries;
+    uint32_t cq_entries; // twice sq_entries
+    volatile uint32_t cq_overflow; // number of CQEs dropped on a full queue
+    uint32_t reserved;
+};
+
+#define IORING_SQES(ring)                                                      \
+    ((struct ioring_sqe*)((uintptr_t)(ring) + sizeof(struct ioring)))
+#define IORING_CQES(ring)                                                      \
+    ((struct ioring_cqe*)(IORING_SQES(ring) + (ring)->sq_entries))
+
+// size of the memory to mmap() for a ring of sq_entries
+#define IORING_SIZE(sq_entries)                                                \
+    ((sizeof(struct ioring) + (sq_entries) * sizeof(struct ioring_sqe) +       \
+      2 * (sq_entries) * sizeof(struct ioring_cqe) + 4095) &                   \
+     ~4095)
@@ -0,0 +1,75 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "../sys/socket.h"
+#include <stdint.h>
+
+#define IPPROTO_IP 0
+#define IPPROTO_ICMP 1
+#define IPPROTO_TCP 6
+#define IPPROTO_UDP 17
+
+typedef uint16_t in_port_t;
+typedef uint32_t in_addr_t;
+
+// addresses and ports are in network byte order
+struct in_addr {
+    in_addr_t s_addr;
+};
+
+typedef struct sockaddr_in {
+    sa_family_t sin_family;
+    in_port_t sin_port;
+    struct in_addr sin_addr;
+    char sin_zero[8];
+} sockaddr_in;
+
+// in host byte order, to be passed through htonl()
+#define INADDR_ANY ((in_addr_t)0x00000000)
+#define INADDR_LOOPBACK ((in_addr_t)0x7f000001)
+
+static inline uint16_t htons(uint16_t x) {
+    return (uint16_t)((x << 8) | (x >> 8));
+}
+
+static inline uint32_t htonl(uint32_t x) {
+    return ((x & 0xff) << 24) | ((x & 0xff00) << 8) | ((x >> 8) & 0xff00) |
+           (x >> 24);
+}
+
+#define ntohs htons
+#define ntohl htonl
@@ -0,0 +1,56 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#pragma once
+
+#define CLONE_VM 0x100                 // share the address space
+#define CLONE_FS 0x200                 // share the working directory
+#define CLONE_FILES 0x400              // share the file descriptor table
+#define CLONE_THREAD 0x10000           // put the child in the caller's thread group
+#define CLONE_SETTLS 0x80000           // set the TLS segment base of the child
+#define CLONE_CHILD_CLEARTID 0x200000  // clear and futex-wake ctid on exit
+#define CLONE_CHILD_SETTID 0x1000000   // store the child's tid at ctid
+
+#define SCHED_OTHER 0 // time-shared by vruntime
+#define SCHED_FIFO 1  // real-time, runs until it blocks or yields
+#define SCHED_RR 2    // real-time, round robin within the same priority
+
+// priorities of the real-time policies, higher runs first
+#define SCHED_RT_PRIORITY_MIN 1
+#define SCHED_RT_PRIORITY_MAX 99
+
+struct sched_param {
+    int sched_priority;
+};
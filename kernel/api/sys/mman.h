@@ -45,3 +45,10 @@
 #define MAP_ANON MAP_ANONYMOUS
 
 #define MAP_FAILED ((void*)-1)
+
+// Accepted for compatibility, but descriptors aren't closed on exec.
+#define MFD_CLOEXEC 0x1
+
+// memfd_create() names are only for debugging and aren't stored, but are
+// limited to the same length as on Linux.
+#define MFD_NAME_MAX 249
@@ -35,12 +35,32 @@
 
 #pragma once
 
+#include "uio.h"
 #include <stdint.h>
 
 #define AF_UNIX 1
 #define AF_LOCAL AF_UNIX
+#define AF_INET 2
 
 #define SOCK_STREAM 1
+#define SOCK_DGRAM 2
+#define SOCK_SEQPACKET 5
+
+#define SOMAXCONN 128
+
+#define SOL_SOCKET 1
+
+#define SO_SNDBUF 7
+#define SO_RCVBUF 8
+
+// control message type carrying file descriptors
+#define SCM_RIGHTS 1
+
+// the most descriptors that a single message can carry
+#define SCM_MAX_FD 253
+
+#define MSG_CTRUNC 0x8
+#define MSG_TRUNC 0x20
 
 typedef uint16_t sa_family_t;
 typedef uint32_t socklen_t;
@@ -54,3 +74,42 @@ typedef struct sockaddr_un {
     sa_family_t sun_family;
     char sun_path[108];
 } sockaddr_un;
+
+typedef struct msghdr {
+    void* msg_name;
+    socklen_t msg_namelen;
+    struct iovec* msg_iov;
+    size_t msg_iovlen;
+    void* msg_control;
+    size_t msg_controllen;
+    int msg_flags;
+} msghdr;
+
+typedef struct cmsghdr {
+    size_t cmsg_len;
+    int cmsg_level;
+    int cmsg_type;
+} cmsghdr;
+
+#define CMSG_ALIGN(len) (((len) + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1))
+#define CMSG_SPACE(len) (CMSG_ALIGN(sizeof(struct cmsghdr)) + CMSG_ALIGN(len))
+#define CMSG_LEN(len) (CMSG_ALIGN(sizeof(struct cmsghdr)) + (len))
+#define CMSG_DATA(cmsg)                                                        \
+    ((unsigned char*)(cmsg) + CMSG_ALIGN(sizeof(struct cmsghdr)))
+#define CMSG_FIRSTHDR(msg)                                                     \
+    ((msg)->msg_controllen >= sizeof(struct cmsghdr)                           \
+         ? (struct cmsghdr*)(msg)->msg_control                                 \
+         : (struct cmsghdr*)NULL)
+#define CMSG_NXTHDR(msg, cmsg) cmsg_nxthdr(msg, cmsg)
+
+static inline struct cmsghdr* cmsg_nxthdr(const struct msghdr* msg,
+                                          const struct cmsghdr* cmsg) {
+    if (cmsg->cmsg_len < sizeof(struct cmsghdr))
+        return NULL;
+    unsigned char* next = (unsigned char*)cmsg + CMSG_ALIGN(cmsg->cmsg_len);
+    unsigned char* end = (unsigned char*)msg->msg_control + msg->msg_controllen;
+    if (next + sizeof(struct cmsghdr) > end ||
+        next + CMSG_ALIGN(((struct cmsghdr*)next)->cmsg_len) > end)
+        return NULL;
+    return (struct cmsghdr*)next;
+}
@@ -35,6 +35,8 @@
 
 #pragma once
 
+#include "../time.h"
+#include "socket.h"
 #include "types.h"
 #include <stddef.h>
 
@@ -46,43 +48,84 @@
     F(chdir)                                                                   \
     F(clock_gettime)                                                           \
     F(clock_nanosleep)                                                         \
+    F(clone)                                                                   \
     F(close)                                                                   \
     F(connect)                                                                 \
+    F(copy_file_range)                                                         \
     F(dbgputs)                                                                 \
     F(dup2)                                                                    \
+    F(epoll_create1)                                                           \
+    F(epoll_ctl)                                                               \
+    F(epoll_wait)                                                              \
+    F(eventfd)                                                                 \
     F(execve)                                                                  \
     F(exit)                                                                    \
+    F(exit_group)                                                              \
     F(fcntl)                                                                   \
     F(fork)                                                                    \
     F(ftruncate)                                                               \
+    F(futex)                                                                   \
     F(getcwd)                                                                  \
     F(getdents)                                                                \
     F(getpgid)                                                                 \
     F(getpid)                                                                  \
+    F(getsockopt)                                                              \
+    F(gettid)                                                                  \
     F(ioctl)                                                                   \
+    F(ioring_enter)                                                            \
+    F(ioring_setup)                                                            \
     F(kill)                                                                    \
     F(link)                                                                    \
     F(listen)                                                                  \
     F(lseek)                                                                   \
+    F(memfd_create)                                                            \
     F(mkdir)                                                                   \
     F(mknod)                                                                   \
     F(mmap)                                                                    \
+    F(mq_getsetattr)                                                           \
+    F(mq_open)                                                                 \
+    F(mq_timedreceive)                                                         \
+    F(mq_timedsend)                                                            \
+    F(mq_unlink)                                                               \
     F(munmap)                                                                  \
+    F(nice)                                                                    \
     F(open)                                                                    \
     F(pipe)                                                                    \
+    F(poll)                                                                    \
+    F(pread)                                                                   \
+    F(pwrite)                                                                  \
     F(read)                                                                    \
+    F(readv)                                                                   \
     F(reboot)                                                                  \
+    F(recvmsg)                                                                 \
     F(rename)                                                                  \
     F(rmdir)                                                                   \
+    F(sched_getparam)                                                          \
+    F(sched_getscheduler)                                                      \
+    F(sched_setscheduler)                                                      \
     F(sched_yield)                                                             \
+    F(sendfile)                                                                \
+    F(sendmsg)                                                                 \
+    F(set_thread_area)                                                         \
     F(setpgid)                                                                 \
+    F(setsockopt)                                                              \
     F(socket)                                                                  \
+    F(socketpair)                                                              \
+    F(splice)                                                                  \
     F(stat)                                                                    \
     F(sysconf)                                                                 \
+    F(systrace)                                                                \
+    F(systrace_read)                                                           \
+    F(tee)                                                                     \
+    F(timerfd_create)                                                          \
+    F(timerfd_gettime)                                                         \
+    F(timerfd_settime)                                                         \
     F(times)                                                                   \
     F(unlink)                                                                  \
+    F(vmsplice)                                                                \
     F(waitpid)                                                                 \
-    F(write)
+    F(write)                                                                   \
+    F(writev)
 
 enum {
 #define DEFINE_ITEM(name) SYS_##name,
@@ -99,3 +142,33 @@ typedef struct mmap_params {
     int fd;
     off_t offset;
 } mmap_params;
+
+// also used by copy_file_range()
+typedef struct splice_params {
+    int fd_in;
+    off_t* off_in;
+    int fd_out;
+    off_t* off_out;
+    size_t len;
+    unsigned flags;
+} splice_params;
+
+// for getsockopt() and setsockopt(), the latter of which passes a pointer to
+// its optlen
+typedef struct sockopt_params {
+    int sockfd;
+    int level;
+    int optname;
+    void* optval;
+    socklen_t* optlen;
+} sockopt_params;
+
+// for mq_timedsend() and mq_timedreceive(), the former of which passes a
+// pointer to its msg_prio
+typedef struct mq_timed_params {
+    int mqdes;
+    char* msg_ptr;
+    size_t msg_len;
+    unsigned* msg_prio;
+    const struct timespec* abs_timeout;
+} mq_timed_params;
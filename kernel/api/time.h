@@ -48,6 +48,11 @@ struct timespec {
     long tv_nsec;
 };
 
+struct itimerspec {
+    struct timespec it_interval; // period, or 0 for a one-shot timer
+    struct timespec it_value;    // first expiration, or 0 to disarm
+};
+
 struct tm {
     int tm_sec;
     int tm_min;
@@ -39,9 +39,13 @@
 #define STDOUT_FILENO 1
 #define STDERR_FILENO 2
 
+// writes of up to PIPE_BUF bytes to a pipe are not interleaved with others
+#define PIPE_BUF 4096
+
 enum {
     _SC_MONOTONIC_CLOCK,
     _SC_OPEN_MAX,
     _SC_PAGESIZE,
     _SC_CLK_TCK,
+    NUM_SYSCONF_NAMES
 };
@@ -0,0 +1,170 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "cpu.h"
+#include "boot_defs.h"
+#include "interrupts.h"
+#include "memory/memory.h"
+#include "panic.h"
+#include "scheduler.h"
+#include "system.h"
+
+#if defined(__i386__)
+
+#define LAPIC_ID 0x20
+#define LAPIC_EOI 0xb0
+#define LAPIC_SVR 0xf0
+#define LAPIC_ICR_LO 0x300
+#define LAPIC_ICR_HI 0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_TIMER_INITIAL_COUNT 0x380
+#define LAPIC_TIMER_CURRENT_COUNT 0x390
+#define LAPIC_TIMER_DIVIDE 0x3e0
+
+#define SVR_ENABLE 0x100
+
+#define ICR_FIXED 0x0
+#define ICR_INIT 0x500
+#define ICR_STARTUP 0x600
+#define ICR_DELIVERY_PENDING 0x1000
+#define ICR_ASSERT 0x4000
+
+#define LVT_MASKED 0x10000
+#define LVT_TIMER_PERIODIC 0x20000
+
+#define TIMER_DIVIDE_BY_16 0x3
+
+// number of PIT ticks to measure the LAPIC timer frequency against
+#define CALIBRATION_TICKS 10
+
+static volatile uint32_t* lapic;
+static uint32_t timer_initial_count;
+
+static uint32_t lapic_read(uint32_t reg) { return lapic[reg / 4]; }
+
+static void lapic_write(uint32_t reg, uint32_t value) {
+    lapic[reg / 4] = value;
+    (void)lapic[LAPIC_ID / 4]; // wait for the write to finish
+}
+
+static void handle_spurious(registers* regs) { (void)regs; }
+
+static void handle_timer(registers* regs) {
+    ASSERT(!interrupts_enabled());
+    lapic_eoi();
+
+    bool in_kernel = (regs->cs & 3) == 0;
+    scheduler_tick(in_kernel);
+}
+
+bool lapic_init(uintptr_t lapic_paddr) {
+    if (lapic)
+        return true;
+
+    uintptr_t vaddr = range_allocator_alloc(&kernel_vaddr_allocator, PAGE_SIZE);
+    if (IS_ERR(vaddr))
+        return false;
+    if (IS_ERR(paging_map_to_physical_range(vaddr, lapic_paddr, PAGE_SIZE, PAGE_WRITE | PAGE_CACHE_DISABLE | PAGE_GLOBAL)))
+        return false;
+    lapic = (volatile uint32_t*)vaddr;
+
+    idt_register_interrupt_handler(LAPIC_SPURIOUS_VECTOR, handle_spurious);
+    idt_register_interrupt_handler(LAPIC_TIMER_VECTOR, handle_timer);
+    return true;
+}
+
+void lapic_enable(void) {
+    lapic_write(LAPIC_SVR, SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+}
+
+uint8_t lapic_get_id(void) { return lapic_read(LAPIC_ID) >> 24; }
+
+void lapic_eoi(void) { lapic_write(LAPIC_EOI, 0); }
+
+static void send_ipi(uint8_t apic_id, uint32_t command) {
+    bool int_flag = push_cli();
+    lapic_write(LAPIC_ICR_HI, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_ICR_LO, command);
+    while (lapic_read(LAPIC_ICR_LO) & ICR_DELIVERY_PENDING)
+        pause();
+    pop_cli(int_flag);
+}
+
+void lapic_send_ipi(uint8_t apic_id, uint8_t vector) {
+    send_ipi(apic_id, ICR_FIXED | ICR_ASSERT | vector);
+}
+
+void lapic_send_init(uint8_t apic_id) {
+    send_ipi(apic_id, ICR_INIT | ICR_ASSERT);
+}
+
+void lapic_send_startup(uint8_t apic_id, uint8_t vector) {
+    send_ipi(apic_id, ICR_STARTUP | ICR_ASSERT | vector);
+}
+
+// measures how many LAPIC timer ticks elapse in 1 / CLK_TCK seconds,
+// using the PIT-driven uptime counter as a reference
+void lapic_timer_calibrate(void) {
+    ASSERT(interrupts_enabled());
+
+    lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_BY_16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | LAPIC_TIMER_VECTOR);
+
+    volatile uint32_t* ticks = &uptime;
+    uint32_t start = *ticks;
+    while (*ticks == start)
+        pause();
+
+    lapic_write(LAPIC_TIMER_INITIAL_COUNT, UINT32_MAX);
+    start = *ticks;
+    while (*ticks - start < CALIBRATION_TICKS)
+        pause();
+    uint32_t elapsed = UINT32_MAX - lapic_read(LAPIC_TIMER_CURRENT_COUNT);
+    lapic_write(LAPIC_TIMER_INITIAL_COUNT, 0);
+
+    timer_initial_count = elapsed / CALIBRATION_TICKS;
+    ASSERT(timer_initial_count > 0);
+}
+
+// PIT only interrupts the bootstrap processor, so application processors use
+// their local APIC timers to drive scheduler ticks
+void lapic_timer_start(void) {
+    ASSERT(timer_initial_count > 0);
+    lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_BY_16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_TIMER_PERIODIC | LAPIC_TIMER_VECTOR);
+    lapic_write(LAPIC_TIMER_INITIAL_COUNT, timer_initial_count);
+}
+
+#endif
@@ -93,10 +93,41 @@ static inline void write_cr4(uint32_t value) {
 
 static inline void flush_tlb(void) { write_cr3(read_cr3()); }
 
+// also flushes global pages by toggling CR4.PGE
+static inline void flush_tlb_all(void) {
+    uint32_t cr4 = read_cr4();
+    write_cr4(cr4 & ~0x80);
+    write_cr4(cr4);
+}
+
 static inline void flush_tlb_single(uintptr_t vaddr) {
     __asm__ volatile("invlpg (%0)" ::"r"(vaddr) : "memory");
 }
 
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx,
+                         uint32_t* ecx, uint32_t* edx) {
+    __asm__ volatile("cpuid"
+                     : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                     : "a"(leaf), "c"(0));
+}
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint64_t read_msr(uint32_t msr) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void write_msr(uint32_t msr, uint64_t value) {
+    __asm__ volatile("wrmsr" ::"c"(msr), "a"((uint32_t)value),
+                     "d"((uint32_t)(value >> 32)));
+}
+
 static inline uint8_t in8(uint16_t port) {
     uint8_t rv;
     __asm__ volatile("inb %1, %0" : "=a"(rv) : "dN"(port));
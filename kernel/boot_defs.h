@@ -39,3 +39,4 @@
 #define KERNEL_VADDR 0xc0000000
 #define KERNEL_PDE_IDX (KERNEL_VADDR >> 22)
 #define STACK_SIZE 0x4000
+#define SMP_TRAMPOLINE_ADDR 0x7000
@@ -41,10 +41,12 @@
 #include <kernel/api/fb.h>
 #include <kernel/api/fcntl.h>
 #include <kernel/api/hid.h>
+#include <kernel/api/poll.h>
 #include <kernel/api/signum.h>
 #include <kernel/api/sys/ioctl.h>
 #include <kernel/api/sys/sysmacros.h>
 #include <kernel/api/sys/types.h>
+#include <kernel/boot_defs.h>
 #include <kernel/fs/fs.h>
 #include <kernel/interrupts.h>
 #include <kernel/lock.h>
@@ -468,6 +470,8 @@ static void on_char(char c) {
 
 static bool initialized = false;
 static ring_buf input_buf;
+static spinlock input_buf_lock;
+static struct inode* device_inode;
 static mutex lock;
 
 void fb_console_init(void) {
@@ -500,15 +504,21 @@ void fb_console_init(void) {
     clear_screen();
     flush();
 
-    ASSERT_OK(ring_buf_init(&input_buf));
+    ASSERT_OK(ring_buf_init(&input_buf, PAGE_SIZE));
 
     initialized = true;
 }
 
+static void notify_input(void) {
+    if (device_inode)
+        inode_notify_poll(device_inode);
+}
+
 static void input_buf_write_str(const char* s) {
-    bool int_flag = push_cli();
+    spinlock_lock(&input_buf_lock);
     ring_buf_write_evicting_oldest(&input_buf, s, strlen(s));
-    pop_cli(int_flag);
+    spinlock_unlock(&input_buf_lock);
+    notify_input();
 }
 
 static pid_t pgid;
@@ -554,16 +564,17 @@ void fb_console_on_key(const key_event* event) {
 
     tty_maybe_send_signal(pgid, key);
 
-    bool int_flag = push_cli();
+    spinlock_lock(&input_buf_lock);
     ring_buf_write_evicting_oldest(&input_buf, &key, 1);
-    pop_cli(int_flag);
+    spinlock_unlock(&input_buf_lock);
+    notify_input();
 }
 
 static bool read_should_unblock(file_description* desc) {
     (void)desc;
-    bool int_flag = push_cli();
+    spinlock_lock(&input_buf_lock);
     bool should_unblock = !ring_buf_is_empty(&input_buf);
-    pop_cli(int_flag);
+    spinlock_unlock(&input_buf_lock);
     return should_unblock;
 }
 
@@ -575,14 +586,14 @@ static ssize_t fb_console_device_read(file_description* desc, void* buffer, size
         if (IS_ERR(rc))
             return rc;
 
-        bool int_flag = push_cli();
+        spinlock_lock(&input_buf_lock);
         if (ring_buf_is_empty(&input_buf)) {
-            pop_cli(int_flag);
+            spinlock_unlock(&input_buf_lock);
             continue;
         }
 
         ssize_t nread = ring_buf_read(&input_buf, buffer, count);
-        pop_cli(int_flag);
+        spinlock_unlock(&input_buf_lock);
         return nread;
     }
 }
@@ -624,6 +635,15 @@ static int fb_console_device_ioctl(file_description* desc, int request, void* ar
     return -EINVAL;
 }
 
+static short fb_console_device_poll(file_description* desc, short events) {
+    short revents = 0;
+    if ((events & POLLIN) && read_should_unblock(desc))
+        revents |= POLLIN;
+    if (events & POLLOUT)
+        revents |= POLLOUT;
+    return revents;
+}
+
 struct inode* fb_console_device_create(void) {
     struct inode* inode = kmalloc(sizeof(struct inode));
     if (!inode)
@@ -631,10 +651,12 @@ struct inode* fb_console_device_create(void) {
 
     static file_ops fops = {.read = fb_console_device_read,
                             .write = fb_console_device_write,
-                            .ioctl = fb_console_device_ioctl};
+                            .ioctl = fb_console_device_ioctl,
+                            .poll = fb_console_device_poll};
     *inode = (struct inode){.fops = &fops,
                             .mode = S_IFCHR,
                             .device_id = makedev(5, 0),
                             .ref_count = 1};
+    device_inode = inode;
     return inode;
 }
@@ -34,9 +34,11 @@
  */
 
 #include "console.h"
+#include <kernel/api/poll.h>
 #include <kernel/api/signum.h>
 #include <kernel/api/sys/ioctl.h>
 #include <kernel/api/sys/sysmacros.h>
+#include <kernel/boot_defs.h>
 #include <kernel/interrupts.h>
 #include <kernel/panic.h>
 #include <kernel/process.h>
@@ -45,11 +47,13 @@
 #include <kernel/serial.h>
 
 static ring_buf input_bufs[4];
+static spinlock input_bufs_lock;
+static struct inode* device_inodes[4];
 static pid_t pgid;
 
 void serial_console_init(void) {
     for (size_t i = 0; i < 4; ++i)
-        ASSERT_OK(ring_buf_init(input_bufs + i));
+        ASSERT_OK(ring_buf_init(input_bufs + i, PAGE_SIZE));
 }
 
 static ring_buf* get_input_buf_for_port(uint16_t port) {
@@ -66,9 +70,13 @@ void serial_console_on_char(uint16_t port, char ch) {
 
     tty_maybe_send_signal(pgid, ch);
 
-    bool int_flag = push_cli();
+    spinlock_lock(&input_bufs_lock);
     ring_buf_write_evicting_oldest(buf, &ch, 1);
-    pop_cli(int_flag);
+    spinlock_unlock(&input_bufs_lock);
+
+    struct inode* inode = device_inodes[serial_port_to_com_number(port) - 1];
+    if (inode)
+        inode_notify_poll(inode);
 }
 
 typedef struct serial_console_device {
@@ -79,9 +87,9 @@ typedef struct serial_console_device {
 static bool read_should_unblock(file_description* desc) {
     serial_console_device* dev = (serial_console_device*)desc->inode;
     ring_buf* buf = get_input_buf_for_port(dev->port);
-    bool int_flag = push_cli();
+    spinlock_lock(&input_bufs_lock);
     bool should_unblock = !ring_buf_is_empty(buf);
-    pop_cli(int_flag);
+    spinlock_unlock(&input_bufs_lock);
     return should_unblock;
 }
 
@@ -95,13 +103,13 @@ static ssize_t serial_console_device_read(file_description* desc, void* buffer,
         if (IS_ERR(rc))
             return rc;
 
-        bool int_flag = push_cli();
+        spinlock_lock(&input_bufs_lock);
         if (ring_buf_is_empty(buf)) {
-            pop_cli(int_flag);
+            spinlock_unlock(&input_bufs_lock);
             continue;
         }
         ssize_t nread = ring_buf_read(buf, buffer, count);
-        pop_cli(int_flag);
+        spinlock_unlock(&input_bufs_lock);
         return nread;
     }
 }
@@ -132,6 +140,15 @@ static int serial_console_device_ioctl(file_description* desc, int request,
     return -EINVAL;
 }
 
+static short serial_console_device_poll(file_description* desc, short events) {
+    short revents = 0;
+    if ((events & POLLIN) && read_should_unblock(desc))
+        revents |= POLLIN;
+    if (events & POLLOUT)
+        revents |= POLLOUT;
+    return revents;
+}
+
 struct inode* serial_console_device_create(uint16_t port) {
     if (!serial_is_valid_port(port))
         return NULL;
@@ -146,11 +163,13 @@ struct inode* serial_console_device_create(uint16_t port) {
     struct inode* inode = (struct inode*)dev;
     static file_ops fops = {.read = serial_console_device_read,
                             .write = serial_console_device_write,
-                            .ioctl = serial_console_device_ioctl};
+                            .ioctl = serial_console_device_ioctl,
+                            .poll = serial_console_device_poll};
     inode->fops = &fops;
     inode->mode = S_IFCHR;
     inode->device_id = makedev(4, 63 + (dev_t)serial_port_to_com_number(port));
     inode->ref_count = 1;
+    device_inodes[serial_port_to_com_number(port) - 1] = inode;
 
     return inode;
 }
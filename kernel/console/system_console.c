@@ -36,11 +36,13 @@
 #include "console.h"
 #include "kernel/panic.h"
 #include <kernel/api/fcntl.h>
+#include <kernel/api/poll.h>
 #include <kernel/api/sys/sysmacros.h>
 #include <kernel/fs/fs.h>
 #include <kernel/memory/memory.h>
 
 static file_description* active_console = NULL;
+static struct inode* device_inode = NULL;
 
 void system_console_init(void) {
     active_console = vfs_open("/dev/tty", O_RDWR, 0);
@@ -69,6 +71,22 @@ static int system_console_device_ioctl(file_description* desc, int request, void
     return file_description_ioctl(active_console, request, argp);
 }
 
+static short system_console_device_poll(file_description* desc,
+                                        short events) {
+    (void)desc;
+    return file_description_poll(active_console, events);
+}
+
+// forwards readiness changes of the active console to the pollers of
+// /dev/console
+static void notify_active_console_poll(poll_watch* watch) {
+    (void)watch;
+    if (device_inode)
+        inode_notify_poll(device_inode);
+}
+
+static poll_watch active_console_watch = {.notify = notify_active_console_poll};
+
 struct inode* system_console_device_create(void) {
     struct inode* inode = kmalloc(sizeof(struct inode));
     if (!inode)
@@ -78,10 +96,13 @@ struct inode* system_console_device_create(void) {
         .read = system_console_device_read,
         .write = system_console_device_write,
         .ioctl = system_console_device_ioctl,
+        .poll = system_console_device_poll,
     };
     *inode = (struct inode){.fops = &fops,
                             .mode = S_IFCHR,
                             .device_id = makedev(5, 1),
                             .ref_count = 1};
+    device_inode = inode;
+    inode_add_poll_watch(active_console->inode, &active_console_watch);
     return inode;
 }
@@ -0,0 +1,170 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "api/sched.h"
+#include "forward.h"
+#include "lock.h"
+#include "rbtree.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_NUM_CPUS 16
+
+#define RT_BITMAP_WORDS ((SCHED_RT_PRIORITY_MAX + 32) / 32)
+
+// Each CPU has its own copy of this structure. The kernel keeps a per-CPU data
+// segment (selector 0x30) whose base points to it, so %gs:0 always yields the
+// structure of the CPU the code is currently running on.
+struct cpu {
+    struct cpu* self;
+    struct process* current_process;
+    page_directory* pd;
+
+    size_t id;
+    uint8_t apic_id;
+    atomic_bool online;
+
+    // process whose FPU state the FPU registers of this CPU hold
+    struct process* fpu_owner;
+
+    struct process* idle;
+    uintptr_t scheduler_stack_top;
+    size_t ticks;
+
+    // Runnable processes ordered by vruntime. The running process is kept out
+    // of the tree until it is preempted.
+    spinlock ready_queue_lock;
+    struct rb_root ready_queue;
+    struct rb_node* leftmost;
+    atomic_size_t num_ready;
+
+    // sum of the weights of the processes in the ready queue
+    unsigned long load;
+
+    // monotonically increasing floor of the vruntimes on this CPU, which new
+    // and woken processes are placed relative to
+    uint64_t min_vruntime;
+
+    // Runnable real-time processes in FIFO order for each priority, with a bit
+    // of rt_bitmap set for each non-empty queue. They run before the processes
+    // in the CFS ready queue unless the CPU is throttled.
+    struct process* rt_heads[SCHED_RT_PRIORITY_MAX + 1];
+    struct process* rt_tails[SCHED_RT_PRIORITY_MAX + 1];
+    uint32_t rt_bitmap[RT_BITMAP_WORDS];
+
+    // ticks real-time processes have run for in the current throttling period
+    size_t rt_ticks;
+    size_t rt_period_start;
+    bool rt_throttled;
+
+    // set when a woken process should preempt the running one
+    atomic_bool need_resched;
+
+    size_t num_switches;
+
+    atomic_uint tlb_flush_requests;
+    atomic_uint tlb_flush_done;
+};
+
+extern struct cpu cpus[MAX_NUM_CPUS];
+extern atomic_size_t num_cpus;
+
+#if defined(__i386__)
+
+#define CPU_DATA_SEGMENT 0x30
+
+// user data segment whose base is switched to the TLS of each process
+#define TLS_SEGMENT (0x38 | 3)
+
+// TSS of the task that handles double faults
+#define DOUBLE_FAULT_TSS_SEGMENT 0x40
+
+// The fields below are read with a single gs-relative load, so the result is
+// consistent even if the reading process migrates to another CPU right after.
+
+static inline struct cpu* cpu_get_current(void) {
+    struct cpu* cpu;
+    __asm__ volatile("movl %%gs:%c1, %0"
+                     : "=r"(cpu)
+                     : "i"(offsetof(struct cpu, self)));
+    return cpu;
+}
+
+static inline struct process* cpu_current_process(void) {
+    struct process* process;
+    __asm__ volatile("movl %%gs:%c1, %0"
+                     : "=r"(process)
+                     : "i"(offsetof(struct cpu, current_process)));
+    return process;
+}
+
+static inline page_directory* cpu_current_page_directory(void) {
+    page_directory* pd;
+    __asm__ volatile("movl %%gs:%c1, %0"
+                     : "=r"(pd)
+                     : "i"(offsetof(struct cpu, pd)));
+    return pd;
+}
+
+#define IPI_TLB_FLUSH_VECTOR 0xf1
+#define IPI_RESCHEDULE_VECTOR 0xf2
+#define LAPIC_TIMER_VECTOR 0xf3
+#define LAPIC_SPURIOUS_VECTOR 0xff
+
+// starts application processors found in ACPI MADT or MP tables
+void smp_init(void);
+
+// invalidates TLBs of all the other online CPUs and waits for them to finish
+void smp_flush_tlb_others(void);
+void smp_handle_pending_tlb_flush(void);
+
+// wakes up the CPU so that it picks up newly enqueued processes
+void smp_send_reschedule(struct cpu*);
+
+bool lapic_init(uintptr_t lapic_paddr);
+void lapic_enable(void);
+uint8_t lapic_get_id(void);
+void lapic_eoi(void);
+void lapic_send_ipi(uint8_t apic_id, uint8_t vector);
+void lapic_send_init(uint8_t apic_id);
+void lapic_send_startup(uint8_t apic_id, uint8_t vector);
+void lapic_timer_calibrate(void);
+void lapic_timer_start(void);
+
+#endif
@@ -49,6 +49,9 @@ typedef union page_table_entry page_table_entry;
 // process.h
 struct process;
 
+// cpu.h
+struct cpu;
+
 // fs/fs.h
 typedef struct file_description file_description;
 
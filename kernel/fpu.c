@@ -0,0 +1,109 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "asm_wrapper.h"
+#include "cpu.h"
+#include "interrupts.h"
+#include "panic.h"
+#include "process.h"
+#include "system.h"
+
+// FPU state is switched lazily. Switching to a process sets CR0.TS, so the
+// first x87/SSE instruction the process executes raises #NM, and only then
+// its state is restored. Processes that never touch the FPU, which is most of
+// them, never pay for fxsave/fxrstor.
+//
+// The state is saved back when a process that used the FPU is switched out,
+// and the CPU remembers whose state its registers still hold, so a process
+// coming back to the same CPU without anyone else using the FPU there in the
+// meantime doesn't even need the restore.
+
+#define CR0_TS 0x8
+
+atomic_size_t fpu_num_lazy_restores;
+atomic_size_t fpu_num_saves;
+
+static void set_ts(void) { write_cr0(read_cr0() | CR0_TS); }
+
+static void clear_ts(void) { __asm__ volatile("clts"); }
+
+static bool is_live(void) { return !(read_cr0() & CR0_TS); }
+
+static void handle_device_not_available(registers* regs) {
+    (void)regs;
+    struct cpu* cpu = cpu_get_current();
+    clear_ts();
+    if (cpu->fpu_owner == current && current->fpu_cpu == cpu)
+        return;
+    __asm__ volatile("fxrstor %0" ::"m"(current->fpu_state));
+    cpu->fpu_owner = current;
+    current->fpu_cpu = cpu;
+    atomic_fetch_add(&fpu_num_lazy_restores, 1);
+}
+
+void fpu_init(void) {
+    idt_register_interrupt_handler(7, handle_device_not_available);
+}
+
+void fpu_switch_out(struct process* prev) {
+    ASSERT(!interrupts_enabled());
+    if (!is_live())
+        return;
+    __asm__ volatile("fxsave %0" : "=m"(prev->fpu_state));
+    atomic_fetch_add(&fpu_num_saves, 1);
+}
+
+void fpu_switch_in(void) {
+    ASSERT(!interrupts_enabled());
+    set_ts();
+}
+
+void fpu_save_current(void) {
+    bool int_flag = push_cli();
+    if (is_live())
+        __asm__ volatile("fxsave %0" : "=m"(current->fpu_state));
+    pop_cli(int_flag);
+}
+
+void fpu_reset_current(void) {
+    bool int_flag = push_cli();
+    struct cpu* cpu = cpu_get_current();
+    current->fpu_state = initial_fpu_state;
+    current->fpu_cpu = NULL;
+    if (cpu->fpu_owner == current)
+        cpu->fpu_owner = NULL;
+    set_ts();
+    pop_cli(int_flag);
+}
@@ -0,0 +1,172 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "fs.h"
+#include <kernel/api/fcntl.h>
+#include <kernel/api/poll.h>
+#include <kernel/api/sys/eventfd.h>
+#include <kernel/memory/memory.h>
+#include <kernel/panic.h>
+#include <kernel/scheduler.h>
+
+#define COUNT_MAX UINT64_C(0xfffffffffffffffe)
+
+struct eventfd {
+    struct inode inode;
+    spinlock lock;
+    uint64_t count;
+    bool semaphore;
+};
+
+static void eventfd_destroy_inode(struct inode* inode) {
+    kfree(inode);
+}
+
+static bool read_should_unblock(file_description* desc) {
+    struct eventfd* eventfd = (struct eventfd*)desc->inode;
+    spinlock_lock(&eventfd->lock);
+    bool should_unblock = eventfd->count > 0;
+    spinlock_unlock(&eventfd->lock);
+    return should_unblock;
+}
+
+static ssize_t eventfd_read(file_description* desc, void* buffer,
+                            size_t count) {
+    if (count < sizeof(eventfd_t))
+        return -EINVAL;
+    struct eventfd* eventfd = (struct eventfd*)desc->inode;
+
+    for (;;) {
+        int rc = file_description_block(desc, read_should_unblock);
+        if (IS_ERR(rc))
+            return rc;
+
+        spinlock_lock(&eventfd->lock);
+        if (eventfd->count == 0) {
+            spinlock_unlock(&eventfd->lock);
+            continue;
+        }
+        eventfd_t value = eventfd->semaphore ? 1 : eventfd->count;
+        eventfd->count -= value;
+        spinlock_unlock(&eventfd->lock);
+
+        inode_notify_poll(desc->inode);
+        *(eventfd_t*)buffer = value;
+        return sizeof(eventfd_t);
+    }
+}
+
+struct write_blocker {
+    struct eventfd* eventfd;
+    eventfd_t value;
+};
+
+static bool write_should_unblock(struct write_blocker* blocker) {
+    struct eventfd* eventfd = blocker->eventfd;
+    spinlock_lock(&eventfd->lock);
+    bool should_unblock = COUNT_MAX - eventfd->count >= blocker->value;
+    spinlock_unlock(&eventfd->lock);
+    return should_unblock;
+}
+
+static ssize_t eventfd_write(file_description* desc, const void* buffer,
+                             size_t count) {
+    if (count < sizeof(eventfd_t))
+        return -EINVAL;
+    eventfd_t value = *(const eventfd_t*)buffer;
+    if (value > COUNT_MAX)
+        return -EINVAL;
+    struct eventfd* eventfd = (struct eventfd*)desc->inode;
+
+    // file_description_block() can't be used as the condition depends on
+    // the value being written
+    struct write_blocker blocker = {.eventfd = eventfd, .value = value};
+    for (;;) {
+        if (desc->flags & O_NONBLOCK) {
+            if (!write_should_unblock(&blocker))
+                return -EAGAIN;
+        } else {
+            int rc = scheduler_block((should_unblock_fn)write_should_unblock,
+                                     &blocker);
+            if (IS_ERR(rc))
+                return rc;
+        }
+
+        spinlock_lock(&eventfd->lock);
+        if (COUNT_MAX - eventfd->count < value) {
+            spinlock_unlock(&eventfd->lock);
+            continue;
+        }
+        eventfd->count += value;
+        spinlock_unlock(&eventfd->lock);
+
+        inode_notify_poll(desc->inode);
+        return sizeof(eventfd_t);
+    }
+}
+
+static short eventfd_poll(file_description* desc, short events) {
+    struct eventfd* eventfd = (struct eventfd*)desc->inode;
+    spinlock_lock(&eventfd->lock);
+    uint64_t count = eventfd->count;
+    spinlock_unlock(&eventfd->lock);
+
+    short revents = 0;
+    if ((events & POLLIN) && count > 0)
+        revents |= POLLIN;
+    if ((events & POLLOUT) && count < COUNT_MAX)
+        revents |= POLLOUT;
+    return revents;
+}
+
+struct inode* eventfd_create(unsigned initval, int flags) {
+    struct eventfd* eventfd = kmalloc(sizeof(struct eventfd));
+    if (!eventfd)
+        return ERR_PTR(-ENOMEM);
+    *eventfd = (struct eventfd){0};
+    eventfd->count = initval;
+    eventfd->semaphore = flags & EFD_SEMAPHORE;
+
+    struct inode* inode = &eventfd->inode;
+    static file_ops fops = {.destroy_inode = eventfd_destroy_inode,
+                            .read = eventfd_read,
+                            .write = eventfd_write,
+                            .poll = eventfd_poll};
+    inode->fops = &fops;
+    inode->mode = S_IFCHR;
+    inode->ref_count = 1;
+
+    return inode;
+}
@@ -34,17 +34,31 @@
  */
 
 #include "fs.h"
+#include <common/string.h>
 #include <kernel/api/fcntl.h>
+#include <kernel/api/poll.h>
 #include <kernel/api/signum.h>
+#include <kernel/api/unistd.h>
+#include <kernel/boot_defs.h>
 #include <kernel/panic.h>
 #include <kernel/process.h>
 #include <kernel/ring_buf.h>
+#include <kernel/scheduler.h>
 
-#define BUF_CAPACITY 1024
+#define DEFAULT_SIZE (16 * PAGE_SIZE)
+#define MAX_SIZE (256 * PAGE_SIZE)
 
+// buf.lock is only held for short updates of the buffer. Transfers between
+// the pipe and another file fill or drain the buffer in place and may block
+// on the other file meanwhile, so writers also serialize on write_lock and
+// readers on read_lock, which keeps the two ends of the pipe independent.
+// The locks are taken in the order write_lock, read_lock, buf.lock, and
+// for two pipes, the pipe at the lower address first.
 struct fifo {
     struct inode inode;
     ring_buf buf;
+    mutex read_lock;
+    mutex write_lock;
     atomic_size_t num_readers;
     atomic_size_t num_writers;
 };
@@ -65,6 +79,7 @@ static int fifo_open(file_description* desc, int flags, mode_t mode) {
         ++fifo->num_readers;
     if (flags & O_WRONLY)
         ++fifo->num_writers;
+    inode_notify_poll(desc->inode);
     return 0;
 }
 
@@ -75,6 +90,7 @@ static int fifo_close(file_description* desc) {
         --fifo->num_readers;
     if (desc->flags & O_WRONLY)
         --fifo->num_writers;
+    inode_notify_poll(desc->inode);
     return 0;
 }
 
@@ -92,23 +108,40 @@ static ssize_t fifo_read(file_description* desc, void* buffer, size_t count) {
         if (IS_ERR(rc))
             return rc;
 
+        mutex_lock(&fifo->read_lock);
         mutex_lock(&buf->lock);
         if (!ring_buf_is_empty(buf)) {
             ssize_t nread = ring_buf_read(buf, buffer, count);
             mutex_unlock(&buf->lock);
+            mutex_unlock(&fifo->read_lock);
+            inode_notify_poll(desc->inode);
             return nread;
         }
 
         bool no_writer = fifo->num_writers == 0;
         mutex_unlock(&buf->lock);
+        mutex_unlock(&fifo->read_lock);
         if (no_writer)
             return 0;
     }
 }
 
+static bool can_write(const struct fifo* fifo, size_t count) {
+    return fifo->num_readers == 0 ||
+           fifo->buf.capacity - ring_buf_size(&fifo->buf) >= count;
+}
+
 static bool write_should_unblock(struct file_description* desc) {
-    struct fifo* fifo = (struct fifo*)desc->inode;
-    return fifo->num_readers == 0 || !ring_buf_is_full(&fifo->buf);
+    return can_write((const struct fifo*)desc->inode, 1);
+}
+
+struct write_blocker {
+    const struct fifo* fifo;
+    size_t count;
+};
+
+static bool write_fits(const struct write_blocker* blocker) {
+    return can_write(blocker->fifo, blocker->count);
 }
 
 static ssize_t fifo_write(file_description* desc, const void* buffer,
@@ -116,38 +149,72 @@ static ssize_t fifo_write(file_description* desc, const void* buffer,
     struct fifo* fifo = (struct fifo*)desc->inode;
     ring_buf* buf = &fifo->buf;
 
+    // a write of up to PIPE_BUF bytes waits until it fits as a whole, so that
+    // it isn't interleaved with other writes
+    struct write_blocker blocker = {.fifo = fifo,
+                                    .count = count <= PIPE_BUF ? count : 1};
+
     for (;;) {
-        int rc = file_description_block(desc, write_should_unblock);
-        if (IS_ERR(rc))
-            return rc;
+        if (!write_fits(&blocker)) {
+            if (desc->flags & O_NONBLOCK)
+                return -EAGAIN;
+            int rc = scheduler_block((should_unblock_fn)write_fits, &blocker);
+            if (IS_ERR(rc))
+                return rc;
+        }
 
+        mutex_lock(&fifo->write_lock);
         mutex_lock(&buf->lock);
         if (fifo->num_readers == 0) {
             mutex_unlock(&buf->lock);
+            mutex_unlock(&fifo->write_lock);
             int rc = process_send_signal_to_one(current->pid, SIGPIPE);
             if (IS_ERR(rc))
                 return rc;
             return -EPIPE;
         }
 
-        if (ring_buf_is_full(buf)) {
+        if (!write_fits(&blocker)) {
             mutex_unlock(&buf->lock);
+            mutex_unlock(&fifo->write_lock);
             continue;
         }
 
-        ssize_t nwritten = ring_buf_write(buf, buffer, count);
+        ssize_t nwritten = ring_buf_unshare(buf, count);
+        if (IS_OK(nwritten))
+            nwritten = ring_buf_write(buf, buffer, count);
         mutex_unlock(&buf->lock);
+        mutex_unlock(&fifo->write_lock);
+        if (IS_ERR(nwritten))
+            return nwritten;
+        inode_notify_poll(desc->inode);
         return nwritten;
     }
 }
 
+static short fifo_poll(file_description* desc, short events) {
+    const struct fifo* fifo = (const struct fifo*)desc->inode;
+    short revents = 0;
+    if ((events & POLLIN) && (desc->flags & O_RDONLY) &&
+        !ring_buf_is_empty(&fifo->buf))
+        revents |= POLLIN;
+    if ((events & POLLOUT) && (desc->flags & O_WRONLY) &&
+        !ring_buf_is_full(&fifo->buf))
+        revents |= POLLOUT;
+    if ((desc->flags & O_RDONLY) && fifo->num_writers == 0)
+        revents |= POLLHUP;
+    if ((desc->flags & O_WRONLY) && fifo->num_readers == 0)
+        revents |= POLLERR;
+    return revents;
+}
+
 struct inode* fifo_create(void) {
     struct fifo* fifo = kmalloc(sizeof(struct fifo));
     if (!fifo)
         return ERR_PTR(-ENOMEM);
     *fifo = (struct fifo){0};
 
-    int rc = ring_buf_init(&fifo->buf);
+    int rc = ring_buf_init(&fifo->buf, DEFAULT_SIZE);
     if (IS_ERR(rc))
         return ERR_PTR(rc);
 
@@ -156,10 +223,300 @@ struct inode* fifo_create(void) {
                             .open = fifo_open,
                             .close = fifo_close,
                             .read = fifo_read,
-                            .write = fifo_write};
+                            .write = fifo_write,
+                            .poll = fifo_poll};
     inode->fops = &fops;
     inode->mode = S_IFIFO;
     inode->ref_count = 1;
 
     return (struct inode*)fifo;
 }
+
+bool inode_is_fifo(const struct inode* inode) {
+    return inode->fops->destroy_inode == fifo_destroy_inode;
+}
+
+int fifo_get_size(file_description* desc) {
+    if (!inode_is_fifo(desc->inode))
+        return -EBADF;
+    struct fifo* fifo = (struct fifo*)desc->inode;
+    return fifo->buf.capacity;
+}
+
+int fifo_set_size(file_description* desc, size_t size) {
+    if (!inode_is_fifo(desc->inode))
+        return -EBADF;
+    if (size > MAX_SIZE)
+        return -EPERM;
+    struct fifo* fifo = (struct fifo*)desc->inode;
+    ring_buf* buf = &fifo->buf;
+
+    // resizing moves the bytes, so it waits for both ends
+    mutex_lock(&fifo->write_lock);
+    mutex_lock(&fifo->read_lock);
+    mutex_lock(&buf->lock);
+    int rc = ring_buf_resize(buf, size);
+    size_t capacity = buf->capacity;
+    mutex_unlock(&buf->lock);
+    mutex_unlock(&fifo->read_lock);
+    mutex_unlock(&fifo->write_lock);
+    if (IS_ERR(rc))
+        return rc;
+
+    // writers blocked on a full buffer may proceed now
+    inode_notify_poll(desc->inode);
+    return capacity;
+}
+
+static int block(file_description* desc,
+                 bool (*should_unblock)(file_description*), bool nonblock) {
+    if (nonblock && !should_unblock(desc))
+        return -EAGAIN;
+    return file_description_block(desc, should_unblock);
+}
+
+static int broken_pipe(void) {
+    int rc = process_send_signal_to_one(current->pid, SIGPIPE);
+    if (IS_ERR(rc))
+        return rc;
+    return -EPIPE;
+}
+
+ssize_t fifo_splice_from(file_description* desc, file_description* in,
+                         size_t count, bool nonblock) {
+    if (!(desc->flags & O_WRONLY))
+        return -EBADF;
+    struct fifo* fifo = (struct fifo*)desc->inode;
+    ring_buf* buf = &fifo->buf;
+
+    for (;;) {
+        int rc = block(desc, write_should_unblock, nonblock);
+        if (IS_ERR(rc))
+            return rc;
+
+        mutex_lock(&fifo->write_lock);
+        if (fifo->num_readers == 0) {
+            mutex_unlock(&fifo->write_lock);
+            return broken_pipe();
+        }
+        if (!ring_buf_is_full(buf))
+            break;
+        mutex_unlock(&fifo->write_lock);
+    }
+
+    // Read straight into the free space of the buffer, which takes at most two
+    // reads as it may wrap around. The read may block, so only write_lock is
+    // held across it: readers only ever free more space.
+    size_t total = 0;
+    ssize_t rc = 0;
+    while (total < count) {
+        void* ptr;
+        size_t n = ring_buf_writable_segment(buf, &ptr);
+        if (n == 0)
+            break;
+        n = MIN(n, count - total);
+        rc = ring_buf_unshare(buf, n);
+        if (IS_ERR(rc))
+            break;
+        rc = file_description_read(in, ptr, n);
+        if (IS_ERR(rc) || rc == 0)
+            break;
+        mutex_lock(&buf->lock);
+        ring_buf_commit(buf, rc);
+        mutex_unlock(&buf->lock);
+        total += rc;
+        if ((size_t)rc < n)
+            break;
+    }
+    mutex_unlock(&fifo->write_lock);
+
+    if (total == 0)
+        return rc;
+    inode_notify_poll(desc->inode);
+    return total;
+}
+
+ssize_t fifo_splice_to(file_description* desc, file_description* out,
+                       size_t count, bool nonblock) {
+    if (!(desc->flags & O_RDONLY))
+        return -EBADF;
+    struct fifo* fifo = (struct fifo*)desc->inode;
+    ring_buf* buf = &fifo->buf;
+
+    for (;;) {
+        int rc = block(desc, read_should_unblock, nonblock);
+        if (IS_ERR(rc))
+            return rc;
+
+        mutex_lock(&fifo->read_lock);
+        if (!ring_buf_is_empty(buf))
+            break;
+        bool no_writer = fifo->num_writers == 0;
+        mutex_unlock(&fifo->read_lock);
+        if (no_writer)
+            return 0;
+    }
+
+    // the write may block, so only read_lock is held across it: writers only
+    // ever append more data
+    size_t total = 0;
+    ssize_t rc = 0;
+    while (total < count) {
+        const void* ptr;
+        size_t n = ring_buf_readable_segment(buf, &ptr);
+        if (n == 0)
+            break;
+        n = MIN(n, count - total);
+        rc = file_description_write(out, ptr, n);
+        if (IS_ERR(rc) || rc == 0)
+            break;
+        mutex_lock(&buf->lock);
+        ring_buf_consume(buf, rc);
+        mutex_unlock(&buf->lock);
+        total += rc;
+        if ((size_t)rc < n)
+            break;
+    }
+    mutex_unlock(&fifo->read_lock);
+
+    if (total == 0)
+        return rc;
+    inode_notify_poll(desc->inode);
+    return total;
+}
+
+ssize_t fifo_gift(file_description* desc, const void* buffer, size_t count,
+                  bool nonblock) {
+    if (!(desc->flags & O_WRONLY))
+        return -EBADF;
+    struct fifo* fifo = (struct fifo*)desc->inode;
+    ring_buf* buf = &fifo->buf;
+
+    for (;;) {
+        int rc = block(desc, write_should_unblock, nonblock);
+        if (IS_ERR(rc))
+            return rc;
+
+        mutex_lock(&fifo->write_lock);
+        if (fifo->num_readers == 0) {
+            mutex_unlock(&fifo->write_lock);
+            return broken_pipe();
+        }
+        if (!ring_buf_is_full(buf))
+            break;
+        mutex_unlock(&fifo->write_lock);
+    }
+
+    // the user pages must stay mapped while they are looked up
+    struct vm* vm = current->vm;
+    mutex_lock(&vm->lock);
+
+    uintptr_t addr = (uintptr_t)buffer;
+    size_t total = 0;
+    ssize_t rc = 0;
+    while (total < count) {
+        void* ptr;
+        size_t n = ring_buf_writable_segment(buf, &ptr);
+        if (n == 0)
+            break;
+
+        if ((addr + total) % PAGE_SIZE == 0 &&
+            (uintptr_t)ptr % PAGE_SIZE == 0 && n >= PAGE_SIZE &&
+            count - total >= PAGE_SIZE) {
+            rc = ring_buf_share_user_page(buf, addr + total);
+            if (IS_OK(rc)) {
+                mutex_lock(&buf->lock);
+                ring_buf_commit(buf, PAGE_SIZE);
+                mutex_unlock(&buf->lock);
+                total += PAGE_SIZE;
+                continue;
+            }
+            // the page is shared too many times, so it is copied instead
+            if (rc != -EBUSY)
+                break;
+        }
+
+        // copy up to the next page boundary of the user buffer, after which
+        // the pages may line up
+        n = MIN(n, count - total);
+        n = MIN(n, PAGE_SIZE - (addr + total) % PAGE_SIZE);
+        rc = ring_buf_unshare(buf, n);
+        if (IS_ERR(rc))
+            break;
+        memcpy(ptr, (const void*)(addr + total), n);
+        mutex_lock(&buf->lock);
+        ring_buf_commit(buf, n);
+        mutex_unlock(&buf->lock);
+        total += n;
+    }
+
+    mutex_unlock(&vm->lock);
+    mutex_unlock(&fifo->write_lock);
+
+    if (total == 0)
+        return rc;
+    inode_notify_poll(desc->inode);
+    return total;
+}
+
+// Two transfers in opposite directions lock the same pair of pipes, so the
+// locks are taken in address order.
+static void lock_pair(struct fifo* src, struct fifo* dest) {
+    struct fifo* a = MIN(src, dest);
+    struct fifo* b = MAX(src, dest);
+    mutex_lock(a == src ? &a->read_lock : &a->write_lock);
+    mutex_lock(b == src ? &b->read_lock : &b->write_lock);
+    mutex_lock(&a->buf.lock);
+    mutex_lock(&b->buf.lock);
+}
+
+static void unlock_pair(struct fifo* src, struct fifo* dest) {
+    mutex_unlock(&src->buf.lock);
+    mutex_unlock(&dest->buf.lock);
+    mutex_unlock(&src->read_lock);
+    mutex_unlock(&dest->write_lock);
+}
+
+ssize_t fifo_transfer(file_description* in, file_description* out,
+                      size_t count, bool consume, bool nonblock) {
+    if (!(in->flags & O_RDONLY) || !(out->flags & O_WRONLY))
+        return -EBADF;
+    struct fifo* src = (struct fifo*)in->inode;
+    struct fifo* dest = (struct fifo*)out->inode;
+    if (src == dest)
+        return -EINVAL;
+
+    for (;;) {
+        int rc = block(in, read_should_unblock, nonblock);
+        if (IS_ERR(rc))
+            return rc;
+        if (ring_buf_is_empty(&src->buf) && src->num_writers == 0)
+            return 0;
+
+        rc = block(out, write_should_unblock, nonblock);
+        if (IS_ERR(rc))
+            return rc;
+        if (dest->num_readers == 0)
+            return broken_pipe();
+
+        lock_pair(src, dest);
+        if (!ring_buf_is_empty(&src->buf) && !ring_buf_is_full(&dest->buf))
+            break;
+        unlock_pair(src, dest);
+    }
+
+    ssize_t n = ring_buf_unshare(&dest->buf, count);
+    if (IS_ERR(n)) {
+        unlock_pair(src, dest);
+        return n;
+    }
+    n = ring_buf_copy(&dest->buf, &src->buf, count);
+    if (consume)
+        ring_buf_consume(&src->buf, n);
+    unlock_pair(src, dest);
+
+    if (consume)
+        inode_notify_poll(in->inode);
+    inode_notify_poll(out->inode);
+    return n;
+}
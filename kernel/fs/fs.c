@@ -37,6 +37,7 @@
 #include <common/string.h>
 #include <kernel/api/dirent.h>
 #include <kernel/api/fcntl.h>
+#include <kernel/api/poll.h>
 #include <kernel/api/stdio.h>
 #include <kernel/lock.h>
 #include <kernel/memory/memory.h>
@@ -50,6 +51,8 @@ int file_descriptor_table_init(file_descriptor_table* table) {
 
     for (size_t i = 0; i < OPEN_MAX; ++i)
         table->entries[i] = NULL;
+    table->lock = (spinlock){0};
+    table->ref_count = 1;
     return 0;
 }
 
@@ -63,17 +66,21 @@ void file_descriptor_table_destroy(file_descriptor_table* table) {
 }
 
 int file_descriptor_table_clone_from(file_descriptor_table* to,
-                                     const file_descriptor_table* from) {
+                                     file_descriptor_table* from) {
     to->entries = kmalloc(OPEN_MAX * sizeof(file_description*));
     if (!to->entries)
         return -ENOMEM;
 
-    memcpy(to->entries, from->entries, OPEN_MAX * sizeof(file_description*));
+    to->lock = (spinlock){0};
+    to->ref_count = 1;
 
+    spinlock_lock(&from->lock);
+    memcpy(to->entries, from->entries, OPEN_MAX * sizeof(file_description*));
     for (size_t i = 0; i < OPEN_MAX; ++i) {
         if (from->entries[i])
             ++from->entries[i]->ref_count;
     }
+    spinlock_unlock(&from->lock);
     return 0;
 }
 
@@ -189,10 +196,39 @@ int inode_stat(struct inode* inode, struct stat* buf) {
     return 0;
 }
 
+void inode_add_poll_watch(struct inode* inode, poll_watch* watch) {
+    spinlock_lock(&inode->poll_watches_lock);
+    watch->next = inode->poll_watches;
+    inode->poll_watches = watch;
+    spinlock_unlock(&inode->poll_watches_lock);
+}
+
+void inode_remove_poll_watch(struct inode* inode, poll_watch* watch) {
+    spinlock_lock(&inode->poll_watches_lock);
+    poll_watch** it = &inode->poll_watches;
+    while (*it) {
+        if (*it == watch) {
+            *it = watch->next;
+            break;
+        }
+        it = &(*it)->next;
+    }
+    spinlock_unlock(&inode->poll_watches_lock);
+}
+
+void inode_notify_poll(struct inode* inode) {
+    spinlock_lock(&inode->poll_watches_lock);
+    for (poll_watch* it = inode->poll_watches; it; it = it->next)
+        it->notify(it);
+    spinlock_unlock(&inode->poll_watches_lock);
+}
+
 int file_description_close(file_description* desc) {
     ASSERT(desc->ref_count > 0);
     if (--desc->ref_count > 0)
         return 0;
+    if (desc->epitems)
+        epoll_remove_description(desc);
     struct inode* inode = desc->inode;
     if (inode->fops->close) {
         int rc = inode->fops->close(desc);
@@ -228,6 +264,57 @@ ssize_t file_description_write(file_description* desc, const void* buffer,
     return inode->fops->write(desc, buffer, count);
 }
 
+ssize_t file_description_pread(file_description* desc, void* buffer,
+                               size_t count, off_t offset) {
+    struct inode* inode = desc->inode;
+    if (S_ISDIR(inode->mode))
+        return -EISDIR;
+    if (S_ISFIFO(inode->mode) || S_ISSOCK(inode->mode))
+        return -ESPIPE;
+    if (!inode->fops->read)
+        return -EINVAL;
+    if (!(desc->flags & O_RDONLY))
+        return -EBADF;
+    if (offset < 0)
+        return -EINVAL;
+    if (inode->fops->pread)
+        return inode->fops->pread(desc, buffer, count, offset);
+
+    // fall back to a read at a temporarily moved offset
+    mutex_lock(&desc->offset_lock);
+    off_t saved_offset = desc->offset;
+    desc->offset = offset;
+    ssize_t nread = inode->fops->read(desc, buffer, count);
+    desc->offset = saved_offset;
+    mutex_unlock(&desc->offset_lock);
+    return nread;
+}
+
+ssize_t file_description_pwrite(file_description* desc, const void* buffer,
+                                size_t count, off_t offset) {
+    struct inode* inode = desc->inode;
+    if (S_ISDIR(inode->mode))
+        return -EISDIR;
+    if (S_ISFIFO(inode->mode) || S_ISSOCK(inode->mode))
+        return -ESPIPE;
+    if (!inode->fops->write)
+        return -EINVAL;
+    if (!(desc->flags & O_WRONLY))
+        return -EBADF;
+    if (offset < 0)
+        return -EINVAL;
+    if (inode->fops->pwrite)
+        return inode->fops->pwrite(desc, buffer, count, offset);
+
+    mutex_lock(&desc->offset_lock);
+    off_t saved_offset = desc->offset;
+    desc->offset = offset;
+    ssize_t nwritten = inode->fops->write(desc, buffer, count);
+    desc->offset = saved_offset;
+    mutex_unlock(&desc->offset_lock);
+    return nwritten;
+}
+
 uintptr_t file_description_mmap(file_description* desc, uintptr_t addr,
                                 size_t length, off_t offset,
                                 uint16_t page_flags) {
@@ -253,6 +340,19 @@ int file_description_truncate(file_description* desc, off_t length) {
     return inode->fops->truncate(desc, length);
 }
 
+ssize_t file_description_copy_range(file_description* out, off_t out_offset,
+                                   file_description* in, off_t in_offset,
+                                   size_t count) {
+    if (S_ISDIR(in->inode->mode) || S_ISDIR(out->inode->mode))
+        return -EISDIR;
+    if (!(in->flags & O_RDONLY) || !(out->flags & O_WRONLY))
+        return -EBADF;
+    const file_ops* fops = out->inode->fops;
+    if (in->inode->fops != fops || !fops->copy_range)
+        return -EXDEV;
+    return fops->copy_range(out, out_offset, in, in_offset, count);
+}
+
 off_t file_description_lseek(file_description* desc, off_t offset, int whence) {
     off_t new_offset;
     switch (whence) {
@@ -291,6 +391,15 @@ int file_description_ioctl(file_description* desc, int request, void* argp) {
     return inode->fops->ioctl(desc, request, argp);
 }
 
+short file_description_poll(file_description* desc, short events) {
+    struct inode* inode = desc->inode;
+    if (!inode->fops->poll) {
+        // regular files and devices without a poll never block
+        return events & (POLLIN | POLLOUT);
+    }
+    return inode->fops->poll(desc, events);
+}
+
 struct getdents_ctx {
     unsigned char* dirp;
     unsigned remaining_count;
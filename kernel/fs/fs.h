@@ -50,6 +50,8 @@
 
 #define OPEN_MAX 1024
 
+struct epitem;
+
 typedef struct file_description {
     mutex offset_lock;
     struct inode* inode;
@@ -57,17 +59,24 @@ typedef struct file_description {
     off_t offset;
     void* private_data;
     atomic_size_t ref_count;
+
+    // the epoll instances watching this description
+    struct epitem* epitems;
 } file_description;
 
 typedef struct file_descriptor_table {
     file_description** entries;
+    spinlock lock;
+
+    // number of processes sharing the table with CLONE_FILES
+    atomic_size_t ref_count;
 } file_descriptor_table;
 
 NODISCARD int file_descriptor_table_init(file_descriptor_table*);
 void file_descriptor_table_destroy(file_descriptor_table*);
 NODISCARD int
 file_descriptor_table_clone_from(file_descriptor_table* to,
-                                 const file_descriptor_table* from);
+                                 file_descriptor_table* from);
 
 typedef void (*destroy_inode_fn)(struct inode*);
 
@@ -84,10 +93,18 @@ typedef int (*close_fn)(file_description*);
 typedef ssize_t (*read_fn)(file_description*, void* buffer, size_t count);
 typedef ssize_t (*write_fn)(file_description*, const void* buffer,
                             size_t count);
+typedef ssize_t (*pread_fn)(file_description*, void* buffer, size_t count,
+                            off_t offset);
+typedef ssize_t (*pwrite_fn)(file_description*, const void* buffer,
+                             size_t count, off_t offset);
 typedef uintptr_t (*mmap_fn)(file_description*, uintptr_t addr, size_t length,
                              off_t offset, uint16_t page_flags);
 typedef int (*truncate_fn)(file_description*, off_t length);
+typedef ssize_t (*copy_range_fn)(file_description* out, off_t out_offset,
+                                 file_description* in, off_t in_offset,
+                                 size_t count);
 typedef int (*ioctl_fn)(file_description*, int request, void* argp);
+typedef short (*poll_fn)(file_description*, short events);
 
 struct getdents_ctx;
 typedef bool (*getdents_callback_fn)(struct getdents_ctx*, const char* name,
@@ -108,12 +125,24 @@ typedef struct file_ops {
     close_fn close;
     read_fn read;
     write_fn write;
+    pread_fn pread;
+    pwrite_fn pwrite;
     mmap_fn mmap;
     truncate_fn truncate;
+    copy_range_fn copy_range;
     ioctl_fn ioctl;
+    poll_fn poll;
     getdents_fn getdents;
 } file_ops;
 
+// Told when the readiness reported by the poll operation of an inode may have
+// changed. notify is called with the poll_watches_lock of the inode held, and
+// possibly from an interrupt handler.
+typedef struct poll_watch {
+    void (*notify)(struct poll_watch*);
+    struct poll_watch* next;
+} poll_watch;
+
 struct inode {
     struct inode* fs_root_inode;
     file_ops* fops;
@@ -122,6 +151,8 @@ struct inode {
     _Atomic(nlink_t) num_links;
     atomic_size_t ref_count;
     mode_t mode;
+    spinlock poll_watches_lock;
+    poll_watch* poll_watches;
 };
 
 void inode_ref(struct inode*);
@@ -137,15 +168,41 @@ NODISCARD int inode_unlink_child(struct inode*, const char* name);
 NODISCARD file_description* inode_open(struct inode*, int flags, mode_t mode);
 NODISCARD int inode_stat(struct inode*, struct stat* buf);
 
+void inode_add_poll_watch(struct inode*, poll_watch*);
+void inode_remove_poll_watch(struct inode*, poll_watch*);
+
+// Called by inodes that implement poll whenever their readiness may have
+// changed, e.g. after data arrives or a peer goes away.
+void inode_notify_poll(struct inode*);
+
 int file_description_close(file_description*);
+
+// Removes the description from the interest lists of all epoll instances.
+// Called when the last reference to the description is dropped.
+void epoll_remove_description(file_description*);
+
 NODISCARD ssize_t file_description_read(file_description*, void* buffer,
                                         size_t count);
 NODISCARD ssize_t file_description_write(file_description*, const void* buffer,
                                          size_t count);
+// Read or write at offset without touching the offset of the description.
+// Files that implement pread and pwrite don't take the offset_lock, so
+// positional I/O on a shared description doesn't serialize.
+NODISCARD ssize_t file_description_pread(file_description*, void* buffer,
+                                         size_t count, off_t offset);
+NODISCARD ssize_t file_description_pwrite(file_description*,
+                                          const void* buffer, size_t count,
+                                          off_t offset);
 NODISCARD uintptr_t file_description_mmap(file_description*, uintptr_t addr,
                                           size_t length, off_t offset,
                                           uint16_t page_flags);
 NODISCARD int file_description_truncate(file_description*, off_t length);
+// Copies between two files of the same filesystem without going through a
+// buffer. Returns -EXDEV if the filesystem can't do that.
+NODISCARD ssize_t file_description_copy_range(file_description* out,
+                                              off_t out_offset,
+                                              file_description* in,
+                                              off_t in_offset, size_t count);
 NODISCARD off_t file_description_lseek(file_description*, off_t offset,
                                        int whence);
 NODISCARD int file_description_ioctl(file_description*, int request,
@@ -153,6 +210,10 @@ NODISCARD int file_description_ioctl(file_description*, int request,
 NODISCARD long file_description_getdents(file_description*, void* dirp,
                                          unsigned int count);
 
+// returns the subset of events (POLLIN, POLLOUT, ...) that wouldn't block.
+// It may be called with interrupts disabled, so it must not block.
+short file_description_poll(file_description*, short events);
+
 NODISCARD int file_description_block(file_description*,
                                      bool (*should_unblock)(file_description*));
 
@@ -170,8 +231,69 @@ struct inode* vfs_resolve_path(const char* pathname, struct inode** out_parent,
 uint8_t mode_to_dirent_type(mode_t);
 
 struct inode* fifo_create(void);
+bool inode_is_fifo(const struct inode*);
+
+// return the buffer size of the pipe, which is rounded up to a power of two
+// multiple of the page size when set
+NODISCARD int fifo_get_size(file_description*);
+NODISCARD int fifo_set_size(file_description*, size_t size);
+
+// Move data between a pipe and another file without copying it through
+// userland: fifo_splice_from() reads from in into the pipe, and
+// fifo_splice_to() writes the contents of the pipe to out.
+NODISCARD ssize_t fifo_splice_from(file_description* pipe, file_description* in,
+                                   size_t count, bool nonblock);
+NODISCARD ssize_t fifo_splice_to(file_description* pipe, file_description* out,
+                                 size_t count, bool nonblock);
+
+// Puts the user buffer into the pipe for vmsplice() with SPLICE_F_GIFT. Whole
+// pages that line up with the pages of the pipe buffer are shared into it
+// rather than copied, so the caller must not modify them afterwards.
+NODISCARD ssize_t fifo_gift(file_description* pipe, const void* buffer,
+                            size_t count, bool nonblock);
+
+// Copies data from the pipe in to the pipe out, and removes it from in if
+// consume is true.
+NODISCARD ssize_t fifo_transfer(file_description* in, file_description* out,
+                                size_t count, bool consume, bool nonblock);
+
+struct inode* eventfd_create(unsigned initval, int flags);
+
+struct itimerspec;
+struct inode* timerfd_create(void);
+NODISCARD int timerfd_settime(struct inode*, int flags,
+                              const struct itimerspec* new_value,
+                              struct itimerspec* old_value);
+NODISCARD int timerfd_gettime(struct inode*, struct itimerspec* curr_value);
+
+// fires the expired timerfds, called on every tick
+void timerfd_tick(void);
 
 void initrd_populate_root_fs(uintptr_t physical_addr, size_t size);
 
 struct inode* tmpfs_create_root(void);
+
+// a tmpfs file that isn't in any directory, for memfd_create()
+struct inode* tmpfs_create_anonymous_file(void);
 struct inode* procfs_create_root(void);
+
+struct mq_attr;
+struct timespec;
+struct inode* mqueue_create_root(void);
+bool inode_is_mqueue(const struct inode*);
+
+// POSIX message queues, which are files in /dev/mqueue. name is of the form
+// "/name". mqueue_open() returns the queue with a reference, creating it with
+// attr (or the defaults if attr is NULL) when oflag has O_CREAT.
+NODISCARD struct inode* mqueue_open(const char* name, int oflag, mode_t mode,
+                                    const struct mq_attr* attr);
+NODISCARD int mqueue_unlink(const char* name);
+NODISCARD int mqueue_timedsend(file_description*, const char* msg_ptr,
+                               size_t msg_len, unsigned msg_prio,
+                               const struct timespec* abs_timeout);
+NODISCARD ssize_t mqueue_timedreceive(file_description*, char* msg_ptr,
+                                      size_t msg_len, unsigned* msg_prio,
+                                      const struct timespec* abs_timeout);
+NODISCARD int mqueue_getsetattr(file_description*,
+                                const struct mq_attr* newattr,
+                                struct mq_attr* oldattr);
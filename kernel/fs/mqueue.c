@@ -0,0 +1,438 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "dentry.h"
+#include <common/string.h>
+#include <kernel/api/fcntl.h>
+#include <kernel/api/mqueue.h>
+#include <kernel/api/poll.h>
+#include <kernel/api/time.h>
+#include <kernel/memory/memory.h>
+#include <kernel/panic.h>
+#include <kernel/scheduler.h>
+#include <kernel/system.h>
+
+#define DEFAULT_MAXMSG 10
+#define DEFAULT_MSGSIZE 8192
+#define MAXMSG_MAX 256
+#define MSGSIZE_MAX 65536
+#define NAME_MAX 255
+
+struct message {
+    struct message* next;
+    unsigned prio;
+    size_t len;
+    unsigned char data[];
+};
+
+// Messages are kept in a list sorted by descending priority, and in the order
+// they were sent within the same priority. Every message node is allocated
+// from a slab cache sized for mq_msgsize, so sending and receiving don't map
+// or unmap pages once the cache is warm. The cache never shrinks: it keeps as
+// many slabs as the queue ever held messages for until the queue is destroyed.
+struct mqueue {
+    struct inode inode;
+    mutex lock;
+    long maxmsg;
+    long msgsize;
+    long curmsgs;
+    struct message* messages;
+    slab_cache message_cache;
+};
+
+struct mqueue_root {
+    struct inode inode;
+    rwlock children_lock;
+    struct dentry* children;
+};
+
+static struct mqueue_root* root;
+
+static void mqueue_destroy_inode(struct inode* inode) {
+    struct mqueue* queue = (struct mqueue*)inode;
+    // the messages are freed along with the slabs
+    slab_cache_destroy(&queue->message_cache);
+    kfree(queue);
+}
+
+static int mqueue_stat(struct inode* inode, struct stat* buf) {
+    buf->st_mode = inode->mode;
+    buf->st_nlink = inode->num_links;
+    buf->st_rdev = 0;
+    buf->st_size = 0;
+    inode_unref(inode);
+    return 0;
+}
+
+static bool can_send(const struct mqueue* queue) {
+    return queue->curmsgs < queue->maxmsg;
+}
+
+static bool can_receive(const struct mqueue* queue) {
+    return queue->curmsgs > 0;
+}
+
+static short mqueue_poll(file_description* desc, short events) {
+    struct mqueue* queue = (struct mqueue*)desc->inode;
+    short revents = 0;
+    if ((events & POLLIN) && can_receive(queue))
+        revents |= POLLIN;
+    if ((events & POLLOUT) && can_send(queue))
+        revents |= POLLOUT;
+    return revents;
+}
+
+static file_ops queue_fops = {.destroy_inode = mqueue_destroy_inode,
+                              .stat = mqueue_stat,
+                              .poll = mqueue_poll};
+
+static struct inode* create_queue(mode_t mode, const struct mq_attr* attr) {
+    long maxmsg = DEFAULT_MAXMSG;
+    long msgsize = DEFAULT_MSGSIZE;
+    if (attr) {
+        if (attr->mq_maxmsg <= 0 || attr->mq_maxmsg > MAXMSG_MAX ||
+            attr->mq_msgsize <= 0 || attr->mq_msgsize > MSGSIZE_MAX)
+            return ERR_PTR(-EINVAL);
+        maxmsg = attr->mq_maxmsg;
+        msgsize = attr->mq_msgsize;
+    }
+
+    struct mqueue* queue = kmalloc(sizeof(struct mqueue));
+    if (!queue)
+        return ERR_PTR(-ENOMEM);
+    *queue = (struct mqueue){0};
+    queue->maxmsg = maxmsg;
+    queue->msgsize = msgsize;
+    slab_cache_init(&queue->message_cache, sizeof(struct message) + msgsize);
+
+    struct inode* inode = &queue->inode;
+    inode->fs_root_inode = &root->inode;
+    inode->fops = &queue_fops;
+    inode->mode = S_IFREG | (mode & 0777);
+    inode->ref_count = 1;
+    return inode;
+}
+
+bool inode_is_mqueue(const struct inode* inode) {
+    return inode->fops == &queue_fops;
+}
+
+static struct inode* mqueue_lookup_child(struct inode* inode,
+                                         const char* name) {
+    struct mqueue_root* node = (struct mqueue_root*)inode;
+    rwlock_lock_read(&node->children_lock);
+    struct inode* child = dentry_find(node->children, name);
+    rwlock_unlock_read(&node->children_lock);
+    inode_unref(inode);
+    return child;
+}
+
+static int mqueue_link_child(struct inode* inode, const char* name,
+                             struct inode* child) {
+    struct mqueue_root* node = (struct mqueue_root*)inode;
+    int rc = -EPERM;
+    if (inode_is_mqueue(child)) {
+        rwlock_lock_write(&node->children_lock);
+        rc = dentry_append(&node->children, name, child);
+        rwlock_unlock_write(&node->children_lock);
+    }
+    inode_unref(inode);
+    return rc;
+}
+
+static struct inode* mqueue_unlink_child(struct inode* inode,
+                                         const char* name) {
+    struct mqueue_root* node = (struct mqueue_root*)inode;
+    rwlock_lock_write(&node->children_lock);
+    struct inode* child = dentry_remove(&node->children, name);
+    rwlock_unlock_write(&node->children_lock);
+    inode_unref(inode);
+    return child;
+}
+
+static struct inode* mqueue_create_child(struct inode* inode, const char* name,
+                                         mode_t mode) {
+    if (!S_ISREG(mode)) {
+        inode_unref(inode);
+        return ERR_PTR(-EPERM);
+    }
+    struct inode* child = create_queue(mode, NULL);
+    if (IS_ERR(child)) {
+        inode_unref(inode);
+        return child;
+    }
+    inode_ref(child);
+    int rc = mqueue_link_child(inode, name, child);
+    if (IS_ERR(rc)) {
+        mqueue_destroy_inode(child);
+        return ERR_PTR(rc);
+    }
+    return child;
+}
+
+static int mqueue_getdents(struct getdents_ctx* ctx, file_description* desc,
+                           getdents_callback_fn callback) {
+    struct mqueue_root* node = (struct mqueue_root*)desc->inode;
+    rwlock_lock_read(&node->children_lock);
+    mutex_lock(&desc->offset_lock);
+    int rc = dentry_getdents(ctx, desc, node->children, callback);
+    mutex_unlock(&desc->offset_lock);
+    rwlock_unlock_read(&node->children_lock);
+    return rc;
+}
+
+struct inode* mqueue_create_root(void) {
+    ASSERT(!root);
+    root = kmalloc(sizeof(struct mqueue_root));
+    if (!root)
+        return ERR_PTR(-ENOMEM);
+    *root = (struct mqueue_root){0};
+
+    static file_ops fops = {.lookup_child = mqueue_lookup_child,
+                            .create_child = mqueue_create_child,
+                            .link_child = mqueue_link_child,
+                            .unlink_child = mqueue_unlink_child,
+                            .stat = mqueue_stat,
+                            .getdents = mqueue_getdents};
+    struct inode* inode = &root->inode;
+    inode->fs_root_inode = inode;
+    inode->fops = &fops;
+    inode->mode = S_IFDIR;
+    inode->ref_count = 1;
+    return inode;
+}
+
+// Queue names are of the form "/name", and name the file /dev/mqueue/name.
+static const char* validate_name(const char* name) {
+    if (name[0] != '/')
+        return ERR_PTR(-EINVAL);
+    ++name;
+    if (name[0] == '\0' || strchr(name, '/') || !strcmp(name, ".") ||
+        !strcmp(name, ".."))
+        return ERR_PTR(-EINVAL);
+    if (strlen(name) > NAME_MAX)
+        return ERR_PTR(-ENAMETOOLONG);
+    return name;
+}
+
+struct inode* mqueue_open(const char* name, int oflag, mode_t mode,
+                          const struct mq_attr* attr) {
+    if (!root)
+        return ERR_PTR(-ENOENT);
+    name = validate_name(name);
+    if (IS_ERR(name))
+        return ERR_CAST(name);
+
+    for (;;) {
+        inode_ref(&root->inode);
+        struct inode* queue = mqueue_lookup_child(&root->inode, name);
+        if (queue) {
+            if ((oflag & O_CREAT) && (oflag & O_EXCL)) {
+                inode_unref(queue);
+                return ERR_PTR(-EEXIST);
+            }
+            return queue;
+        }
+        if (!(oflag & O_CREAT))
+            return ERR_PTR(-ENOENT);
+
+        queue = create_queue(mode, attr);
+        if (IS_ERR(queue))
+            return queue;
+        inode_ref(queue);
+        inode_ref(&root->inode);
+        int rc = mqueue_link_child(&root->inode, name, queue);
+        if (IS_OK(rc))
+            return queue;
+        mqueue_destroy_inode(queue);
+        // someone else created the queue after the lookup
+        if (rc != -EEXIST)
+            return ERR_PTR(rc);
+    }
+}
+
+int mqueue_unlink(const char* name) {
+    if (!root)
+        return -ENOENT;
+    name = validate_name(name);
+    if (IS_ERR(name))
+        return PTR_ERR(name);
+    inode_ref(&root->inode);
+    return inode_unlink_child(&root->inode, name);
+}
+
+struct blocker {
+    struct mqueue* queue;
+    bool (*is_ready)(const struct mqueue*);
+    const struct timespec* deadline;
+};
+
+static bool should_unblock(struct blocker* blocker) {
+    return blocker->is_ready(blocker->queue) ||
+           (blocker->deadline && time_has_passed(blocker->deadline));
+}
+
+// Waits until the queue is ready, or fails with -EAGAIN for non-blocking
+// descriptors and -ETIMEDOUT once the deadline has passed. The deadline only
+// matters when the operation would block.
+static int wait(file_description* desc, struct blocker* blocker) {
+    if (blocker->is_ready(blocker->queue))
+        return 0;
+    if (desc->flags & O_NONBLOCK)
+        return -EAGAIN;
+    if (blocker->deadline && time_has_passed(blocker->deadline))
+        return -ETIMEDOUT;
+    return scheduler_block((should_unblock_fn)should_unblock, blocker);
+}
+
+int mqueue_timedsend(file_description* desc, const char* msg_ptr,
+                     size_t msg_len, unsigned msg_prio,
+                     const struct timespec* abs_timeout) {
+    if (!inode_is_mqueue(desc->inode))
+        return -EBADF;
+    if (!(desc->flags & O_WRONLY))
+        return -EBADF;
+    if (msg_prio >= MQ_PRIO_MAX)
+        return -EINVAL;
+    if (abs_timeout &&
+        (abs_timeout->tv_nsec < 0 || abs_timeout->tv_nsec >= 1000000000))
+        return -EINVAL;
+
+    struct mqueue* queue = (struct mqueue*)desc->inode;
+    if (msg_len > (size_t)queue->msgsize)
+        return -EMSGSIZE;
+
+    struct blocker blocker = {
+        .queue = queue, .is_ready = can_send, .deadline = abs_timeout};
+    for (;;) {
+        int rc = wait(desc, &blocker);
+        if (IS_ERR(rc))
+            return rc;
+
+        mutex_lock(&queue->lock);
+        if (!can_send(queue)) {
+            mutex_unlock(&queue->lock);
+            continue;
+        }
+
+        struct message* msg = slab_cache_alloc(&queue->message_cache);
+        if (!msg) {
+            mutex_unlock(&queue->lock);
+            return -ENOMEM;
+        }
+        msg->prio = msg_prio;
+        msg->len = msg_len;
+        memcpy(msg->data, msg_ptr, msg_len);
+
+        struct message** it = &queue->messages;
+        while (*it && (*it)->prio >= msg_prio)
+            it = &(*it)->next;
+        msg->next = *it;
+        *it = msg;
+        ++queue->curmsgs;
+        mutex_unlock(&queue->lock);
+
+        inode_notify_poll(desc->inode);
+        return 0;
+    }
+}
+
+ssize_t mqueue_timedreceive(file_description* desc, char* msg_ptr,
+                            size_t msg_len, unsigned* msg_prio,
+                            const struct timespec* abs_timeout) {
+    if (!inode_is_mqueue(desc->inode))
+        return -EBADF;
+    if (!(desc->flags & O_RDONLY))
+        return -EBADF;
+    if (abs_timeout &&
+        (abs_timeout->tv_nsec < 0 || abs_timeout->tv_nsec >= 1000000000))
+        return -EINVAL;
+
+    struct mqueue* queue = (struct mqueue*)desc->inode;
+    if (msg_len < (size_t)queue->msgsize)
+        return -EMSGSIZE;
+
+    struct blocker blocker = {
+        .queue = queue, .is_ready = can_receive, .deadline = abs_timeout};
+    for (;;) {
+        int rc = wait(desc, &blocker);
+        if (IS_ERR(rc))
+            return rc;
+
+        mutex_lock(&queue->lock);
+        struct message* msg = queue->messages;
+        if (!msg) {
+            mutex_unlock(&queue->lock);
+            continue;
+        }
+        queue->messages = msg->next;
+        --queue->curmsgs;
+
+        size_t len = msg->len;
+        memcpy(msg_ptr, msg->data, len);
+        if (msg_prio)
+            *msg_prio = msg->prio;
+        slab_cache_free(&queue->message_cache, msg);
+        mutex_unlock(&queue->lock);
+
+        inode_notify_poll(desc->inode);
+        return len;
+    }
+}
+
+int mqueue_getsetattr(file_description* desc, const struct mq_attr* newattr,
+                      struct mq_attr* oldattr) {
+    if (!inode_is_mqueue(desc->inode))
+        return -EBADF;
+    struct mqueue* queue = (struct mqueue*)desc->inode;
+    if (oldattr) {
+        mutex_lock(&queue->lock);
+        *oldattr = (struct mq_attr){.mq_flags = desc->flags & O_NONBLOCK,
+                                    .mq_maxmsg = queue->maxmsg,
+                                    .mq_msgsize = queue->msgsize,
+                                    .mq_curmsgs = queue->curmsgs};
+        mutex_unlock(&queue->lock);
+    }
+    if (newattr) {
+        // only O_NONBLOCK can be changed after the queue is created
+        if (newattr->mq_flags & ~O_NONBLOCK)
+            return -EINVAL;
+        if (newattr->mq_flags & O_NONBLOCK)
+            desc->flags |= O_NONBLOCK;
+        else
+            desc->flags &= ~O_NONBLOCK;
+    }
+    return 0;
+}
@@ -53,13 +53,43 @@ static int populate_comm(file_description* desc, growable_buf* buf) {
         return -ENOENT;
 
     char comm[sizeof(process->comm)];
-    bool int_flag = push_cli();
+    spinlock_lock(&all_processes_lock);
     strlcpy(comm, process->comm, sizeof(process->comm));
-    pop_cli(int_flag);
+    spinlock_unlock(&all_processes_lock);
 
     return growable_buf_printf(buf, "%s\n", comm);
 }
 
+static int populate_sched(file_description* desc, growable_buf* buf) {
+    procfs_pid_item_inode* node = (procfs_pid_item_inode*)desc->inode;
+    struct process* process = process_find_process_by_pid(node->pid);
+    if (!process)
+        return -ENOENT;
+
+    spinlock_lock(&all_processes_lock);
+    int policy = process->policy;
+    int priority = process->rt_priority;
+    int nice = process->nice;
+    size_t num_voluntary_switches = process->num_voluntary_switches;
+    size_t num_involuntary_switches = process->num_involuntary_switches;
+    size_t wait_ticks = process->wait_ticks;
+    size_t block_ticks = process->block_ticks;
+    spinlock_unlock(&all_processes_lock);
+
+    return growable_buf_printf(buf,
+                               "policy %d\n"
+                               "priority %d\n"
+                               "nice %d\n"
+                               "voluntary_switches %u\n"
+                               "involuntary_switches %u\n"
+                               "wait_ms %u\n"
+                               "block_ms %u\n",
+                               policy, priority, nice, num_voluntary_switches,
+                               num_involuntary_switches,
+                               wait_ticks * (1000 / CLK_TCK),
+                               block_ticks * (1000 / CLK_TCK));
+}
+
 static int add_item(procfs_dir_inode* parent, const procfs_item_def* item_def,
                     pid_t pid) {
     procfs_pid_item_inode* node = kmalloc(sizeof(procfs_pid_item_inode));
@@ -79,7 +109,8 @@ static int add_item(procfs_dir_inode* parent, const procfs_item_def* item_def,
     return dentry_append(&parent->children, item_def->name, inode);
 }
 
-static procfs_item_def pid_items[] = {{"comm", populate_comm}};
+static procfs_item_def pid_items[] = {{"comm", populate_comm},
+                                      {"sched", populate_sched}};
 #define NUM_ITEMS (sizeof(pid_items) / sizeof(procfs_item_def))
 
 struct inode* procfs_pid_dir_inode_create(procfs_dir_inode* parent, pid_t pid) {
@@ -42,12 +42,23 @@
 #include <kernel/interrupts.h>
 #include <kernel/panic.h>
 #include <kernel/process.h>
+#include <kernel/scheduler.h>
+#include <kernel/syscall/syscall.h>
 
 static int populate_cmdline(file_description* desc, growable_buf* buf) {
     (void)desc;
     return growable_buf_printf(buf, "%s\n", cmdline_get_raw());
 }
 
+static int populate_fpustat(file_description* desc, growable_buf* buf) {
+    (void)desc;
+    return growable_buf_printf(buf,
+                               "lazy_restores %u\n"
+                               "saves %u\n",
+                               atomic_load(&fpu_num_lazy_restores),
+                               atomic_load(&fpu_num_saves));
+}
+
 static int populate_meminfo(file_description* desc, growable_buf* buf) {
     (void)desc;
     struct physical_memory_info memory_info;
@@ -59,12 +70,76 @@ static int populate_meminfo(file_description* desc, growable_buf* buf) {
                                memory_info.total, memory_info.free);
 }
 
+#define TICKS_TO_MS(ticks) ((ticks) * (1000 / CLK_TCK))
+
+static int populate_schedstat(file_description* desc, growable_buf* buf) {
+    (void)desc;
+    size_t n = atomic_load(&num_cpus);
+    for (size_t i = 0; i < n; ++i) {
+        struct cpu* cpu = cpus + i;
+        int rc = growable_buf_printf(buf, "cpu%u switches %u ready %u\n",
+                                     cpu->id, cpu->num_switches,
+                                     atomic_load(&cpu->num_ready));
+        if (IS_ERR(rc))
+            return rc;
+    }
+
+    int rc = growable_buf_printf(buf, "wakeup latency (ms):\n");
+    if (IS_ERR(rc))
+        return rc;
+    for (size_t i = 0; i < SCHED_LATENCY_NUM_BUCKETS; ++i) {
+        unsigned count = atomic_load(&sched_latency_histogram[i]);
+        if (i == 0)
+            rc = growable_buf_printf(buf, "  <%u %u\n", TICKS_TO_MS(1), count);
+        else if (i < SCHED_LATENCY_NUM_BUCKETS - 1)
+            rc = growable_buf_printf(buf, "  %u-%u %u\n",
+                                     TICKS_TO_MS(1u << (i - 1)),
+                                     TICKS_TO_MS(1u << i), count);
+        else
+            rc = growable_buf_printf(buf, "  >=%u %u\n",
+                                     TICKS_TO_MS(1u << (i - 1)), count);
+        if (IS_ERR(rc))
+            return rc;
+    }
+    return 0;
+}
+
+// lists the traced syscalls with their counts, followed by
+// log2(cycles):count pairs for the non-empty buckets of the histograms
+static int populate_syscallstat(file_description* desc, growable_buf* buf) {
+    (void)desc;
+    for (size_t i = 0; i < NUM_SYSCALLS; ++i) {
+        struct syscall_stat* stat = syscall_stats + i;
+        unsigned count = atomic_load(&stat->count);
+        if (!count)
+            continue;
+        int rc = growable_buf_printf(buf, "%s %u", syscall_names[i], count);
+        if (IS_ERR(rc))
+            return rc;
+        for (size_t j = 0; j < SYSCALL_HISTOGRAM_NUM_BUCKETS; ++j) {
+            unsigned n = atomic_load(&stat->histogram[j]);
+            if (!n)
+                continue;
+            rc = growable_buf_printf(buf, " %u:%u", j, n);
+            if (IS_ERR(rc))
+                return rc;
+        }
+        rc = growable_buf_printf(buf, "\n");
+        if (IS_ERR(rc))
+            return rc;
+    }
+    return 0;
+}
+
 static int populate_uptime(file_description* desc, growable_buf* buf) {
     (void)desc;
     return growable_buf_printf(buf, "%u\n", uptime / CLK_TCK);
 }
 static procfs_item_def root_items[] = {{"cmdline", populate_cmdline},
+                                       {"fpustat", populate_fpustat},
                                        {"meminfo", populate_meminfo},
+                                       {"schedstat", populate_schedstat},
+                                       {"syscallstat", populate_syscallstat},
                                        {"uptime", populate_uptime}};
 #define NUM_ITEMS (sizeof(root_items) / sizeof(procfs_item_def))
 
@@ -95,7 +170,7 @@ static int procfs_root_getdents(struct getdents_ctx* ctx,
         return 0;
     }
 
-    bool int_flag = push_cli();
+    spinlock_lock(&all_processes_lock);
 
     pid_t offset_pid = (pid_t)(desc->offset - NUM_ITEMS);
     struct process* it = all_processes;
@@ -114,7 +189,7 @@ static int procfs_root_getdents(struct getdents_ctx* ctx,
         it = it->next_in_all_processes;
     }
 
-    pop_cli(int_flag);
+    spinlock_unlock(&all_processes_lock);
     mutex_unlock(&desc->offset_lock);
     return 0;
 }
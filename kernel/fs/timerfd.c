@@ -0,0 +1,240 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "fs.h"
+#include <common/extra.h>
+#include <kernel/api/fcntl.h>
+#include <kernel/api/poll.h>
+#include <kernel/api/sys/timerfd.h>
+#include <kernel/memory/memory.h>
+#include <kernel/panic.h>
+#include <kernel/system.h>
+
+#define NANOS_PER_TICK (1000000000 / CLK_TCK)
+
+// timers further away than this are clamped, so that deadlines can be
+// compared with wrapping arithmetic on uptime
+#define MAX_TICKS (INT32_MAX / 2)
+
+// Timers count in ticks of uptime. Armed timers are kept in a list sorted by
+// deadline, so timerfd_tick() only looks at the timers that expire.
+struct timerfd {
+    struct inode inode;
+    bool armed;
+    uint32_t deadline; // uptime of the next expiration
+    uint32_t interval; // in ticks, 0 for a one-shot timer
+    uint64_t num_expirations;
+    struct timerfd* next_armed;
+};
+
+static spinlock timers_lock;
+static struct timerfd* armed_timers;
+
+static bool deadline_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+static void arm(struct timerfd* timer) {
+    struct timerfd** it = &armed_timers;
+    while (*it && !deadline_before(timer->deadline, (*it)->deadline))
+        it = &(*it)->next_armed;
+    timer->next_armed = *it;
+    *it = timer;
+    timer->armed = true;
+}
+
+static void disarm(struct timerfd* timer) {
+    if (!timer->armed)
+        return;
+    struct timerfd** it = &armed_timers;
+    while (*it != timer)
+        it = &(*it)->next_armed;
+    *it = timer->next_armed;
+    timer->armed = false;
+}
+
+void timerfd_tick(void) {
+    spinlock_lock(&timers_lock);
+    while (armed_timers && !deadline_before(uptime, armed_timers->deadline)) {
+        struct timerfd* timer = armed_timers;
+        armed_timers = timer->next_armed;
+        timer->armed = false;
+
+        if (timer->interval > 0) {
+            // count the periods that were missed too
+            uint32_t n = (uptime - timer->deadline) / timer->interval + 1;
+            timer->num_expirations += n;
+            timer->deadline += n * timer->interval;
+            arm(timer);
+        } else {
+            ++timer->num_expirations;
+        }
+        inode_notify_poll(&timer->inode);
+    }
+    spinlock_unlock(&timers_lock);
+}
+
+static uint32_t timespec_to_ticks(const struct timespec* ts) {
+    if (ts->tv_sec >= MAX_TICKS / CLK_TCK)
+        return MAX_TICKS;
+    uint32_t ticks = ts->tv_sec * CLK_TCK;
+    return ticks + div_ceil(ts->tv_nsec, NANOS_PER_TICK);
+}
+
+static void ticks_to_timespec(uint32_t ticks, struct timespec* ts) {
+    ts->tv_sec = ticks / CLK_TCK;
+    ts->tv_nsec = (ticks % CLK_TCK) * NANOS_PER_TICK;
+}
+
+static void timerfd_destroy_inode(struct inode* inode) {
+    spinlock_lock(&timers_lock);
+    disarm((struct timerfd*)inode);
+    spinlock_unlock(&timers_lock);
+    kfree(inode);
+}
+
+static bool read_should_unblock(file_description* desc) {
+    struct timerfd* timer = (struct timerfd*)desc->inode;
+    spinlock_lock(&timers_lock);
+    bool should_unblock = timer->num_expirations > 0;
+    spinlock_unlock(&timers_lock);
+    return should_unblock;
+}
+
+static ssize_t timerfd_read(file_description* desc, void* buffer,
+                            size_t count) {
+    if (count < sizeof(uint64_t))
+        return -EINVAL;
+    struct timerfd* timer = (struct timerfd*)desc->inode;
+
+    for (;;) {
+        int rc = file_description_block(desc, read_should_unblock);
+        if (IS_ERR(rc))
+            return rc;
+
+        spinlock_lock(&timers_lock);
+        uint64_t num_expirations = timer->num_expirations;
+        timer->num_expirations = 0;
+        spinlock_unlock(&timers_lock);
+
+        if (num_expirations > 0) {
+            *(uint64_t*)buffer = num_expirations;
+            return sizeof(uint64_t);
+        }
+    }
+}
+
+static short timerfd_poll(file_description* desc, short events) {
+    if ((events & POLLIN) && read_should_unblock(desc))
+        return POLLIN;
+    return 0;
+}
+
+static file_ops fops = {.destroy_inode = timerfd_destroy_inode,
+                        .read = timerfd_read,
+                        .poll = timerfd_poll};
+
+struct inode* timerfd_create(void) {
+    struct timerfd* timer = kmalloc(sizeof(struct timerfd));
+    if (!timer)
+        return ERR_PTR(-ENOMEM);
+    *timer = (struct timerfd){0};
+
+    struct inode* inode = &timer->inode;
+    inode->fops = &fops;
+    inode->mode = S_IFCHR;
+    inode->ref_count = 1;
+
+    return inode;
+}
+
+// must be called with timers_lock held
+static void get_time(const struct timerfd* timer, struct itimerspec* value) {
+    *value = (struct itimerspec){0};
+    if (!timer->armed)
+        return;
+    ticks_to_timespec(timer->interval, &value->it_interval);
+    uint32_t remaining = 0;
+    if (deadline_before(uptime, timer->deadline))
+        remaining = timer->deadline - uptime;
+    ticks_to_timespec(remaining, &value->it_value);
+}
+
+int timerfd_gettime(struct inode* inode, struct itimerspec* curr_value) {
+    if (inode->fops != &fops)
+        return -EINVAL;
+    spinlock_lock(&timers_lock);
+    get_time((struct timerfd*)inode, curr_value);
+    spinlock_unlock(&timers_lock);
+    return 0;
+}
+
+int timerfd_settime(struct inode* inode, int flags,
+                    const struct itimerspec* new_value,
+                    struct itimerspec* old_value) {
+    if (inode->fops != &fops)
+        return -EINVAL;
+    if (new_value->it_value.tv_nsec < 0 ||
+        new_value->it_value.tv_nsec >= 1000000000 ||
+        new_value->it_interval.tv_nsec < 0 ||
+        new_value->it_interval.tv_nsec >= 1000000000)
+        return -EINVAL;
+
+    struct timespec delay = new_value->it_value;
+    if (flags & TFD_TIMER_ABSTIME) {
+        struct timespec now;
+        int rc = time_now(&now);
+        if (IS_ERR(rc))
+            return rc;
+        timespec_saturating_sub(&delay, &now);
+    }
+    bool arming = new_value->it_value.tv_sec || new_value->it_value.tv_nsec;
+
+    struct timerfd* timer = (struct timerfd*)inode;
+    spinlock_lock(&timers_lock);
+    if (old_value)
+        get_time(timer, old_value);
+    disarm(timer);
+    timer->num_expirations = 0;
+    if (arming) {
+        timer->deadline = uptime + timespec_to_ticks(&delay);
+        timer->interval = timespec_to_ticks(&new_value->it_interval);
+        arm(timer);
+    }
+    spinlock_unlock(&timers_lock);
+
+    inode_notify_poll(inode);
+    return 0;
+}
@@ -41,7 +41,7 @@
 typedef struct tmpfs_inode {
     struct inode inode;
     growable_buf buf;
-    mutex children_lock;
+    rwlock children_lock;
     struct dentry* children;
 } tmpfs_inode;
 
@@ -54,9 +54,9 @@ static void tmpfs_destroy_inode(struct inode* inode) {
 
 static struct inode* tmpfs_lookup_child(struct inode* inode, const char* name) {
     tmpfs_inode* node = (tmpfs_inode*)inode;
-    mutex_lock(&node->children_lock);
+    rwlock_lock_read(&node->children_lock);
     struct inode* child = dentry_find(node->children, name);
-    mutex_unlock(&node->children_lock);
+    rwlock_unlock_read(&node->children_lock);
     inode_unref(inode);
     return child;
 }
@@ -71,12 +71,27 @@ static int tmpfs_stat(struct inode* inode, struct stat* buf) {
     return 0;
 }
 
-static ssize_t tmpfs_read(file_description* desc, void* buffer, size_t count) {
+static ssize_t tmpfs_pread(file_description* desc, void* buffer, size_t count,
+                           off_t offset) {
     tmpfs_inode* node = (tmpfs_inode*)desc->inode;
-    mutex_lock(&desc->offset_lock);
     mutex_lock(&node->buf.lock);
-    ssize_t nread = growable_buf_pread(&node->buf, buffer, count, desc->offset);
+    ssize_t nread = growable_buf_pread(&node->buf, buffer, count, offset);
     mutex_unlock(&node->buf.lock);
+    return nread;
+}
+
+static ssize_t tmpfs_pwrite(file_description* desc, const void* buffer,
+                            size_t count, off_t offset) {
+    tmpfs_inode* node = (tmpfs_inode*)desc->inode;
+    mutex_lock(&node->buf.lock);
+    ssize_t nwritten = growable_buf_pwrite(&node->buf, buffer, count, offset);
+    mutex_unlock(&node->buf.lock);
+    return nwritten;
+}
+
+static ssize_t tmpfs_read(file_description* desc, void* buffer, size_t count) {
+    mutex_lock(&desc->offset_lock);
+    ssize_t nread = tmpfs_pread(desc, buffer, count, desc->offset);
     if (IS_OK(nread))
         desc->offset += nread;
     mutex_unlock(&desc->offset_lock);
@@ -85,12 +100,8 @@ static ssize_t tmpfs_read(file_description* desc, void* buffer, size_t count) {
 
 static ssize_t tmpfs_write(file_description* desc, const void* buffer,
                            size_t count) {
-    tmpfs_inode* node = (tmpfs_inode*)desc->inode;
     mutex_lock(&desc->offset_lock);
-    mutex_lock(&node->buf.lock);
-    ssize_t nwritten =
-        growable_buf_pwrite(&node->buf, buffer, count, desc->offset);
-    mutex_unlock(&node->buf.lock);
+    ssize_t nwritten = tmpfs_pwrite(desc, buffer, count, desc->offset);
     if (IS_OK(nwritten))
         desc->offset += nwritten;
     mutex_unlock(&desc->offset_lock);
@@ -101,8 +112,14 @@ static uintptr_t tmpfs_mmap(file_description* desc, uintptr_t addr,
                             size_t length, off_t offset, uint16_t page_flags) {
     tmpfs_inode* node = (tmpfs_inode*)desc->inode;
     mutex_lock(&node->buf.lock);
-    uintptr_t rc =
-        growable_buf_mmap(&node->buf, addr, length, offset, page_flags);
+
+    // Mapping past the end of the file allocates the pages without changing
+    // the size, so that the mapping sees the data once the file grows into
+    // them.
+    uintptr_t rc = growable_buf_reserve(&node->buf, offset + length);
+    if (IS_OK(rc))
+        rc = growable_buf_mmap(&node->buf, addr, length, offset, page_flags);
+
     mutex_unlock(&node->buf.lock);
     return rc;
 }
@@ -115,32 +132,61 @@ static int tmpfs_truncate(file_description* desc, off_t length) {
     return rc;
 }
 
+static ssize_t tmpfs_copy_range(file_description* out, off_t out_offset,
+                                file_description* in, off_t in_offset,
+                                size_t count) {
+    tmpfs_inode* dest = (tmpfs_inode*)out->inode;
+    tmpfs_inode* src = (tmpfs_inode*)in->inode;
+
+    // lock in address order so that copies in opposite directions between
+    // the same files don't deadlock
+    growable_buf* first = dest < src ? &dest->buf : &src->buf;
+    growable_buf* second = dest < src ? &src->buf : &dest->buf;
+    mutex_lock(&first->lock);
+    mutex_lock(&second->lock);
+
+    ssize_t rc = 0;
+    if ((size_t)in_offset < src->buf.size) {
+        count = MIN(count, src->buf.size - in_offset);
+        if (dest == src && in_offset < out_offset + (off_t)count &&
+            out_offset < in_offset + (off_t)count)
+            rc = -EINVAL;
+        else
+            rc = growable_buf_copy_range(&dest->buf, out_offset, &src->buf,
+                                         in_offset, count);
+    }
+
+    mutex_unlock(&second->lock);
+    mutex_unlock(&first->lock);
+    return rc;
+}
+
 static int tmpfs_getdents(struct getdents_ctx* ctx, file_description* desc,
                           getdents_callback_fn callback) {
     tmpfs_inode* node = (tmpfs_inode*)desc->inode;
-    mutex_lock(&node->children_lock);
+    rwlock_lock_read(&node->children_lock);
     mutex_lock(&desc->offset_lock);
     int rc = dentry_getdents(ctx, desc, node->children, callback);
     mutex_unlock(&desc->offset_lock);
-    mutex_unlock(&node->children_lock);
+    rwlock_unlock_read(&node->children_lock);
     return rc;
 }
 
 static int tmpfs_link_child(struct inode* inode, const char* name,
                             struct inode* child) {
     tmpfs_inode* node = (tmpfs_inode*)inode;
-    mutex_lock(&node->children_lock);
+    rwlock_lock_write(&node->children_lock);
     int rc = dentry_append(&node->children, name, child);
-    mutex_unlock(&node->children_lock);
+    rwlock_unlock_write(&node->children_lock);
     inode_unref(inode);
     return rc;
 }
 
 static struct inode* tmpfs_unlink_child(struct inode* inode, const char* name) {
     tmpfs_inode* node = (tmpfs_inode*)inode;
-    mutex_lock(&node->children_lock);
+    rwlock_lock_write(&node->children_lock);
     struct inode* child = dentry_remove(&node->children, name);
-    mutex_unlock(&node->children_lock);
+    rwlock_unlock_write(&node->children_lock);
     inode_unref(inode);
     return child;
 }
@@ -159,8 +205,11 @@ static file_ops non_dir_fops = {.destroy_inode = tmpfs_destroy_inode,
                                 .stat = tmpfs_stat,
                                 .read = tmpfs_read,
                                 .write = tmpfs_write,
+                                .pread = tmpfs_pread,
+                                .pwrite = tmpfs_pwrite,
                                 .mmap = tmpfs_mmap,
-                                .truncate = tmpfs_truncate};
+                                .truncate = tmpfs_truncate,
+                                .copy_range = tmpfs_copy_range};
 
 static struct inode* tmpfs_create_child(struct inode* inode, const char* name,
                                         mode_t mode) {
@@ -199,3 +248,19 @@ struct inode* tmpfs_create_root(void) {
 
     return inode;
 }
+
+struct inode* tmpfs_create_anonymous_file(void) {
+    tmpfs_inode* node = kmalloc(sizeof(tmpfs_inode));
+    if (!node)
+        return ERR_PTR(-ENOMEM);
+    *node = (tmpfs_inode){0};
+
+    // being its own filesystem, the file can't be linked into any directory
+    struct inode* inode = &node->inode;
+    inode->fs_root_inode = inode;
+    inode->fops = &non_dir_fops;
+    inode->mode = S_IFREG;
+    inode->ref_count = 1;
+
+    return inode;
+}
@@ -55,6 +55,7 @@ typedef struct device {
 
 static struct inode* root;
 static mount_point* mount_points;
+static rwlock mount_points_lock;
 static device* devices;
 
 static int mount_at(struct inode* host, struct inode* guest) {
@@ -67,6 +68,7 @@ static int mount_at(struct inode* host, struct inode* guest) {
     mp->host = host;
     mp->guest = guest;
     mp->next = NULL;
+    rwlock_lock_write(&mount_points_lock);
     if (mount_points) {
         mount_point* it = mount_points;
         while (it->next)
@@ -75,21 +77,23 @@ static int mount_at(struct inode* host, struct inode* guest) {
     } else {
         mount_points = mp;
     }
+    rwlock_unlock_write(&mount_points_lock);
     return 0;
 }
 
 static struct inode* find_mounted_guest(struct inode* host) {
-    mount_point* it = mount_points;
-    while (it) {
+    rwlock_lock_read(&mount_points_lock);
+    struct inode* guest = NULL;
+    for (mount_point* it = mount_points; it; it = it->next) {
         if (it->host == host) {
-            inode_unref(host);
-            inode_ref(it->guest);
-            return it->guest;
+            guest = it->guest;
+            inode_ref(guest);
+            break;
         }
-        it = it->next;
     }
+    rwlock_unlock_read(&mount_points_lock);
     inode_unref(host);
-    return NULL;
+    return guest;
 }
 
 static bool is_absolute_path(const char* path) {
@@ -244,7 +248,9 @@ static int create_path_component_list(const char* pathname,
     size_t num_components = 0;
 
     if (!is_absolute_path(pathname)) {
-        char* dup_cwd = kstrdup(current->cwd_path);
+        mutex_lock(&current->cwd->lock);
+        char* dup_cwd = kstrdup(current->cwd->path);
+        mutex_unlock(&current->cwd->lock);
         if (!dup_cwd)
             return -ENOMEM;
 
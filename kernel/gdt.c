@@ -34,6 +34,10 @@
  */
 
 #include "system.h"
+#include "boot_defs.h"
+#include "cpu.h"
+#include "kprintf.h"
+#include "panic.h"
 #include <stddef.h>
 
 #if defined(__i386__)
@@ -63,13 +67,29 @@ struct tss {
     uint16_t trap, iomap_base;
 } __attribute__((packed));
 
-#define NUM_GDT_ENTRIES 6
-static gdt_descriptor gdt[NUM_GDT_ENTRIES];
-static struct tss tss;
-static gdt_pointer gdtr;
+#define NUM_GDT_ENTRIES 9
+static gdt_descriptor gdts[MAX_NUM_CPUS][NUM_GDT_ENTRIES];
+static struct tss tsses[MAX_NUM_CPUS];
+static gdt_pointer gdtrs[MAX_NUM_CPUS];
+
+extern unsigned char kernel_page_directory[];
+
+#define DOUBLE_FAULT_STACK_SIZE PAGE_SIZE
+static struct tss double_fault_tsses[MAX_NUM_CPUS];
+static unsigned char double_fault_stacks[MAX_NUM_CPUS][DOUBLE_FAULT_STACK_SIZE]
+    __attribute__((aligned(16)));
+
+// Runs as a separate task, so the state of the faulting context has been saved
+// in the main TSS of the CPU.
+static noreturn void handle_double_fault(void) {
+    struct tss* tss = tsses + cpu_get_current()->id;
+    kprintf("Exception: Double fault at eip=0x%x esp=0x%x\n", tss->eip,
+            tss->esp);
+    PANIC("Unrecoverable exception");
+}
 
-static void gdt_set_gate(size_t idx, uint32_t base, uint32_t limit,
-                         uint8_t access, uint8_t flags) {
+static void gdt_set_gate(gdt_descriptor* gdt, size_t idx, uint32_t base,
+                         uint32_t limit, uint8_t access, uint8_t flags) {
     gdt_descriptor* entry = gdt + idx;
 
     entry->base_lo = base & 0xffff;
@@ -83,37 +103,71 @@ static void gdt_set_gate(size_t idx, uint32_t base, uint32_t limit,
     entry->flags = flags & 0xf;
 }
 
-void gdt_init(void) {
-    gdtr.limit = NUM_GDT_ENTRIES * sizeof(gdt_descriptor) - 1;
-    gdtr.base = (uint32_t)&gdt;
-
-    gdt_set_gate(0, 0, 0, 0, 0);
-    gdt_set_gate(1, 0, 0xfffff, 0x9a, 0xc);                       // kernel code
-    gdt_set_gate(2, 0, 0xfffff, 0x92, 0xc);                       // kernel data
-    gdt_set_gate(3, 0, 0xfffff, 0xfa, 0xc);                       // user code
-    gdt_set_gate(4, 0, 0xfffff, 0xf2, 0xc);                       // user data
-    gdt_set_gate(5, (uint32_t)&tss, sizeof(struct tss), 0xe9, 0); // TSS
-
-    tss.ss0 = 0x10;
-    tss.cs = 0x8 | 3;
-    tss.ss = tss.ds = tss.es = tss.fs = tss.gs = 0x10 | 3;
-    tss.iomap_base = sizeof(struct tss);
+// every CPU gets its own GDT because TSS and the per-CPU data segment differ
+void gdt_init(struct cpu* cpu) {
+    ASSERT(cpu->id < MAX_NUM_CPUS);
+    gdt_descriptor* gdt = gdts[cpu->id];
+    struct tss* tss = tsses + cpu->id;
+    struct tss* df_tss = double_fault_tsses + cpu->id;
+    gdt_pointer* gdtr = gdtrs + cpu->id;
+
+    cpu->self = cpu;
+
+    gdtr->limit = NUM_GDT_ENTRIES * sizeof(gdt_descriptor) - 1;
+    gdtr->base = (uint32_t)gdt;
+
+    gdt_set_gate(gdt, 0, 0, 0, 0, 0);
+    gdt_set_gate(gdt, 1, 0, 0xfffff, 0x9a, 0xc);                      // kernel code
+    gdt_set_gate(gdt, 2, 0, 0xfffff, 0x92, 0xc);                      // kernel data
+    gdt_set_gate(gdt, 3, 0, 0xfffff, 0xfa, 0xc);                      // user code
+    gdt_set_gate(gdt, 4, 0, 0xfffff, 0xf2, 0xc);                      // user data
+    gdt_set_gate(gdt, 5, (uint32_t)tss, sizeof(struct tss), 0xe9, 0); // TSS
+    gdt_set_gate(gdt, 6, (uint32_t)cpu, sizeof(struct cpu), 0x92, 0x4); // per-CPU data
+    gdt_set_gate(gdt, 7, 0, 0xfffff, 0xf2, 0xc);                      // user TLS
+    gdt_set_gate(gdt, 8, (uint32_t)df_tss, sizeof(struct tss), 0x89, 0); // double fault TSS
+
+    tss->ss0 = 0x10;
+    tss->cs = 0x8 | 3;
+    tss->ss = tss->ds = tss->es = tss->fs = tss->gs = 0x10 | 3;
+    tss->iomap_base = sizeof(struct tss);
+
+    df_tss->cr3 = (uint32_t)kernel_page_directory;
+    df_tss->eip = (uint32_t)handle_double_fault;
+    df_tss->eflags = 0x2;
+    df_tss->esp = (uint32_t)(double_fault_stacks[cpu->id] + DOUBLE_FAULT_STACK_SIZE);
+    df_tss->cs = 0x8;
+    df_tss->ss = df_tss->ds = df_tss->es = df_tss->fs = 0x10;
+    df_tss->gs = CPU_DATA_SEGMENT;
+    df_tss->iomap_base = sizeof(struct tss);
 
     // flush GDT
     __asm__ volatile("lgdt %0\n"
                      "movw %%ax, %%ds\n"
                      "movw %%ax, %%es\n"
                      "movw %%ax, %%fs\n"
-                     "movw %%ax, %%gs\n"
                      "movw %%ax, %%ss\n"
+                     "movw %%cx, %%gs\n"
                      "ljmpl $0x8, $1f\n"
-                     "1:" ::"m"(gdtr),
-                     "a"(0x10));
+                     "1:" ::"m"(*gdtr),
+                     "a"(0x10), "c"(CPU_DATA_SEGMENT));
 
     // flush TSS
     __asm__ volatile("ltr %%ax" ::"a"(0x2b));
+
+    syscall_init_sysenter((uintptr_t)&tss->esp0);
+}
+
+void gdt_set_kernel_stack(uintptr_t stack_top) {
+    tsses[cpu_get_current()->id].esp0 = stack_top;
 }
 
-void gdt_set_kernel_stack(uintptr_t stack_top) { tss.esp0 = stack_top; }
+// The new base takes effect when userland reloads gs, which happens on every
+// return to userland as the segment registers are popped from the stack.
+void gdt_set_tls_base(uintptr_t base) {
+    gdt_descriptor* entry = gdts[cpu_get_current()->id] + 7;
+    entry->base_lo = base & 0xffff;
+    entry->base_mid = (base >> 16) & 0xff;
+    entry->base_hi = (base >> 24) & 0xff;
+}
 
 #endif
\ No newline at end of file
@@ -83,8 +83,9 @@ NODISCARD static int grow_buf(growable_buf* buf, size_t requested_size) {
     if (IS_ERR(rc))
         return rc;
 
-    if (buf->addr)
-        memcpy((void*)new_addr, (void*)buf->addr, buf->size);
+    // The existing pages keep their physical addresses and only move to the
+    // new virtual range, so the contents don't have to be copied and
+    // userland mappings of them stay valid.
     memset((void*)(new_addr + buf->size), 0, new_capacity - buf->size);
 
     if (buf->addr) {
@@ -100,6 +101,19 @@ NODISCARD static int grow_buf(growable_buf* buf, size_t requested_size) {
     return 0;
 }
 
+// Gives the pages in the range their own copies before they are modified,
+// if they are shared copy-on-write with other buffers.
+NODISCARD static int unshare(growable_buf* buf, size_t offset, size_t count) {
+    uintptr_t end = buf->addr + offset + count;
+    for (uintptr_t page = round_down(buf->addr + offset, PAGE_SIZE);
+         page < end; page += PAGE_SIZE) {
+        int rc = paging_unshare_page(page);
+        if (IS_ERR(rc))
+            return rc;
+    }
+    return 0;
+}
+
 ssize_t growable_buf_pwrite(growable_buf* buf, const void* bytes, size_t count,
                             off_t offset) {
     size_t end = offset + count;
@@ -109,6 +123,10 @@ ssize_t growable_buf_pwrite(growable_buf* buf, const void* bytes, size_t count,
             return rc;
     }
 
+    int rc = unshare(buf, offset, count);
+    if (IS_ERR(rc))
+        return rc;
+
     memcpy((void*)(buf->addr + offset), bytes, count);
     if (buf->size < end)
         buf->size = end;
@@ -123,8 +141,14 @@ ssize_t growable_buf_append(growable_buf* buf, const void* bytes,
 
 int growable_buf_truncate(growable_buf* buf, off_t length) {
     if ((size_t)length <= buf->size) {
+        int rc = unshare(buf, length, buf->size - length);
+        if (IS_ERR(rc))
+            return rc;
         memset((void*)(buf->addr + length), 0, buf->size - length);
     } else if ((size_t)length <= buf->capacity) {
+        int rc = unshare(buf, buf->size, length - buf->size);
+        if (IS_ERR(rc))
+            return rc;
         memset((void*)(buf->addr + buf->size), 0, length - buf->size);
     } else {
         // length > capacity
@@ -137,21 +161,76 @@ int growable_buf_truncate(growable_buf* buf, off_t length) {
     return 0;
 }
 
+int growable_buf_reserve(growable_buf* buf, size_t capacity) {
+    if (capacity <= buf->capacity)
+        return 0;
+    return grow_buf(buf, capacity);
+}
+
 uintptr_t growable_buf_mmap(growable_buf* buf, uintptr_t addr, size_t length,
                             off_t offset, uint16_t page_flags) {
-    if (offset != 0 || !(page_flags & PAGE_SHARED))
+    if (!(page_flags & PAGE_SHARED))
         return -ENOTSUP;
+    ASSERT(offset % PAGE_SIZE == 0);
 
-    if (length > buf->size)
+    if (offset + length > buf->capacity)
         return -EINVAL;
 
-    int rc = paging_copy_mapping(addr, buf->addr, length, page_flags);
+    // writes through the mapping can't be caught, so it gets its own pages
+    int rc = unshare(buf, offset, length);
+    if (IS_ERR(rc))
+        return rc;
+
+    rc = paging_copy_mapping(addr, buf->addr + offset, length, page_flags);
     if (IS_ERR(rc))
         return rc;
 
     return addr;
 }
 
+ssize_t growable_buf_copy_range(growable_buf* dest, off_t dest_offset,
+                                growable_buf* src, off_t src_offset,
+                                size_t count) {
+    if ((size_t)src_offset >= src->size)
+        return 0;
+    count = MIN(count, src->size - src_offset);
+
+    size_t end = dest_offset + count;
+    if (end > dest->capacity) {
+        int rc = grow_buf(dest, end);
+        if (IS_ERR(rc))
+            return rc;
+    }
+
+    // Whole pages are shared when both ranges are page-aligned, and
+    // everything else is copied.
+    size_t copied = 0;
+    while (copied < count) {
+        uintptr_t from = src->addr + src_offset + copied;
+        uintptr_t to = dest->addr + dest_offset + copied;
+        size_t n = count - copied;
+        int rc;
+        if (from % PAGE_SIZE == 0 && to % PAGE_SIZE == 0 && n >= PAGE_SIZE) {
+            n = round_down(n, PAGE_SIZE);
+            rc = paging_share_cow(to, from, n);
+        } else {
+            n = MIN(n, PAGE_SIZE - from % PAGE_SIZE);
+            n = MIN(n, PAGE_SIZE - to % PAGE_SIZE);
+            rc = unshare(dest, to - dest->addr, n);
+            if (IS_ERR(rc))
+                return rc;
+            memcpy((void*)to, (void*)from, n);
+        }
+        if (IS_ERR(rc))
+            return rc;
+        copied += n;
+    }
+
+    if (dest->size < end)
+        dest->size = end;
+    return count;
+}
+
 int growable_buf_printf(growable_buf* buf, const char* format, ...) {
     va_list args;
     va_start(args, format);
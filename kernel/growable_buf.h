@@ -55,8 +55,20 @@ NODISCARD ssize_t growable_buf_pwrite(growable_buf*, const void* bytes,
 NODISCARD ssize_t growable_buf_append(growable_buf*, const void* bytes,
                                       size_t count);
 
+// Copies count bytes from src to dest, sharing whole pages copy-on-write
+// where possible. src and dest may be the same buffer if the ranges don't
+// overlap.
+NODISCARD ssize_t growable_buf_copy_range(growable_buf* dest, off_t dest_offset,
+                                          growable_buf* src, off_t src_offset,
+                                          size_t count);
+
 NODISCARD int growable_buf_truncate(growable_buf*, off_t length);
 
+// Allocates pages up to capacity without changing the size.
+NODISCARD int growable_buf_reserve(growable_buf*, size_t capacity);
+
+// Maps the pages of the buffer. The range can extend past the size, but not
+// past the capacity.
 NODISCARD uintptr_t growable_buf_mmap(growable_buf*, uintptr_t addr,
                                       size_t length, off_t offset,
                                       uint16_t page_flags);
@@ -34,6 +34,7 @@
  */
 
 #include "hid.h"
+#include <kernel/api/poll.h>
 #include <kernel/api/sys/sysmacros.h>
 #include <kernel/console/console.h>
 #include <kernel/fs/fs.h>
@@ -278,6 +279,8 @@ static void set_state(uint8_t which, bool pressed) {
 static key_event queue[QUEUE_SIZE];
 static size_t queue_read_idx = 0;
 static size_t queue_write_idx = 0;
+static spinlock queue_lock;
+static struct inode* device_inode;
 
 static void irq_handler(registers* reg) {
     (void)reg;
@@ -327,20 +330,26 @@ static void irq_handler(registers* reg) {
     const char* to_key = (modifiers & KEY_MODIFIER_SHIFT) ? scancode_to_shifted_key : scancode_to_key;
     const uint8_t* to_keycode = (modifiers & KEY_MODIFIER_SHIFT) ? scancode_to_shifted_keycode : scancode_to_keycode;
 
-    key_event* event = queue + queue_write_idx;
-    queue_write_idx = (queue_write_idx + 1) % QUEUE_SIZE;
-
-    event->scancode = ch;
+    key_event event = {
+        .scancode = ch,
+        .key = to_key[ch],
+        .keycode = to_keycode[ch],
+        .modifiers = modifiers,
+        .pressed = pressed,
+    };
     if (received_e0)
-        event->scancode |= 0xe000;
-    event->key = to_key[ch];
-    event->keycode = to_keycode[ch];
-    event->modifiers = modifiers;
-    event->pressed = pressed;
+        event.scancode |= 0xe000;
 
     received_e0 = false;
 
-    fb_console_on_key(event);
+    spinlock_lock(&queue_lock);
+    queue[queue_write_idx] = event;
+    queue_write_idx = (queue_write_idx + 1) % QUEUE_SIZE;
+    spinlock_unlock(&queue_lock);
+    if (device_inode)
+        inode_notify_poll(device_inode);
+
+    fb_console_on_key(&event);
 }
 
 void ps2_keyboard_init(void) {
@@ -353,9 +362,9 @@ void ps2_keyboard_init(void) {
 static bool read_should_unblock(file_description* desc) {
     #if defined(__i386__)
     (void)desc;
-    bool int_flag = push_cli();
+    spinlock_lock(&queue_lock);
     bool should_unblock = queue_read_idx != queue_write_idx;
-    pop_cli(int_flag);
+    spinlock_unlock(&queue_lock);
     return should_unblock;
     #else
     return false;
@@ -371,9 +380,9 @@ static ssize_t ps2_keyboard_device_read(file_description* desc, void* buffer, si
         if (IS_ERR(rc))
             return rc;
 
-        bool int_flag = push_cli();
+        spinlock_lock(&queue_lock);
         if (queue_read_idx == queue_write_idx) {
-            pop_cli(int_flag);
+            spinlock_unlock(&queue_lock);
             continue;
         }
 
@@ -387,7 +396,7 @@ static ssize_t ps2_keyboard_device_read(file_description* desc, void* buffer, si
             count -= sizeof(key_event);
             queue_read_idx = (queue_read_idx + 1) % QUEUE_SIZE;
         }
-        pop_cli(int_flag);
+        spinlock_unlock(&queue_lock);
         return nread;
     }
     #else
@@ -395,12 +404,20 @@ static ssize_t ps2_keyboard_device_read(file_description* desc, void* buffer, si
     #endif
 }
 
+static short ps2_keyboard_device_poll(file_description* desc, short events) {
+    short revents = 0;
+    if ((events & POLLIN) && read_should_unblock(desc))
+        revents |= POLLIN;
+    return revents;
+}
+
 struct inode* ps2_keyboard_device_create(void) {
     struct inode* inode = kmalloc(sizeof(struct inode));
     if (!inode)
         return ERR_PTR(-ENOMEM);
 
-    static file_ops fops = {.read = ps2_keyboard_device_read};
+    static file_ops fops = {.read = ps2_keyboard_device_read, .poll = ps2_keyboard_device_poll};
     *inode = (struct inode){.fops = &fops, .mode = S_IFCHR, .device_id = makedev(11, 0), .ref_count = 1};
+    device_inode = inode;
     return inode;
 }
@@ -35,6 +35,7 @@
 
 #include "hid.h"
 #include <kernel/api/hid.h>
+#include <kernel/api/poll.h>
 #include <kernel/api/sys/sysmacros.h>
 #include <kernel/fs/fs.h>
 #include <kernel/interrupts.h>
@@ -56,6 +57,8 @@ static size_t state = 0;
 static mouse_event queue[QUEUE_SIZE];
 static size_t queue_read_idx = 0;
 static size_t queue_write_idx = 0;
+static spinlock queue_lock;
+static struct inode* device_inode;
 
 /* IRQs are i?86-specific */
 #if defined(__i386__)
@@ -82,8 +85,12 @@ static void irq_handler(registers* reg) {
         if (buf[0] & 0xc0)
             dx = dy = 0;
 
+        spinlock_lock(&queue_lock);
         queue[queue_write_idx] = (mouse_event){dx, -dy, buf[0] & 7};
         queue_write_idx = (queue_write_idx + 1) % QUEUE_SIZE;
+        spinlock_unlock(&queue_lock);
+        if (device_inode)
+            inode_notify_poll(device_inode);
 
         state = 0;
         return;
@@ -102,9 +109,9 @@ void ps2_mouse_init(void) {
 
 static bool read_should_unblock(file_description* desc) {
     (void)desc;
-    bool int_flag = push_cli();
+    spinlock_lock(&queue_lock);
     bool should_unblock = queue_read_idx != queue_write_idx;
-    pop_cli(int_flag);
+    spinlock_unlock(&queue_lock);
     return should_unblock;
 }
 
@@ -117,9 +124,9 @@ static ssize_t ps2_mouse_device_read(file_description* desc, void* buffer,
         if (IS_ERR(rc))
             return rc;
 
-        bool int_flag = push_cli();
+        spinlock_lock(&queue_lock);
         if (queue_read_idx == queue_write_idx) {
-            pop_cli(int_flag);
+            spinlock_unlock(&queue_lock);
             continue;
         }
 
@@ -134,20 +141,28 @@ static ssize_t ps2_mouse_device_read(file_description* desc, void* buffer,
             count -= sizeof(mouse_event);
             queue_read_idx = (queue_read_idx + 1) % QUEUE_SIZE;
         }
-        pop_cli(int_flag);
+        spinlock_unlock(&queue_lock);
         return nread;
     }
 }
 
+static short ps2_mouse_device_poll(file_description* desc, short events) {
+    short revents = 0;
+    if ((events & POLLIN) && read_should_unblock(desc))
+        revents |= POLLIN;
+    return revents;
+}
+
 struct inode* ps2_mouse_device_create(void) {
     struct inode* inode = kmalloc(sizeof(struct inode));
     if (!inode)
         return ERR_PTR(-ENOMEM);
 
-    static file_ops fops = {.read = ps2_mouse_device_read};
+    static file_ops fops = {.read = ps2_mouse_device_read, .poll = ps2_mouse_device_poll};
     *inode = (struct inode){.fops = &fops,
                             .mode = S_IFCHR,
                             .device_id = makedev(10, 1),
                             .ref_count = 1};
+    device_inode = inode;
     return inode;
 }
@@ -158,7 +158,6 @@ static void handle_exception6(registers* regs) {
 }
 
 DEFINE_EXCEPTION_WITHOUT_ERROR_CODE(7, "Device not available")
-DEFINE_EXCEPTION_WITH_ERROR_CODE(8, "Double fault")
 DEFINE_EXCEPTION_WITHOUT_ERROR_CODE(9, "Coprocessor segment overrun")
 DEFINE_EXCEPTION_WITH_ERROR_CODE(10, "Invalid TSS")
 DEFINE_EXCEPTION_WITH_ERROR_CODE(11, "Segment not present")
@@ -207,7 +206,9 @@ void idt_init(void) {
     REGISTER_EXCEPTION(5);
     REGISTER_EXCEPTION(6);
     REGISTER_EXCEPTION(7);
-    REGISTER_EXCEPTION(8);
+    // A double fault is most likely caused by a kernel stack overflowing into
+    // its guard page, so the handler is run as a task on its own stack.
+    idt_set_gate(8, 0, DOUBLE_FAULT_TSS_SEGMENT, TASK_GATE, 0);
     REGISTER_EXCEPTION(9);
     REGISTER_EXCEPTION(10);
     REGISTER_EXCEPTION(11);
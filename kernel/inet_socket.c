@@ -0,0 +1,728 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "api/fcntl.h"
+#include "api/netinet/tcp.h"
+#include "api/poll.h"
+#include "boot_defs.h"
+#include "memory/memory.h"
+#include "network.h"
+#include "nic.h"
+#include "panic.h"
+#include "process.h"
+#include "scheduler.h"
+#include "socket.h"
+#include <common/string.h>
+
+#define EPHEMERAL_PORT_MIN 49152
+#define EPHEMERAL_PORT_MAX 65535
+
+#define DEFAULT_DGRAM_RCVBUF (16 * PAGE_SIZE)
+#define MAX_DGRAM_RCVBUF (256 * PAGE_SIZE)
+
+// on the stack of a process blocked on a socket
+struct inet_waiter {
+    struct process* process;
+    struct inet_waiter* next;
+};
+
+// All bound sockets, linked through next_hashed. The table holds a reference
+// to each of them.
+static mutex table_lock;
+static inet_socket* sockets;
+
+static bool addresses_overlap(uint32_t a, uint32_t b) {
+    return a == htonl(INADDR_ANY) || b == htonl(INADDR_ANY) || a == b;
+}
+
+// called with table_lock held
+static bool is_port_in_use(int protocol, uint32_t ip, uint16_t port) {
+    for (inet_socket* it = sockets; it; it = it->next_hashed) {
+        if (it->protocol != protocol || it->local_port != port)
+            continue;
+        // accepted connections share the port of their listener, and
+        // connections in TIME_WAIT don't keep a server from restarting
+        if (it->type == SOCK_STREAM && it->connected)
+            continue;
+        if (addresses_overlap(it->local_ip, ip))
+            return true;
+    }
+    return false;
+}
+
+// called with table_lock held
+static int pick_ephemeral_port(int protocol, uint32_t ip) {
+    static uint16_t next = EPHEMERAL_PORT_MIN;
+    for (size_t i = 0; i <= EPHEMERAL_PORT_MAX - EPHEMERAL_PORT_MIN; ++i) {
+        uint16_t port = next;
+        next = next == EPHEMERAL_PORT_MAX ? EPHEMERAL_PORT_MIN : next + 1;
+        if (!is_port_in_use(protocol, ip, htons(port)))
+            return port;
+    }
+    return -EADDRINUSE;
+}
+
+// called with table_lock held
+static void hash_locked(inet_socket* socket) {
+    ASSERT(!socket->hashed);
+    inode_ref(&socket->inode);
+    socket->hashed = true;
+    socket->next_hashed = sockets;
+    sockets = socket;
+}
+
+// called with table_lock held, and returns whether the socket was in the table
+static bool unhash_locked(inet_socket* socket) {
+    if (!socket->hashed)
+        return false;
+    for (inet_socket** it = &sockets; *it; it = &(*it)->next_hashed) {
+        if (*it == socket) {
+            *it = socket->next_hashed;
+            break;
+        }
+    }
+    socket->hashed = false;
+    socket->next_hashed = NULL;
+    return true;
+}
+
+// called with table_lock held, with port in network byte order or 0 for an
+// ephemeral one
+static int bind_locked(inet_socket* socket, uint32_t ip, uint16_t port) {
+    if (socket->local_port)
+        return -EINVAL;
+    if (port == 0) {
+        int rc = pick_ephemeral_port(socket->protocol, ip);
+        if (IS_ERR(rc))
+            return rc;
+        port = htons(rc);
+    } else if (is_port_in_use(socket->protocol, ip, port)) {
+        return -EADDRINUSE;
+    }
+    socket->local_ip = ip;
+    socket->local_port = port;
+    hash_locked(socket);
+    return 0;
+}
+
+// binds the socket to an ephemeral port unless it was bound already
+static int ensure_bound(inet_socket* socket) {
+    mutex_lock(&table_lock);
+    int rc = 0;
+    if (!socket->local_port)
+        rc = bind_locked(socket, htonl(INADDR_ANY), 0);
+    mutex_unlock(&table_lock);
+    return rc;
+}
+
+void inet_socket_hash(inet_socket* socket) {
+    mutex_lock(&table_lock);
+    hash_locked(socket);
+    mutex_unlock(&table_lock);
+}
+
+void inet_socket_unhash(inet_socket* socket) {
+    mutex_lock(&table_lock);
+    bool was_hashed = unhash_locked(socket);
+    mutex_unlock(&table_lock);
+    if (was_hashed)
+        inode_unref(&socket->inode);
+}
+
+inet_socket* inet_socket_lookup(int protocol, uint32_t local_ip,
+                                uint16_t local_port, uint32_t remote_ip,
+                                uint16_t remote_port) {
+    mutex_lock(&table_lock);
+    inet_socket* best = NULL;
+    int best_score = -1;
+    for (inet_socket* it = sockets; it; it = it->next_hashed) {
+        if (it->protocol != protocol || it->local_port != local_port)
+            continue;
+        if (it->local_ip != htonl(INADDR_ANY) && it->local_ip != local_ip)
+            continue;
+        int score = 0;
+        if (it->connected) {
+            if (it->remote_ip != remote_ip || it->remote_port != remote_port)
+                continue;
+            score += 2;
+        }
+        if (it->local_ip != htonl(INADDR_ANY))
+            ++score;
+        if (score > best_score) {
+            best = it;
+            best_score = score;
+        }
+    }
+    if (best)
+        inode_ref(&best->inode);
+    mutex_unlock(&table_lock);
+    return best;
+}
+
+void inet_socket_sweep(int protocol, bool (*fn)(inet_socket*, void* ctx),
+                       void* ctx) {
+    // the removed sockets are unreferenced after unlocking, as that may
+    // destroy them
+    inet_socket* removed = NULL;
+    mutex_lock(&table_lock);
+    inet_socket** it = &sockets;
+    while (*it) {
+        inet_socket* socket = *it;
+        if (socket->protocol != protocol || !fn(socket, ctx)) {
+            it = &socket->next_hashed;
+            continue;
+        }
+        *it = socket->next_hashed;
+        socket->hashed = false;
+        socket->next_hashed = removed;
+        removed = socket;
+    }
+    mutex_unlock(&table_lock);
+
+    while (removed) {
+        inet_socket* next = removed->next_hashed;
+        removed->next_hashed = NULL;
+        inode_unref(&removed->inode);
+        removed = next;
+    }
+}
+
+int inet_socket_wait(inet_socket* socket,
+                     bool (*should_unblock)(inet_socket*)) {
+    struct inet_waiter waiter = {.process = current, .next = socket->waiters};
+    socket->waiters = &waiter;
+    mutex_unlock(&socket->lock);
+
+    int rc = scheduler_block((should_unblock_fn)should_unblock, socket);
+
+    mutex_lock(&socket->lock);
+    for (struct inet_waiter** it = &socket->waiters; *it; it = &(*it)->next) {
+        if (*it == &waiter) {
+            *it = waiter.next;
+            break;
+        }
+    }
+    return rc;
+}
+
+void inet_socket_notify(inet_socket* socket) {
+    for (struct inet_waiter* it = socket->waiters; it; it = it->next)
+        scheduler_wake(it->process);
+    inode_notify_poll(&socket->inode);
+}
+
+static size_t iov_total_len(const struct iovec* iov, size_t iovlen) {
+    size_t total = 0;
+    for (size_t i = 0; i < iovlen; ++i)
+        total += iov[i].iov_len;
+    return total;
+}
+
+static int parse_sockaddr(const sockaddr* addr, socklen_t addrlen,
+                          const sockaddr_in** out_addr_in) {
+    if (!addr || addrlen < sizeof(sockaddr_in))
+        return -EINVAL;
+    if (addr->sa_family != AF_INET)
+        return -EAFNOSUPPORT;
+    *out_addr_in = (const sockaddr_in*)addr;
+    return 0;
+}
+
+static void fill_sockaddr(sockaddr* addr, socklen_t* addrlen, uint32_t ip,
+                          uint16_t port) {
+    sockaddr_in addr_in = {.sin_family = AF_INET,
+                           .sin_port = port,
+                           .sin_addr = {.s_addr = ip}};
+    if (addr && addrlen)
+        memcpy(addr, &addr_in, MIN(*addrlen, sizeof(sockaddr_in)));
+    if (addrlen)
+        *addrlen = sizeof(sockaddr_in);
+}
+
+static bool is_nonblock(file_description* desc) {
+    return desc->flags & O_NONBLOCK;
+}
+
+// UDP and ping sockets
+
+void inet_socket_deliver(inet_socket* socket, struct packet* packet) {
+    mutex_lock(&socket->lock);
+    if (socket->rx_bytes + packet->capacity > socket->rcvbuf) {
+        mutex_unlock(&socket->lock);
+        packet_free(packet);
+        return;
+    }
+    packet->next = NULL;
+    if (socket->rx_tail)
+        socket->rx_tail->next = packet;
+    else
+        socket->rx_head = packet;
+    socket->rx_tail = packet;
+    socket->rx_bytes += packet->capacity;
+    inet_socket_notify(socket);
+    mutex_unlock(&socket->lock);
+}
+
+void udp_recv(struct packet* packet) {
+    const struct udp_header* header = (const struct udp_header*)packet->data;
+    if (packet->len < sizeof(struct udp_header))
+        goto drop;
+    size_t len = ntohs(header->len);
+    if (len < sizeof(struct udp_header) || len > packet->len)
+        goto drop;
+    if (!(packet->interface->flags & NET_IF_LOOPBACK) && header->checksum &&
+        net_checksum(packet->data, len,
+                     net_pseudo_header_sum(packet->src_ip, packet->dest_ip,
+                                           IPPROTO_UDP, len)) != 0)
+        goto drop;
+
+    packet->src_port = header->src_port;
+    inet_socket* socket =
+        inet_socket_lookup(IPPROTO_UDP, packet->dest_ip, header->dest_port,
+                           packet->src_ip, header->src_port);
+    if (!socket)
+        goto drop;
+    packet->data += sizeof(struct udp_header);
+    packet->len = len - sizeof(struct udp_header);
+    inet_socket_deliver(socket, packet);
+    inode_unref(&socket->inode);
+    return;
+drop:
+    packet_free(packet);
+}
+
+static bool dgram_should_unblock(inet_socket* socket) {
+    return socket->rx_head;
+}
+
+static ssize_t dgram_recvmsg(inet_socket* socket, msghdr* msg,
+                             bool nonblock) {
+    mutex_lock(&socket->lock);
+    while (!socket->rx_head) {
+        if (nonblock) {
+            mutex_unlock(&socket->lock);
+            return -EAGAIN;
+        }
+        int rc = inet_socket_wait(socket, dgram_should_unblock);
+        if (IS_ERR(rc)) {
+            mutex_unlock(&socket->lock);
+            return rc;
+        }
+    }
+    struct packet* packet = socket->rx_head;
+    socket->rx_head = packet->next;
+    if (!socket->rx_head)
+        socket->rx_tail = NULL;
+    socket->rx_bytes -= packet->capacity;
+    mutex_unlock(&socket->lock);
+
+    msg->msg_flags = 0;
+    size_t nread = 0;
+    for (size_t i = 0; i < msg->msg_iovlen && nread < packet->len; ++i) {
+        size_t n = MIN(msg->msg_iov[i].iov_len, packet->len - nread);
+        memcpy(msg->msg_iov[i].iov_base, packet->data + nread, n);
+        nread += n;
+    }
+    if (nread < packet->len)
+        msg->msg_flags |= MSG_TRUNC;
+    if (msg->msg_name)
+        fill_sockaddr(msg->msg_name, &msg->msg_namelen, packet->src_ip,
+                      packet->src_port);
+    msg->msg_controllen = 0;
+    packet_free(packet);
+    return nread;
+}
+
+static ssize_t dgram_sendmsg(inet_socket* socket, const msghdr* msg) {
+    uint32_t dest_ip;
+    uint16_t dest_port;
+    if (msg->msg_name) {
+        const sockaddr_in* addr_in;
+        int rc = parse_sockaddr(msg->msg_name, msg->msg_namelen, &addr_in);
+        if (IS_ERR(rc))
+            return rc;
+        dest_ip = addr_in->sin_addr.s_addr;
+        dest_port = addr_in->sin_port;
+    } else {
+        if (!socket->connected)
+            return -EDESTADDRREQ;
+        dest_ip = socket->remote_ip;
+        dest_port = socket->remote_port;
+    }
+
+    bool is_udp = socket->protocol == IPPROTO_UDP;
+    size_t header_len = is_udp ? sizeof(struct udp_header) : 0;
+    size_t len = iov_total_len(msg->msg_iov, msg->msg_iovlen);
+    if (!is_udp && len < sizeof(struct icmp_header))
+        return -EINVAL;
+    if (sizeof(struct ip_header) + header_len + len > NET_MTU)
+        return -EMSGSIZE;
+
+    int rc = ensure_bound(socket);
+    if (IS_ERR(rc))
+        return rc;
+    uint32_t src_ip = socket->local_ip;
+    if (src_ip == htonl(INADDR_ANY)) {
+        rc = net_route(dest_ip, &src_ip);
+        if (IS_ERR(rc))
+            return rc;
+    }
+
+    struct packet* packet = packet_alloc(header_len + len);
+    if (!packet)
+        return -ENOBUFS;
+    size_t offset = header_len;
+    for (size_t i = 0; i < msg->msg_iovlen; ++i) {
+        memcpy(packet->data + offset, msg->msg_iov[i].iov_base,
+               msg->msg_iov[i].iov_len);
+        offset += msg->msg_iov[i].iov_len;
+    }
+    packet->len = header_len + len;
+
+    if (is_udp) {
+        struct udp_header* header = (struct udp_header*)packet->data;
+        header->src_port = socket->local_port;
+        header->dest_port = dest_port;
+        header->len = htons(packet->len);
+        header->checksum = 0;
+        header->checksum = net_checksum(
+            packet->data, packet->len,
+            net_pseudo_header_sum(src_ip, dest_ip, IPPROTO_UDP, packet->len));
+        // 0 means that there is no checksum
+        if (header->checksum == 0)
+            header->checksum = 0xffff;
+    } else {
+        // the identifier of the echo request is the port of the socket
+        struct icmp_header* header = (struct icmp_header*)packet->data;
+        if (header->type != ICMP_ECHO_REQUEST || header->code != 0) {
+            packet_free(packet);
+            return -EINVAL;
+        }
+        header->id = socket->local_port;
+        header->checksum = 0;
+        header->checksum = net_checksum(packet->data, packet->len, 0);
+    }
+
+    rc = net_send_packet(src_ip, dest_ip, socket->protocol, packet);
+    if (IS_ERR(rc))
+        return rc;
+    return len;
+}
+
+// file operations
+
+static void inet_socket_destroy_inode(struct inode* inode) {
+    inet_socket* socket = (inet_socket*)inode;
+    if (socket->type == SOCK_STREAM)
+        tcp_destroy_socket(socket);
+    struct packet* it = socket->rx_head;
+    while (it) {
+        struct packet* next = it->next;
+        packet_free(it);
+        it = next;
+    }
+    kfree(socket);
+}
+
+static int inet_socket_close(file_description* desc) {
+    inet_socket* socket = (inet_socket*)desc->inode;
+    if (socket->type == SOCK_STREAM) {
+        // A closed connection stays in the table until it has been shut down
+        // with the peer, and then the timers of TCP remove it.
+        mutex_lock(&socket->lock);
+        tcp_close(socket);
+        bool is_closed = socket->tcp.state == TCP_CLOSED;
+        mutex_unlock(&socket->lock);
+        if (!is_closed)
+            return 0;
+    }
+    inet_socket_unhash(socket);
+    return 0;
+}
+
+ssize_t inet_socket_recvmsg(file_description* desc, msghdr* msg) {
+    inet_socket* socket = (inet_socket*)desc->inode;
+    if (socket->type == SOCK_STREAM)
+        return tcp_recvmsg(socket, msg, is_nonblock(desc));
+    return dgram_recvmsg(socket, msg, is_nonblock(desc));
+}
+
+ssize_t inet_socket_sendmsg(file_description* desc, const msghdr* msg) {
+    inet_socket* socket = (inet_socket*)desc->inode;
+    if (socket->type == SOCK_STREAM) {
+        if (msg->msg_name)
+            return -EISCONN;
+        return tcp_sendmsg(socket, msg, is_nonblock(desc));
+    }
+    return dgram_sendmsg(socket, msg);
+}
+
+static ssize_t inet_socket_read(file_description* desc, void* buffer,
+                                size_t count) {
+    struct iovec iov = {.iov_base = buffer, .iov_len = count};
+    msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1};
+    return inet_socket_recvmsg(desc, &msg);
+}
+
+static ssize_t inet_socket_write(file_description* desc, const void* buffer,
+                                 size_t count) {
+    struct iovec iov = {.iov_base = (void*)buffer, .iov_len = count};
+    msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1};
+    return inet_socket_sendmsg(desc, &msg);
+}
+
+static short inet_socket_poll(file_description* desc, short events) {
+    inet_socket* socket = (inet_socket*)desc->inode;
+    if (socket->type == SOCK_STREAM)
+        return tcp_poll(socket, events);
+    short revents = 0;
+    if ((events & POLLIN) && socket->rx_head)
+        revents |= POLLIN;
+    if (events & POLLOUT)
+        revents |= POLLOUT;
+    return revents;
+}
+
+static file_ops fops = {
+    .destroy_inode = inet_socket_destroy_inode,
+    .close = inet_socket_close,
+    .read = inet_socket_read,
+    .write = inet_socket_write,
+    .poll = inet_socket_poll,
+};
+
+bool inode_is_inet_socket(const struct inode* inode) {
+    return inode->fops == &fops;
+}
+
+inet_socket* inet_socket_create(int type, int protocol) {
+    switch (type) {
+    case SOCK_STREAM:
+        if (protocol != IPPROTO_IP && protocol != IPPROTO_TCP)
+            return ERR_PTR(-EPROTONOSUPPORT);
+        protocol = IPPROTO_TCP;
+        break;
+    case SOCK_DGRAM:
+        if (protocol == IPPROTO_IP)
+            protocol = IPPROTO_UDP;
+        if (protocol != IPPROTO_UDP && protocol != IPPROTO_ICMP)
+            return ERR_PTR(-EPROTONOSUPPORT);
+        break;
+    default:
+        return ERR_PTR(-EPROTONOSUPPORT);
+    }
+
+    inet_socket* socket = kmalloc(sizeof(inet_socket));
+    if (!socket)
+        return ERR_PTR(-ENOMEM);
+    *socket = (inet_socket){0};
+    socket->type = type;
+    socket->protocol = protocol;
+    socket->rcvbuf = DEFAULT_DGRAM_RCVBUF;
+
+    struct inode* inode = &socket->inode;
+    inode->fops = &fops;
+    inode->mode = S_IFSOCK;
+    inode->ref_count = 1;
+
+    if (type == SOCK_STREAM) {
+        int rc = tcp_init_socket(socket);
+        if (IS_ERR(rc)) {
+            kfree(socket);
+            return ERR_PTR(rc);
+        }
+    }
+    return socket;
+}
+
+int inet_socket_bind(inet_socket* socket, const sockaddr* addr,
+                     socklen_t addrlen) {
+    const sockaddr_in* addr_in;
+    int rc = parse_sockaddr(addr, addrlen, &addr_in);
+    if (IS_ERR(rc))
+        return rc;
+    uint32_t ip = addr_in->sin_addr.s_addr;
+    if (ip != htonl(INADDR_ANY) && !net_find_interface(ip))
+        return -EADDRNOTAVAIL;
+
+    mutex_lock(&table_lock);
+    rc = bind_locked(socket, ip, addr_in->sin_port);
+    mutex_unlock(&table_lock);
+    return rc;
+}
+
+int inet_socket_listen(inet_socket* socket, int backlog) {
+    if (socket->type != SOCK_STREAM)
+        return -EOPNOTSUPP;
+    int rc = ensure_bound(socket);
+    if (IS_ERR(rc))
+        return rc;
+    mutex_lock(&socket->lock);
+    rc = tcp_listen(socket, MIN(MAX(backlog, 1), SOMAXCONN));
+    mutex_unlock(&socket->lock);
+    return rc;
+}
+
+inet_socket* inet_socket_accept(file_description* desc, sockaddr* addr,
+                                socklen_t* addrlen) {
+    inet_socket* listener = (inet_socket*)desc->inode;
+    if (listener->type != SOCK_STREAM)
+        return ERR_PTR(-EOPNOTSUPP);
+    inet_socket* socket = tcp_accept(listener, is_nonblock(desc));
+    if (IS_ERR(socket))
+        return socket;
+    fill_sockaddr(addr, addrlen, socket->remote_ip, socket->remote_port);
+    return socket;
+}
+
+int inet_socket_connect(file_description* desc, const sockaddr* addr,
+                        socklen_t addrlen) {
+    inet_socket* socket = (inet_socket*)desc->inode;
+    const sockaddr_in* addr_in;
+    int rc = parse_sockaddr(addr, addrlen, &addr_in);
+    if (IS_ERR(rc))
+        return rc;
+    uint32_t remote_ip = addr_in->sin_addr.s_addr;
+    uint16_t remote_port = addr_in->sin_port;
+    uint32_t src_ip;
+    rc = net_route(remote_ip, &src_ip);
+    if (IS_ERR(rc))
+        return rc;
+    if (socket->type == SOCK_STREAM && remote_port == 0)
+        return -ECONNREFUSED;
+
+    mutex_lock(&table_lock);
+    if (socket->type == SOCK_STREAM &&
+        (socket->connected || socket->tcp.state != TCP_CLOSED)) {
+        mutex_unlock(&table_lock);
+        return socket->tcp.state == TCP_SYN_SENT ? -EALREADY : -EISCONN;
+    }
+    if (!socket->local_port) {
+        rc = bind_locked(socket, htonl(INADDR_ANY), 0);
+        if (IS_ERR(rc)) {
+            mutex_unlock(&table_lock);
+            return rc;
+        }
+    }
+    mutex_lock(&socket->lock);
+    if (socket->local_ip == htonl(INADDR_ANY) && socket->type == SOCK_STREAM)
+        socket->local_ip = src_ip;
+    socket->remote_ip = remote_ip;
+    socket->remote_port = remote_port;
+    socket->connected = true;
+    mutex_unlock(&table_lock);
+
+    // a datagram socket only records its default destination
+    if (socket->type != SOCK_STREAM) {
+        mutex_unlock(&socket->lock);
+        return 0;
+    }
+
+    rc = tcp_connect(socket, is_nonblock(desc));
+    bool failed = socket->tcp.state == TCP_CLOSED;
+    mutex_unlock(&socket->lock);
+    if (!failed)
+        return rc;
+
+    // let the socket be connected again
+    mutex_lock(&table_lock);
+    mutex_lock(&socket->lock);
+    if (socket->tcp.state == TCP_CLOSED)
+        socket->connected = false;
+    mutex_unlock(&socket->lock);
+    mutex_unlock(&table_lock);
+    return rc;
+}
+
+int inet_socket_getsockopt(file_description* desc, int level, int optname,
+                           void* optval, socklen_t* optlen) {
+    inet_socket* socket = (inet_socket*)desc->inode;
+    if (*optlen < sizeof(int))
+        return -EINVAL;
+    int value;
+    mutex_lock(&socket->lock);
+    if (level == SOL_SOCKET && optname == SO_SNDBUF) {
+        value = socket->type == SOCK_STREAM ? socket->tcp.send_buf.capacity
+                                            : NET_MTU;
+    } else if (level == SOL_SOCKET && optname == SO_RCVBUF) {
+        value = socket->type == SOCK_STREAM ? socket->tcp.recv_buf.capacity
+                                            : socket->rcvbuf;
+    } else if (level == IPPROTO_TCP && optname == TCP_NODELAY &&
+               socket->type == SOCK_STREAM) {
+        value = socket->tcp.nodelay;
+    } else {
+        mutex_unlock(&socket->lock);
+        return -ENOPROTOOPT;
+    }
+    mutex_unlock(&socket->lock);
+    *(int*)optval = value;
+    *optlen = sizeof(int);
+    return 0;
+}
+
+int inet_socket_setsockopt(file_description* desc, int level, int optname,
+                           const void* optval, socklen_t optlen) {
+    inet_socket* socket = (inet_socket*)desc->inode;
+    if (optlen < sizeof(int))
+        return -EINVAL;
+    int value = *(const int*)optval;
+
+    if (level == IPPROTO_TCP) {
+        if (optname != TCP_NODELAY || socket->type != SOCK_STREAM)
+            return -ENOPROTOOPT;
+        mutex_lock(&socket->lock);
+        socket->tcp.nodelay = value != 0;
+        mutex_unlock(&socket->lock);
+        return 0;
+    }
+
+    if (level != SOL_SOCKET || (optname != SO_SNDBUF && optname != SO_RCVBUF))
+        return -ENOPROTOOPT;
+    if (value < 0)
+        return -EINVAL;
+    bool send = optname == SO_SNDBUF;
+    int rc = 0;
+    mutex_lock(&socket->lock);
+    if (socket->type == SOCK_STREAM) {
+        rc = tcp_set_buf_size(socket, send, value);
+    } else if (!send) {
+        if ((size_t)value > MAX_DGRAM_RCVBUF)
+            rc = -EINVAL;
+        else
+            socket->rcvbuf = MAX((size_t)value, PAGE_SIZE);
+    }
+    mutex_unlock(&socket->lock);
+    return rc;
+}
@@ -34,64 +34,230 @@
  */
 
 #include "lock.h"
+#include "cpu.h"
 #include "interrupts.h"
 #include "panic.h"
 #include "process.h"
 #include "scheduler.h"
 
-void mutex_lock(mutex* m) {
-    ASSERT(interrupts_enabled());
+void spinlock_lock(spinlock* s) {
+    bool int_flag = push_cli();
+    struct cpu* cpu = cpu_get_current();
+
+    if (s->holder == cpu) {
+        ++s->level;
+        return;
+    }
 
     for (;;) {
         bool expected = false;
-        if (atomic_compare_exchange_strong_explicit(&m->lock, &expected, true, memory_order_acq_rel, memory_order_acquire)) {
-            if (!m->holder || m->holder == current) {
-                m->holder = current;
-                ++m->level;
-                atomic_store_explicit(&m->lock, false, memory_order_release);
-                return;
-            }
-            atomic_store_explicit(&m->lock, false, memory_order_release);
-        }
-        scheduler_yield(true);
+        if (atomic_compare_exchange_weak_explicit(&s->lock, &expected, true, memory_order_acquire, memory_order_relaxed))
+            break;
+
+        // the holder may be waiting for us to flush our TLB
+        smp_handle_pending_tlb_flush();
+        pause();
     }
+
+    s->holder = cpu;
+    s->level = 1;
+    s->int_flag = int_flag;
 }
 
-void mutex_unlock(mutex* m) {
-    for (;;) {
-        bool expected = false;
-        if (atomic_compare_exchange_strong_explicit(&m->lock, &expected, true, memory_order_acq_rel, memory_order_acquire)) {
-            ASSERT(m->holder == current);
-            ASSERT(m->level > 0);
-            if (--m->level == 0)
-                m->holder = NULL;
-            atomic_store_explicit(&m->lock, false, memory_order_release);
+void spinlock_unlock(spinlock* s) {
+    ASSERT(!interrupts_enabled());
+    ASSERT(s->holder == cpu_get_current());
+    ASSERT(s->level > 0);
+
+    if (--s->level > 0)
+        return;
+
+    bool int_flag = s->int_flag;
+    s->holder = NULL;
+    atomic_store_explicit(&s->lock, false, memory_order_release);
+    pop_cli(int_flag);
+}
+
+struct lock_waiter {
+    struct process* process;
+    bool is_writer;
+    atomic_bool granted;
+    struct lock_waiter* next;
+};
+
+static void push_waiter(struct lock_waiter** head, struct lock_waiter** tail,
+                        struct lock_waiter* waiter) {
+    waiter->next = NULL;
+    if (*tail)
+        (*tail)->next = waiter;
+    else
+        *head = waiter;
+    *tail = waiter;
+}
+
+static struct lock_waiter* pop_waiter(struct lock_waiter** head,
+                                      struct lock_waiter** tail) {
+    struct lock_waiter* waiter = *head;
+    if (waiter) {
+        *head = waiter->next;
+        if (!*head)
+            *tail = NULL;
+    }
+    return waiter;
+}
+
+static bool waiter_is_granted(void* data) {
+    struct lock_waiter* waiter = data;
+    return atomic_load_explicit(&waiter->granted, memory_order_acquire);
+}
+
+// Once granted is set, the waiter may return and its stack frame, where the
+// lock_waiter lives, may be gone. So nothing may touch the waiter after this.
+static void grant(struct lock_waiter* waiter) {
+    atomic_store_explicit(&waiter->granted, true, memory_order_release);
+}
+
+// called with the guard locked, and returns with the guard unlocked
+static void wait_for_grant(spinlock* guard, struct lock_waiter* waiter) {
+    spinlock_unlock(guard);
+    scheduler_block_uninterruptible(waiter_is_granted, waiter);
+    ASSERT(waiter_is_granted(waiter));
+}
+
+// How many times a contending process polls the mutex before going to sleep
+// while the holder is running on another CPU. The holder is likely to release
+// the mutex soon in that case, and sleeping would cost two context switches.
+#define MUTEX_SPIN_LIMIT 1000
+
+static bool holder_is_running(const mutex* m) {
+    return m->holder && m->holder->on_cpu && atomic_load(&num_cpus) > 1;
+}
+
+void mutex_lock(mutex* m) {
+    ASSERT(interrupts_enabled());
+
+    for (size_t i = 0;; ++i) {
+        spinlock_lock(&m->guard);
+        if (!m->holder || m->holder == current) {
+            m->holder = current;
+            ++m->level;
+            spinlock_unlock(&m->guard);
             return;
         }
-        scheduler_yield(true);
+        if (i >= MUTEX_SPIN_LIMIT || !holder_is_running(m))
+            break;
+        spinlock_unlock(&m->guard);
+        pause();
     }
+
+    struct lock_waiter waiter = {.process = current};
+    push_waiter(&m->waiters_head, &m->waiters_tail, &waiter);
+    wait_for_grant(&m->guard, &waiter);
+
+    // mutex_unlock() made us the holder
+    ASSERT(m->holder == current);
+    ASSERT(m->level == 1);
+}
+
+static void release_mutex(mutex* m) {
+    ASSERT(m->holder == current);
+    ASSERT(m->level > 0);
+    if (--m->level > 0)
+        return;
+
+    struct lock_waiter* waiter = pop_waiter(&m->waiters_head, &m->waiters_tail);
+    if (waiter) {
+        m->holder = waiter->process;
+        m->level = 1;
+        grant(waiter);
+    } else {
+        m->holder = NULL;
+    }
+}
+
+void mutex_unlock(mutex* m) {
+    spinlock_lock(&m->guard);
+    release_mutex(m);
+    spinlock_unlock(&m->guard);
 }
 
 bool mutex_unlock_if_locked(mutex* m) {
-    for (;;) {
-        bool expected = false;
-        if (atomic_compare_exchange_strong_explicit(&m->lock, &expected, true, memory_order_acq_rel, memory_order_acquire)) {
-            if (m->level == 0) {
-                atomic_store_explicit(&m->lock, false, memory_order_release);
-                return false;
-            }
-            if (m->holder != current) {
-                atomic_store_explicit(&m->lock, false, memory_order_release);
-                return false;
-            }
-            ASSERT(m->level > 0);
-            if (--m->level == 0) {
-                atomic_store_explicit(&m->lock, false, memory_order_release);
-                return false;
-            }
-            m->holder = NULL;
-            atomic_store_explicit(&m->lock, false, memory_order_release);
-            return true;
+    spinlock_lock(&m->guard);
+    bool locked = m->level > 0 && m->holder == current;
+    if (locked)
+        release_mutex(m);
+    spinlock_unlock(&m->guard);
+    return locked;
+}
+
+// admits waiters at the head of the queue as long as they can hold the lock
+// together with the current holders
+static void rwlock_grant_waiters(rwlock* l) {
+    while (l->waiters_head) {
+        struct lock_waiter* waiter = l->waiters_head;
+        bool is_writer = waiter->is_writer;
+        if (is_writer) {
+            if (l->writer || l->num_readers > 0)
+                return;
+            l->writer = waiter->process;
+        } else {
+            if (l->writer)
+                return;
+            ++l->num_readers;
         }
+        pop_waiter(&l->waiters_head, &l->waiters_tail);
+        grant(waiter);
+        if (is_writer)
+            return;
     }
 }
+
+void rwlock_lock_read(rwlock* l) {
+    ASSERT(interrupts_enabled());
+    spinlock_lock(&l->guard);
+    ASSERT(l->writer != current);
+
+    // queued writers go first so that they don't starve
+    if (!l->writer && !l->waiters_head) {
+        ++l->num_readers;
+        spinlock_unlock(&l->guard);
+        return;
+    }
+
+    struct lock_waiter waiter = {.process = current, .is_writer = false};
+    push_waiter(&l->waiters_head, &l->waiters_tail, &waiter);
+    wait_for_grant(&l->guard, &waiter);
+}
+
+void rwlock_unlock_read(rwlock* l) {
+    spinlock_lock(&l->guard);
+    ASSERT(l->num_readers > 0);
+    if (--l->num_readers == 0)
+        rwlock_grant_waiters(l);
+    spinlock_unlock(&l->guard);
+}
+
+void rwlock_lock_write(rwlock* l) {
+    ASSERT(interrupts_enabled());
+    spinlock_lock(&l->guard);
+    ASSERT(l->writer != current);
+
+    if (!l->writer && l->num_readers == 0 && !l->waiters_head) {
+        l->writer = current;
+        spinlock_unlock(&l->guard);
+        return;
+    }
+
+    struct lock_waiter waiter = {.process = current, .is_writer = true};
+    push_waiter(&l->waiters_head, &l->waiters_tail, &waiter);
+    wait_for_grant(&l->guard, &waiter);
+    ASSERT(l->writer == current);
+}
+
+void rwlock_unlock_write(rwlock* l) {
+    spinlock_lock(&l->guard);
+    ASSERT(l->writer == current);
+    l->writer = NULL;
+    rwlock_grant_waiters(l);
+    spinlock_unlock(&l->guard);
+}
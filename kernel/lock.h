@@ -39,12 +39,50 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+// Spinlocks protect data that is touched with interrupts disabled, e.g. from
+// interrupt handlers or the scheduler. Interrupts stay disabled on the holding
+// CPU until the lock is released. A CPU may lock the same spinlock recursively.
+typedef struct spinlock {
+    volatile struct cpu* holder;
+    volatile uint32_t level;
+    volatile bool int_flag;
+    volatile atomic_bool lock;
+} spinlock;
+
+void spinlock_lock(spinlock*);
+void spinlock_unlock(spinlock*);
+
+struct lock_waiter;
+
+// Recursive mutex. Contending processes sleep in FIFO order and the mutex is
+// handed off directly to the first waiter on unlock, so a released mutex can't
+// be stolen by a process that didn't wait for it.
 typedef struct mutex {
     volatile struct process* holder;
     volatile uint32_t level;
-    volatile atomic_bool lock;
+    spinlock guard;
+    struct lock_waiter* waiters_head;
+    struct lock_waiter* waiters_tail;
 } mutex;
 
 void mutex_lock(mutex*);
 void mutex_unlock(mutex*);
+
+// unlocks the mutex if it is held by the current process
 bool mutex_unlock_if_locked(mutex* m);
+
+// Readers-writer lock for read-mostly data. Waiters are served in FIFO order,
+// and consecutive readers at the head of the queue are admitted together.
+// It is not recursive.
+typedef struct rwlock {
+    volatile struct process* writer;
+    volatile uint32_t num_readers;
+    spinlock guard;
+    struct lock_waiter* waiters_head;
+    struct lock_waiter* waiters_tail;
+} rwlock;
+
+void rwlock_lock_read(rwlock*);
+void rwlock_unlock_read(rwlock*);
+void rwlock_lock_write(rwlock*);
+void rwlock_unlock_write(rwlock*);
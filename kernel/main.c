@@ -37,12 +37,14 @@
 #include "api/sys/stat.h"
 #include "boot_defs.h"
 #include "console/console.h"
+#include "cpu.h"
 #include "graphics/graphics.h"
 #include "hid/hid.h"
 #include "interrupts.h"
 #include "kprintf.h"
 #include "memory/memory.h"
 #include "multiboot.h"
+#include "network.h"
 #include "panic.h"
 #include "process.h"
 #include "scheduler.h"
@@ -54,8 +56,6 @@
  *  Call a userland binary called `init`, which can be found in the `bin` directory. 
  */
 static noreturn void init(void) {
-    current->pid = current->pgid = process_generate_next_pid();
-
     const char* init_path = cmdline_lookup("init");
     if (!init_path)
         init_path = "/bin/init";
@@ -96,13 +96,18 @@ void start(uint32_t mb_magic, uintptr_t mb_info_paddr) {
      *  Initialize the GDT (Global Descriptor Table). This is a table that can be defined as a struct in C. This struct's pointer can be given to the CPU so that it
      *  knows the characteristics (and the segments themselves) of each segment in memory.
      */
-    gdt_init();
+    gdt_init(cpus);
 
     /*
      *  Initialize the IDT (Interrupt Descriptor Table). This will be documented later.
      */
     idt_init();
 
+    /*
+     *  Take over the "Device not available" exception, which is how the FPU state of a process gets restored lazily.
+     */
+    fpu_init();
+
     /*
      *  Initialize the IRQ (Interrupt Request) driver. This will be documented later.
      */
@@ -154,6 +159,7 @@ void start(uint32_t mb_magic, uintptr_t mb_info_paddr) {
 
     ASSERT_OK(vfs_mount("/tmp", tmpfs_create_root()));
     ASSERT_OK(vfs_mount("/dev/shm", tmpfs_create_root()));
+    ASSERT_OK(vfs_mount("/dev/mqueue", mqueue_create_root()));
     ASSERT_OK(vfs_mount("/proc", procfs_create_root()));
 
     create_char_device("/dev/null", null_device_create());
@@ -218,6 +224,7 @@ void start(uint32_t mb_magic, uintptr_t mb_info_paddr) {
     syscall_init();
     scheduler_init();
     time_init();
+    vdso_init();
     
     /* 
      *  PIT is i?86-specific, so we make this work only when compiling
@@ -225,12 +232,23 @@ void start(uint32_t mb_magic, uintptr_t mb_info_paddr) {
      */
     #if defined(__i386__)
     pit_init();
+
+    /*
+     *  Bring up the other processors. This needs the PIT running, because the local APIC timers of the other processors are calibrated against it.
+     */
+    smp_init();
     #endif
-    
+
     kprintf(F_GREEN "Initialization done\x1b[m\n");
 
     /* Start a process called `init`, which spawns shells on all TTYs in user mode... */
     ASSERT_OK(process_spawn_kernel_process("userland_init", init));
 
+    /*
+     *  Bring up the network stack with its loopback interface. Its worker process is spawned
+     *  after init so that init keeps pid 1, which orphans are reparented to.
+     */
+    net_init();
+
     process_exit(0);
 }
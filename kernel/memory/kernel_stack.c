@@ -0,0 +1,100 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "memory.h"
+#include <kernel/boot_defs.h>
+#include <kernel/panic.h>
+
+// Each kernel stack occupies STACK_SIZE bytes right above a guard page that is
+// reserved in kernel_vaddr_allocator but never mapped, so that overflowing
+// the stack faults instead of corrupting whatever lies below it.
+#define REGION_SIZE (PAGE_SIZE + STACK_SIZE)
+
+// number of freed stacks kept mapped for reuse
+#define MAX_CACHED_STACKS 64
+
+// Freed stacks are linked through their lowest word and reused in LIFO order,
+// as the most recently freed stack is the most likely to be still in cache.
+struct cached_stack {
+    struct cached_stack* next;
+};
+
+static struct cached_stack* cached_stacks;
+static size_t num_cached_stacks;
+static mutex lock;
+
+void* kernel_stack_alloc(void) {
+    mutex_lock(&lock);
+    struct cached_stack* stack = cached_stacks;
+    if (stack) {
+        cached_stacks = stack->next;
+        --num_cached_stacks;
+    }
+    mutex_unlock(&lock);
+    if (stack)
+        return stack;
+
+    uintptr_t region = range_allocator_alloc(&kernel_vaddr_allocator, REGION_SIZE);
+    if (IS_ERR(region))
+        return NULL;
+    uintptr_t base = region + PAGE_SIZE;
+    if (IS_ERR(paging_map_to_free_pages(base, STACK_SIZE, PAGE_WRITE | PAGE_GLOBAL))) {
+        paging_unmap(base, STACK_SIZE);
+        ASSERT_OK(range_allocator_free(&kernel_vaddr_allocator, region, REGION_SIZE));
+        return NULL;
+    }
+    return (void*)base;
+}
+
+void kernel_stack_free(void* ptr) {
+    if (!ptr)
+        return;
+    uintptr_t base = (uintptr_t)ptr;
+    ASSERT(base % PAGE_SIZE == 0);
+
+    mutex_lock(&lock);
+    if (num_cached_stacks < MAX_CACHED_STACKS) {
+        struct cached_stack* stack = ptr;
+        stack->next = cached_stacks;
+        cached_stacks = stack;
+        ++num_cached_stacks;
+        mutex_unlock(&lock);
+        return;
+    }
+    mutex_unlock(&lock);
+
+    paging_unmap(base, STACK_SIZE);
+    ASSERT_OK(range_allocator_free(&kernel_vaddr_allocator, base - PAGE_SIZE, REGION_SIZE));
+}
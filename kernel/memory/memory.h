@@ -62,6 +62,7 @@ extern range_allocator kernel_vaddr_allocator;
 
 #define PAGE_WRITE 0x2
 #define PAGE_USER 0x4
+#define PAGE_CACHE_DISABLE 0x10
 #define PAGE_PAT 0x80
 #define PAGE_GLOBAL 0x100
 
@@ -69,11 +70,20 @@ extern range_allocator kernel_vaddr_allocator;
 // linked, not copied, when cloning a page directory
 #define PAGE_SHARED 0x200
 
+// and another one to mark kernel pages of tmpfs files that are shared
+// copy-on-write with other files
+#define PAGE_COW 0x400
+
 void paging_init(const multiboot_info_t*);
 
 uintptr_t paging_virtual_to_physical_addr(uintptr_t virtual_addr);
 
+// returns -EFAULT if the address is not mapped to a user page
+uintptr_t paging_user_virtual_to_physical_addr(uintptr_t virtual_addr);
+
 page_directory* paging_current_page_directory(void);
+page_directory* paging_kernel_page_directory(void);
+page_directory* paging_create_boot_page_directory(void);
 page_directory* paging_create_page_directory(void);
 page_directory* paging_clone_current_page_directory(void);
 void paging_destroy_current_page_directory(void);
@@ -84,11 +94,51 @@ NODISCARD int paging_map_to_physical_range(uintptr_t virtual_addr, uintptr_t phy
 NODISCARD int paging_copy_mapping(uintptr_t to_virtual_addr, uintptr_t from_virtual_addr, uintptr_t size, uint16_t flags);
 void paging_unmap(uintptr_t virtual_addr, uintptr_t size);
 
+// Makes the mapped kernel pages at to_virtual_addr share the physical pages
+// at from_virtual_addr copy-on-write. Pages that are also mapped elsewhere,
+// e.g. into userland, are copied instead.
+NODISCARD int paging_share_cow(uintptr_t to_virtual_addr, uintptr_t from_virtual_addr, uintptr_t size);
+
+// gives the page a private copy of its contents if it is shared copy-on-write
+NODISCARD int paging_unshare_page(uintptr_t virtual_addr);
+
+// like paging_unshare_page, but the private page starts out with garbage, for
+// pages that are about to be overwritten
+NODISCARD int paging_unshare_page_discarding(uintptr_t virtual_addr);
+
+// Makes the mapped kernel page at virtual_addr reference the physical page of
+// the user page at user_virtual_addr, marked copy-on-write so that the kernel
+// unshares it before writing to it. Writes from userland are still seen
+// through the kernel page.
+NODISCARD int paging_share_user_page(uintptr_t virtual_addr, uintptr_t user_virtual_addr);
+
 void* kmalloc(size_t size);
 void* kaligned_alloc(size_t alignment, size_t size);
 void* krealloc(void* ptr, size_t new_size);
 void kfree(void* ptr);
 
+// Allocates a kernel stack of STACK_SIZE bytes and returns its lowest
+// address. The page below the stack is left unmapped to catch overflows.
+void* kernel_stack_alloc(void);
+void kernel_stack_free(void*);
+
+// A cache of objects of one size, carved out of slabs of one or more pages.
+// Unlike kmalloc(), which maps pages for every allocation, objects are
+// recycled through a free list, and the slabs are only released when the cache
+// is destroyed.
+typedef struct slab_cache {
+    mutex lock;
+    size_t obj_size;
+    size_t slab_size;
+    struct slab* slabs;
+    struct slab_obj* free_list;
+} slab_cache;
+
+void slab_cache_init(slab_cache*, size_t obj_size);
+void slab_cache_destroy(slab_cache*);
+void* slab_cache_alloc(slab_cache*);
+void slab_cache_free(slab_cache*, void*);
+
 char* kstrdup(const char*);
 char* kstrndup(const char*, size_t n);
 
@@ -101,4 +151,5 @@ void page_allocator_init(const multiboot_info_t* mb_info);
 uintptr_t page_allocator_alloc(void);
 void page_allocator_ref_page(uintptr_t physical_addr);
 void page_allocator_unref_page(uintptr_t physical_addr);
+size_t page_allocator_get_ref_count(uintptr_t physical_addr);
 void page_allocator_get_info(struct physical_memory_info* out_memory_info);
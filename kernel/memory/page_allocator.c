@@ -228,6 +228,15 @@ void page_allocator_unref_page(uintptr_t physical_addr) {
     mutex_unlock(&lock);
 }
 
+size_t page_allocator_get_ref_count(uintptr_t physical_addr) {
+    ASSERT(physical_addr % PAGE_SIZE == 0);
+    size_t idx = physical_addr / PAGE_SIZE;
+    mutex_lock(&lock);
+    size_t ref_count = ref_counts[idx];
+    mutex_unlock(&lock);
+    return ref_count;
+}
+
 void page_allocator_get_info(struct physical_memory_info* out_memory_info) {
     mutex_lock(&lock);
     *out_memory_info = memory_info;
@@ -37,6 +37,7 @@
 #include <common/extra.h>
 #include <common/string.h>
 #include <kernel/boot_defs.h>
+#include <kernel/cpu.h>
 #include <kernel/interrupts.h>
 #include <kernel/kprintf.h>
 #include <kernel/lock.h>
@@ -90,7 +91,8 @@ typedef struct page_table {
     alignas(PAGE_SIZE) page_table_entry entries[1024];
 } page_table;
 
-static page_directory* current_pd;
+// each CPU has its own active page directory
+#define current_pd cpu_current_page_directory()
 
 page_directory* paging_current_page_directory(void) { return current_pd; }
 
@@ -143,6 +145,15 @@ uintptr_t paging_virtual_to_physical_addr(uintptr_t vaddr) {
     return (pte->raw & ~0xfff) | (vaddr & 0xfff);
 }
 
+uintptr_t paging_user_virtual_to_physical_addr(uintptr_t vaddr) {
+    if (vaddr >= KERNEL_VADDR)
+        return -EFAULT;
+    const volatile page_table_entry* pte = get_pte(vaddr);
+    if (!pte || !pte->present || !pte->user)
+        return -EFAULT;
+    return (pte->raw & ~0xfff) | (vaddr & 0xfff);
+}
+
 static int map_page_to_free_page(uintptr_t vaddr, uint32_t flags) {
     volatile page_table_entry* pte = get_or_create_pte(vaddr);
     if (IS_ERR(pte))
@@ -188,7 +199,8 @@ static int copy_page_mapping(uintptr_t to_vaddr, uintptr_t from_vaddr,
     uintptr_t paddr = from_pte->raw & ~0xfff;
     page_allocator_ref_page(paddr);
 
-    to_pte->raw = paddr | flags;
+    // the pages stay copy-on-write when a growable_buf moves them
+    to_pte->raw = paddr | flags | (from_pte->raw & PAGE_COW);
     to_pte->present = true;
     flush_tlb_single(to_vaddr);
 
@@ -354,12 +366,25 @@ void paging_destroy_current_page_directory(void) {
     kfree(pd);
 }
 
+page_directory* paging_kernel_page_directory(void) { return kernel_pd; }
+
+// Application processors enable paging while executing the trampoline in the
+// low memory, so they need the low 4MiB identity-mapped in addition to
+// the kernel mappings.
+page_directory* paging_create_boot_page_directory(void) {
+    page_directory* pd = paging_create_page_directory();
+    if (IS_ERR(pd))
+        return pd;
+    pd->entries[0] = pd->entries[KERNEL_PDE_IDX];
+    return pd;
+}
+
 void paging_switch_page_directory(page_directory* pd) {
     bool int_flag = push_cli();
 
     uintptr_t paddr = paging_virtual_to_physical_addr((uintptr_t)pd);
     write_cr3(paddr);
-    current_pd = pd;
+    cpu_get_current()->pd = pd;
     if (current)
         current->pd = pd;
     ASSERT(paddr == paging_virtual_to_physical_addr(0xfffff000));
@@ -370,7 +395,7 @@ void paging_switch_page_directory(page_directory* pd) {
 range_allocator kernel_vaddr_allocator;
 
 void paging_init(const multiboot_info_t* mb_info) {
-    current_pd = kernel_pd;
+    cpu_get_current()->pd = kernel_pd;
     kprintf("Kernel page directory: P0x%x\n", (uintptr_t)kernel_page_directory);
 
     page_allocator_init(mb_info);
@@ -427,12 +452,135 @@ int paging_copy_mapping(uintptr_t to_vaddr, uintptr_t from_vaddr,
     return 0;
 }
 
+// Sharing stops before the reference count gets close to saturating, as a
+// saturated page is never freed.
+#define MAX_COW_REF_COUNT (UINT8_MAX / 2)
+
+// A page can be shared copy-on-write if no other mapping would see the
+// writes to it, i.e. if it is not mapped anywhere else or is already shared
+// copy-on-write.
+static bool can_share(const volatile page_table_entry* pte) {
+    size_t ref_count = page_allocator_get_ref_count(pte->raw & ~0xfff);
+    if (pte->raw & PAGE_COW)
+        return ref_count < MAX_COW_REF_COUNT;
+    return ref_count == 1;
+}
+
+int paging_share_cow(uintptr_t to_vaddr, uintptr_t from_vaddr,
+                     uintptr_t size) {
+    ASSERT((to_vaddr % PAGE_SIZE) == 0);
+    ASSERT((from_vaddr % PAGE_SIZE) == 0);
+    size = round_up(size, PAGE_SIZE);
+
+    bool remapped = false;
+    int rc = 0;
+    for (uintptr_t offset = 0; offset < size; offset += PAGE_SIZE) {
+        volatile page_table_entry* from_pte = get_pte(from_vaddr + offset);
+        volatile page_table_entry* to_pte = get_pte(to_vaddr + offset);
+        ASSERT(from_pte && from_pte->present);
+        ASSERT(to_pte && to_pte->present);
+
+        uintptr_t paddr = from_pte->raw & ~0xfff;
+        uintptr_t old_paddr = to_pte->raw & ~0xfff;
+        if (paddr == old_paddr)
+            continue;
+
+        if (!can_share(from_pte) || !can_share(to_pte)) {
+            rc = paging_unshare_page(to_vaddr + offset);
+            if (IS_ERR(rc))
+                break;
+            memcpy((void*)(to_vaddr + offset), (void*)(from_vaddr + offset),
+                   PAGE_SIZE);
+            continue;
+        }
+
+        page_allocator_ref_page(paddr);
+        from_pte->raw |= PAGE_COW;
+        to_pte->raw = paddr | (to_pte->raw & 0xfff) | PAGE_COW;
+        flush_tlb_single(to_vaddr + offset);
+        page_allocator_unref_page(old_paddr);
+        remapped = true;
+    }
+
+    if (remapped)
+        smp_flush_tlb_others();
+    return rc;
+}
+
+int paging_share_user_page(uintptr_t vaddr, uintptr_t user_vaddr) {
+    ASSERT((vaddr % PAGE_SIZE) == 0);
+    ASSERT((user_vaddr % PAGE_SIZE) == 0);
+    uintptr_t paddr = paging_user_virtual_to_physical_addr(user_vaddr);
+    if (IS_ERR(paddr))
+        return paddr;
+    if (page_allocator_get_ref_count(paddr) >= MAX_COW_REF_COUNT)
+        return -EBUSY;
+
+    volatile page_table_entry* pte = get_pte(vaddr);
+    ASSERT(pte && pte->present);
+    uintptr_t old_paddr = pte->raw & ~0xfff;
+
+    page_allocator_ref_page(paddr);
+    pte->raw = paddr | (pte->raw & 0xfff) | PAGE_COW;
+    flush_tlb_single(vaddr);
+    smp_flush_tlb_others();
+    page_allocator_unref_page(old_paddr);
+    return 0;
+}
+
+static int unshare_page(uintptr_t vaddr, bool keep_contents) {
+    vaddr = round_down(vaddr, PAGE_SIZE);
+    volatile page_table_entry* pte = get_pte(vaddr);
+    ASSERT(pte && pte->present);
+    if (!(pte->raw & PAGE_COW))
+        return 0;
+
+    uintptr_t paddr = pte->raw & ~0xfff;
+    uint32_t flags = pte->raw & 0xfff & ~PAGE_COW;
+
+    // the other sharers have already made their own copies
+    if (page_allocator_get_ref_count(paddr) == 1) {
+        pte->raw = paddr | flags;
+        return 0;
+    }
+
+    uintptr_t new_paddr = page_allocator_alloc();
+    if (IS_ERR(new_paddr))
+        return new_paddr;
+
+    if (keep_contents) {
+        mutex_lock(&quickmap_lock);
+        uintptr_t new_page = quickmap(QUICKMAP_PAGE, new_paddr, PAGE_WRITE);
+        memcpy((void*)new_page, (void*)vaddr, PAGE_SIZE);
+        unquickmap(QUICKMAP_PAGE);
+        mutex_unlock(&quickmap_lock);
+    }
+
+    pte->raw = new_paddr | flags;
+    flush_tlb_single(vaddr);
+    smp_flush_tlb_others();
+    page_allocator_unref_page(paddr);
+    return 0;
+}
+
+int paging_unshare_page(uintptr_t vaddr) { return unshare_page(vaddr, true); }
+
+int paging_unshare_page_discarding(uintptr_t vaddr) {
+    return unshare_page(vaddr, false);
+}
+
 void paging_unmap(uintptr_t vaddr, uintptr_t size) {
     ASSERT((vaddr % PAGE_SIZE) == 0);
     size = round_up(size, PAGE_SIZE);
 
     for (uintptr_t offset = 0; offset < size; offset += PAGE_SIZE)
         unmap_page(vaddr + offset);
+
+    // kernel page tables are shared among all the CPUs, and user page tables
+    // are shared among threads that may be running on other CPUs
+    if (vaddr >= KERNEL_VADDR || (current && current->vm &&
+                                  current->vm->ref_count > 1))
+        smp_flush_tlb_others();
 }
 
 #endif
\ No newline at end of file
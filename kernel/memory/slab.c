@@ -0,0 +1,124 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "memory.h"
+#include <common/extra.h>
+#include <kernel/boot_defs.h>
+#include <kernel/panic.h>
+#include <stdalign.h>
+
+// at the start of each slab, followed by the objects
+struct slab {
+    struct slab* next;
+};
+
+// free objects are linked through their first word
+struct slab_obj {
+    struct slab_obj* next;
+};
+
+#define OBJS_OFFSET round_up(sizeof(struct slab), alignof(max_align_t))
+
+void slab_cache_init(slab_cache* cache, size_t obj_size) {
+    *cache = (slab_cache){0};
+    cache->obj_size = round_up(MAX(obj_size, sizeof(struct slab_obj)),
+                               alignof(max_align_t));
+    // a slab holds at least one object
+    cache->slab_size = round_up(OBJS_OFFSET + cache->obj_size, PAGE_SIZE);
+}
+
+void slab_cache_destroy(slab_cache* cache) {
+    struct slab* slab = cache->slabs;
+    while (slab) {
+        struct slab* next = slab->next;
+        paging_unmap((uintptr_t)slab, cache->slab_size);
+        ASSERT_OK(range_allocator_free(&kernel_vaddr_allocator,
+                                       (uintptr_t)slab, cache->slab_size));
+        slab = next;
+    }
+    cache->slabs = NULL;
+    cache->free_list = NULL;
+}
+
+// called with the lock of cache held
+static int grow_cache(slab_cache* cache) {
+    uintptr_t addr =
+        range_allocator_alloc(&kernel_vaddr_allocator, cache->slab_size);
+    if (IS_ERR(addr))
+        return addr;
+    int rc = paging_map_to_free_pages(addr, cache->slab_size,
+                                      PAGE_WRITE | PAGE_GLOBAL);
+    if (IS_ERR(rc)) {
+        paging_unmap(addr, cache->slab_size);
+        ASSERT_OK(range_allocator_free(&kernel_vaddr_allocator, addr,
+                                       cache->slab_size));
+        return rc;
+    }
+
+    struct slab* slab = (struct slab*)addr;
+    slab->next = cache->slabs;
+    cache->slabs = slab;
+
+    for (uintptr_t obj = addr + OBJS_OFFSET;
+         obj + cache->obj_size <= addr + cache->slab_size;
+         obj += cache->obj_size) {
+        struct slab_obj* free_obj = (struct slab_obj*)obj;
+        free_obj->next = cache->free_list;
+        cache->free_list = free_obj;
+    }
+    return 0;
+}
+
+void* slab_cache_alloc(slab_cache* cache) {
+    mutex_lock(&cache->lock);
+    if (!cache->free_list && IS_ERR(grow_cache(cache))) {
+        mutex_unlock(&cache->lock);
+        return NULL;
+    }
+    struct slab_obj* obj = cache->free_list;
+    cache->free_list = obj->next;
+    mutex_unlock(&cache->lock);
+    return obj;
+}
+
+void slab_cache_free(slab_cache* cache, void* ptr) {
+    if (!ptr)
+        return;
+    struct slab_obj* obj = ptr;
+    mutex_lock(&cache->lock);
+    obj->next = cache->free_list;
+    cache->free_list = obj;
+    mutex_unlock(&cache->lock);
+}
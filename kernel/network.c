@@ -34,20 +34,290 @@
  */
 
 #include "network.h"
+#include "memory/memory.h"
 #include "nic.h"
+#include "panic.h"
+#include "process.h"
+#include "scheduler.h"
+#include "socket.h"
+#include "system.h"
+#include <common/string.h>
+
+#define IP_DONT_FRAGMENT 0x4000
+#define IP_MORE_FRAGMENTS 0x2000
+#define IP_FRAGMENT_OFFSET 0x1fff
+#define IP_TTL 64
+
+// Small packets, e.g. ACKs and short datagrams, come from their own cache so
+// that they don't take up a buffer for a whole NET_MTU. Two of them fit in a
+// page.
+#define SMALL_PACKET_SIZE ETHERNET_MTU
+
+static slab_cache small_packets;
+static slab_cache large_packets;
+
+struct packet* packet_alloc(size_t len) {
+    size_t size = sizeof(struct ip_header) + len;
+    if (size > NET_MTU)
+        return NULL;
+    bool small = size <= SMALL_PACKET_SIZE;
+    struct packet* packet =
+        slab_cache_alloc(small ? &small_packets : &large_packets);
+    if (!packet)
+        return NULL;
+    *packet = (struct packet){0};
+    packet->capacity = small ? SMALL_PACKET_SIZE : NET_MTU;
+    packet->data = packet->buf + sizeof(struct ip_header);
+    return packet;
+}
+
+void packet_free(struct packet* packet) {
+    if (!packet)
+        return;
+    slab_cache_free(packet->capacity == SMALL_PACKET_SIZE ? &small_packets
+                                                          : &large_packets,
+                    packet);
+}
+
+// Adding up the 16-bit words in the byte order of the CPU gives the same sum
+// with its bytes swapped, so the result can be stored into a header as is.
+uint16_t net_checksum(const void* data, size_t len, uint32_t sum) {
+    const uint16_t* words = data;
+    for (; len > 1; len -= 2)
+        sum += *words++;
+    if (len)
+        sum += *(const uint8_t*)words;
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return ~sum;
+}
+
+uint32_t net_pseudo_header_sum(uint32_t src_ip, uint32_t dest_ip,
+                               uint8_t protocol, size_t len) {
+    return (src_ip & 0xffff) + (src_ip >> 16) + (dest_ip & 0xffff) +
+           (dest_ip >> 16) + htons(protocol) + htons(len);
+}
+
+int net_route(uint32_t dest_ip, uint32_t* out_src_ip) {
+    struct net_interface* interface = net_find_interface(dest_ip);
+    if (!interface)
+        return -ENETUNREACH;
+    *out_src_ip = interface->ip;
+    return 0;
+}
+
+int net_send_packet(uint32_t src_ip, uint32_t dest_ip, uint8_t protocol,
+                    struct packet* packet) {
+    struct net_interface* interface = net_find_interface(dest_ip);
+    if (!interface) {
+        packet_free(packet);
+        return -ENETUNREACH;
+    }
+
+    static atomic_uint next_id;
+    packet->data -= sizeof(struct ip_header);
+    packet->len += sizeof(struct ip_header);
+    ASSERT(packet->data >= packet->buf);
+    if (packet->len > interface->mtu) {
+        packet_free(packet);
+        return -EMSGSIZE;
+    }
+
+    struct ip_header* header = (struct ip_header*)packet->data;
+    *header = (struct ip_header){.version_ihl = 0x45,
+                                 .total_len = htons(packet->len),
+                                 .id = htons(next_id++),
+                                 .flags = htons(IP_DONT_FRAGMENT),
+                                 .ttl = IP_TTL,
+                                 .protocol = protocol,
+                                 .src_ip = src_ip,
+                                 .dest_ip = dest_ip};
+    header->checksum = net_checksum(header, sizeof(struct ip_header), 0);
+    return interface->transmit(interface, packet);
+}
+
+static bool is_local_address(const struct net_interface* interface,
+                             uint32_t ip) {
+    // the whole 127.0.0.0/8 reaches the loopback interface
+    return ip == interface->ip ||
+           ((interface->flags & NET_IF_LOOPBACK) &&
+            (ip & interface->netmask) == (interface->ip & interface->netmask));
+}
+
+static void icmp_send_echo_reply(struct packet* packet) {
+    struct icmp_header* header = (struct icmp_header*)packet->data;
+    header->type = ICMP_ECHO_REPLY;
+    header->checksum = 0;
+    header->checksum = net_checksum(packet->data, packet->len, 0);
+    net_send_packet(packet->dest_ip, packet->src_ip, IPPROTO_ICMP, packet);
+}
+
+void icmp_recv(struct packet* packet) {
+    if (packet->len < sizeof(struct icmp_header) ||
+        (!(packet->interface->flags & NET_IF_LOOPBACK) &&
+         net_checksum(packet->data, packet->len, 0) != 0)) {
+        packet_free(packet);
+        return;
+    }
+
+    const struct icmp_header* header = (const struct icmp_header*)packet->data;
+    switch (header->type) {
+    case ICMP_ECHO_REQUEST:
+        icmp_send_echo_reply(packet);
+        return;
+    case ICMP_ECHO_REPLY: {
+        // for the ping socket whose port is the identifier of the echo
+        inet_socket* socket = inet_socket_lookup(
+            IPPROTO_ICMP, packet->dest_ip, header->id, packet->src_ip, 0);
+        if (socket) {
+            inet_socket_deliver(socket, packet);
+            inode_unref(&socket->inode);
+            return;
+        }
+        break;
+    }
+    }
+    packet_free(packet);
+}
+
+static void ip_recv(struct packet* packet) {
+    const struct ip_header* header = (const struct ip_header*)packet->data;
+    if (packet->len < sizeof(struct ip_header))
+        goto drop;
+    size_t header_len = (header->version_ihl & 0xf) * 4;
+    size_t total_len = ntohs(header->total_len);
+    if ((header->version_ihl >> 4) != 4 ||
+        header_len < sizeof(struct ip_header) || total_len < header_len ||
+        total_len > packet->len)
+        goto drop;
+    if (!(packet->interface->flags & NET_IF_LOOPBACK) &&
+        net_checksum(header, header_len, 0) != 0)
+        goto drop;
+
+    // fragments aren't reassembled, and nothing is sent in fragments
+    if (ntohs(header->flags) & (IP_MORE_FRAGMENTS | IP_FRAGMENT_OFFSET))
+        goto drop;
+    if (!is_local_address(packet->interface, header->dest_ip))
+        goto drop;
+
+    packet->src_ip = header->src_ip;
+    packet->dest_ip = header->dest_ip;
+    uint8_t protocol = header->protocol;
+    packet->data += header_len;
+    packet->len = total_len - header_len;
+
+    switch (protocol) {
+    case IPPROTO_ICMP:
+        icmp_recv(packet);
+        return;
+    case IPPROTO_UDP:
+        udp_recv(packet);
+        return;
+    case IPPROTO_TCP:
+        tcp_recv(packet);
+        return;
+    }
+drop:
+    packet_free(packet);
+}
+
+// Received packets and the TCP timers are handled by a kernel process, so that
+// the protocols run in process context and can take mutexes, and so that the
+// sender of a packet over loopback doesn't end up handling it recursively.
+static struct process* worker;
+static spinlock rx_queue_lock;
+static struct packet* rx_queue_head;
+static struct packet* rx_queue_tail;
+
+// Senders over loopback can queue packets faster than the worker handles
+// them, so the queue is capped like the queue of a real NIC.
+#define RX_QUEUE_MAX 256
+static size_t rx_queue_len;
+static atomic_uint timer_deadline;
+
+static bool has_expired(uint32_t deadline) {
+    return deadline && (int32_t)(uptime - deadline) >= 0;
+}
+
+int net_recv_packet(struct net_interface* interface, struct packet* packet) {
+    packet->interface = interface;
+    packet->next = NULL;
+    spinlock_lock(&rx_queue_lock);
+    if (rx_queue_len >= RX_QUEUE_MAX) {
+        spinlock_unlock(&rx_queue_lock);
+        packet_free(packet);
+        return -ENOBUFS;
+    }
+    if (rx_queue_tail)
+        rx_queue_tail->next = packet;
+    else
+        rx_queue_head = packet;
+    rx_queue_tail = packet;
+    ++rx_queue_len;
+    spinlock_unlock(&rx_queue_lock);
+    scheduler_wake(worker);
+    return 0;
+}
+
+void net_arm_timer(uint32_t deadline) {
+    // 0 means that no timer is armed
+    if (deadline == 0)
+        deadline = 1;
+    unsigned armed = timer_deadline;
+    while (armed == 0 || (int32_t)(deadline - armed) < 0) {
+        if (atomic_compare_exchange_weak(&timer_deadline, &armed, deadline))
+            break;
+    }
+    scheduler_wake(worker);
+}
+
+static bool worker_should_unblock(void* data) {
+    (void)data;
+    return rx_queue_head || has_expired(timer_deadline);
+}
+
+static noreturn void worker_loop(void) {
+    for (;;) {
+        scheduler_block_uninterruptible(worker_should_unblock, NULL);
+
+        for (;;) {
+            spinlock_lock(&rx_queue_lock);
+            struct packet* packet = rx_queue_head;
+            if (packet) {
+                rx_queue_head = packet->next;
+                if (!rx_queue_head)
+                    rx_queue_tail = NULL;
+                --rx_queue_len;
+            }
+            spinlock_unlock(&rx_queue_lock);
+            if (!packet)
+                break;
+            ip_recv(packet);
+        }
+
+        if (has_expired(timer_deadline)) {
+            // Timers armed from now on call net_arm_timer() again, and the
+            // ones armed before are found by tcp_run_timers().
+            timer_deadline = 0;
+            uint32_t next = tcp_run_timers();
+            if (next)
+                net_arm_timer(next);
+        }
+    }
+}
 
 /* Initialize the network stack... */
-void net_init() {
+void net_init(void) {
+    slab_cache_init(&small_packets,
+                    sizeof(struct packet) + SMALL_PACKET_SIZE);
+    slab_cache_init(&large_packets, sizeof(struct packet) + NET_MTU);
+
     /* Initialize drivers here! */
+    loopback_init();
     eth_driver_init();
-}
 
-/* Send a packet to an IP address... */
-void net_send_packet(unsigned int dest_ip, unsigned char protocol, unsigned char *data, int len) {
-    /* Ask the driver to send a packet... */
+    worker = process_create_kernel_process("net", worker_loop);
+    ASSERT_OK(worker);
+    worker->pid = worker->tgid = worker->pgid = process_generate_next_pid();
+    scheduler_register(worker);
 }
-
-/* Recieve a packet... */
-void net_recv_packet(unsigned char *packet, int len) {
-    /* Handle the recieved packet... */
-}
\ No newline at end of file
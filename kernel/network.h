@@ -40,36 +40,116 @@
  *  networking between different computers, not UNIX sockets...
  */
 
-/* IP protocol number for TCP! */
-#define IP_PROTOCOL_TCP 6
+#include "api/netinet/in.h"
+#include <common/extra.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
-/* This structure defines the IP header format... */
+struct net_interface;
+
+/* This structure defines the IP header format. Multi-byte fields are in network byte order... */
 struct ip_header {
-    unsigned char version;
-    unsigned char ihl;
-    unsigned short total_len;
-    unsigned short id;
-    unsigned short flags;
-    unsigned char ttl;
-    unsigned char protocol;
-    unsigned short checksum;
-    unsigned int src_ip;
-    unsigned int dest_ip;
-};
+    uint8_t version_ihl;
+    uint8_t tos;
+    uint16_t total_len;
+    uint16_t id;
+    uint16_t flags;
+    uint8_t ttl;
+    uint8_t protocol;
+    uint16_t checksum;
+    uint32_t src_ip;
+    uint32_t dest_ip;
+} __attribute__((packed));
+
+#define ICMP_ECHO_REPLY 0
+#define ICMP_ECHO_REQUEST 8
+
+struct icmp_header {
+    uint8_t type;
+    uint8_t code;
+    uint16_t checksum;
+    uint16_t id;
+    uint16_t seq;
+} __attribute__((packed));
 
-/* This structure defines the TCP header format... */
+struct udp_header {
+    uint16_t src_port;
+    uint16_t dest_port;
+    uint16_t len;
+    uint16_t checksum;
+} __attribute__((packed));
+
+#define TCP_FIN 0x01
+#define TCP_SYN 0x02
+#define TCP_RST 0x04
+#define TCP_PSH 0x08
+#define TCP_ACK 0x10
+
+/* This structure defines the TCP header format. data_offset holds the header length in 32-bit words in its upper nibble... */
 struct tcp_header {
-    unsigned short src_port;
-    unsigned short dest_port;
-    unsigned int seq_num;
-    unsigned int ack_num;
-    unsigned char data_offset;
-    unsigned char flags;
-    unsigned short window_size;
-    unsigned short checksum;
-    unsigned short urgent_pointer;
+    uint16_t src_port;
+    uint16_t dest_port;
+    uint32_t seq_num;
+    uint32_t ack_num;
+    uint8_t data_offset;
+    uint8_t flags;
+    uint16_t window_size;
+    uint16_t checksum;
+    uint16_t urgent_pointer;
+} __attribute__((packed));
+
+/* The largest IP packet, headers included, that the stack sends or receives... */
+#define NET_MTU 16384
+
+// A packet on its way through the stack. data points at the header of the
+// layer handling it, and there is always room in front of it for the IP
+// header, so that transports can build their segments in place.
+struct packet {
+    struct packet* next;
+    struct net_interface* interface; // that received the packet
+    uint32_t src_ip;
+    uint32_t dest_ip;
+    uint16_t src_port;
+    unsigned char* data;
+    size_t len;
+    size_t capacity;
+    unsigned char buf[];
 };
 
-void net_init();
-void net_send_packet(unsigned int dest_ip, unsigned char protocol, unsigned char *data, int len);
-void net_recv_packet(unsigned char *packet, int len);
\ No newline at end of file
+// Returns a packet with room for len bytes after the IP header, or NULL.
+// Packets come from slab caches, so this doesn't map pages in the common case.
+struct packet* packet_alloc(size_t len);
+void packet_free(struct packet*);
+
+// the ones' complement sum used by IP, ICMP, UDP and TCP, folded to 16 bits
+uint16_t net_checksum(const void* data, size_t len, uint32_t sum);
+// the sum of the pseudo header that UDP and TCP checksums start from
+uint32_t net_pseudo_header_sum(uint32_t src_ip, uint32_t dest_ip,
+                               uint8_t protocol, size_t len);
+
+/* Initialize the network stack... */
+void net_init(void);
+
+// Returns the address that packets to dest_ip are sent from, or
+// -ENETUNREACH.
+NODISCARD int net_route(uint32_t dest_ip, uint32_t* out_src_ip);
+
+/* Send a packet to an IP address. packet->data holds the transport segment, and the IP header is prepended to it. Takes ownership of the packet... */
+int net_send_packet(uint32_t src_ip, uint32_t dest_ip, uint8_t protocol,
+                    struct packet*);
+
+/* Called by an interface that received a packet. The packet is handled later by the network worker. May be called from an interrupt handler... */
+/* Drops the packet and returns -ENOBUFS if the worker is too far behind. */
+int net_recv_packet(struct net_interface*, struct packet*);
+
+// Registers the deadline (in ticks of uptime) by which the worker should
+// call tcp_run_timers().
+void net_arm_timer(uint32_t deadline);
+
+// handlers of the worker for the transports
+void icmp_recv(struct packet*);
+void udp_recv(struct packet*);
+void tcp_recv(struct packet*);
+// returns the next deadline, or 0 if no timers are armed
+uint32_t tcp_run_timers(void);
@@ -34,22 +34,62 @@
  */
 
 #include "nic.h"
+#include "network.h"
 
 /*
  *  The files `nic.c` & `nic.h` represent the NIC (Network Interface Driver), while the files `network.c` & `network.h` represent the
  *  network protocol stack...
  */
 
+// Interfaces are only registered while the kernel initializes, so the list is
+// read without a lock.
+static struct net_interface* interfaces;
+
+void net_register_interface(struct net_interface* interface) {
+    interface->next = interfaces;
+    interfaces = interface;
+}
+
+struct net_interface* net_find_interface(uint32_t ip) {
+    for (struct net_interface* it = interfaces; it; it = it->next) {
+        if ((ip & it->netmask) == (it->ip & it->netmask))
+            return it;
+    }
+    return NULL;
+}
+
+static int loopback_transmit(struct net_interface* interface,
+                             struct packet* packet) {
+    return net_recv_packet(interface, packet);
+}
+
+static struct net_interface loopback = {
+    .name = "lo",
+    .mtu = NET_MTU,
+    .flags = NET_IF_LOOPBACK,
+    .transmit = loopback_transmit,
+};
+
+void loopback_init(void) {
+    loopback.ip = htonl(INADDR_LOOPBACK);
+    loopback.netmask = htonl(0xff000000);
+    net_register_interface(&loopback);
+}
+
 /* Use this function to initiailize the corresponding ethernet driver... */
 void eth_driver_init() {
     
 }
 
 /* Send a packet through ethernet... */
-void eth_send_packet(unsigned char *packet, int len) { }
+void eth_send_packet(unsigned char *packet, int len) { (void)packet; (void)len; }
 
 /* Recieve a packet through ethernet... */
-int eth_recv_packet(unsigned char *packet, int maxlen) { /* Return -1 if an error happens... */ }
+int eth_recv_packet(unsigned char *packet, int maxlen) {
+    (void)packet;
+    (void)maxlen;
+    return -1; /* Return -1 if an error happens... */
+}
 
 /* A loop for the ethernet driver to use... */
-void eth_driver_loop() { /* call eth_recv_packet() when a packet is received */ }
\ No newline at end of file
+void eth_driver_loop() { /* call eth_recv_packet() when a packet is received */ }
@@ -35,6 +35,11 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
+struct packet;
+
 #define ETHERNET_MTU 1500
 
 struct ethernet_header {
@@ -43,7 +48,31 @@ struct ethernet_header {
     unsigned short ethertype;
 };
 
+#define NET_IF_LOOPBACK 0x1
+
+/* A network interface. Addresses are in network byte order... */
+struct net_interface {
+    const char* name;
+    uint32_t ip;
+    uint32_t netmask;
+    size_t mtu;
+    unsigned flags;
+
+    // Sends an IP packet, taking ownership of it. Returns 0 or a negative
+    // errno, in which case the packet has been freed.
+    int (*transmit)(struct net_interface*, struct packet*);
+
+    struct net_interface* next;
+};
+
+void net_register_interface(struct net_interface*);
+// the interface whose subnet contains ip, or NULL
+struct net_interface* net_find_interface(uint32_t ip);
+
+/* The loopback interface `lo`, which has 127.0.0.1/8 and hands every packet it sends back to the stack... */
+void loopback_init(void);
+
 void eth_driver_init();
 void eth_send_packet(unsigned char *packet, int len);
 int eth_recv_packet(unsigned char *packet, int maxlen);
-void eth_driver_loop();
\ No newline at end of file
+void eth_driver_loop();
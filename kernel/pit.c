@@ -56,6 +56,7 @@ static void pit_handler(registers* regs) {
 
     ++uptime;
     time_tick();
+    timerfd_tick();
 
     bool in_kernel = (regs->cs & 3) == 0;
     scheduler_tick(in_kernel);
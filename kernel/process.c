@@ -41,14 +41,15 @@
 #include "memory/memory.h"
 #include "panic.h"
 #include "scheduler.h"
+#include "syscall/syscall.h"
 #include <common/string.h>
 #include <stdatomic.h>
 
-struct process* current;
 struct fpu_state initial_fpu_state;
 static atomic_int next_pid = 1;
 
 struct process* all_processes;
+spinlock all_processes_lock;
 
 extern unsigned char kernel_page_directory[];
 extern unsigned char stack_top[];
@@ -57,24 +58,31 @@ void process_init(void) {
     __asm__ volatile("fninit");
     __asm__ volatile("fxsave %0" : "=m"(initial_fpu_state));
 
-    current = kaligned_alloc(alignof(struct process), sizeof(struct process));
-    ASSERT(current);
-    *current = (struct process){0};
+    struct process* process =
+        kaligned_alloc(alignof(struct process), sizeof(struct process));
+    ASSERT(process);
+    *process = (struct process){0};
 
-    current->fpu_state = initial_fpu_state;
-    current->state = PROCESS_STATE_RUNNING;
-    strlcpy(current->comm, "kernel_init", sizeof(current->comm));
-    current->pd =
+    process->fpu_state = initial_fpu_state;
+    process->state = PROCESS_STATE_RUNNING;
+    strlcpy(process->comm, "kernel_init", sizeof(process->comm));
+    process->pd =
         (page_directory*)((uintptr_t)kernel_page_directory + KERNEL_VADDR);
-    current->stack_top = (uintptr_t)stack_top;
+    process->stack_top = (uintptr_t)stack_top;
 
-    current->cwd_path = kstrdup(ROOT_DIR);
-    ASSERT(current->cwd_path);
-    current->cwd_inode = vfs_get_root();
+    process->vm = process_create_vm(process->pd);
+    ASSERT_OK(process->vm);
+    process->cwd = process_create_cwd(ROOT_DIR, vfs_get_root());
+    ASSERT_OK(process->cwd);
+    process->fd_table = process_create_fd_table();
+    ASSERT_OK(process->fd_table);
 
-    ASSERT_OK(file_descriptor_table_init(&current->fd_table));
+    struct cpu* cpu = cpu_get_current();
+    process->cpu = cpu;
+    process->on_cpu = true;
+    cpu->current_process = process;
 
-    gdt_set_kernel_stack(current->stack_top);
+    gdt_set_kernel_stack(process->stack_top);
 }
 
 struct process* process_create_kernel_process(const char* comm,
@@ -93,17 +101,19 @@ struct process* process_create_kernel_process(const char* comm,
     process->pd = paging_create_page_directory();
     if (IS_ERR(process->pd))
         return ERR_CAST(process->pd);
+    process->vm = process_create_vm(process->pd);
+    if (IS_ERR(process->vm))
+        return ERR_CAST(process->vm);
 
-    process->cwd_path = kstrdup(ROOT_DIR);
-    if (!process->cwd_path)
-        return ERR_PTR(-ENOMEM);
-    process->cwd_inode = vfs_get_root();
+    process->cwd = process_create_cwd(ROOT_DIR, vfs_get_root());
+    if (IS_ERR(process->cwd))
+        return ERR_CAST(process->cwd);
 
-    int rc = file_descriptor_table_init(&process->fd_table);
-    if (IS_ERR(rc))
-        return ERR_PTR(rc);
+    process->fd_table = process_create_fd_table();
+    if (IS_ERR(process->fd_table))
+        return ERR_CAST(process->fd_table);
 
-    void* stack = kmalloc(STACK_SIZE);
+    void* stack = kernel_stack_alloc();
     if (!stack)
         return ERR_PTR(-ENOMEM);
     process->stack_top = (uintptr_t)stack + STACK_SIZE;
@@ -117,32 +127,253 @@ pid_t process_spawn_kernel_process(const char* comm,
     struct process* process = process_create_kernel_process(comm, entry_point);
     if (IS_ERR(process))
         return PTR_ERR(process);
+    process->pid = process->tgid = process->pgid = process_generate_next_pid();
     scheduler_register(process);
     return process->pid;
 }
 
-pid_t process_generate_next_pid(void) { return atomic_fetch_add(&next_pid, 1); }
+struct vm* process_create_vm(page_directory* pd) {
+    struct vm* vm = kmalloc(sizeof(struct vm));
+    if (!vm)
+        return ERR_PTR(-ENOMEM);
+    *vm = (struct vm){0};
+    vm->pd = pd;
+    vm->ref_count = 1;
+    return vm;
+}
 
-struct process* process_find_process_by_pid(pid_t pid) {
-    bool int_flag = push_cli();
-    struct process* it = all_processes;
-    for (; it; it = it->next_in_all_processes) {
-        if (it->pid == pid)
-            break;
+// Drops the reference of the current process to its address space and leaves
+// the process on the kernel page directory. The address space is destroyed
+// along with the last reference.
+void process_release_vm(void) {
+    struct vm* vm = current->vm;
+    current->vm = NULL;
+    if (atomic_fetch_sub(&vm->ref_count, 1) > 1) {
+        paging_switch_page_directory(paging_kernel_page_directory());
+        return;
+    }
+    paging_switch_page_directory(vm->pd);
+    paging_destroy_current_page_directory();
+    kfree(vm);
+}
+
+struct cwd* process_create_cwd(const char* path, struct inode* inode) {
+    struct cwd* cwd = kmalloc(sizeof(struct cwd));
+    if (!cwd)
+        return ERR_PTR(-ENOMEM);
+    *cwd = (struct cwd){0};
+    cwd->path = kstrdup(path);
+    if (!cwd->path) {
+        kfree(cwd);
+        return ERR_PTR(-ENOMEM);
+    }
+    cwd->inode = inode;
+    cwd->ref_count = 1;
+    return cwd;
+}
+
+void process_unref_cwd(struct cwd* cwd) {
+    if (atomic_fetch_sub(&cwd->ref_count, 1) > 1)
+        return;
+    kfree(cwd->path);
+    inode_unref(cwd->inode);
+    kfree(cwd);
+}
+
+file_descriptor_table* process_create_fd_table(void) {
+    file_descriptor_table* table = kmalloc(sizeof(file_descriptor_table));
+    if (!table)
+        return ERR_PTR(-ENOMEM);
+    int rc = file_descriptor_table_init(table);
+    if (IS_ERR(rc)) {
+        kfree(table);
+        return ERR_PTR(rc);
     }
-    pop_cli(int_flag);
+    return table;
+}
+
+void process_unref_fd_table(file_descriptor_table* table) {
+    if (atomic_fetch_sub(&table->ref_count, 1) > 1)
+        return;
+    file_descriptor_table_destroy(table);
+    kfree(table);
+}
+
+pid_t process_generate_next_pid(void) { return atomic_fetch_add(&next_pid, 1); }
+
+#define PID_HASH_SIZE 256
+
+static struct process* pid_hash[PID_HASH_SIZE];
+static struct process* pgid_hash[PID_HASH_SIZE];
+
+static size_t hash_pid(pid_t pid) {
+    return (size_t)pid & (PID_HASH_SIZE - 1);
+}
+
+struct process* process_table_find(pid_t pid) {
+    struct process* it = pid_hash[hash_pid(pid)];
+    while (it && it->pid != pid)
+        it = it->next_in_pid_hash;
+    return it;
+}
+
+struct process* process_table_find_group(pid_t pgid) {
+    struct process* it = pgid_hash[hash_pid(pgid)];
+    while (it && it->pgid != pgid)
+        it = it->next_in_pgid_hash;
     return it;
 }
 
+static void add_to_group(struct process* process) {
+    struct process* leader = process_table_find_group(process->pgid);
+    if (leader) {
+        process->next_in_pgid_hash = leader->next_in_pgid_hash;
+        leader->next_in_pgid_hash = process;
+    } else {
+        struct process** head = &pgid_hash[hash_pid(process->pgid)];
+        process->next_in_pgid_hash = *head;
+        *head = process;
+    }
+}
+
+static void remove_from_group(struct process* process) {
+    struct process** it = &pgid_hash[hash_pid(process->pgid)];
+    while (*it != process)
+        it = &(*it)->next_in_pgid_hash;
+    *it = process->next_in_pgid_hash;
+    process->next_in_pgid_hash = NULL;
+}
+
+void process_table_set_pgid(struct process* process, pid_t pgid) {
+    remove_from_group(process);
+    process->pgid = pgid;
+    add_to_group(process);
+}
+
+void process_table_insert(struct process* process) {
+    // pids are allocated in increasing order, so the process mostly goes to
+    // the tail
+    struct process* prev = NULL;
+    if (all_processes) {
+        prev = all_processes->prev_in_all_processes;
+        while (prev && prev->pid > process->pid)
+            prev = prev == all_processes ? NULL : prev->prev_in_all_processes;
+    }
+    if (prev) {
+        process->next_in_all_processes = prev->next_in_all_processes;
+        process->prev_in_all_processes = prev;
+        if (prev->next_in_all_processes)
+            prev->next_in_all_processes->prev_in_all_processes = process;
+        else
+            all_processes->prev_in_all_processes = process;
+        prev->next_in_all_processes = process;
+    } else {
+        process->next_in_all_processes = all_processes;
+        process->prev_in_all_processes =
+            all_processes ? all_processes->prev_in_all_processes : process;
+        if (all_processes)
+            all_processes->prev_in_all_processes = process;
+        all_processes = process;
+    }
+
+    struct process** bucket = &pid_hash[hash_pid(process->pid)];
+    process->next_in_pid_hash = *bucket;
+    *bucket = process;
+
+    add_to_group(process);
+
+    // threads aren't waited for, so they don't go to the child list
+    struct process* parent =
+        process_is_thread(process) ? NULL : process_table_find(process->ppid);
+    if (parent) {
+        process->next_sibling = parent->first_child;
+        parent->first_child = process;
+    }
+}
+
+void process_table_remove(struct process* process) {
+    // The head of all_processes keeps the tail in prev_in_all_processes.
+    if (process == all_processes) {
+        all_processes = process->next_in_all_processes;
+        if (all_processes)
+            all_processes->prev_in_all_processes =
+                process->prev_in_all_processes;
+    } else {
+        process->prev_in_all_processes->next_in_all_processes =
+            process->next_in_all_processes;
+        if (process->next_in_all_processes)
+            process->next_in_all_processes->prev_in_all_processes =
+                process->prev_in_all_processes;
+        else
+            all_processes->prev_in_all_processes =
+                process->prev_in_all_processes;
+    }
+    process->next_in_all_processes = process->prev_in_all_processes = NULL;
+
+    struct process** it = &pid_hash[hash_pid(process->pid)];
+    while (*it != process)
+        it = &(*it)->next_in_pid_hash;
+    *it = process->next_in_pid_hash;
+    process->next_in_pid_hash = NULL;
+
+    remove_from_group(process);
+
+    struct process* parent =
+        process_is_thread(process) ? NULL : process_table_find(process->ppid);
+    if (parent) {
+        it = &parent->first_child;
+        while (*it != process)
+            it = &(*it)->next_sibling;
+        *it = process->next_sibling;
+        process->next_sibling = NULL;
+    }
+
+    // a process is only removed once it is dead, by which time its children
+    // have been handed over to init
+    ASSERT(!process->first_child);
+}
+
+struct process* process_find_process_by_pid(pid_t pid) {
+    spinlock_lock(&all_processes_lock);
+    struct process* process = process_table_find(pid);
+    spinlock_unlock(&all_processes_lock);
+    return process;
+}
+
 struct process* process_find_process_by_ppid(pid_t ppid) {
-    bool int_flag = push_cli();
-    struct process* it = all_processes;
-    for (; it; it = it->next_in_all_processes) {
-        if (it->ppid == ppid)
-            break;
+    spinlock_lock(&all_processes_lock);
+    struct process* parent = process_table_find(ppid);
+    struct process* child = parent ? parent->first_child : NULL;
+    spinlock_unlock(&all_processes_lock);
+    return child;
+}
+
+// exited threads waiting for process_reap_dead_threads()
+static struct process* dead_threads;
+
+void process_reap_dead_threads(void) {
+    struct process* reaped = NULL;
+    spinlock_lock(&all_processes_lock);
+    struct process** it = &dead_threads;
+    while (*it) {
+        struct process* thread = *it;
+        // the thread may still be running on its kernel stack
+        if (thread->on_cpu) {
+            it = &thread->next_dead_thread;
+            continue;
+        }
+        *it = thread->next_dead_thread;
+        thread->next_dead_thread = reaped;
+        reaped = thread;
+    }
+    spinlock_unlock(&all_processes_lock);
+
+    while (reaped) {
+        struct process* next = reaped->next_dead_thread;
+        kernel_stack_free((void*)(reaped->stack_top - STACK_SIZE));
+        kfree(reaped);
+        reaped = next;
     }
-    pop_cli(int_flag);
-    return it;
 }
 
 static noreturn void die(void) {
@@ -150,23 +381,44 @@ static noreturn void die(void) {
         PANIC("init process exited");
 
     sti();
-    paging_destroy_current_page_directory();
-    file_descriptor_table_destroy(&current->fd_table);
-    kfree(current->cwd_path);
-    inode_unref(current->cwd_inode);
+    process_reap_dead_threads();
+    if (current->clear_child_tid)
+        futex_clear_and_wake(current->clear_child_tid);
+    process_release_vm();
+    process_unref_fd_table(current->fd_table);
+    current->fd_table = NULL;
+    process_unref_cwd(current->cwd);
+    current->cwd = NULL;
 
     cli();
-    {
-        struct process* it = all_processes;
-        while (it) {
-            // Orphaned child process is adopted by init process.
-            if (it->ppid == current->pid)
-                it->ppid = 1;
-            it = it->next_in_all_processes;
+    spinlock_lock(&all_processes_lock);
+    if (current->first_child) {
+        // Orphaned child process is adopted by init process.
+        struct process* last = current->first_child;
+        for (;;) {
+            last->ppid = 1;
+            if (!last->next_sibling)
+                break;
+            last = last->next_sibling;
         }
+        struct process* init = process_table_find(1);
+        ASSERT(init);
+        last->next_sibling = init->first_child;
+        init->first_child = current->first_child;
+        current->first_child = NULL;
     }
 
+    // waitpid on another CPU may reap the process as soon as it sees it dead,
+    // but it waits until on_cpu is cleared, i.e. until we leave this stack.
+    // Nobody waits for threads, so they are freed by the next
+    // process_reap_dead_threads() instead.
     current->state = PROCESS_STATE_DEAD;
+    if (process_is_thread(current)) {
+        process_table_remove(current);
+        current->next_dead_thread = dead_threads;
+        dead_threads = current;
+    }
+    spinlock_unlock(&all_processes_lock);
 
     scheduler_yield(false);
     UNREACHABLE();
@@ -184,6 +436,11 @@ noreturn void process_exit(int status) {
     die();
 }
 
+noreturn void process_exit_group(int status) {
+    process_kill_other_threads();
+    process_exit(status);
+}
+
 noreturn void process_crash_in_userland(int signum) {
     kprintf("\x1b[31mProcess %d crashed with signal %d\x1b[m\n", current->pid,
             signum);
@@ -209,21 +466,29 @@ int process_alloc_file_descriptor(int fd, file_description* desc) {
     if (fd >= OPEN_MAX)
         return -EBADF;
 
+    file_descriptor_table* table = current->fd_table;
+    spinlock_lock(&table->lock);
+
     if (fd >= 0) {
-        file_description** entry = current->fd_table.entries + fd;
-        if (*entry)
+        file_description** entry = table->entries + fd;
+        if (*entry) {
+            spinlock_unlock(&table->lock);
             return -EEXIST;
+        }
         *entry = desc;
+        spinlock_unlock(&table->lock);
         return fd;
     }
 
-    file_description** it = current->fd_table.entries;
+    file_description** it = table->entries;
     for (int i = 0; i < OPEN_MAX; ++i, ++it) {
         if (*it)
             continue;
         *it = desc;
+        spinlock_unlock(&table->lock);
         return i;
     }
+    spinlock_unlock(&table->lock);
     return -EMFILE;
 }
 
@@ -231,10 +496,15 @@ int process_free_file_descriptor(int fd) {
     if (fd < 0 || OPEN_MAX <= fd)
         return -EBADF;
 
-    file_description** desc = current->fd_table.entries + fd;
-    if (!*desc)
+    file_descriptor_table* table = current->fd_table;
+    spinlock_lock(&table->lock);
+    file_description** desc = table->entries + fd;
+    if (!*desc) {
+        spinlock_unlock(&table->lock);
         return -EBADF;
+    }
     *desc = NULL;
+    spinlock_unlock(&table->lock);
     return 0;
 }
 
@@ -242,7 +512,7 @@ file_description* process_get_file_description(int fd) {
     if (fd < 0 || OPEN_MAX <= fd)
         return ERR_PTR(-EBADF);
 
-    file_description* desc = current->fd_table.entries[fd];
+    file_description* desc = current->fd_table->entries[fd];
     if (!desc)
         return ERR_PTR(-EBADF);
 
@@ -323,42 +593,70 @@ static int send_signal(struct process* process, int signum) {
     return 0;
 }
 
+// A process ID designates the whole thread group. A thread ID that is not the
+// ID of a thread group designates the single thread.
 int process_send_signal_to_one(pid_t pid, int signum) {
+    spinlock_lock(&all_processes_lock);
+    bool found = false;
+    for (struct process* it = all_processes; it;
+         it = it->next_in_all_processes) {
+        if (it->tgid != pid)
+            continue;
+        found = true;
+        int rc = send_signal(it, signum);
+        if (IS_ERR(rc)) {
+            spinlock_unlock(&all_processes_lock);
+            return rc;
+        }
+    }
+    spinlock_unlock(&all_processes_lock);
+    if (found)
+        return 0;
+
     struct process* process = process_find_process_by_pid(pid);
     if (!process)
         return -ESRCH;
     return send_signal(process, signum);
 }
 
-int process_send_signal_to_group(pid_t pgid, int signum) {
-    bool int_flag = push_cli();
+void process_kill_other_threads(void) {
+    spinlock_lock(&all_processes_lock);
     for (struct process* it = all_processes; it;
          it = it->next_in_all_processes) {
-        if (it->pgid != pgid)
-            continue;
+        if (it != current && it->tgid == current->tgid &&
+            it->state != PROCESS_STATE_DEAD)
+            ASSERT_OK(send_signal(it, SIGKILL));
+    }
+    spinlock_unlock(&all_processes_lock);
+}
+
+int process_send_signal_to_group(pid_t pgid, int signum) {
+    spinlock_lock(&all_processes_lock);
+    for (struct process* it = process_table_find_group(pgid);
+         it && it->pgid == pgid; it = it->next_in_pgid_hash) {
         int rc = send_signal(it, signum);
         if (IS_ERR(rc)) {
-            pop_cli(int_flag);
+            spinlock_unlock(&all_processes_lock);
             return rc;
         }
     }
-    pop_cli(int_flag);
+    spinlock_unlock(&all_processes_lock);
     return 0;
 }
 
 int process_send_signal_to_all(int signum) {
-    bool int_flag = push_cli();
+    spinlock_lock(&all_processes_lock);
     for (struct process* it = all_processes; it;
          it = it->next_in_all_processes) {
         if (it->pid <= 1)
             continue;
         int rc = send_signal(it, signum);
         if (IS_ERR(rc)) {
-            pop_cli(int_flag);
+            spinlock_unlock(&all_processes_lock);
             return rc;
         }
     }
-    pop_cli(int_flag);
+    spinlock_unlock(&all_processes_lock);
     return 0;
 }
 
@@ -35,17 +35,39 @@
 
 #pragma once
 
+#include "cpu.h"
 #include "fs/fs.h"
 #include "memory/memory.h"
 #include "system.h"
 #include <common/extra.h>
 #include <stdnoreturn.h>
 
+// address space shared by the threads created with CLONE_VM
+struct vm {
+    page_directory* pd;
+    range_allocator vaddr_allocator;
+    mutex lock;
+    atomic_size_t ref_count;
+};
+
+// working directory shared by the threads created with CLONE_FS
+struct cwd {
+    char* path;
+    struct inode* inode;
+    mutex lock;
+    atomic_size_t ref_count;
+};
+
 struct process {
-    pid_t pid, ppid, pgid;
+    // pid is the thread ID, and tgid is the pid of the thread group leader,
+    // which is what userland sees as the process ID
+    pid_t pid, tgid, ppid, pgid;
     uint32_t eip, esp, ebp, ebx, esi, edi;
     struct fpu_state fpu_state;
 
+    // CPU that last loaded fpu_state into its FPU registers
+    struct cpu* fpu_cpu;
+
     enum {
         PROCESS_STATE_RUNNABLE,
         PROCESS_STATE_RUNNING,
@@ -57,16 +79,24 @@ struct process {
 
     char comm[16];
 
+    // page directory loaded while the process runs. It only differs from
+    // vm->pd while execve() builds the new address space.
     page_directory* pd;
     uintptr_t stack_top;
-    range_allocator vaddr_allocator;
+    struct vm* vm;
+
+    // base address of the TLS segment
+    uintptr_t tls_base;
 
-    char* cwd_path;
-    struct inode* cwd_inode;
-    file_descriptor_table fd_table;
+    // cleared and futex-woken when the process exits (CLONE_CHILD_CLEARTID)
+    pid_t* clear_child_tid;
+
+    struct cwd* cwd;
+    file_descriptor_table* fd_table;
 
     bool (*should_unblock)(void*);
     void* blocker_data;
+    bool blocker_is_interruptible;
     bool blocker_was_interrupted;
 
     size_t user_ticks;
@@ -74,12 +104,59 @@ struct process {
 
     uint32_t pending_signals;
 
+    // CPU whose ready queue the process was last put in
+    struct cpu* cpu;
+
+    // set while a CPU is running on the kernel stack of the process
+    atomic_bool on_cpu;
+
+    // Runtime in nanoseconds scaled by NICE_0_WEIGHT / weight. The scheduler
+    // runs the ready process with the smallest vruntime.
+    uint64_t vruntime;
+    int nice;
+    size_t ticks_in_slice;
+
+    // SCHED_OTHER processes are scheduled by vruntime, while real-time
+    // processes (SCHED_FIFO and SCHED_RR) run in the order of rt_priority.
+    int policy;
+    int rt_priority;
+
+    // whether the process is in the ready queue of a CPU
+    bool queued;
+
+    // whether the syscalls of the process are recorded for systrace_read()
+    bool traced;
+
+    // scheduler statistics, shown in /proc/<pid>/sched
+    size_t num_voluntary_switches;   // blocked or yielded
+    size_t num_involuntary_switches; // preempted
+    size_t wait_ticks;               // runnable but waiting in a ready queue
+    size_t block_ticks;
+    uint32_t enqueued_at; // uptime when the process was last enqueued
+    uint32_t blocked_at;  // uptime when the process last blocked
+    bool woken_up;        // whether the process was enqueued on a wakeup
+
+    // all_processes is sorted by pid. The other links index the processes by
+    // pid, by process group and by parent, and are protected by
+    // all_processes_lock as well.
     struct process* next_in_all_processes;
-    struct process* next_in_ready_queue;
+    struct process* prev_in_all_processes;
+    struct process* next_in_pid_hash;
+    struct process* next_in_pgid_hash; // members of a group are adjacent
+    struct process* first_child;
+    struct process* next_sibling;
+    struct process* next_dead_thread;
+    struct rb_node ready_queue_node;
+    struct process* next_in_rt_queue;
 };
 
-extern struct process* current;
+#define NICE_MIN -20
+#define NICE_MAX 19
+
+#define current cpu_current_process()
+
 extern struct process* all_processes;
+extern spinlock all_processes_lock;
 extern struct fpu_state initial_fpu_state;
 
 void process_init(void);
@@ -89,9 +166,38 @@ struct process* process_create_kernel_process(const char* comm,
 pid_t process_spawn_kernel_process(const char* comm, void (*entry_point)(void));
 
 pid_t process_generate_next_pid(void);
+
+// whether the process is a thread other than the thread group leader
+static inline bool process_is_thread(const struct process* process) {
+    return process->pid != process->tgid;
+}
+
+// frees the threads that have exited and left their kernel stacks
+void process_reap_dead_threads(void);
+
 struct process* process_find_process_by_pid(pid_t);
 struct process* process_find_process_by_ppid(pid_t ppid);
+
+// The process_table_* functions must be called with all_processes_lock held.
+void process_table_insert(struct process*);
+void process_table_remove(struct process*);
+struct process* process_table_find(pid_t pid);
+// the members of the group follow the returned process in next_in_pgid_hash
+// for as long as their pgid matches
+struct process* process_table_find_group(pid_t pgid);
+void process_table_set_pgid(struct process*, pid_t pgid);
 noreturn void process_exit(int status);
+noreturn void process_exit_group(int status);
+
+NODISCARD struct vm* process_create_vm(page_directory*);
+void process_release_vm(void);
+NODISCARD struct cwd* process_create_cwd(const char* path, struct inode*);
+void process_unref_cwd(struct cwd*);
+NODISCARD file_descriptor_table* process_create_fd_table(void);
+void process_unref_fd_table(file_descriptor_table*);
+
+// makes all the other threads in the thread group of the current process die
+void process_kill_other_threads(void);
 noreturn void process_crash_in_userland(int signum);
 
 void process_die_if_needed(void);
@@ -0,0 +1,253 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "rbtree.h"
+
+static void rotate_left(struct rb_node* node, struct rb_root* root) {
+    struct rb_node* right = node->right;
+    node->right = right->left;
+    if (right->left)
+        right->left->parent = node;
+    right->parent = node->parent;
+    if (!node->parent)
+        root->node = right;
+    else if (node == node->parent->left)
+        node->parent->left = right;
+    else
+        node->parent->right = right;
+    right->left = node;
+    node->parent = right;
+}
+
+static void rotate_right(struct rb_node* node, struct rb_root* root) {
+    struct rb_node* left = node->left;
+    node->left = left->right;
+    if (left->right)
+        left->right->parent = node;
+    left->parent = node->parent;
+    if (!node->parent)
+        root->node = left;
+    else if (node == node->parent->right)
+        node->parent->right = left;
+    else
+        node->parent->left = left;
+    left->right = node;
+    node->parent = left;
+}
+
+void rb_insert_color(struct rb_node* node, struct rb_root* root) {
+    struct rb_node* parent;
+    while ((parent = node->parent) && parent->red) {
+        struct rb_node* grandparent = parent->parent;
+        if (parent == grandparent->left) {
+            struct rb_node* uncle = grandparent->right;
+            if (uncle && uncle->red) {
+                parent->red = uncle->red = false;
+                grandparent->red = true;
+                node = grandparent;
+                continue;
+            }
+            if (node == parent->right) {
+                rotate_left(parent, root);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->red = false;
+            grandparent->red = true;
+            rotate_right(grandparent, root);
+        } else {
+            struct rb_node* uncle = grandparent->left;
+            if (uncle && uncle->red) {
+                parent->red = uncle->red = false;
+                grandparent->red = true;
+                node = grandparent;
+                continue;
+            }
+            if (node == parent->left) {
+                rotate_right(parent, root);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->red = false;
+            grandparent->red = true;
+            rotate_left(grandparent, root);
+        }
+    }
+    root->node->red = false;
+}
+
+static bool is_red(const struct rb_node* node) { return node && node->red; }
+
+// restores the black height after a black node was removed above node,
+// which may be NULL, in which case parent tells where it is
+static void erase_color(struct rb_node* node, struct rb_node* parent,
+                        struct rb_root* root) {
+    while (node != root->node && !is_red(node)) {
+        if (node == parent->left) {
+            struct rb_node* sibling = parent->right;
+            if (is_red(sibling)) {
+                sibling->red = false;
+                parent->red = true;
+                rotate_left(parent, root);
+                sibling = parent->right;
+            }
+            if (!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->red = true;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (!is_red(sibling->right)) {
+                sibling->left->red = false;
+                sibling->red = true;
+                rotate_right(sibling, root);
+                sibling = parent->right;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->right->red = false;
+            rotate_left(parent, root);
+        } else {
+            struct rb_node* sibling = parent->left;
+            if (is_red(sibling)) {
+                sibling->red = false;
+                parent->red = true;
+                rotate_right(parent, root);
+                sibling = parent->left;
+            }
+            if (!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->red = true;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (!is_red(sibling->left)) {
+                sibling->right->red = false;
+                sibling->red = true;
+                rotate_left(sibling, root);
+                sibling = parent->left;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->left->red = false;
+            rotate_right(parent, root);
+        }
+        node = root->node;
+    }
+    if (node)
+        node->red = false;
+}
+
+static void replace_child(struct rb_node* old, struct rb_node* new,
+                          struct rb_node* parent, struct rb_root* root) {
+    if (!parent)
+        root->node = new;
+    else if (parent->left == old)
+        parent->left = new;
+    else
+        parent->right = new;
+}
+
+void rb_erase(struct rb_node* node, struct rb_root* root) {
+    struct rb_node* child;
+    struct rb_node* parent;
+    bool removed_red;
+
+    if (node->left && node->right) {
+        // replace the node with its successor, which has no left child
+        struct rb_node* successor = node->right;
+        while (successor->left)
+            successor = successor->left;
+
+        child = successor->right;
+        removed_red = successor->red;
+        if (successor->parent == node) {
+            parent = successor;
+        } else {
+            parent = successor->parent;
+            parent->left = child;
+            if (child)
+                child->parent = parent;
+            successor->right = node->right;
+            node->right->parent = successor;
+        }
+
+        replace_child(node, successor, node->parent, root);
+        successor->parent = node->parent;
+        successor->left = node->left;
+        node->left->parent = successor;
+        successor->red = node->red;
+    } else {
+        child = node->left ? node->left : node->right;
+        parent = node->parent;
+        removed_red = node->red;
+        if (child)
+            child->parent = parent;
+        replace_child(node, child, parent, root);
+    }
+
+    if (!removed_red)
+        erase_color(child, parent, root);
+}
+
+struct rb_node* rb_first(const struct rb_root* root) {
+    struct rb_node* node = root->node;
+    if (!node)
+        return NULL;
+    while (node->left)
+        node = node->left;
+    return node;
+}
+
+struct rb_node* rb_last(const struct rb_root* root) {
+    struct rb_node* node = root->node;
+    if (!node)
+        return NULL;
+    while (node->right)
+        node = node->right;
+    return node;
+}
+
+struct rb_node* rb_next(const struct rb_node* node) {
+    if (node->right) {
+        node = node->right;
+        while (node->left)
+            node = node->left;
+        return (struct rb_node*)node;
+    }
+    while (node->parent && node == node->parent->right)
+        node = node->parent;
+    return node->parent;
+}
@@ -0,0 +1,81 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <common/extra.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Intrusive red-black tree. Users embed struct rb_node in their structs and
+// do the ordered descent themselves, then link the new node at the leaf they
+// found and let rb_insert_color() rebalance the tree:
+//
+//     struct rb_node** link = &root->node;
+//     struct rb_node* parent = NULL;
+//     while (*link) {
+//         parent = *link;
+//         link = less(new, parent) ? &parent->left : &parent->right;
+//     }
+//     rb_link_node(new, parent, link);
+//     rb_insert_color(new, root);
+
+struct rb_node {
+    struct rb_node* parent;
+    struct rb_node* left;
+    struct rb_node* right;
+    bool red;
+};
+
+struct rb_root {
+    struct rb_node* node;
+};
+
+#define RB_ENTRY(ptr, type, member) CONTAINER_OF(ptr, type, member)
+
+static inline void rb_link_node(struct rb_node* node, struct rb_node* parent,
+                                struct rb_node** link) {
+    node->parent = parent;
+    node->left = node->right = NULL;
+    node->red = true;
+    *link = node;
+}
+
+void rb_insert_color(struct rb_node*, struct rb_root*);
+void rb_erase(struct rb_node*, struct rb_root*);
+
+struct rb_node* rb_first(const struct rb_root*);
+struct rb_node* rb_last(const struct rb_root*);
+struct rb_node* rb_next(const struct rb_node*);
@@ -35,62 +35,198 @@
 
 #include "ring_buf.h"
 #include "api/errno.h"
+#include "boot_defs.h"
 #include "memory/memory.h"
+#include "panic.h"
+#include <common/string.h>
 
-#define BUF_CAPACITY 1024
+static size_t valid_capacity(size_t capacity) {
+    return next_power_of_two(MAX(capacity, PAGE_SIZE));
+}
+
+static void* alloc_inner_buf(size_t capacity) {
+    uintptr_t addr = range_allocator_alloc(&kernel_vaddr_allocator, capacity);
+    if (IS_ERR(addr))
+        return ERR_PTR(addr);
+    int rc = paging_map_to_free_pages(addr, capacity, PAGE_WRITE | PAGE_GLOBAL);
+    if (IS_ERR(rc)) {
+        paging_unmap(addr, capacity);
+        ASSERT_OK(range_allocator_free(&kernel_vaddr_allocator, addr, capacity));
+        return ERR_PTR(rc);
+    }
+    return (void*)addr;
+}
+
+static void free_inner_buf(void* inner_buf, size_t capacity) {
+    paging_unmap((uintptr_t)inner_buf, capacity);
+    ASSERT_OK(range_allocator_free(&kernel_vaddr_allocator, (uintptr_t)inner_buf, capacity));
+}
 
-int ring_buf_init(ring_buf* buf) {
+int ring_buf_init(ring_buf* buf, size_t capacity) {
     *buf = (ring_buf){0};
-    buf->inner_buf = kmalloc(BUF_CAPACITY);
-    if (!buf->inner_buf)
-        return -ENOMEM;
+    capacity = valid_capacity(capacity);
+    void* inner_buf = alloc_inner_buf(capacity);
+    if (IS_ERR(inner_buf))
+        return PTR_ERR(inner_buf);
+    buf->inner_buf = inner_buf;
+    buf->capacity = capacity;
     buf->write_idx = buf->read_idx = 0;
     return 0;
 }
 
-void ring_buf_destroy(ring_buf* buf) { kfree(buf->inner_buf); }
+void ring_buf_destroy(ring_buf* buf) {
+    if (buf->inner_buf)
+        free_inner_buf(buf->inner_buf, buf->capacity);
+}
+
+size_t ring_buf_size(const ring_buf* buf) {
+    return buf->write_idx - buf->read_idx;
+}
 
 bool ring_buf_is_empty(const ring_buf* buf) {
     return buf->write_idx == buf->read_idx;
 }
 
 bool ring_buf_is_full(const ring_buf* buf) {
-    return (buf->write_idx + 1) % BUF_CAPACITY == buf->read_idx;
+    return ring_buf_size(buf) >= buf->capacity;
 }
 
-ssize_t ring_buf_read(ring_buf* buf, void* bytes, size_t count) {
-    size_t nread = 0;
-    unsigned char* dest = bytes;
+// copies count bytes starting at idx out of the buffer, in at most two
+// segments as the range may wrap around the end
+static void copy_out(const ring_buf* buf, size_t idx, void* bytes, size_t count) {
     const unsigned char* src = buf->inner_buf;
-    while (nread < count) {
-        dest[nread++] = src[buf->read_idx];
-        buf->read_idx = (buf->read_idx + 1) % BUF_CAPACITY;
-        if (buf->read_idx == buf->write_idx)
-            break;
-    }
+    size_t offset = idx & (buf->capacity - 1);
+    size_t first = MIN(count, buf->capacity - offset);
+    memcpy(bytes, src + offset, first);
+    memcpy((unsigned char*)bytes + first, src, count - first);
+}
+
+static void copy_in(ring_buf* buf, size_t idx, const void* bytes, size_t count) {
+    unsigned char* dest = buf->inner_buf;
+    size_t offset = idx & (buf->capacity - 1);
+    size_t first = MIN(count, buf->capacity - offset);
+    memcpy(dest + offset, bytes, first);
+    memcpy(dest, (const unsigned char*)bytes + first, count - first);
+}
+
+ssize_t ring_buf_read(ring_buf* buf, void* bytes, size_t count) {
+    size_t nread = MIN(count, ring_buf_size(buf));
+    copy_out(buf, buf->read_idx, bytes, nread);
+    buf->read_idx += nread;
     return nread;
 }
 
 ssize_t ring_buf_write(ring_buf* buf, const void* bytes, size_t count) {
-    size_t nwritten = 0;
-    unsigned char* dest = buf->inner_buf;
-    const unsigned char* src = bytes;
-    while (nwritten < count) {
-        dest[buf->write_idx] = src[nwritten++];
-        buf->write_idx = (buf->write_idx + 1) % BUF_CAPACITY;
-        if ((buf->write_idx + 1) % BUF_CAPACITY == buf->read_idx)
-            break;
-    }
+    size_t nwritten = MIN(count, buf->capacity - ring_buf_size(buf));
+    copy_in(buf, buf->write_idx, bytes, nwritten);
+    buf->write_idx += nwritten;
     return nwritten;
 }
 
 ssize_t ring_buf_write_evicting_oldest(ring_buf* buf, const void* bytes, size_t count) {
-    size_t nwritten = 0;
-    unsigned char* dest = buf->inner_buf;
-    const unsigned char* src = bytes;
-    while (nwritten < count) {
-        dest[buf->write_idx] = src[nwritten++];
-        buf->write_idx = (buf->write_idx + 1) % BUF_CAPACITY;
+    size_t nwritten = count;
+    if (count > buf->capacity) {
+        // only the last capacity bytes would survive
+        bytes = (const unsigned char*)bytes + (count - buf->capacity);
+        count = buf->capacity;
     }
+    size_t free_space = buf->capacity - ring_buf_size(buf);
+    if (count > free_space)
+        buf->read_idx += count - free_space;
+    copy_in(buf, buf->write_idx, bytes, count);
+    buf->write_idx += count;
     return nwritten;
 }
+
+ssize_t ring_buf_copy(ring_buf* dest, const ring_buf* src, size_t count) {
+    size_t n = MIN(count, ring_buf_size(src));
+    n = MIN(n, dest->capacity - ring_buf_size(dest));
+    unsigned char* dest_buf = dest->inner_buf;
+    size_t offset = dest->write_idx & (dest->capacity - 1);
+    size_t first = MIN(n, dest->capacity - offset);
+    copy_out(src, src->read_idx, dest_buf + offset, first);
+    copy_out(src, src->read_idx + first, dest_buf, n - first);
+    dest->write_idx += n;
+    return n;
+}
+
+ssize_t ring_buf_peek(const ring_buf* buf, size_t offset, void* bytes,
+                      size_t count) {
+    size_t size = ring_buf_size(buf);
+    if (offset >= size)
+        return 0;
+    size_t n = MIN(count, size - offset);
+    copy_out(buf, buf->read_idx + offset, bytes, n);
+    return n;
+}
+
+size_t ring_buf_readable_segment(const ring_buf* buf, const void** out_ptr) {
+    size_t offset = buf->read_idx & (buf->capacity - 1);
+    *out_ptr = (const unsigned char*)buf->inner_buf + offset;
+    return MIN(ring_buf_size(buf), buf->capacity - offset);
+}
+
+void ring_buf_consume(ring_buf* buf, size_t count) {
+    ASSERT(count <= ring_buf_size(buf));
+    buf->read_idx += count;
+}
+
+size_t ring_buf_writable_segment(const ring_buf* buf, void** out_ptr) {
+    size_t offset = buf->write_idx & (buf->capacity - 1);
+    *out_ptr = (unsigned char*)buf->inner_buf + offset;
+    return MIN(buf->capacity - ring_buf_size(buf), buf->capacity - offset);
+}
+
+void ring_buf_commit(ring_buf* buf, size_t count) {
+    ASSERT(count <= buf->capacity - ring_buf_size(buf));
+    buf->write_idx += count;
+}
+
+int ring_buf_share_user_page(ring_buf* buf, uintptr_t user_addr) {
+    size_t offset = buf->write_idx & (buf->capacity - 1);
+    ASSERT(offset % PAGE_SIZE == 0);
+    ASSERT(buf->capacity - ring_buf_size(buf) >= PAGE_SIZE);
+    return paging_share_user_page((uintptr_t)buf->inner_buf + offset,
+                                  user_addr);
+}
+
+int ring_buf_unshare(ring_buf* buf, size_t count) {
+    size_t free_space = buf->capacity - ring_buf_size(buf);
+    count = MIN(count, free_space);
+    if (count == 0)
+        return 0;
+    size_t offset = buf->write_idx & (buf->capacity - 1);
+    size_t head = offset % PAGE_SIZE;
+    for (size_t i = 0; i < head + count; i += PAGE_SIZE) {
+        uintptr_t page = (uintptr_t)buf->inner_buf +
+                         ((offset - head + i) & (buf->capacity - 1));
+        // the contents only matter if the page also holds stored bytes
+        bool all_free = i >= head && i - head + PAGE_SIZE <= free_space;
+        int rc = all_free ? paging_unshare_page_discarding(page)
+                          : paging_unshare_page(page);
+        if (IS_ERR(rc))
+            return rc;
+    }
+    return 0;
+}
+
+int ring_buf_resize(ring_buf* buf, size_t capacity) {
+    capacity = valid_capacity(capacity);
+    if (capacity == buf->capacity)
+        return 0;
+    size_t size = ring_buf_size(buf);
+    if (size > capacity)
+        return -EBUSY;
+
+    void* inner_buf = alloc_inner_buf(capacity);
+    if (IS_ERR(inner_buf))
+        return PTR_ERR(inner_buf);
+    copy_out(buf, buf->read_idx, inner_buf, size);
+
+    free_inner_buf(buf->inner_buf, buf->capacity);
+    buf->inner_buf = inner_buf;
+    buf->capacity = capacity;
+    buf->read_idx = 0;
+    buf->write_idx = size;
+    return 1;
+}
@@ -39,17 +39,58 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+// The capacity is a power of two and a multiple of the page size. write_idx
+// and read_idx run freely and are masked with capacity - 1 on access, so
+// write_idx - read_idx is the number of stored bytes even after they wrap.
 typedef struct ring_buf {
     mutex lock;
     void* inner_buf;
+    size_t capacity;
     atomic_size_t write_idx;
     atomic_size_t read_idx;
 } ring_buf;
 
-NODISCARD int ring_buf_init(ring_buf*);
+// capacity is rounded up to a valid one
+NODISCARD int ring_buf_init(ring_buf*, size_t capacity);
 void ring_buf_destroy(ring_buf*);
 bool ring_buf_is_empty(const ring_buf*);
 bool ring_buf_is_full(const ring_buf*);
+size_t ring_buf_size(const ring_buf*);
+
+// Copies up to count bytes from the front of src to dest without consuming
+// them from src.
+ssize_t ring_buf_copy(ring_buf* dest, const ring_buf* src, size_t count);
+
+// Copies up to count bytes starting offset bytes after the read position
+// without consuming them.
+ssize_t ring_buf_peek(const ring_buf*, size_t offset, void* bytes, size_t count);
+
+// The stored bytes starting at the read position that are contiguous in
+// memory, which the caller can pass on in place and then discard with
+// ring_buf_consume().
+size_t ring_buf_readable_segment(const ring_buf*, const void** out_ptr);
+void ring_buf_consume(ring_buf*, size_t count);
+
+// The free space starting at the write position that is contiguous in memory,
+// which the caller can fill in place and then publish with ring_buf_commit().
+size_t ring_buf_writable_segment(const ring_buf*, void** out_ptr);
+void ring_buf_commit(ring_buf*, size_t count);
+
+// Makes the page of free space at the write position, which must be page
+// aligned, reference the user page at user_addr instead of holding a copy of
+// it. The page is published with ring_buf_commit() as usual.
+NODISCARD int ring_buf_share_user_page(ring_buf*, uintptr_t user_addr);
+
+// Gives the pages of the next count bytes of free space back their own
+// physical pages if they still reference user pages, so that they can be
+// written to. Must be called before writing to a buffer that may have had
+// user pages shared into it.
+NODISCARD int ring_buf_unshare(ring_buf*, size_t count);
+
+// keeps the stored bytes, so fails with -EBUSY if they don't fit in the new
+// capacity. Returns 1 if the bytes were moved to a new buffer starting at
+// index 0, and 0 if the capacity stayed the same.
+NODISCARD int ring_buf_resize(ring_buf*, size_t capacity);
 NODISCARD ssize_t ring_buf_write(ring_buf*, const void* bytes, size_t count);
 ssize_t ring_buf_write_evicting_oldest(ring_buf*, const void* bytes, size_t count);
 NODISCARD ssize_t ring_buf_read(ring_buf*, void* bytes, size_t count);
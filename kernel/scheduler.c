@@ -35,104 +35,361 @@
 
 #include "scheduler.h"
 #include "api/errno.h"
+#include "boot_defs.h"
+#include "cpu.h"
 #include "interrupts.h"
 #include "memory/memory.h"
 #include "panic.h"
 #include "process.h"
 #include "system.h"
 
-static struct process* ready_queue;
-static struct process* idle;
+// how often (in ticks) each CPU tries to take a process from the busiest CPU
+#define LOAD_BALANCE_INTERVAL 8
 
-void scheduler_register(struct process* process) {
-    ASSERT(process->state == PROCESS_STATE_RUNNABLE);
+#define NSEC_PER_TICK (1000000000 / CLK_TCK)
 
-    bool int_flag = push_cli();
-    struct process* prev = NULL;
-    struct process* it = all_processes;
-    while (it && it->pid < process->pid) {
-        prev = it;
-        it = it->next_in_all_processes;
+// period (in ticks) in which every ready process gets to run once, unless
+// there are so many of them that the slices would get shorter than a tick
+#define SCHED_LATENCY_TICKS 6
+
+// the running process is preempted when its vruntime gets ahead of the
+// leftmost ready process by more than this
+#define SCHED_WAKEUP_GRANULARITY NSEC_PER_TICK
+
+#define NICE_0_WEIGHT 1024
+
+// SCHED_RR processes of the same priority take turns every 100 ms
+#define RR_TIMESLICE_TICKS (CLK_TCK / 10)
+
+// Real-time processes may run for RT_RUNTIME_TICKS out of every RT_PERIOD_TICKS
+// on each CPU. The remaining ticks are left to SCHED_OTHER processes so that a
+// runaway real-time process can't lock up the system.
+#define RT_PERIOD_TICKS CLK_TCK
+#define RT_RUNTIME_TICKS (RT_PERIOD_TICKS * 95 / 100)
+
+atomic_uint sched_latency_histogram[SCHED_LATENCY_NUM_BUCKETS];
+
+// each nice level is worth about 10% of CPU time
+static const unsigned nice_to_weight[40] = {
+    /* -20 */ 88761, 71755, 56483, 46273, 36291,
+    /* -15 */ 29154, 23254, 18705, 14949, 11916,
+    /* -10 */ 9548,  7620,  6100,  4904,  3906,
+    /*  -5 */ 3121,  2501,  1991,  1586,  1277,
+    /*   0 */ 1024,  820,   655,   526,   423,
+    /*   5 */ 335,   272,   215,   172,   137,
+    /*  10 */ 110,   87,    70,    56,    45,
+    /*  15 */ 36,    29,    23,    18,    15,
+};
+
+static unsigned weight_of(const struct process* process) {
+    return nice_to_weight[process->nice - NICE_MIN];
+}
+
+static bool vruntime_before(uint64_t a, uint64_t b) {
+    return (int64_t)(a - b) < 0;
+}
+
+static bool is_rt(const struct process* process) {
+    return process->policy != SCHED_OTHER;
+}
+
+// returns the highest priority among the ready real-time processes, or 0 if
+// there are none
+static int highest_rt_priority(const struct cpu* cpu) {
+    for (int i = RT_BITMAP_WORDS - 1; i >= 0; --i) {
+        if (cpu->rt_bitmap[i])
+            return i * 32 + 31 - __builtin_clz(cpu->rt_bitmap[i]);
     }
-    if (prev) {
-        process->next_in_all_processes = it;
-        prev->next_in_all_processes = process;
-    } else {
-        process->next_in_all_processes = all_processes;
-        all_processes = process;
+    return 0;
+}
+
+static struct cpu* find_least_loaded_cpu(void) {
+    struct cpu* least_loaded = cpus;
+    size_t n = atomic_load(&num_cpus);
+    for (size_t i = 1; i < n; ++i) {
+        struct cpu* cpu = cpus + i;
+        if (atomic_load(&cpu->online) &&
+            atomic_load(&cpu->num_ready) < atomic_load(&least_loaded->num_ready))
+            least_loaded = cpu;
     }
-    pop_cli(int_flag);
+    return least_loaded;
+}
 
-    scheduler_enqueue(process);
+static void update_min_vruntime(struct cpu* cpu) {
+    uint64_t vruntime = cpu->min_vruntime;
+    struct process* running = cpu->current_process;
+    bool has_running = running && running != cpu->idle && !is_rt(running);
+    if (has_running)
+        vruntime = running->vruntime;
+    if (cpu->leftmost) {
+        uint64_t leftmost_vruntime =
+            RB_ENTRY(cpu->leftmost, struct process, ready_queue_node)
+                ->vruntime;
+        if (!has_running || vruntime_before(leftmost_vruntime, vruntime))
+            vruntime = leftmost_vruntime;
+    }
+    if (vruntime_before(cpu->min_vruntime, vruntime))
+        cpu->min_vruntime = vruntime;
 }
 
-void scheduler_unregister(struct process* process) {
-    bool int_flag = push_cli();
+enum placement {
+    PLACE_REQUEUE, // keeps the vruntime
+    PLACE_NEW,     // starts at the floor of the CPU
+    PLACE_WAKEUP,  // gets credit for sleeping, bounded by half the latency
+};
+
+static void fair_enqueue(struct cpu* cpu, struct process* process,
+                         enum placement placement) {
+    switch (placement) {
+    case PLACE_REQUEUE:
+        break;
+    case PLACE_NEW:
+        process->vruntime = cpu->min_vruntime;
+        break;
+    case PLACE_WAKEUP: {
+        // a process that slept long has its vruntime far behind, and letting
+        // it catch up would starve the others, but some credit lets
+        // interactive processes preempt CPU hogs promptly after waking up
+        uint64_t floor =
+            cpu->min_vruntime - SCHED_LATENCY_TICKS * NSEC_PER_TICK / 2;
+        if (vruntime_before(process->vruntime, floor))
+            process->vruntime = floor;
+        break;
+    }
+    }
 
-    struct process* prev = NULL;
-    for (struct process* it = all_processes; it;) {
-        if (it != process) {
-            prev = it;
-            it = it->next_in_all_processes;
-            continue;
+    struct rb_node** link = &cpu->ready_queue.node;
+    struct rb_node* parent = NULL;
+    bool is_leftmost = true;
+    while (*link) {
+        parent = *link;
+        struct process* it =
+            RB_ENTRY(parent, struct process, ready_queue_node);
+        if (vruntime_before(process->vruntime, it->vruntime)) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+            is_leftmost = false;
         }
-        if (prev)
-            prev->next_in_all_processes = it->next_in_all_processes;
-        else
-            all_processes = it->next_in_all_processes;
     }
+    rb_link_node(&process->ready_queue_node, parent, link);
+    rb_insert_color(&process->ready_queue_node, &cpu->ready_queue);
+    if (is_leftmost)
+        cpu->leftmost = &process->ready_queue_node;
 
-    pop_cli(int_flag);
+    cpu->load += weight_of(process);
 }
 
-void scheduler_enqueue(struct process* process) {
+static void fair_dequeue(struct cpu* cpu, struct process* process) {
+    struct rb_node* node = &process->ready_queue_node;
+    if (cpu->leftmost == node)
+        cpu->leftmost = rb_next(node);
+    rb_erase(node, &cpu->ready_queue);
+    cpu->load -= weight_of(process);
+}
+
+static void rt_enqueue(struct cpu* cpu, struct process* process) {
+    int prio = process->rt_priority;
+    process->next_in_rt_queue = NULL;
+    if (cpu->rt_tails[prio])
+        cpu->rt_tails[prio]->next_in_rt_queue = process;
+    else
+        cpu->rt_heads[prio] = process;
+    cpu->rt_tails[prio] = process;
+    cpu->rt_bitmap[prio / 32] |= 1u << (prio % 32);
+}
+
+static void rt_dequeue(struct cpu* cpu, struct process* process) {
+    int prio = process->rt_priority;
+    struct process* prev = NULL;
+    struct process* it = cpu->rt_heads[prio];
+    while (it != process) {
+        ASSERT(it);
+        prev = it;
+        it = it->next_in_rt_queue;
+    }
+    if (prev)
+        prev->next_in_rt_queue = process->next_in_rt_queue;
+    else
+        cpu->rt_heads[prio] = process->next_in_rt_queue;
+    if (cpu->rt_tails[prio] == process)
+        cpu->rt_tails[prio] = prev;
+    if (!cpu->rt_heads[prio])
+        cpu->rt_bitmap[prio / 32] &= ~(1u << (prio % 32));
+    process->next_in_rt_queue = NULL;
+}
+
+// whether the ready process should run in place of the running one right away
+static bool wakeup_preempts(const struct cpu* cpu,
+                            const struct process* process) {
+    if (!is_rt(process) || cpu->rt_throttled)
+        return false;
+    struct process* running = cpu->current_process;
+    if (!running || running == cpu->idle || !is_rt(running))
+        return true;
+    return process->rt_priority > running->rt_priority;
+}
+
+static void enqueue_on(struct cpu* cpu, struct process* process,
+                       enum placement placement) {
+    spinlock_lock(&cpu->ready_queue_lock);
+
+    process->cpu = cpu;
+    if (is_rt(process))
+        rt_enqueue(cpu, process);
+    else
+        fair_enqueue(cpu, process, placement);
+    process->queued = true;
+    process->enqueued_at = uptime;
+    process->woken_up = placement == PLACE_WAKEUP;
+    atomic_fetch_add(&cpu->num_ready, 1);
+
+    // wake the CPU up if it is halting in the idle process, or have it switch
+    // to a real-time process without waiting for the end of the timeslice
+    if (cpu->current_process == cpu->idle) {
+        smp_send_reschedule(cpu);
+    } else if (wakeup_preempts(cpu, process)) {
+        atomic_store(&cpu->need_resched, true);
+        smp_send_reschedule(cpu);
+    }
+
+    spinlock_unlock(&cpu->ready_queue_lock);
+}
+
+static void enqueue(struct process* process, enum placement placement) {
     ASSERT(process->state != PROCESS_STATE_DEAD);
 
-    bool int_flag = push_cli();
+    // a process keeps running on the same CPU to make use of warm caches,
+    // while new processes are spread over the CPUs
+    struct cpu* cpu = process->cpu;
+    if (!cpu) {
+        cpu = find_least_loaded_cpu();
+        placement = PLACE_NEW;
+    }
+    enqueue_on(cpu, process, placement);
+}
 
-    process->next_in_ready_queue = NULL;
-    if (ready_queue) {
-        struct process* it = ready_queue;
-        while (it->next_in_ready_queue)
-            it = it->next_in_ready_queue;
-        it->next_in_ready_queue = process;
-    } else {
-        ready_queue = process;
+void scheduler_enqueue(struct process* process) {
+    enqueue(process, PLACE_REQUEUE);
+}
+
+void scheduler_register(struct process* process) {
+    ASSERT(process->state == PROCESS_STATE_RUNNABLE);
+    ASSERT(NICE_MIN <= process->nice && process->nice <= NICE_MAX);
+
+    spinlock_lock(&all_processes_lock);
+    process_table_insert(process);
+    spinlock_unlock(&all_processes_lock);
+
+    enqueue(process, PLACE_NEW);
+}
+
+void scheduler_unregister(struct process* process) {
+    spinlock_lock(&all_processes_lock);
+    process_table_remove(process);
+    spinlock_unlock(&all_processes_lock);
+}
+
+static struct process* dequeue_from(struct cpu* cpu) {
+    spinlock_lock(&cpu->ready_queue_lock);
+
+    struct process* process = NULL;
+    int prio = cpu->rt_throttled ? 0 : highest_rt_priority(cpu);
+    if (prio > 0) {
+        process = cpu->rt_heads[prio];
+        rt_dequeue(cpu, process);
+    } else if (cpu->leftmost) {
+        process = RB_ENTRY(cpu->leftmost, struct process, ready_queue_node);
+        fair_dequeue(cpu, process);
+    }
+    if (process) {
+        process->queued = false;
+        atomic_fetch_sub(&cpu->num_ready, 1);
     }
 
-    pop_cli(int_flag);
+    spinlock_unlock(&cpu->ready_queue_lock);
+    return process;
 }
 
-static struct process* scheduler_deque(void) {
+static struct process* scheduler_deque(struct cpu* cpu) {
     ASSERT(!interrupts_enabled());
-    if (!ready_queue)
-        return idle;
-    struct process* process = ready_queue;
-    ready_queue = process->next_in_ready_queue;
-    process->next_in_ready_queue = NULL;
+    struct process* process = dequeue_from(cpu);
+    if (!process)
+        return cpu->idle;
     ASSERT(process->state != PROCESS_STATE_DEAD);
+    process->ticks_in_slice = 0;
     return process;
 }
 
+// moves a process from the busiest CPU to this CPU if the imbalance is
+// larger than one process
+static void balance_load(struct cpu* cpu) {
+    struct cpu* busiest = NULL;
+    size_t busiest_num_ready = atomic_load(&cpu->num_ready) + 1;
+    size_t n = atomic_load(&num_cpus);
+    for (size_t i = 0; i < n; ++i) {
+        struct cpu* it = cpus + i;
+        if (it == cpu || !atomic_load(&it->online))
+            continue;
+        size_t num_ready = atomic_load(&it->num_ready);
+        if (num_ready > busiest_num_ready) {
+            busiest = it;
+            busiest_num_ready = num_ready;
+        }
+    }
+    if (!busiest)
+        return;
+
+    struct process* process = dequeue_from(busiest);
+    if (!process)
+        return;
+
+    // vruntimes are only comparable within a CPU, so carry over the
+    // position of the process relative to the floor
+    spinlock_lock(&busiest->ready_queue_lock);
+    process->vruntime -= busiest->min_vruntime;
+    spinlock_unlock(&busiest->ready_queue_lock);
+    process->vruntime += cpu->min_vruntime;
+    enqueue_on(cpu, process, PLACE_REQUEUE);
+}
+
+// called with all_processes_lock held
+static void try_unblock(struct process* process) {
+    // a blocked process may still be on its way out of its CPU
+    if (process->state != PROCESS_STATE_BLOCKED || process->on_cpu)
+        return;
+
+    ASSERT(process->should_unblock);
+    bool interrupted =
+        process->blocker_is_interruptible && process->pending_signals != 0;
+    if (interrupted || process->should_unblock(process->blocker_data)) {
+        process->should_unblock = NULL;
+        process->blocker_data = NULL;
+        process->blocker_was_interrupted = interrupted;
+        process->state = PROCESS_STATE_RUNNING;
+        process->block_ticks += uptime - process->blocked_at;
+        enqueue(process, PLACE_WAKEUP);
+    }
+}
+
 static void unblock_processes(void) {
     ASSERT(!interrupts_enabled());
-    if (!all_processes)
-        return;
+
+    spinlock_lock(&all_processes_lock);
 
     for (struct process* it = all_processes; it;
-         it = it->next_in_all_processes) {
-        if (it->state != PROCESS_STATE_BLOCKED)
-            continue;
+         it = it->next_in_all_processes)
+        try_unblock(it);
 
-        ASSERT(it->should_unblock);
-        if (it->pending_signals || it->should_unblock(it->blocker_data)) {
-            it->should_unblock = NULL;
-            it->blocker_data = NULL;
-            it->blocker_was_interrupted = it->pending_signals != 0;
-            it->state = PROCESS_STATE_RUNNING;
-            scheduler_enqueue(it);
-        }
-    }
+    spinlock_unlock(&all_processes_lock);
+}
+
+void scheduler_wake(struct process* process) {
+    bool int_flag = push_cli();
+    spinlock_lock(&all_processes_lock);
+    try_unblock(process);
+    spinlock_unlock(&all_processes_lock);
+    pop_cli(int_flag);
 }
 
 static noreturn void do_idle(void) {
@@ -144,25 +401,59 @@ static noreturn void do_idle(void) {
     }
 }
 
-void scheduler_init(void) {
-    idle = process_create_kernel_process("idle", do_idle);
-    ASSERT_OK(idle);
+int scheduler_init_cpu(struct cpu* cpu) {
+    cpu->idle = process_create_kernel_process("idle", do_idle);
+    if (IS_ERR(cpu->idle))
+        return PTR_ERR(cpu->idle);
+    cpu->idle->cpu = cpu;
+
+    // scheduler_yield() moves to this stack before switching processes so
+    // that other CPUs can pick up the previous process right away
+    void* stack = kernel_stack_alloc();
+    if (!stack)
+        return -ENOMEM;
+    cpu->scheduler_stack_top = (uintptr_t)stack + STACK_SIZE;
+
+    return 0;
+}
+
+void scheduler_init(void) { ASSERT_OK(scheduler_init_cpu(cpu_get_current())); }
+
+static void record_wait(struct process* process) {
+    size_t wait = uptime - process->enqueued_at;
+    process->wait_ticks += wait;
+    if (!process->woken_up)
+        return;
+    size_t bucket = 0;
+    while (wait && bucket < SCHED_LATENCY_NUM_BUCKETS - 1) {
+        wait >>= 1;
+        ++bucket;
+    }
+    atomic_fetch_add(&sched_latency_histogram[bucket], 1);
 }
 
 static noreturn void switch_to_next_process(void) {
     ASSERT(!interrupts_enabled());
     unblock_processes();
 
-    current = scheduler_deque();
-    ASSERT(current);
-    ASSERT(current->state != PROCESS_STATE_DEAD);
+    struct cpu* cpu = cpu_get_current();
+    struct process* next = scheduler_deque(cpu);
+    ASSERT(next);
+    ASSERT(next->state != PROCESS_STATE_DEAD);
+    ASSERT(!next->on_cpu);
+    next->on_cpu = true;
+    cpu->current_process = next;
+    if (next != cpu->idle)
+        record_wait(next);
+    ++cpu->num_switches;
 
     paging_switch_page_directory(current->pd);
     gdt_set_kernel_stack(current->stack_top);
+    gdt_set_tls_base(current->tls_base);
 
     process_handle_pending_signals();
 
-    __asm__ volatile("fxrstor %0" ::"m"(current->fpu_state));
+    fpu_switch_in();
 
     if (current->state == PROCESS_STATE_RUNNABLE) {
         current->state = PROCESS_STATE_RUNNING;
@@ -194,14 +485,38 @@ static noreturn void switch_to_next_process(void) {
     UNREACHABLE();
 }
 
+noreturn void scheduler_start(void) {
+    cli();
+    struct cpu* cpu = cpu_get_current();
+    cpu->current_process = cpu->idle;
+    cpu->idle->state = PROCESS_STATE_RUNNABLE;
+    switch_to_next_process();
+}
+
+// called on the scheduler stack of the CPU after the context of prev is saved
+static noreturn void finish_yield(struct process* prev, bool requeue_prev) {
+    ASSERT(!interrupts_enabled());
+
+    // once on_cpu is cleared, other CPUs may unblock, run, or reap prev,
+    // so we must not touch prev afterwards unless it stays runnable
+    prev->on_cpu = false;
+    if (requeue_prev)
+        scheduler_enqueue(prev);
+
+    switch_to_next_process();
+}
+
 void scheduler_yield(bool requeue_current) {
     bool int_flag = push_cli();
-    ASSERT(current);
+    struct cpu* cpu = cpu_get_current();
+    struct process* prev = cpu->current_process;
+    ASSERT(prev);
 
-    if (current == idle) {
+    if (prev == cpu->idle) {
         // because we don't save the context for the idle task, it has to be
         // launched as a brand new task every time.
-        idle->state = PROCESS_STATE_RUNNABLE;
+        prev->state = PROCESS_STATE_RUNNABLE;
+        prev->on_cpu = false;
 
         // skip saving the context
         switch_to_next_process();
@@ -226,42 +541,214 @@ void scheduler_yield(bool requeue_current) {
     uint32_t edi;
     __asm__ volatile("mov %%edi, %0" : "=m"(edi));
 
-    current->eip = eip;
-    current->esp = esp;
-    current->ebp = ebp;
-    current->ebx = ebx;
-    current->esi = esi;
-    current->edi = edi;
+    prev->eip = eip;
+    prev->esp = esp;
+    prev->ebp = ebp;
+    prev->ebx = ebx;
+    prev->esi = esi;
+    prev->edi = edi;
+
+    fpu_switch_out(prev);
+
+    // leave the kernel stack of prev before it becomes visible to other CPUs
+    __asm__ volatile("mov %0, %%esp\n"
+                     "push %1\n"
+                     "push %2\n"
+                     "call *%3"
+                     :
+                     : "r"(cpu->scheduler_stack_top),
+                       "r"((uint32_t)requeue_current), "r"(prev),
+                       "r"(finish_yield)
+                     : "memory");
+    UNREACHABLE();
+}
 
-    __asm__ volatile("fxsave %0" : "=m"(current->fpu_state));
+// the running process gets a share of the latency period proportional to
+// its weight
+static size_t timeslice_ticks(const struct cpu* cpu,
+                              const struct process* running) {
+    size_t period = MAX(SCHED_LATENCY_TICKS, atomic_load(&cpu->num_ready) + 1);
+    unsigned weight = weight_of(running);
+    return MAX(1, period * weight / (cpu->load + weight));
+}
 
-    if (requeue_current)
-        scheduler_enqueue(current);
+static bool fair_should_preempt(struct cpu* cpu, struct process* running) {
+    // NSEC_PER_TICK * NICE_0_WEIGHT still fits in 32 bits, and we avoid
+    // 64-bit division which needs libgcc
+    running->vruntime +=
+        (uint32_t)NSEC_PER_TICK * NICE_0_WEIGHT / weight_of(running);
+    ++running->ticks_in_slice;
+    update_min_vruntime(cpu);
+
+    if (!cpu->rt_throttled && highest_rt_priority(cpu) > 0)
+        return true;
+    if (!cpu->leftmost)
+        return false;
+    struct process* leftmost =
+        RB_ENTRY(cpu->leftmost, struct process, ready_queue_node);
+    if (running->ticks_in_slice >= timeslice_ticks(cpu, running))
+        return true;
+    return vruntime_before(leftmost->vruntime + SCHED_WAKEUP_GRANULARITY,
+                           running->vruntime);
+}
 
-    switch_to_next_process();
-    UNREACHABLE();
+static bool rt_should_preempt(struct cpu* cpu, struct process* running) {
+    if (++cpu->rt_ticks >= RT_RUNTIME_TICKS)
+        cpu->rt_throttled = true;
+    if (cpu->rt_throttled)
+        return true;
+
+    int highest = highest_rt_priority(cpu);
+    if (highest > running->rt_priority)
+        return true;
+    if (running->policy != SCHED_RR ||
+        ++running->ticks_in_slice < RR_TIMESLICE_TICKS)
+        return false;
+
+    // the timeslice of a SCHED_RR process only matters when another process
+    // of the same priority is waiting
+    if (highest == running->rt_priority)
+        return true;
+    running->ticks_in_slice = 0;
+    return false;
+}
+
+// charges the tick to the running process and decides whether it should make
+// way for a ready process
+static bool should_preempt(struct cpu* cpu) {
+    struct process* running = cpu->current_process;
+
+    spinlock_lock(&cpu->ready_queue_lock);
+
+    if (cpu->ticks - cpu->rt_period_start >= RT_PERIOD_TICKS) {
+        cpu->rt_period_start = cpu->ticks;
+        cpu->rt_ticks = 0;
+        cpu->rt_throttled = false;
+    }
+
+    bool preempt = atomic_exchange(&cpu->need_resched, false);
+    if (running == cpu->idle)
+        preempt = atomic_load(&cpu->num_ready) > 0;
+    else if (is_rt(running))
+        preempt |= rt_should_preempt(cpu, running);
+    else
+        preempt |= fair_should_preempt(cpu, running);
+
+    spinlock_unlock(&cpu->ready_queue_lock);
+    return preempt;
+}
+
+static void preempt_current(struct cpu* cpu) {
+    if (cpu->current_process != cpu->idle)
+        ++cpu->current_process->num_involuntary_switches;
+    scheduler_yield(true);
 }
 
 void scheduler_tick(bool in_kernel) {
     if (!in_kernel)
         process_die_if_needed();
     process_tick(in_kernel);
-    scheduler_yield(true);
+
+    struct cpu* cpu = cpu_get_current();
+    if (++cpu->ticks % LOAD_BALANCE_INTERVAL == 0 && atomic_load(&num_cpus) > 1)
+        balance_load(cpu);
+
+    // the running process is no longer switched out on every tick, so blocked
+    // processes have to be checked here to be woken up in time
+    unblock_processes();
+
+    if (should_preempt(cpu))
+        preempt_current(cpu);
+}
+
+void scheduler_handle_reschedule(void) {
+    struct cpu* cpu = cpu_get_current();
+    if (atomic_exchange(&cpu->need_resched, false))
+        preempt_current(cpu);
 }
 
-int scheduler_block(bool (*should_unblock)(void*), void* data) {
+void scheduler_set_policy(struct process* process, int policy, int priority) {
+    bool int_flag = push_cli();
+
+    // the process may be moved to another CPU until we hold the lock of the
+    // CPU it is on
+    struct cpu* cpu;
+    for (;;) {
+        cpu = process->cpu;
+        if (!cpu)
+            break;
+        spinlock_lock(&cpu->ready_queue_lock);
+        if (process->cpu == cpu)
+            break;
+        spinlock_unlock(&cpu->ready_queue_lock);
+    }
+
+    bool was_rt = is_rt(process);
+    bool requeue = cpu && process->queued;
+    if (requeue) {
+        if (was_rt)
+            rt_dequeue(cpu, process);
+        else
+            fair_dequeue(cpu, process);
+    }
+
+    process->policy = policy;
+    process->rt_priority = priority;
+
+    if (requeue) {
+        if (is_rt(process)) {
+            rt_enqueue(cpu, process);
+            if (wakeup_preempts(cpu, process)) {
+                atomic_store(&cpu->need_resched, true);
+                smp_send_reschedule(cpu);
+            }
+        } else {
+            fair_enqueue(cpu, process,
+                         was_rt ? PLACE_NEW : PLACE_REQUEUE);
+        }
+    } else if (cpu && was_rt && !is_rt(process)) {
+        // the vruntime was left behind while the process was real-time
+        process->vruntime = cpu->min_vruntime;
+    }
+
+    if (cpu)
+        spinlock_unlock(&cpu->ready_queue_lock);
+    pop_cli(int_flag);
+}
+
+static int block(should_unblock_fn should_unblock, void* data,
+                 bool interruptible) {
     ASSERT(!current->should_unblock);
     ASSERT(!current->blocker_data);
 
     if (should_unblock(data))
         return 0;
 
+    // the process must not be preempted between being marked as blocked and
+    // yielding, or it would be put in the ready queue while being blocked
+    bool int_flag = push_cli();
+
     current->state = PROCESS_STATE_BLOCKED;
     current->should_unblock = should_unblock;
     current->blocker_data = data;
+    current->blocker_is_interruptible = interruptible;
     current->blocker_was_interrupted = false;
+    current->blocked_at = uptime;
+    ++current->num_voluntary_switches;
 
     scheduler_yield(false);
 
+    pop_cli(int_flag);
+
     return current->blocker_was_interrupted ? -EINTR : 0;
 }
+
+int scheduler_block(should_unblock_fn should_unblock, void* data) {
+    return block(should_unblock, data, true);
+}
+
+void scheduler_block_uninterruptible(should_unblock_fn should_unblock,
+                                     void* data) {
+    int rc = block(should_unblock, data, false);
+    ASSERT_OK(rc);
+}
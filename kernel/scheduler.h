@@ -38,9 +38,13 @@
 #include "api/sys/types.h"
 #include "forward.h"
 #include <common/extra.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdnoreturn.h>
 
 void scheduler_init(void);
+NODISCARD int scheduler_init_cpu(struct cpu*);
+noreturn void scheduler_start(void);
 
 void scheduler_yield(bool requeue_current);
 void scheduler_register(struct process*);
@@ -48,5 +52,28 @@ void scheduler_unregister(struct process*);
 void scheduler_enqueue(struct process*);
 void scheduler_tick(bool in_kernel);
 
+// called on the reschedule IPI to switch to a woken real-time process
+void scheduler_handle_reschedule(void);
+
+// changes the scheduling policy of the process, moving it within the ready
+// queue if it is queued
+void scheduler_set_policy(struct process*, int policy, int priority);
+
+// Histogram of the time from a process being woken up to it getting to run,
+// in ticks. Bucket 0 counts processes that ran within the tick they were woken
+// up in, and bucket i > 0 counts latencies in [2^(i-1), 2^i) ticks, with the
+// last bucket also counting anything longer.
+#define SCHED_LATENCY_NUM_BUCKETS 10
+extern atomic_uint sched_latency_histogram[SCHED_LATENCY_NUM_BUCKETS];
+
 typedef bool (*should_unblock_fn)(void*);
 NODISCARD int scheduler_block(should_unblock_fn should_unblock, void* data);
+
+// signals don't interrupt the block
+void scheduler_block_uninterruptible(should_unblock_fn should_unblock,
+                                     void* data);
+
+// Blocked processes are checked for whether they can run again on every tick.
+// This checks the process right away, for when the caller has just made its
+// should_unblock true. The process must be known to be alive.
+void scheduler_wake(struct process*);
@@ -36,6 +36,7 @@
 #include "serial.h"
 #include "console/console.h"
 #include "interrupts.h"
+#include "lock.h"
 #include "panic.h"
 
 static void init_port(uint16_t port) {
@@ -108,10 +109,12 @@ static void write_char(uint16_t port, char c) {
     out8(port, c);
 }
 
+static spinlock write_lock;
+
 size_t serial_write(uint16_t port, const char* s, size_t count) {
     // this function is also called by kprintf, which can be used in critical
-    // situations, so we protect it by disabling interrupts, not with mutex.
-    bool int_flag = push_cli();
+    // situations, so we protect it with spinlock, not with mutex.
+    spinlock_lock(&write_lock);
 
     for (size_t i = 0; i < count; ++i) {
         if (s[i] == '\n')
@@ -119,6 +122,6 @@ size_t serial_write(uint16_t port, const char* s, size_t count) {
         write_char(port, s[i]);
     }
 
-    pop_cli(int_flag);
+    spinlock_unlock(&write_lock);
     return count;
 }
@@ -0,0 +1,441 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "cpu.h"
+#include "boot_defs.h"
+#include "interrupts.h"
+#include "kprintf.h"
+#include "memory/memory.h"
+#include "panic.h"
+#include "process.h"
+#include "scheduler.h"
+#include "system.h"
+#include <common/string.h>
+
+struct cpu cpus[MAX_NUM_CPUS] = {{.self = &cpus[0], .online = true}};
+atomic_size_t num_cpus = 1;
+
+#if defined(__i386__)
+
+#define MSR_PAT 0x277
+#define CR4_PGE 0x80
+
+struct acpi_rsdp {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+} __attribute__((packed));
+
+struct acpi_sdt_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+struct acpi_madt {
+    struct acpi_sdt_header header;
+    uint32_t lapic_address;
+    uint32_t flags;
+} __attribute__((packed));
+
+#define MADT_LAPIC 0
+#define MADT_LAPIC_ADDRESS_OVERRIDE 5
+
+#define MADT_LAPIC_ENABLED 0x1
+#define MADT_LAPIC_ONLINE_CAPABLE 0x2
+
+struct mp_floating_pointer {
+    char signature[4];
+    uint32_t config_table;
+    uint8_t length;
+    uint8_t spec_rev;
+    uint8_t checksum;
+    uint8_t features[5];
+} __attribute__((packed));
+
+struct mp_config_table {
+    char signature[4];
+    uint16_t length;
+    uint8_t spec_rev;
+    uint8_t checksum;
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entry_count;
+    uint32_t lapic_address;
+    uint16_t extended_table_length;
+    uint8_t extended_table_checksum;
+    uint8_t reserved;
+} __attribute__((packed));
+
+#define MP_ENTRY_PROCESSOR 0
+#define MP_PROCESSOR_ENTRY_SIZE 20
+#define MP_OTHER_ENTRY_SIZE 8
+#define MP_PROCESSOR_ENABLED 0x1
+
+typedef struct cpu_list {
+    uintptr_t lapic_paddr;
+    uint8_t apic_ids[MAX_NUM_CPUS];
+    size_t count;
+} cpu_list;
+
+static void cpu_list_add(cpu_list* list, uint8_t apic_id) {
+    if (list->count < MAX_NUM_CPUS)
+        list->apic_ids[list->count++] = apic_id;
+}
+
+static bool checksum_is_valid(const void* data, size_t size) {
+    const uint8_t* bytes = data;
+    uint8_t sum = 0;
+    for (size_t i = 0; i < size; ++i)
+        sum += bytes[i];
+    return sum == 0;
+}
+
+// Firmware tables may live anywhere in physical memory. They are small and
+// read only once, so they are kept mapped instead of being unmapped after use.
+static const void* map_physical(uintptr_t paddr, size_t size) {
+    uintptr_t aligned_paddr = round_down(paddr, PAGE_SIZE);
+    size_t mapped_size = round_up(paddr + size, PAGE_SIZE) - aligned_paddr;
+    uintptr_t vaddr = range_allocator_alloc(&kernel_vaddr_allocator, mapped_size);
+    if (IS_ERR(vaddr))
+        return ERR_PTR(vaddr);
+    int rc = paging_map_to_physical_range(vaddr, aligned_paddr, mapped_size, 0);
+    if (IS_ERR(rc))
+        return ERR_PTR(rc);
+    return (const void*)(vaddr + paddr - aligned_paddr);
+}
+
+// scans [paddr, paddr + size) in the low memory for a 16-byte aligned
+// structure starting with the signature
+static const void* find_in_low_memory(uintptr_t paddr, size_t size,
+                                      const char* signature,
+                                      size_t signature_len,
+                                      size_t struct_size) {
+    for (uintptr_t addr = paddr; addr + struct_size <= paddr + size; addr += 16) {
+        const void* p = (const void*)(addr + KERNEL_VADDR);
+        if (!memcmp(p, signature, signature_len) &&
+            checksum_is_valid(p, struct_size))
+            return p;
+    }
+    return NULL;
+}
+
+static uintptr_t get_ebda_paddr(void) {
+    return (uintptr_t)*(const volatile uint16_t*)(KERNEL_VADDR + 0x40e) << 4;
+}
+
+static const struct acpi_rsdp* find_rsdp(void) {
+    uintptr_t ebda = get_ebda_paddr();
+    const struct acpi_rsdp* rsdp = NULL;
+    if (ebda)
+        rsdp = find_in_low_memory(ebda, 0x400, "RSD PTR ", 8, sizeof(struct acpi_rsdp));
+    if (!rsdp)
+        rsdp = find_in_low_memory(0xe0000, 0x20000, "RSD PTR ", 8, sizeof(struct acpi_rsdp));
+    return rsdp;
+}
+
+static const struct acpi_sdt_header* map_sdt(uintptr_t paddr) {
+    const struct acpi_sdt_header* header = map_physical(paddr, sizeof(struct acpi_sdt_header));
+    if (IS_ERR(header))
+        return header;
+    header = map_physical(paddr, header->length);
+    if (IS_ERR(header))
+        return header;
+    if (!checksum_is_valid(header, header->length))
+        return ERR_PTR(-EINVAL);
+    return header;
+}
+
+static bool enumerate_cpus_from_madt(cpu_list* list) {
+    const struct acpi_rsdp* rsdp = find_rsdp();
+    if (!rsdp)
+        return false;
+
+    const struct acpi_sdt_header* rsdt = map_sdt(rsdp->rsdt_address);
+    if (IS_ERR(rsdt) || memcmp(rsdt->signature, "RSDT", 4))
+        return false;
+
+    const uint32_t* entries = (const uint32_t*)(rsdt + 1);
+    size_t num_entries = (rsdt->length - sizeof(struct acpi_sdt_header)) / sizeof(uint32_t);
+    const struct acpi_madt* madt = NULL;
+    for (size_t i = 0; i < num_entries; ++i) {
+        const struct acpi_sdt_header* header = map_sdt(entries[i]);
+        if (IS_OK(header) && !memcmp(header->signature, "APIC", 4)) {
+            madt = (const struct acpi_madt*)header;
+            break;
+        }
+    }
+    if (!madt)
+        return false;
+
+    list->lapic_paddr = madt->lapic_address;
+
+    const uint8_t* it = (const uint8_t*)(madt + 1);
+    const uint8_t* end = (const uint8_t*)madt + madt->header.length;
+    while (it + 2 <= end && it[1] >= 2) {
+        switch (it[0]) {
+        case MADT_LAPIC: {
+            // processor ID, APIC ID, flags
+            uint32_t flags = *(const uint32_t*)(it + 4);
+            if (flags & (MADT_LAPIC_ENABLED | MADT_LAPIC_ONLINE_CAPABLE))
+                cpu_list_add(list, it[3]);
+            break;
+        }
+        case MADT_LAPIC_ADDRESS_OVERRIDE:
+            list->lapic_paddr = *(const uint32_t*)(it + 4);
+            break;
+        }
+        it += it[1];
+    }
+
+    return list->count > 0;
+}
+
+static bool enumerate_cpus_from_mp_table(cpu_list* list) {
+    const size_t size = sizeof(struct mp_floating_pointer);
+    const struct mp_floating_pointer* fp = NULL;
+    uintptr_t ebda = get_ebda_paddr();
+    if (ebda)
+        fp = find_in_low_memory(ebda, 0x400, "_MP_", 4, size);
+    if (!fp)
+        fp = find_in_low_memory(0x9fc00, 0x400, "_MP_", 4, size);
+    if (!fp)
+        fp = find_in_low_memory(0xf0000, 0x10000, "_MP_", 4, size);
+    if (!fp || !fp->config_table)
+        return false;
+
+    const struct mp_config_table* table = map_physical(fp->config_table, sizeof(struct mp_config_table));
+    if (IS_ERR(table))
+        return false;
+    table = map_physical(fp->config_table, table->length);
+    if (IS_ERR(table) || memcmp(table->signature, "PCMP", 4) ||
+        !checksum_is_valid(table, table->length))
+        return false;
+
+    list->lapic_paddr = table->lapic_address;
+
+    const uint8_t* it = (const uint8_t*)(table + 1);
+    const uint8_t* end = (const uint8_t*)table + table->length;
+    for (size_t i = 0; i < table->entry_count && it < end; ++i) {
+        if (it[0] != MP_ENTRY_PROCESSOR) {
+            it += MP_OTHER_ENTRY_SIZE;
+            continue;
+        }
+        // type, APIC ID, APIC version, flags
+        if (it[3] & MP_PROCESSOR_ENABLED)
+            cpu_list_add(list, it[1]);
+        it += MP_PROCESSOR_ENTRY_SIZE;
+    }
+
+    return list->count > 0;
+}
+
+extern unsigned char smp_trampoline_start[];
+extern unsigned char smp_trampoline_end[];
+extern unsigned char smp_trampoline_page_directory[];
+extern unsigned char smp_trampoline_stack_top[];
+extern unsigned char smp_trampoline_entry_point[];
+
+static uint32_t* trampoline_slot(unsigned char* sym) {
+    return (uint32_t*)(KERNEL_VADDR + SMP_TRAMPOLINE_ADDR +
+                       (sym - smp_trampoline_start));
+}
+
+static struct cpu* volatile booting_cpu;
+static page_directory* boot_pd;
+static uint64_t pat;
+
+static noreturn void ap_start(void) {
+    struct cpu* cpu = booting_cpu;
+
+    gdt_init(cpu);
+    idt_flush();
+    cpu->pd = boot_pd;
+    paging_switch_page_directory(paging_kernel_page_directory());
+
+    write_cr4(read_cr4() | CR4_PGE);
+    write_msr(MSR_PAT, pat);
+    __asm__ volatile("fninit");
+
+    lapic_enable();
+    lapic_timer_start();
+
+    atomic_store(&cpu->online, true);
+    scheduler_start();
+}
+
+static bool start_ap(struct cpu* cpu) {
+    *trampoline_slot(smp_trampoline_stack_top) = cpu->scheduler_stack_top;
+    *trampoline_slot(smp_trampoline_entry_point) = (uintptr_t)ap_start;
+    booting_cpu = cpu;
+
+    lapic_send_init(cpu->apic_id);
+    delay(10000);
+    for (size_t i = 0; i < 2 && !atomic_load(&cpu->online); ++i) {
+        lapic_send_startup(cpu->apic_id, SMP_TRAMPOLINE_ADDR >> 12);
+        delay(200);
+    }
+
+    // wait for about a second
+    for (size_t i = 0; i < 100000 && !atomic_load(&cpu->online); ++i)
+        delay(10);
+
+    return atomic_load(&cpu->online);
+}
+
+static void handle_tlb_flush(registers* regs) {
+    (void)regs;
+    lapic_eoi();
+    smp_handle_pending_tlb_flush();
+}
+
+static void handle_reschedule(registers* regs) {
+    (void)regs;
+    lapic_eoi();
+    scheduler_handle_reschedule();
+}
+
+void smp_init(void) {
+    if (cmdline_contains("nosmp"))
+        return;
+
+    cpu_list list = {0};
+    if (!enumerate_cpus_from_madt(&list) && !enumerate_cpus_from_mp_table(&list))
+        return;
+    if (!lapic_init(list.lapic_paddr))
+        return;
+
+    lapic_enable();
+    cpus[0].apic_id = lapic_get_id();
+    if (list.count <= 1)
+        return;
+
+    idt_register_interrupt_handler(IPI_TLB_FLUSH_VECTOR, handle_tlb_flush);
+    idt_register_interrupt_handler(IPI_RESCHEDULE_VECTOR, handle_reschedule);
+
+    lapic_timer_calibrate();
+    pat = read_msr(MSR_PAT);
+
+    memcpy((void*)(KERNEL_VADDR + SMP_TRAMPOLINE_ADDR), smp_trampoline_start,
+           smp_trampoline_end - smp_trampoline_start);
+
+    boot_pd = paging_create_boot_page_directory();
+    ASSERT_OK(boot_pd);
+    *trampoline_slot(smp_trampoline_page_directory) =
+        paging_virtual_to_physical_addr((uintptr_t)boot_pd);
+
+    size_t num_online = 1;
+    for (size_t i = 0; i < list.count; ++i) {
+        uint8_t apic_id = list.apic_ids[i];
+        if (apic_id == cpus[0].apic_id)
+            continue;
+
+        size_t id = atomic_load(&num_cpus);
+        struct cpu* cpu = cpus + id;
+        cpu->id = id;
+        cpu->apic_id = apic_id;
+        ASSERT_OK(scheduler_init_cpu(cpu));
+        atomic_fetch_add(&num_cpus, 1);
+
+        if (start_ap(cpu))
+            ++num_online;
+        else
+            kprintf("SMP: CPU with APIC ID %u did not start\n", apic_id);
+    }
+
+    kfree(boot_pd);
+    boot_pd = NULL;
+
+    kprintf("SMP: %u CPUs online\n", num_online);
+}
+
+void smp_flush_tlb_others(void) {
+    if (atomic_load(&num_cpus) <= 1)
+        return;
+
+    bool int_flag = push_cli();
+
+    struct cpu* self = cpu_get_current();
+    size_t n = atomic_load(&num_cpus);
+    unsigned targets[MAX_NUM_CPUS];
+    uint32_t target_mask = 0;
+    for (size_t i = 0; i < n; ++i) {
+        struct cpu* cpu = cpus + i;
+        if (cpu == self || !atomic_load(&cpu->online))
+            continue;
+        targets[i] = atomic_fetch_add(&cpu->tlb_flush_requests, 1) + 1;
+        target_mask |= 1 << i;
+        lapic_send_ipi(cpu->apic_id, IPI_TLB_FLUSH_VECTOR);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        struct cpu* cpu = cpus + i;
+        if (!(target_mask & (1 << i)))
+            continue;
+        // other CPUs may be waiting for us at the same time
+        while ((int)(atomic_load(&cpu->tlb_flush_done) - targets[i]) < 0) {
+            smp_handle_pending_tlb_flush();
+            pause();
+        }
+    }
+
+    pop_cli(int_flag);
+}
+
+void smp_handle_pending_tlb_flush(void) {
+    ASSERT(!interrupts_enabled());
+    struct cpu* cpu = cpu_get_current();
+    unsigned requests = atomic_load(&cpu->tlb_flush_requests);
+    if (requests == atomic_load(&cpu->tlb_flush_done))
+        return;
+    flush_tlb_all();
+    atomic_store(&cpu->tlb_flush_done, requests);
+}
+
+void smp_send_reschedule(struct cpu* cpu) {
+    if (cpu != cpu_get_current() && atomic_load(&cpu->online))
+        lapic_send_ipi(cpu->apic_id, IPI_RESCHEDULE_VECTOR);
+}
+
+#endif
@@ -35,26 +35,212 @@
 
 #pragma once
 
+#include "api/sys/socket.h"
 #include "fs/fs.h"
 #include "ring_buf.h"
 
+// one direction of a connection, or the receive queue of a SOCK_DGRAM socket
+typedef struct unix_channel {
+    ring_buf buf;
+
+    // descriptors in flight, in the order they were sent, guarded by buf.lock
+    struct unix_rights* rights;
+} unix_channel;
+
 typedef struct unix_socket {
     struct inode inode;
+    int type;
     int backlog;
 
+    // On a listening socket, the FIFO of sockets waiting to be accepted,
+    // linked through their next, and the FIFO of processes blocked in
+    // accept().
     mutex pending_queue_lock;
     atomic_size_t num_pending;
-    struct unix_socket* next; // pending queue
+    struct unix_socket* next;
+    struct unix_socket* pending_tail;
+    struct accept_waiter* accept_waiters;
+    struct accept_waiter* accept_waiters_tail;
 
     atomic_bool connected;
     file_description* connector_fd;
 
-    ring_buf server_to_client_buf;
-    ring_buf client_to_server_buf;
+    // the process blocked in connect(), guarded by pending_queue_lock of the
+    // listener
+    struct process* connecting_process;
+
+    // where a SOCK_DGRAM socket that isn't one of a pair sends to by default
+    _Atomic(struct unix_socket*) peer;
+
+    unix_channel server_to_client;
+    unix_channel client_to_server;
 } unix_socket;
 
-unix_socket* unix_socket_create(void);
+unix_socket* unix_socket_create(int type);
 void unix_socket_set_backlog(unix_socket*, int backlog);
-NODISCARD unix_socket* unix_socket_accept(unix_socket* listener);
+NODISCARD unix_socket* unix_socket_accept(unix_socket* listener,
+                                         bool nonblock);
 NODISCARD int unix_socket_connect(file_description* connector_fd,
                                   unix_socket* listener);
+
+// Sends to dest if given, which only SOCK_DGRAM sockets may do, and to the
+// other end of the connection otherwise.
+NODISCARD ssize_t unix_socket_sendmsg(file_description*, unix_socket* dest,
+                                      const msghdr*);
+NODISCARD ssize_t unix_socket_recvmsg(file_description*, msghdr*);
+
+// resize the channel that desc receives from or sends to
+NODISCARD int unix_socket_get_buf_size(file_description*, bool send);
+NODISCARD int unix_socket_set_buf_size(file_description*, bool send,
+                                       size_t size);
+
+enum {
+    TCP_CLOSED,
+    TCP_LISTEN,
+    TCP_SYN_SENT,
+    TCP_SYN_RECEIVED,
+    TCP_ESTABLISHED,
+    TCP_FIN_WAIT_1,
+    TCP_FIN_WAIT_2,
+    TCP_CLOSE_WAIT,
+    TCP_CLOSING,
+    TCP_LAST_ACK,
+    TCP_TIME_WAIT,
+};
+
+// The state of a TCP connection, guarded by the lock of its socket. Sequence
+// numbers are in host byte order.
+struct tcp_state {
+    int state;
+
+    uint32_t iss;
+    uint32_t snd_una; // oldest unacknowledged sequence number
+    uint32_t snd_nxt; // next sequence number to send
+    uint32_t snd_max; // highest sequence number sent so far
+    uint32_t snd_wnd; // window advertised by the peer
+    uint32_t rcv_nxt; // next sequence number expected
+    uint32_t rcv_adv; // right edge of the window last advertised
+    size_t mss;       // largest segment the peer accepts
+
+    // send_buf starts at snd_una and holds the unacknowledged and unsent data
+    ring_buf send_buf;
+    ring_buf recv_buf;
+
+    bool nodelay;
+    bool orphan;     // no descriptor refers to the socket
+    bool fin_queued; // close() was called, so FIN follows the data
+    bool fin_sent;
+    bool ack_now;
+    unsigned segs_unacked; // received full segments not acknowledged yet
+
+    // Deadlines in ticks of uptime, or 0 when not armed. rtx_deadline also
+    // serves as the persist timer while the peer's window is zero.
+    uint32_t rtx_deadline;
+    uint32_t delack_deadline;
+    uint32_t time_wait_deadline;
+    unsigned rto;
+    unsigned num_retransmits;
+
+    // On a listener, the established connections waiting to be accepted,
+    // linked through next_pending. num_pending also counts the connections
+    // still in SYN_RECEIVED.
+    struct inet_socket* accept_head;
+    struct inet_socket* accept_tail;
+    struct inet_socket* next_pending;
+    atomic_size_t num_pending;
+
+    // the listener of a connection in SYN_RECEIVED, with a reference
+    struct inet_socket* listener;
+};
+
+// AF_INET sockets: SOCK_STREAM for TCP, and SOCK_DGRAM for UDP and for ICMP
+// echo ("ping") sockets, which are told apart by protocol.
+typedef struct inet_socket {
+    struct inode inode;
+    int type;
+    int protocol;
+
+    // guards everything below except the fields of the socket table
+    mutex lock;
+
+    // Addresses and ports in network byte order. They are only changed with
+    // the table lock held as well, so that lookups can read them.
+    uint32_t local_ip;
+    uint16_t local_port;
+    uint32_t remote_ip;
+    uint16_t remote_port;
+    bool connected;
+    int error; // reported by the next operation, e.g. -ECONNREFUSED
+    int backlog;
+
+    // processes blocked on the socket, woken up on every change
+    struct inet_waiter* waiters;
+
+    // received datagrams and the number of bytes they take up
+    struct packet* rx_head;
+    struct packet* rx_tail;
+    size_t rx_bytes;
+    size_t rcvbuf;
+
+    struct tcp_state tcp;
+
+    // in the socket table, which is guarded by its own lock
+    bool hashed;
+    struct inet_socket* next_hashed;
+} inet_socket;
+
+bool inode_is_inet_socket(const struct inode*);
+NODISCARD inet_socket* inet_socket_create(int type, int protocol);
+
+NODISCARD int inet_socket_bind(inet_socket*, const sockaddr*, socklen_t);
+NODISCARD int inet_socket_listen(inet_socket*, int backlog);
+NODISCARD inet_socket* inet_socket_accept(file_description*, sockaddr* addr,
+                                          socklen_t* addrlen);
+NODISCARD int inet_socket_connect(file_description*, const sockaddr*,
+                                  socklen_t);
+NODISCARD ssize_t inet_socket_sendmsg(file_description*, const msghdr*);
+NODISCARD ssize_t inet_socket_recvmsg(file_description*, msghdr*);
+NODISCARD int inet_socket_getsockopt(file_description*, int level,
+                                     int optname, void* optval,
+                                     socklen_t* optlen);
+NODISCARD int inet_socket_setsockopt(file_description*, int level,
+                                     int optname, const void* optval,
+                                     socklen_t optlen);
+
+// Between the socket layer and the protocols. The socket table takes a
+// reference to the sockets in it. Its lock may be taken before the lock of a
+// socket, but not while holding one.
+
+// Returns the socket that a packet for the given addresses is for, with a
+// reference, preferring connected sockets and then specific local addresses.
+inet_socket* inet_socket_lookup(int protocol, uint32_t local_ip,
+                                uint16_t local_port, uint32_t remote_ip,
+                                uint16_t remote_port);
+void inet_socket_hash(inet_socket*);
+void inet_socket_unhash(inet_socket*);
+
+// Calls fn on every socket of protocol in the table, and removes the ones
+// for which it returns true.
+void inet_socket_sweep(int protocol, bool (*fn)(inet_socket*, void* ctx),
+                       void* ctx);
+
+// Blocks until should_unblock returns true, with the lock of the socket held
+// by the caller released in the meantime.
+NODISCARD int inet_socket_wait(inet_socket*,
+                               bool (*should_unblock)(inet_socket*));
+// wakes up the waiters and pollers after the state of the socket changed
+void inet_socket_notify(inet_socket*);
+
+// queues a datagram on a UDP or ping socket, taking ownership of it
+void inet_socket_deliver(inet_socket*, struct packet*);
+
+NODISCARD int tcp_init_socket(inet_socket*);
+void tcp_destroy_socket(inet_socket*);
+NODISCARD int tcp_listen(inet_socket*, int backlog);
+NODISCARD inet_socket* tcp_accept(inet_socket* listener, bool nonblock);
+NODISCARD int tcp_connect(inet_socket*, bool nonblock);
+NODISCARD ssize_t tcp_sendmsg(inet_socket*, const msghdr*, bool nonblock);
+NODISCARD ssize_t tcp_recvmsg(inet_socket*, msghdr*, bool nonblock);
+void tcp_close(inet_socket*);
+short tcp_poll(inet_socket*, short events);
+NODISCARD int tcp_set_buf_size(inet_socket*, bool send, size_t size);
@@ -35,7 +35,11 @@
 
 #include <kernel/api/err.h>
 #include <kernel/api/errno.h>
+#include <kernel/api/fcntl.h>
+#include <kernel/api/sys/timerfd.h>
 #include <kernel/api/time.h>
+#include <kernel/fs/fs.h>
+#include <kernel/process.h>
 #include <kernel/scheduler.h>
 #include <kernel/system.h>
 
@@ -50,32 +54,6 @@ int sys_clock_gettime(clockid_t clk_id, struct timespec* tp) {
     }
 }
 
-static void timespec_add(struct timespec* this, const struct timespec* other) {
-    this->tv_sec += other->tv_sec;
-    this->tv_nsec += other->tv_nsec;
-    if (this->tv_nsec >= 1000000000) {
-        ++this->tv_sec;
-        this->tv_nsec -= 1000000000;
-    }
-}
-
-static void timespec_saturating_sub(struct timespec* this, const struct timespec* other) {
-    this->tv_sec -= other->tv_sec;
-    this->tv_nsec -= other->tv_nsec;
-    if (this->tv_nsec < 0) {
-        --this->tv_sec;
-        this->tv_nsec += 1000000000;
-    }
-    if (this->tv_sec < 0)
-        this->tv_sec = this->tv_nsec = 0;
-}
-
-static bool sleep_should_unblock(const struct timespec* deadline) {
-    struct timespec now = {0};
-    time_now(&now);
-    return now.tv_sec > deadline->tv_sec || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
-}
-
 int sys_clock_nanosleep(clockid_t clockid, int flags, const struct timespec* request, struct timespec* remain) {
     switch (clockid) {
     case CLOCK_REALTIME:
@@ -102,7 +80,7 @@ int sys_clock_nanosleep(clockid_t clockid, int flags, const struct timespec* req
     }
 
     int rc =
-        scheduler_block((should_unblock_fn)sleep_should_unblock, &deadline);
+        scheduler_block((should_unblock_fn)time_has_passed, &deadline);
     if (IS_ERR(rc))
         return rc;
     if (remain) {
@@ -115,3 +93,45 @@ int sys_clock_nanosleep(clockid_t clockid, int flags, const struct timespec* req
     }
     return 0;
 }
+
+int sys_timerfd_create(clockid_t clockid, int flags) {
+    switch (clockid) {
+    case CLOCK_REALTIME:
+    case CLOCK_MONOTONIC:
+        break;
+    default:
+        return -EINVAL;
+    }
+    if (flags & ~TFD_NONBLOCK)
+        return -EINVAL;
+
+    struct inode* timer = timerfd_create();
+    if (IS_ERR(timer))
+        return PTR_ERR(timer);
+    file_description* desc =
+        inode_open(timer, O_RDONLY | (flags & TFD_NONBLOCK), 0);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+
+    int fd = process_alloc_file_descriptor(-1, desc);
+    if (IS_ERR(fd))
+        file_description_close(desc);
+    return fd;
+}
+
+int sys_timerfd_settime(int fd, int flags, const struct itimerspec* new_value,
+                        struct itimerspec* old_value) {
+    if (flags & ~TFD_TIMER_ABSTIME)
+        return -EINVAL;
+    file_description* desc = process_get_file_description(fd);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+    return timerfd_settime(desc->inode, flags, new_value, old_value);
+}
+
+int sys_timerfd_gettime(int fd, struct itimerspec* curr_value) {
+    file_description* desc = process_get_file_description(fd);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+    return timerfd_gettime(desc->inode, curr_value);
+}
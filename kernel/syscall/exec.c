@@ -38,6 +38,7 @@
 #include <common/string.h>
 #include <kernel/api/elf.h>
 #include <kernel/api/fcntl.h>
+#include <kernel/api/vdso.h>
 #include <kernel/asm_wrapper.h>
 #include <kernel/boot_defs.h>
 #include <kernel/panic.h>
@@ -232,6 +233,17 @@ int sys_execve(const char* pathname, char* const argv[], char* const envp[]) {
         return PTR_ERR(new_pd);
     }
 
+    struct vm* new_vm = process_create_vm(new_pd);
+    if (IS_ERR(new_vm)) {
+        kfree(executable_buf);
+        string_list_destroy(&copied_argv);
+        string_list_destroy(&copied_envp);
+        paging_switch_page_directory(new_pd);
+        paging_destroy_current_page_directory();
+        paging_switch_page_directory(prev_pd);
+        return PTR_ERR(new_vm);
+    }
+
     paging_switch_page_directory(new_pd);
 
     // after this point, we have to revert to prev_pd if we want to abort.
@@ -268,14 +280,18 @@ int sys_execve(const char* pathname, char* const argv[], char* const envp[]) {
     kfree(executable_buf);
     executable_buf = NULL;
 
-    range_allocator vaddr_allocator;
-    ret = range_allocator_init(&vaddr_allocator, max_segment_addr, KERNEL_VADDR);
+    range_allocator* vaddr_allocator = &new_vm->vaddr_allocator;
+    // the vDSO data page sits right below the kernel
+    ret = range_allocator_init(vaddr_allocator, max_segment_addr, VDSO_DATA_ADDR);
+    if (IS_ERR(ret))
+        goto fail;
+    ret = vdso_map();
     if (IS_ERR(ret))
         goto fail;
 
     // we keep extra pages before and after stack unmapped to detect stack
     // overflow and underflow by causing page faults
-    uintptr_t stack_region = range_allocator_alloc(&vaddr_allocator, 2 * PAGE_SIZE + STACK_SIZE);
+    uintptr_t stack_region = range_allocator_alloc(vaddr_allocator, 2 * PAGE_SIZE + STACK_SIZE);
     if (IS_ERR(stack_region)) {
         ret = stack_region;
         goto fail;
@@ -333,17 +349,21 @@ int sys_execve(const char* pathname, char* const argv[], char* const envp[]) {
     if (IS_ERR(ret))
         goto fail;
 
-    paging_switch_page_directory(prev_pd);
-    paging_destroy_current_page_directory();
+    // other threads would keep running the old program in the address
+    // space that is going away
+    process_kill_other_threads();
+
+    process_release_vm();
     paging_switch_page_directory(new_pd);
 
     cli();
 
-    current->vaddr_allocator = vaddr_allocator;
+    current->vm = new_vm;
+    current->tls_base = 0;
     current->eip = entry_point;
     current->esp = current->ebp = current->stack_top;
     current->ebx = current->esi = current->edi = 0;
-    current->fpu_state = initial_fpu_state;
+    fpu_reset_current();
 
     strlcpy(current->comm, comm, sizeof(current->comm));
 
@@ -378,6 +398,7 @@ fail:
 
     paging_destroy_current_page_directory();
     paging_switch_page_directory(prev_pd);
+    kfree(new_vm);
 
     return ret;
     #endif
@@ -33,10 +33,16 @@
  *  THE SOFTWARE.
  */
 
+#include <common/string.h>
 #include <kernel/api/err.h>
 #include <kernel/api/fcntl.h>
+#include <kernel/api/poll.h>
+#include <kernel/api/sys/eventfd.h>
 #include <kernel/api/sys/stat.h>
+#include <kernel/api/sys/uio.h>
+#include <kernel/api/unistd.h>
 #include <kernel/fs/fs.h>
+#include <kernel/memory/memory.h>
 #include <kernel/panic.h>
 #include <kernel/process.h>
 #include <kernel/system.h>
@@ -74,6 +80,108 @@ ssize_t sys_write(int fd, const void* buf, size_t count) {
     return file_description_write(desc, buf, count);
 }
 
+ssize_t sys_pread(int fd, void* buf, size_t count, off_t offset) {
+    file_description* desc = process_get_file_description(fd);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+    return file_description_pread(desc, buf, count, offset);
+}
+
+ssize_t sys_pwrite(int fd, const void* buf, size_t count, off_t offset) {
+    file_description* desc = process_get_file_description(fd);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+    return file_description_pwrite(desc, buf, count, offset);
+}
+
+// returns the total length of the iovecs
+static ssize_t validate_iov(const struct iovec* iov, int iovcnt) {
+    if (iovcnt < 0 || iovcnt > IOV_MAX)
+        return -EINVAL;
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        // the total has to fit in the ssize_t return value
+        if (iov[i].iov_len > (size_t)INT32_MAX - total)
+            return -EINVAL;
+        total += iov[i].iov_len;
+    }
+    return total;
+}
+
+// A pipe only keeps a single write of up to PIPE_BUF bytes in one piece, so
+// such a vector is gathered and written at once.
+static ssize_t gather_write(file_description* desc, const struct iovec* iov,
+                            int iovcnt, size_t total) {
+    unsigned char* buf = kmalloc(total);
+    if (!buf)
+        return -ENOMEM;
+    unsigned char* p = buf;
+    for (int i = 0; i < iovcnt; ++i) {
+        memcpy(p, iov[i].iov_base, iov[i].iov_len);
+        p += iov[i].iov_len;
+    }
+    ssize_t rc = file_description_write(desc, buf, total);
+    kfree(buf);
+    return rc;
+}
+
+// Transfers the iovecs one by one, stopping at the first short transfer or
+// when the next one would block. The offset_lock is held throughout for
+// regular files so that the vector ends up contiguous even when other
+// threads use the same description.
+static ssize_t transfer_iov(file_description* desc, const struct iovec* iov,
+                            int iovcnt, bool write) {
+    ssize_t len = validate_iov(iov, iovcnt);
+    if (IS_ERR(len))
+        return len;
+    if (write && iovcnt > 1 && len > 0 && len <= PIPE_BUF &&
+        S_ISFIFO(desc->inode->mode))
+        return gather_write(desc, iov, iovcnt, len);
+
+    bool is_reg = S_ISREG(desc->inode->mode);
+    if (is_reg)
+        mutex_lock(&desc->offset_lock);
+
+    short event = write ? POLLOUT : POLLIN;
+    ssize_t total = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        if (iov[i].iov_len == 0)
+            continue;
+        if (total > 0 && !(file_description_poll(desc, event) & event))
+            break;
+        ssize_t n = write ? file_description_write(desc, iov[i].iov_base,
+                                                   iov[i].iov_len)
+                          : file_description_read(desc, iov[i].iov_base,
+                                                  iov[i].iov_len);
+        if (IS_ERR(n)) {
+            if (total == 0)
+                total = n;
+            break;
+        }
+        total += n;
+        if ((size_t)n < iov[i].iov_len)
+            break;
+    }
+
+    if (is_reg)
+        mutex_unlock(&desc->offset_lock);
+    return total;
+}
+
+ssize_t sys_readv(int fd, const struct iovec* iov, int iovcnt) {
+    file_description* desc = process_get_file_description(fd);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+    return transfer_iov(desc, iov, iovcnt, false);
+}
+
+ssize_t sys_writev(int fd, const struct iovec* iov, int iovcnt) {
+    file_description* desc = process_get_file_description(fd);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+    return transfer_iov(desc, iov, iovcnt, true);
+}
+
 int sys_ftruncate(int fd, off_t length) {
     file_description* desc = process_get_file_description(fd);
     if (IS_ERR(desc))
@@ -349,6 +457,10 @@ int sys_fcntl(int fd, int cmd, uintptr_t arg) {
     case F_SETFL:
         desc->flags = arg;
         return 0;
+    case F_GETPIPE_SZ:
+        return fifo_get_size(desc);
+    case F_SETPIPE_SZ:
+        return fifo_set_size(desc, arg);
     default:
         return -EINVAL;
     }
@@ -413,3 +525,21 @@ int sys_pipe(int fifofd[2]) {
 
     return 0;
 }
+
+int sys_eventfd(unsigned initval, int flags) {
+    if (flags & ~(EFD_SEMAPHORE | EFD_NONBLOCK))
+        return -EINVAL;
+
+    struct inode* eventfd = eventfd_create(initval, flags);
+    if (IS_ERR(eventfd))
+        return PTR_ERR(eventfd);
+    file_description* desc =
+        inode_open(eventfd, O_RDWR | (flags & EFD_NONBLOCK), 0);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+
+    int fd = process_alloc_file_descriptor(-1, desc);
+    if (IS_ERR(fd))
+        file_description_close(desc);
+    return fd;
+}
@@ -0,0 +1,208 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <kernel/api/err.h>
+#include <kernel/api/futex.h>
+#include <kernel/api/time.h>
+#include <kernel/lock.h>
+#include <kernel/memory/memory.h>
+#include <kernel/process.h>
+#include <kernel/scheduler.h>
+#include <kernel/system.h>
+
+// Waiters are keyed by the physical address of the futex word, so processes
+// waiting on a shared page meet in the same queue regardless of where the
+// page is mapped in their address spaces.
+
+struct futex_waiter {
+    uintptr_t key;
+    atomic_bool woken;
+    struct futex_waiter* next;
+};
+
+// waiters are woken in FIFO order
+struct futex_queue {
+    spinlock lock;
+    struct futex_waiter* head;
+    struct futex_waiter* tail;
+};
+
+#define NUM_QUEUES 64
+
+static struct futex_queue queues[NUM_QUEUES];
+
+static struct futex_queue* get_queue(uintptr_t key) {
+    // Fibonacci hashing of the word index
+    uint32_t hash = (key >> 2) * 0x9e3779b9;
+    return queues + (hash >> 26);
+}
+
+static void remove_waiter(struct futex_queue* queue,
+                          struct futex_waiter* prev,
+                          struct futex_waiter* waiter) {
+    if (prev)
+        prev->next = waiter->next;
+    else
+        queue->head = waiter->next;
+    if (queue->tail == waiter)
+        queue->tail = prev;
+}
+
+struct futex_blocker {
+    struct futex_waiter* waiter;
+    bool has_deadline;
+    struct timespec deadline;
+};
+
+static bool futex_should_unblock(struct futex_blocker* blocker) {
+    if (blocker->waiter->woken)
+        return true;
+    return blocker->has_deadline && time_has_passed(&blocker->deadline);
+}
+
+// Called with the vm lock held, which keeps the futex word mapped while it is
+// read. The lock is released once the waiter is queued.
+static int futex_wait(struct vm* vm, uint32_t* uaddr, uintptr_t key,
+                      uint32_t val, const struct timespec* timeout) {
+    struct futex_blocker blocker = {0};
+    if (timeout) {
+        blocker.has_deadline = true;
+        time_now(&blocker.deadline);
+        timespec_add(&blocker.deadline, timeout);
+    }
+
+    struct futex_waiter waiter = {.key = key};
+    blocker.waiter = &waiter;
+
+    // Comparing the word and queueing the waiter under the queue lock makes
+    // sure a FUTEX_WAKE after the word changes can't miss us.
+    struct futex_queue* queue = get_queue(key);
+    spinlock_lock(&queue->lock);
+    if (*(volatile uint32_t*)uaddr != val) {
+        spinlock_unlock(&queue->lock);
+        mutex_unlock(&vm->lock);
+        return -EAGAIN;
+    }
+    if (queue->tail)
+        queue->tail->next = &waiter;
+    else
+        queue->head = &waiter;
+    queue->tail = &waiter;
+    spinlock_unlock(&queue->lock);
+    mutex_unlock(&vm->lock);
+
+    int rc = scheduler_block((should_unblock_fn)futex_should_unblock, &blocker);
+
+    // the waker dequeues the waiters it wakes, so we only have to dequeue
+    // ourselves if we gave up waiting
+    spinlock_lock(&queue->lock);
+    bool woken = waiter.woken;
+    if (!woken) {
+        struct futex_waiter* prev = NULL;
+        struct futex_waiter* it = queue->head;
+        for (; it != &waiter; it = it->next)
+            prev = it;
+        remove_waiter(queue, prev, &waiter);
+    }
+    spinlock_unlock(&queue->lock);
+
+    if (woken)
+        return 0;
+    if (IS_ERR(rc))
+        return rc;
+    return -ETIMEDOUT;
+}
+
+static int futex_wake(uintptr_t key, uint32_t count) {
+    struct futex_queue* queue = get_queue(key);
+    int num_woken = 0;
+
+    spinlock_lock(&queue->lock);
+    struct futex_waiter* prev = NULL;
+    struct futex_waiter* it = queue->head;
+    while (it && (uint32_t)num_woken < count) {
+        struct futex_waiter* next = it->next;
+        if (it->key == key) {
+            remove_waiter(queue, prev, it);
+            it->woken = true;
+            ++num_woken;
+        } else {
+            prev = it;
+        }
+        it = next;
+    }
+    spinlock_unlock(&queue->lock);
+
+    return num_woken;
+}
+
+int sys_futex(uint32_t* uaddr, int op, uint32_t val,
+              const struct timespec* timeout) {
+    if ((uintptr_t)uaddr % sizeof(uint32_t))
+        return -EINVAL;
+    op &= ~FUTEX_PRIVATE_FLAG;
+    if (op != FUTEX_WAIT && op != FUTEX_WAKE)
+        return -ENOSYS;
+    if (op == FUTEX_WAIT && timeout &&
+        (timeout->tv_nsec < 0 || timeout->tv_nsec >= 1000000000))
+        return -EINVAL;
+
+    // Another thread may munmap() the word at any time. Holding the vm lock
+    // keeps it mapped until FUTEX_WAIT has read it.
+    struct vm* vm = current->vm;
+    mutex_lock(&vm->lock);
+    uintptr_t key = paging_user_virtual_to_physical_addr((uintptr_t)uaddr);
+    if (IS_ERR(key)) {
+        mutex_unlock(&vm->lock);
+        return key;
+    }
+    if (op == FUTEX_WAIT)
+        return futex_wait(vm, uaddr, key, val, timeout);
+    mutex_unlock(&vm->lock);
+    return futex_wake(key, val);
+}
+
+void futex_clear_and_wake(pid_t* uaddr) {
+    if ((uintptr_t)uaddr % sizeof(uint32_t))
+        return;
+    struct vm* vm = current->vm;
+    mutex_lock(&vm->lock);
+    uintptr_t key = paging_user_virtual_to_physical_addr((uintptr_t)uaddr);
+    if (IS_OK(key))
+        *(volatile pid_t*)uaddr = 0;
+    mutex_unlock(&vm->lock);
+    if (IS_OK(key))
+        futex_wake(key, UINT32_MAX);
+}
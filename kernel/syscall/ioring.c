@@ -0,0 +1,362 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "syscall.h"
+#include <common/extra.h>
+#include <kernel/api/err.h>
+#include <kernel/api/fcntl.h>
+#include <kernel/api/ioring.h>
+#include <kernel/api/poll.h>
+#include <kernel/fs/fs.h>
+#include <kernel/growable_buf.h>
+#include <kernel/memory/memory.h>
+#include <kernel/panic.h>
+#include <kernel/process.h>
+#include <kernel/scheduler.h>
+#include <kernel/system.h>
+
+// an operation that was submitted but couldn't complete without blocking
+struct pending_op {
+    struct ioring_sqe sqe;
+    file_description* desc; // NULL for IORING_OP_NANOSLEEP
+    struct timespec deadline;
+    struct pending_op* next;
+};
+
+struct ioring_file {
+    struct inode inode;
+
+    // serializes ioring_enter()
+    mutex lock;
+
+    // memory shared with userland, starting with struct ioring
+    growable_buf buf;
+
+    // Private copies of the sizes and of the indices the kernel produces.
+    // The ones in the shared memory are only written to, as userland can
+    // overwrite them at any time.
+    uint32_t sq_entries, cq_entries;
+    uint32_t sq_head, cq_tail;
+    uint32_t cq_overflow;
+
+    // operations run in the address space of the thread group that created
+    // the ring, as the addresses in SQEs point into it
+    pid_t tgid;
+
+    // pending operations in the order of submission
+    struct pending_op* pending;
+    struct pending_op** pending_tail;
+    size_t num_pending;
+};
+
+static struct ioring* ring_of(struct ioring_file* file) {
+    return (struct ioring*)file->buf.addr;
+}
+
+static void ioring_destroy_inode(struct inode* inode) {
+    struct ioring_file* file = (struct ioring_file*)inode;
+    struct pending_op* op = file->pending;
+    while (op) {
+        struct pending_op* next = op->next;
+        if (op->desc)
+            file_description_close(op->desc);
+        kfree(op);
+        op = next;
+    }
+    growable_buf_destroy(&file->buf);
+    kfree(file);
+}
+
+static uintptr_t ioring_mmap(file_description* desc, uintptr_t addr,
+                             size_t length, off_t offset,
+                             uint16_t page_flags) {
+    struct ioring_file* file = (struct ioring_file*)desc->inode;
+    // the ring never grows after ioring_setup()
+    if (offset + length > file->buf.size)
+        return -EINVAL;
+    return growable_buf_mmap(&file->buf, addr, length, offset, page_flags);
+}
+
+static short ioring_poll(file_description* desc, short events) {
+    struct ioring_file* file = (struct ioring_file*)desc->inode;
+    if ((events & POLLIN) && file->cq_tail != ring_of(file)->cq_head)
+        return POLLIN;
+    return 0;
+}
+
+// number of CQEs that userland hasn't consumed yet
+static uint32_t cq_used(struct ioring_file* file) {
+    uint32_t used = file->cq_tail - ring_of(file)->cq_head;
+
+    // userland moved cq_head past cq_tail. Treat the queue as full.
+    return MIN(used, file->cq_entries);
+}
+
+static void post_completion(struct ioring_file* file, uint64_t user_data,
+                            int res) {
+    struct ioring* ring = ring_of(file);
+
+    // Submission keeps room for the CQE of every operation in flight, so
+    // the queue only overflows if userland moved cq_head backwards. The
+    // CQE is dropped and counted.
+    if (cq_used(file) >= file->cq_entries) {
+        ring->cq_overflow = ++file->cq_overflow;
+        return;
+    }
+
+    struct ioring_cqe* cqe =
+        (struct ioring_cqe*)(IORING_SQES(ring) + file->sq_entries) +
+        (file->cq_tail & (file->cq_entries - 1));
+    *cqe = (struct ioring_cqe){.user_data = user_data, .res = res};
+
+    // publish the CQE before the new tail
+    atomic_thread_fence(memory_order_release);
+    ring->cq_tail = ++file->cq_tail;
+    inode_notify_poll(&file->inode);
+}
+
+static short events_to_wait_for(const struct pending_op* op) {
+    switch (op->sqe.opcode) {
+    case IORING_OP_READ:
+    case IORING_OP_ACCEPT:
+        return POLLIN;
+    case IORING_OP_WRITE:
+        return POLLOUT;
+    case IORING_OP_POLL:
+        return op->sqe.poll_events;
+    }
+    UNREACHABLE();
+}
+
+// Called with interrupts disabled from scheduler_block() too, so this
+// mustn't block.
+static bool op_is_ready(const struct pending_op* op) {
+    switch (op->sqe.opcode) {
+    case IORING_OP_NOP:
+        return true;
+    case IORING_OP_NANOSLEEP:
+        return time_has_passed(&op->deadline);
+    }
+    short events = events_to_wait_for(op) | POLLERR | POLLHUP;
+    return file_description_poll(op->desc, events) & events;
+}
+
+static int run_op(const struct pending_op* op) {
+    const struct ioring_sqe* sqe = &op->sqe;
+    switch (sqe->opcode) {
+    case IORING_OP_NOP:
+    case IORING_OP_NANOSLEEP:
+        return 0;
+    case IORING_OP_READ:
+        return file_description_read(op->desc, (void*)sqe->addr, sqe->len);
+    case IORING_OP_WRITE:
+        return file_description_write(op->desc, (const void*)sqe->addr,
+                                      sqe->len);
+    case IORING_OP_ACCEPT:
+        return socket_accept(op->desc, (struct sockaddr*)sqe->addr,
+                             (socklen_t*)sqe->len);
+    case IORING_OP_POLL:
+        return file_description_poll(op->desc,
+                                     sqe->poll_events | POLLERR | POLLHUP);
+    }
+    UNREACHABLE();
+}
+
+// Consumes an SQE. The operation is queued as pending, or completes right
+// away with an error.
+static void submit(struct ioring_file* file, const struct ioring_sqe* sqe) {
+    struct pending_op* op = kmalloc(sizeof(struct pending_op));
+    if (!op) {
+        post_completion(file, sqe->user_data, -ENOMEM);
+        return;
+    }
+    *op = (struct pending_op){.sqe = *sqe};
+
+    switch (sqe->opcode) {
+    case IORING_OP_NOP:
+        break;
+    case IORING_OP_NANOSLEEP: {
+        int rc = time_now(&op->deadline);
+        if (IS_ERR(rc)) {
+            kfree(op);
+            post_completion(file, sqe->user_data, rc);
+            return;
+        }
+        timespec_add(&op->deadline, (const struct timespec*)sqe->addr);
+        break;
+    }
+    case IORING_OP_READ:
+    case IORING_OP_WRITE:
+    case IORING_OP_ACCEPT:
+    case IORING_OP_POLL: {
+        file_description* desc = process_get_file_description(sqe->fd);
+        if (IS_ERR(desc)) {
+            kfree(op);
+            post_completion(file, sqe->user_data, PTR_ERR(desc));
+            return;
+        }
+        ++desc->ref_count;
+        op->desc = desc;
+        break;
+    }
+    default:
+        kfree(op);
+        post_completion(file, sqe->user_data, -EINVAL);
+        return;
+    }
+
+    *file->pending_tail = op;
+    file->pending_tail = &op->next;
+    ++file->num_pending;
+}
+
+// runs the pending operations that are ready and posts their completions
+static void complete_ready_ops(struct ioring_file* file) {
+    struct pending_op** it = &file->pending;
+    while (*it) {
+        struct pending_op* op = *it;
+        if (!op_is_ready(op)) {
+            it = &op->next;
+            continue;
+        }
+
+        int res = run_op(op);
+        post_completion(file, op->sqe.user_data, res);
+
+        *it = op->next;
+        if (file->pending_tail == &op->next)
+            file->pending_tail = it;
+        --file->num_pending;
+        if (op->desc)
+            file_description_close(op->desc);
+        kfree(op);
+    }
+}
+
+static bool any_op_is_ready(struct ioring_file* file) {
+    for (const struct pending_op* op = file->pending; op; op = op->next) {
+        if (op_is_ready(op))
+            return true;
+    }
+    return false;
+}
+
+int sys_ioring_setup(unsigned entries) {
+    if (entries == 0 || entries > IORING_MAX_ENTRIES ||
+        next_power_of_two(entries) != entries)
+        return -EINVAL;
+
+    struct ioring_file* file = kmalloc(sizeof(struct ioring_file));
+    if (!file)
+        return -ENOMEM;
+    *file = (struct ioring_file){0};
+    file->sq_entries = entries;
+    file->cq_entries = 2 * entries;
+    file->tgid = current->tgid;
+    file->pending_tail = &file->pending;
+
+    int rc = growable_buf_truncate(&file->buf, IORING_SIZE(entries));
+    if (IS_ERR(rc)) {
+        growable_buf_destroy(&file->buf);
+        kfree(file);
+        return rc;
+    }
+    struct ioring* ring = ring_of(file);
+    ring->sq_entries = file->sq_entries;
+    ring->cq_entries = file->cq_entries;
+
+    struct inode* inode = &file->inode;
+    static file_ops fops = {.destroy_inode = ioring_destroy_inode,
+                            .mmap = ioring_mmap,
+                            .poll = ioring_poll};
+    inode->fops = &fops;
+    inode->mode = S_IFCHR;
+    inode->ref_count = 1;
+
+    file_description* desc = inode_open(inode, O_RDWR, 0);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+    int fd = process_alloc_file_descriptor(-1, desc);
+    if (IS_ERR(fd))
+        file_description_close(desc);
+    return fd;
+}
+
+int sys_ioring_enter(int fd, unsigned to_submit, unsigned min_complete) {
+    file_description* desc = process_get_file_description(fd);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+    if (desc->inode->fops->destroy_inode != ioring_destroy_inode)
+        return -EINVAL;
+    struct ioring_file* file = (struct ioring_file*)desc->inode;
+    if (file->tgid != current->tgid)
+        return -EBADF;
+
+    mutex_lock(&file->lock);
+    struct ioring* ring = ring_of(file);
+
+    unsigned nsubmitted = 0;
+    uint32_t sq_tail = ring->sq_tail;
+    atomic_thread_fence(memory_order_acquire);
+    while (nsubmitted < to_submit && file->sq_head != sq_tail) {
+        // every operation in flight has to have room for its CQE
+        if (file->num_pending + cq_used(file) >= file->cq_entries)
+            break;
+        struct ioring_sqe sqe =
+            IORING_SQES(ring)[file->sq_head & (file->sq_entries - 1)];
+        ring->sq_head = ++file->sq_head;
+        submit(file, &sqe);
+        ++nsubmitted;
+    }
+    if (nsubmitted == 0 && to_submit > 0 && file->sq_head != sq_tail) {
+        mutex_unlock(&file->lock);
+        return -EBUSY;
+    }
+
+    min_complete = MIN(min_complete, file->cq_entries);
+    for (;;) {
+        complete_ready_ops(file);
+        if (cq_used(file) >= min_complete || !file->pending)
+            break;
+        int rc = scheduler_block((should_unblock_fn)any_op_is_ready, file);
+        if (IS_ERR(rc)) {
+            mutex_unlock(&file->lock);
+            return nsubmitted > 0 ? (int)nsubmitted : rc;
+        }
+    }
+
+    mutex_unlock(&file->lock);
+    return nsubmitted;
+}
@@ -36,21 +36,23 @@
 #include <common/extra.h>
 #include <common/string.h>
 #include <kernel/api/err.h>
+#include <kernel/api/fcntl.h>
 #include <kernel/api/sys/mman.h>
 #include <kernel/api/sys/stat.h>
 #include <kernel/api/sys/syscall.h>
 #include <kernel/boot_defs.h>
+#include <kernel/fs/fs.h>
 #include <kernel/memory/memory.h>
 #include <kernel/process.h>
 
-void* sys_mmap(const mmap_params* params) {
+static void* do_mmap(const mmap_params* params) {
     if (params->length == 0 || params->offset < 0 || (params->offset % PAGE_SIZE) || !((params->flags & MAP_PRIVATE) ^ (params->flags & MAP_SHARED)))
         return ERR_PTR(-EINVAL);
 
     if ((params->flags & MAP_FIXED) || !(params->prot & PROT_READ))
         return ERR_PTR(-ENOTSUP);
 
-    uintptr_t addr = range_allocator_alloc(&current->vaddr_allocator, params->length);
+    uintptr_t addr = range_allocator_alloc(&current->vm->vaddr_allocator, params->length);
     if (IS_ERR(addr))
         return ERR_PTR(addr);
 
@@ -81,9 +83,39 @@ void* sys_mmap(const mmap_params* params) {
     return (void*)file_description_mmap(desc, addr, params->length, params->offset, page_flags);
 }
 
+// threads sharing the address space must not create page tables concurrently
+void* sys_mmap(const mmap_params* params) {
+    mutex_lock(&current->vm->lock);
+    void* ret = do_mmap(params);
+    mutex_unlock(&current->vm->lock);
+    return ret;
+}
+
 int sys_munmap(void* addr, size_t length) {
     if ((uintptr_t)addr % PAGE_SIZE)
         return -EINVAL;
+    struct vm* vm = current->vm;
+    mutex_lock(&vm->lock);
     paging_unmap((uintptr_t)addr, length);
-    return range_allocator_free(&current->vaddr_allocator, (uintptr_t)addr, length);
+    int rc = range_allocator_free(&vm->vaddr_allocator, (uintptr_t)addr, length);
+    mutex_unlock(&vm->lock);
+    return rc;
+}
+
+int sys_memfd_create(const char* name, unsigned int flags) {
+    if (flags & ~MFD_CLOEXEC)
+        return -EINVAL;
+    if (strnlen(name, MFD_NAME_MAX + 1) > MFD_NAME_MAX)
+        return -EINVAL;
+
+    struct inode* inode = tmpfs_create_anonymous_file();
+    if (IS_ERR(inode))
+        return PTR_ERR(inode);
+    file_description* desc = inode_open(inode, O_RDWR, 0);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+    int fd = process_alloc_file_descriptor(-1, desc);
+    if (IS_ERR(fd))
+        file_description_close(desc);
+    return fd;
 }
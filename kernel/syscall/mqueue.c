@@ -0,0 +1,82 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "syscall.h"
+#include <kernel/api/err.h>
+#include <kernel/api/fcntl.h>
+#include <kernel/api/mqueue.h>
+#include <kernel/fs/fs.h>
+#include <kernel/process.h>
+
+int sys_mq_open(const char* name, int oflag, mode_t mode,
+                const struct mq_attr* attr) {
+    struct inode* inode = mqueue_open(name, oflag, mode, attr);
+    if (IS_ERR(inode))
+        return PTR_ERR(inode);
+    file_description* desc =
+        inode_open(inode, oflag & (O_RDWR | O_NONBLOCK), 0);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+    int fd = process_alloc_file_descriptor(-1, desc);
+    if (IS_ERR(fd))
+        file_description_close(desc);
+    return fd;
+}
+
+int sys_mq_unlink(const char* name) { return mqueue_unlink(name); }
+
+int sys_mq_timedsend(const mq_timed_params* params) {
+    file_description* desc = process_get_file_description(params->mqdes);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+    return mqueue_timedsend(desc, params->msg_ptr, params->msg_len,
+                            *params->msg_prio, params->abs_timeout);
+}
+
+ssize_t sys_mq_timedreceive(const mq_timed_params* params) {
+    file_description* desc = process_get_file_description(params->mqdes);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+    return mqueue_timedreceive(desc, params->msg_ptr, params->msg_len,
+                               params->msg_prio, params->abs_timeout);
+}
+
+int sys_mq_getsetattr(int mqdes, const struct mq_attr* newattr,
+                      struct mq_attr* oldattr) {
+    file_description* desc = process_get_file_description(mqdes);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+    return mqueue_getsetattr(desc, newattr, oldattr);
+}
@@ -0,0 +1,535 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "syscall.h"
+#include <common/extra.h>
+#include <kernel/api/err.h>
+#include <kernel/api/fcntl.h>
+#include <kernel/api/poll.h>
+#include <kernel/api/sys/epoll.h>
+#include <kernel/fs/fs.h>
+#include <kernel/memory/memory.h>
+#include <kernel/panic.h>
+#include <kernel/process.h>
+#include <kernel/scheduler.h>
+#include <kernel/system.h>
+
+// Rather than asking every file whether it is ready each time the scheduler
+// looks at a blocked process, poll() and epoll_wait() register a poll_watch
+// on each inode and only look at the files again once one of them notifies.
+// The notification wakes the blocked process with scheduler_wake(), so it
+// doesn't wait for the next tick to notice.
+
+struct timeout {
+    bool has_deadline;
+    struct timespec deadline;
+};
+
+// timeout_ms < 0 means no timeout
+static int timeout_init(struct timeout* timeout, int timeout_ms) {
+    *timeout = (struct timeout){0};
+    if (timeout_ms < 0)
+        return 0;
+    int rc = time_now(&timeout->deadline);
+    if (IS_ERR(rc))
+        return rc;
+    struct timespec delta = {.tv_sec = timeout_ms / 1000,
+                             .tv_nsec = (timeout_ms % 1000) * 1000000};
+    timespec_add(&timeout->deadline, &delta);
+    timeout->has_deadline = true;
+    return 0;
+}
+
+static bool timeout_has_expired(const struct timeout* timeout) {
+    return timeout->has_deadline && time_has_passed(&timeout->deadline);
+}
+
+struct poll_ctx {
+    atomic_bool notified;
+    struct timeout timeout;
+    struct process* waiter;
+};
+
+struct poll_entry {
+    poll_watch watch;
+    struct poll_ctx* ctx;
+    file_description* desc;
+};
+
+static void notify_poll_entry(poll_watch* watch) {
+    struct poll_entry* entry = CONTAINER_OF(watch, struct poll_entry, watch);
+    entry->ctx->notified = true;
+    // the watches are removed before the waiter returns from poll()
+    scheduler_wake(entry->ctx->waiter);
+}
+
+static bool poll_should_unblock(struct poll_ctx* ctx) {
+    return ctx->notified || timeout_has_expired(&ctx->timeout);
+}
+
+int sys_poll(struct pollfd* fds, nfds_t nfds, int timeout_ms) {
+    if (nfds > OPEN_MAX)
+        return -EINVAL;
+
+    struct poll_ctx ctx = {.waiter = current};
+    int rc = timeout_init(&ctx.timeout, timeout_ms);
+    if (IS_ERR(rc))
+        return rc;
+
+    struct poll_entry* entries = NULL;
+    if (nfds > 0) {
+        entries = kmalloc(nfds * sizeof(struct poll_entry));
+        if (!entries)
+            return -ENOMEM;
+    }
+    for (nfds_t i = 0; i < nfds; ++i) {
+        struct poll_entry* entry = entries + i;
+        *entry = (struct poll_entry){.watch = {.notify = notify_poll_entry},
+                                     .ctx = &ctx};
+        if (fds[i].fd < 0)
+            continue;
+        file_description* desc = process_get_file_description(fds[i].fd);
+        if (IS_ERR(desc))
+            continue;
+        ++desc->ref_count;
+        entry->desc = desc;
+        inode_add_poll_watch(desc->inode, &entry->watch);
+    }
+
+    int nready;
+    for (;;) {
+        // cleared before looking at the files so that no notification
+        // arriving in between gets lost
+        ctx.notified = false;
+
+        nready = 0;
+        for (nfds_t i = 0; i < nfds; ++i) {
+            short revents = 0;
+            if (fds[i].fd >= 0) {
+                file_description* desc = entries[i].desc;
+                if (desc) {
+                    short events = fds[i].events | POLLERR | POLLHUP;
+                    revents = file_description_poll(desc, events) & events;
+                } else {
+                    revents = POLLNVAL;
+                }
+            }
+            fds[i].revents = revents;
+            if (revents)
+                ++nready;
+        }
+        if (nready > 0 || timeout_ms == 0 ||
+            timeout_has_expired(&ctx.timeout))
+            break;
+
+        rc = scheduler_block((should_unblock_fn)poll_should_unblock, &ctx);
+        if (IS_ERR(rc)) {
+            nready = rc;
+            break;
+        }
+    }
+
+    for (nfds_t i = 0; i < nfds; ++i) {
+        file_description* desc = entries[i].desc;
+        if (!desc)
+            continue;
+        inode_remove_poll_watch(desc->inode, &entries[i].watch);
+        file_description_close(desc);
+    }
+    kfree(entries);
+    return nready;
+}
+
+// A file in the interest list of an epoll instance. The item doesn't hold a
+// reference to the description; closing the description removes the item
+// from the instance instead.
+struct epitem {
+    poll_watch watch;
+    struct epoll_file* ep;
+    int fd;
+    file_description* desc;
+    struct epoll_event event;
+
+    // whether the item is in the ready list
+    bool ready;
+
+    struct epitem* next;
+    struct epitem* next_ready;
+    struct epitem* next_in_desc;
+};
+
+// Protects the epitems lists of the descriptions. Taken before the lock of
+// epoll instances.
+static mutex epitems_lock;
+
+struct epoll_file {
+    struct inode inode;
+
+    // protects the interest list, and serializes epoll_ctl() and the
+    // collection of events in epoll_wait()
+    mutex lock;
+    struct epitem* items;
+
+    // Items that were notified since they were last looked at. As
+    // notifications can come from interrupt handlers, the list is protected
+    // by a spinlock.
+    spinlock ready_lock;
+    struct epitem* ready_head;
+    struct epitem* ready_tail;
+};
+
+static void mark_ready(struct epitem* item) {
+    struct epoll_file* ep = item->ep;
+    spinlock_lock(&ep->ready_lock);
+    bool was_ready = item->ready;
+    if (!was_ready) {
+        item->ready = true;
+        item->next_ready = NULL;
+        if (ep->ready_tail)
+            ep->ready_tail->next_ready = item;
+        else
+            ep->ready_head = item;
+        ep->ready_tail = item;
+    }
+    spinlock_unlock(&ep->ready_lock);
+
+    // for the pollers of the epoll instance itself
+    if (!was_ready)
+        inode_notify_poll(&ep->inode);
+}
+
+static void unmark_ready(struct epitem* item) {
+    struct epoll_file* ep = item->ep;
+    spinlock_lock(&ep->ready_lock);
+    if (item->ready) {
+        struct epitem* prev = NULL;
+        struct epitem* it = ep->ready_head;
+        while (it != item) {
+            prev = it;
+            it = it->next_ready;
+        }
+        if (prev)
+            prev->next_ready = item->next_ready;
+        else
+            ep->ready_head = item->next_ready;
+        if (ep->ready_tail == item)
+            ep->ready_tail = prev;
+        item->ready = false;
+    }
+    spinlock_unlock(&ep->ready_lock);
+}
+
+static void notify_epitem(poll_watch* watch) {
+    mark_ready(CONTAINER_OF(watch, struct epitem, watch));
+}
+
+// The caller holds epitems_lock and has removed the item from ep->items.
+static void destroy_epitem(struct epitem* item) {
+    struct epitem** it = &item->desc->epitems;
+    while (*it != item)
+        it = &(*it)->next_in_desc;
+    *it = item->next_in_desc;
+
+    // once the watch is removed, no notification can be in progress
+    inode_remove_poll_watch(item->desc->inode, &item->watch);
+    unmark_ready(item);
+    kfree(item);
+}
+
+void epoll_remove_description(file_description* desc) {
+    mutex_lock(&epitems_lock);
+    while (desc->epitems) {
+        struct epitem* item = desc->epitems;
+        struct epoll_file* ep = item->ep;
+        mutex_lock(&ep->lock);
+        struct epitem** it = &ep->items;
+        while (*it != item)
+            it = &(*it)->next;
+        *it = item->next;
+        destroy_epitem(item);
+        mutex_unlock(&ep->lock);
+    }
+    mutex_unlock(&epitems_lock);
+}
+
+static void epoll_destroy_inode(struct inode* inode) {
+    struct epoll_file* ep = (struct epoll_file*)inode;
+    mutex_lock(&epitems_lock);
+    struct epitem* item = ep->items;
+    while (item) {
+        struct epitem* next = item->next;
+        destroy_epitem(item);
+        item = next;
+    }
+    mutex_unlock(&epitems_lock);
+    kfree(ep);
+}
+
+static short epoll_poll(file_description* desc, short events) {
+    struct epoll_file* ep = (struct epoll_file*)desc->inode;
+    if ((events & POLLIN) && ep->ready_head)
+        return POLLIN;
+    return 0;
+}
+
+static struct epoll_file* get_epoll_file(file_description* desc) {
+    if (desc->inode->fops->destroy_inode != epoll_destroy_inode)
+        return NULL;
+    return (struct epoll_file*)desc->inode;
+}
+
+int sys_epoll_create1(int flags) {
+    if (flags != 0)
+        return -EINVAL;
+
+    struct epoll_file* ep = kmalloc(sizeof(struct epoll_file));
+    if (!ep)
+        return -ENOMEM;
+    *ep = (struct epoll_file){0};
+
+    struct inode* inode = &ep->inode;
+    static file_ops fops = {.destroy_inode = epoll_destroy_inode,
+                            .poll = epoll_poll};
+    inode->fops = &fops;
+    inode->mode = S_IFCHR;
+    inode->ref_count = 1;
+
+    file_description* desc = inode_open(inode, O_RDWR, 0);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+    int fd = process_alloc_file_descriptor(-1, desc);
+    if (IS_ERR(fd))
+        file_description_close(desc);
+    return fd;
+}
+
+static int epoll_add(struct epoll_file* ep, int fd, file_description* desc,
+                     const struct epoll_event* event) {
+    for (struct epitem* it = ep->items; it; it = it->next) {
+        if (it->fd == fd && it->desc == desc)
+            return -EEXIST;
+    }
+
+    struct epitem* item = kmalloc(sizeof(struct epitem));
+    if (!item)
+        return -ENOMEM;
+    *item = (struct epitem){.watch = {.notify = notify_epitem},
+                            .ep = ep,
+                            .fd = fd,
+                            .desc = desc,
+                            .event = *event,
+                            .next = ep->items,
+                            .next_in_desc = desc->epitems};
+    ep->items = item;
+    desc->epitems = item;
+    inode_add_poll_watch(desc->inode, &item->watch);
+
+    // the file may already be ready
+    mark_ready(item);
+    return 0;
+}
+
+static struct epitem** find_item(struct epoll_file* ep, int fd,
+                                 file_description* desc) {
+    struct epitem** it = &ep->items;
+    while (*it) {
+        if ((*it)->fd == fd && (*it)->desc == desc)
+            return it;
+        it = &(*it)->next;
+    }
+    return NULL;
+}
+
+int sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event* event) {
+    file_description* ep_desc = process_get_file_description(epfd);
+    if (IS_ERR(ep_desc))
+        return PTR_ERR(ep_desc);
+    struct epoll_file* ep = get_epoll_file(ep_desc);
+    if (!ep)
+        return -EINVAL;
+
+    file_description* desc = process_get_file_description(fd);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+    if (desc == ep_desc)
+        return -EINVAL;
+    if (op != EPOLL_CTL_DEL && !event)
+        return -EFAULT;
+
+    mutex_lock(&epitems_lock);
+    mutex_lock(&ep->lock);
+    int rc = 0;
+    switch (op) {
+    case EPOLL_CTL_ADD:
+        rc = epoll_add(ep, fd, desc, event);
+        break;
+    case EPOLL_CTL_MOD: {
+        struct epitem** it = find_item(ep, fd, desc);
+        if (!it) {
+            rc = -ENOENT;
+            break;
+        }
+        (*it)->event = *event;
+        mark_ready(*it);
+        break;
+    }
+    case EPOLL_CTL_DEL: {
+        struct epitem** it = find_item(ep, fd, desc);
+        if (!it) {
+            rc = -ENOENT;
+            break;
+        }
+        struct epitem* item = *it;
+        *it = item->next;
+        destroy_epitem(item);
+        break;
+    }
+    default:
+        rc = -EINVAL;
+        break;
+    }
+    mutex_unlock(&ep->lock);
+    mutex_unlock(&epitems_lock);
+    return rc;
+}
+
+// Reports the ready items, polling each of them to find out whether it is
+// still ready. Level-triggered items that are ready go back to the ready list
+// to be polled again by the next epoll_wait().
+static int collect_events(struct epoll_file* ep, struct epoll_event* events,
+                          int maxevents) {
+    spinlock_lock(&ep->ready_lock);
+    struct epitem* list = ep->ready_head;
+    ep->ready_head = ep->ready_tail = NULL;
+    spinlock_unlock(&ep->ready_lock);
+
+    // Items in the list keep their ready flag until they are looked at, so
+    // that notifications don't move them to the new ready list meanwhile.
+    int n = 0;
+    while (list && n < maxevents) {
+        spinlock_lock(&ep->ready_lock);
+        struct epitem* item = list;
+        list = item->next_ready;
+        item->ready = false;
+        spinlock_unlock(&ep->ready_lock);
+
+        short wanted =
+            (short)(item->event.events & ~EPOLLET) | POLLERR | POLLHUP;
+        short revents = file_description_poll(item->desc, wanted) & wanted;
+        if (!revents)
+            continue;
+        events[n++] = (struct epoll_event){.events = (uint16_t)revents,
+                                           .data = item->event.data};
+        if (!(item->event.events & EPOLLET))
+            mark_ready(item);
+    }
+
+    if (list) {
+        // put back the items that didn't fit in events
+        spinlock_lock(&ep->ready_lock);
+        struct epitem* tail = list;
+        while (tail->next_ready)
+            tail = tail->next_ready;
+        tail->next_ready = ep->ready_head;
+        ep->ready_head = list;
+        if (!ep->ready_tail)
+            ep->ready_tail = tail;
+        spinlock_unlock(&ep->ready_lock);
+    }
+
+    return n;
+}
+
+struct epoll_wait_ctx {
+    // watches the epoll instance itself, which mark_ready() notifies
+    poll_watch watch;
+    struct process* waiter;
+    struct epoll_file* ep;
+    struct timeout timeout;
+};
+
+static void notify_epoll_waiter(poll_watch* watch) {
+    struct epoll_wait_ctx* ctx =
+        CONTAINER_OF(watch, struct epoll_wait_ctx, watch);
+    scheduler_wake(ctx->waiter);
+}
+
+static bool epoll_wait_should_unblock(struct epoll_wait_ctx* ctx) {
+    return ctx->ep->ready_head || timeout_has_expired(&ctx->timeout);
+}
+
+int sys_epoll_wait(int epfd, struct epoll_event* events, int maxevents,
+                   int timeout_ms) {
+    if (maxevents <= 0)
+        return -EINVAL;
+
+    file_description* desc = process_get_file_description(epfd);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+    struct epoll_file* ep = get_epoll_file(desc);
+    if (!ep)
+        return -EINVAL;
+
+    struct epoll_wait_ctx ctx = {.watch = {.notify = notify_epoll_waiter},
+                                 .waiter = current,
+                                 .ep = ep};
+    int rc = timeout_init(&ctx.timeout, timeout_ms);
+    if (IS_ERR(rc))
+        return rc;
+
+    // keep the instance alive even if another thread closes epfd
+    ++desc->ref_count;
+    inode_add_poll_watch(&ep->inode, &ctx.watch);
+
+    int n;
+    for (;;) {
+        mutex_lock(&ep->lock);
+        n = collect_events(ep, events, maxevents);
+        mutex_unlock(&ep->lock);
+        if (n > 0 || timeout_ms == 0 || timeout_has_expired(&ctx.timeout))
+            break;
+
+        rc = scheduler_block((should_unblock_fn)epoll_wait_should_unblock,
+                             &ctx);
+        if (IS_ERR(rc)) {
+            n = rc;
+            break;
+        }
+    }
+
+    inode_remove_poll_watch(&ep->inode, &ctx.watch);
+    file_description_close(desc);
+    return n;
+}
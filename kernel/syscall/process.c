@@ -34,6 +34,7 @@
  */
 
 #include <common/string.h>
+#include <kernel/api/sched.h>
 #include <kernel/api/sys/times.h>
 #include <kernel/api/sys/wait.h>
 #include <kernel/boot_defs.h>
@@ -44,19 +45,23 @@
 
 noreturn uintptr_t sys_exit(int status) { process_exit(status); }
 
-pid_t sys_getpid(void) { return current->pid; }
+noreturn uintptr_t sys_exit_group(int status) { process_exit_group(status); }
+
+pid_t sys_getpid(void) { return current->tgid; }
+
+pid_t sys_gettid(void) { return current->pid; }
 
 int sys_setpgid(pid_t pid, pid_t pgid) {
     if (pgid < 0)
         return -EINVAL;
 
     pid_t target_pid = pid ? pid : current->pid;
-    struct process* target = process_find_process_by_pid(target_pid);
-    if (!target)
-        return -ESRCH;
-
-    target->pgid = pgid ? pgid : target_pid;
-    return 0;
+    spinlock_lock(&all_processes_lock);
+    struct process* target = process_table_find(target_pid);
+    if (target)
+        process_table_set_pgid(target, pgid ? pgid : target_pid);
+    spinlock_unlock(&all_processes_lock);
+    return target ? 0 : -ESRCH;
 }
 
 pid_t sys_getpgid(pid_t pid) {
@@ -68,66 +73,204 @@ pid_t sys_getpgid(pid_t pid) {
     return process->pgid;
 }
 
+int sys_nice(int inc) {
+    int nice = current->nice + inc;
+    if (nice < NICE_MIN)
+        nice = NICE_MIN;
+    if (nice > NICE_MAX)
+        nice = NICE_MAX;
+    current->nice = nice;
+    return nice;
+}
+
+int sys_sched_setscheduler(pid_t pid, int policy,
+                           const struct sched_param* param) {
+    if (!param)
+        return -EINVAL;
+    int priority = param->sched_priority;
+    switch (policy) {
+    case SCHED_OTHER:
+        if (priority != 0)
+            return -EINVAL;
+        break;
+    case SCHED_FIFO:
+    case SCHED_RR:
+        if (priority < SCHED_RT_PRIORITY_MIN ||
+            SCHED_RT_PRIORITY_MAX < priority)
+            return -EINVAL;
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    struct process* process =
+        pid ? process_find_process_by_pid(pid) : current;
+    if (!process)
+        return -ESRCH;
+    scheduler_set_policy(process, policy, priority);
+    return 0;
+}
+
+int sys_sched_getscheduler(pid_t pid) {
+    struct process* process =
+        pid ? process_find_process_by_pid(pid) : current;
+    if (!process)
+        return -ESRCH;
+    return process->policy;
+}
+
+int sys_sched_getparam(pid_t pid, struct sched_param* param) {
+    if (!param)
+        return -EINVAL;
+    struct process* process =
+        pid ? process_find_process_by_pid(pid) : current;
+    if (!process)
+        return -ESRCH;
+    param->sched_priority = process->rt_priority;
+    return 0;
+}
+
 int sys_sched_yield(void) {
+    ++current->num_voluntary_switches;
     scheduler_yield(true);
     return 0;
 }
 
 void return_to_userland(registers);
 
-pid_t sys_fork(registers* regs) {
+#define SUPPORTED_CLONE_FLAGS                                                  \
+    (CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_THREAD | CLONE_SETTLS |       \
+     CLONE_CHILD_CLEARTID | CLONE_CHILD_SETTID)
+
+pid_t sys_clone(registers* regs, unsigned long flags, void* stack,
+                void* tls, pid_t* ctid) {
+    if (flags & ~SUPPORTED_CLONE_FLAGS)
+        return -ENOTSUP;
+
+    // threads in a thread group share the signal handling, which we can
+    // only do if they also share the address space
+    if ((flags & CLONE_THREAD) && !(flags & CLONE_VM))
+        return -EINVAL;
+
+    // ctid is written from the parent, so it has to be in shared memory
+    if ((flags & CLONE_CHILD_SETTID) && !(flags & CLONE_VM))
+        return -EINVAL;
+
+    process_reap_dead_threads();
+
     struct process* process = kaligned_alloc(alignof(struct process), sizeof(struct process));
     if (!process)
         return -ENOMEM;
     *process = (struct process){0};
 
-    process->pd = paging_clone_current_page_directory();
-    if (IS_ERR(process->pd))
-        return PTR_ERR(process->pd);
-
-    process->vaddr_allocator = current->vaddr_allocator;
+    if (flags & CLONE_VM) {
+        process->vm = current->vm;
+        ++process->vm->ref_count;
+        process->pd = process->vm->pd;
+    } else {
+        // Another thread may mmap() or munmap() meanwhile, and the page
+        // directory and the allocator have to be copied from the same state.
+        struct vm* vm = current->vm;
+        mutex_lock(&vm->lock);
+        process->pd = paging_clone_current_page_directory();
+        if (IS_ERR(process->pd)) {
+            mutex_unlock(&vm->lock);
+            return PTR_ERR(process->pd);
+        }
+        process->vm = process_create_vm(process->pd);
+        if (IS_ERR(process->vm)) {
+            mutex_unlock(&vm->lock);
+            return PTR_ERR(process->vm);
+        }
+        process->vm->vaddr_allocator = vm->vaddr_allocator;
+        process->vm->vaddr_allocator.lock = (mutex){0};
+        mutex_unlock(&vm->lock);
+    }
 
     process->pid = process_generate_next_pid();
+    process->tgid = (flags & CLONE_THREAD) ? current->tgid : process->pid;
     process->ppid = current->pid;
     process->pgid = current->pgid;
     process->eip = (uintptr_t)return_to_userland;
     process->ebx = current->ebx;
     process->esi = current->esi;
     process->edi = current->edi;
+    fpu_save_current();
     process->fpu_state = current->fpu_state;
     process->state = PROCESS_STATE_RUNNABLE;
     strlcpy(process->comm, current->comm, sizeof(process->comm));
 
     process->user_ticks = current->user_ticks;
     process->kernel_ticks = current->kernel_ticks;
+    process->nice = current->nice;
+    process->policy = current->policy;
+    process->rt_priority = current->rt_priority;
+    process->traced = current->traced;
+
+    process->tls_base = (flags & CLONE_SETTLS) ? (uintptr_t)tls : current->tls_base;
+    if (flags & CLONE_CHILD_CLEARTID)
+        process->clear_child_tid = ctid;
+
+    if (flags & CLONE_FS) {
+        process->cwd = current->cwd;
+        ++process->cwd->ref_count;
+    } else {
+        mutex_lock(&current->cwd->lock);
+        process->cwd = process_create_cwd(current->cwd->path, current->cwd->inode);
+        if (IS_OK(process->cwd))
+            inode_ref(process->cwd->inode);
+        mutex_unlock(&current->cwd->lock);
+        if (IS_ERR(process->cwd))
+            return PTR_ERR(process->cwd);
+    }
 
-    process->cwd_path = kstrdup(current->cwd_path);
-    if (!process->cwd_path)
-        return -ENOMEM;
-    process->cwd_inode = current->cwd_inode;
-    inode_ref(process->cwd_inode);
-
-    int rc = file_descriptor_table_clone_from(&process->fd_table, &current->fd_table);
-    if (IS_ERR(rc))
-        return rc;
+    if (flags & CLONE_FILES) {
+        process->fd_table = current->fd_table;
+        ++process->fd_table->ref_count;
+    } else {
+        process->fd_table = kmalloc(sizeof(file_descriptor_table));
+        if (!process->fd_table)
+            return -ENOMEM;
+        int rc = file_descriptor_table_clone_from(process->fd_table, current->fd_table);
+        if (IS_ERR(rc))
+            return rc;
+    }
 
-    void* stack = kmalloc(STACK_SIZE);
-    if (!stack)
+    void* kernel_stack = kernel_stack_alloc();
+    if (!kernel_stack)
         return -ENOMEM;
-    process->stack_top = (uintptr_t)stack + STACK_SIZE;
+    process->stack_top = (uintptr_t)kernel_stack + STACK_SIZE;
     process->esp = process->ebp = process->stack_top;
 
     // push the argument of return_to_userland()
     process->esp -= sizeof(registers);
     registers* child_regs = (registers*)process->esp;
     *child_regs = *regs;
-    child_regs->eax = 0; // fork() returns 0 in the child
+    child_regs->eax = 0; // clone() returns 0 in the child
+    if (stack)
+        child_regs->user_esp = (uintptr_t)stack;
+    if (flags & CLONE_SETTLS)
+        child_regs->gs = TLS_SEGMENT;
+
+    // before the child runs, so that it can't exit and clear ctid first
+    if (flags & CLONE_CHILD_SETTID)
+        *ctid = process->pid;
 
     scheduler_register(process);
 
     return process->pid;
 }
 
+pid_t sys_fork(registers* regs) {
+    return sys_clone(regs, 0, NULL, NULL, NULL);
+}
+
+int sys_set_thread_area(void* base) {
+    current->tls_base = (uintptr_t)base;
+    gdt_set_tls_base(current->tls_base);
+    return TLS_SEGMENT;
+}
+
 int sys_kill(pid_t pid, int sig) {
     if (pid > 0)
         return process_send_signal_to_one(pid, sig);
@@ -140,61 +283,65 @@ int sys_kill(pid_t pid, int sig) {
 
 struct waitpid_blocker {
     pid_t param_pid;
-    pid_t current_pid, current_pgid;
+    struct process* waiter;
+    pid_t waiter_pgid;
+    bool any_target_exists;
     struct process* waited_process;
 };
 
+// the process is still running on its kernel stack until it switches to
+// another process
+static bool is_reapable(const struct process* process) {
+    return process->state == PROCESS_STATE_DEAD && !process->on_cpu;
+}
+
+// Threads other than the thread group leader reap themselves when they exit
+// and are joined through CLONE_CHILD_CLEARTID, so waitpid() never targets
+// them. They aren't in the child lists to begin with.
+static struct process* find_reapable_target(struct waitpid_blocker* blocker) {
+    pid_t pid = blocker->param_pid;
+    if (pid > 0) {
+        struct process* it = process_table_find(pid);
+        if (it && process_is_thread(it))
+            it = NULL;
+        blocker->any_target_exists = it;
+        return it && is_reapable(it) ? it : NULL;
+    }
+    if (pid == -1) {
+        struct process* it = blocker->waiter->first_child;
+        blocker->any_target_exists = it;
+        for (; it; it = it->next_sibling) {
+            if (is_reapable(it))
+                return it;
+        }
+        return NULL;
+    }
+    pid_t pgid = pid == 0 ? blocker->waiter_pgid : -pid;
+    for (struct process* it = process_table_find_group(pgid);
+         it && it->pgid == pgid; it = it->next_in_pgid_hash) {
+        if (process_is_thread(it))
+            continue;
+        blocker->any_target_exists = true;
+        if (is_reapable(it))
+            return it;
+    }
+    return NULL;
+}
+
 /*
  *  This function uses a i?86-specific function, so we'll make the function's definition exclusive to i?86 for now, until we come
  *  up with an implementation for other architectures...
  */
 static bool waitpid_should_unblock(struct waitpid_blocker* blocker) {
     #if defined(__i386__)
-    bool int_flag = push_cli();
-
-    struct process* prev = NULL;
-    struct process* it = all_processes;
-    bool any_target_exists = false;
-
-    while (it) {
-        bool is_target = false;
-        if (blocker->param_pid < -1) {
-            if (it->pgid == -blocker->param_pid)
-                is_target = true;
-        } else if (blocker->param_pid == -1) {
-            if (it->ppid == blocker->current_pid)
-                is_target = true;
-        } else if (blocker->param_pid == 0) {
-            if (it->pgid == blocker->current_pgid)
-                is_target = true;
-        } else {
-            if (it->pid == blocker->param_pid)
-                is_target = true;
-        }
-        any_target_exists |= is_target;
-        if (is_target && it->state == PROCESS_STATE_DEAD)
-            break;
-
-        prev = it;
-        it = it->next_in_all_processes;
-    }
-    if (!it) {
-        pop_cli(int_flag);
-        if (!any_target_exists) {
-            blocker->waited_process = NULL;
-            return true;
-        }
-        return false;
-    }
-
-    if (prev)
-        prev->next_in_all_processes = it->next_in_all_processes;
-    else
-        all_processes = it->next_in_all_processes;
-    blocker->waited_process = it;
-
-    pop_cli(int_flag);
-    return true;
+    spinlock_lock(&all_processes_lock);
+    struct process* process = find_reapable_target(blocker);
+    // removing the process here makes sure only one waiter reaps it
+    if (process)
+        process_table_remove(process);
+    spinlock_unlock(&all_processes_lock);
+    blocker->waited_process = process;
+    return process || !blocker->any_target_exists;
     #else
     return false;
     #endif
@@ -204,10 +351,10 @@ pid_t sys_waitpid(pid_t pid, int* wstatus, int options) {
     if (options & ~WNOHANG)
         return -ENOTSUP;
 
-    struct waitpid_blocker blocker = {.param_pid = pid, .current_pid = current->pid, .current_pgid = current->pgid, .waited_process = NULL};
+    struct waitpid_blocker blocker = {.param_pid = pid, .waiter = current, .waiter_pgid = current->pgid, .any_target_exists = false, .waited_process = NULL};
     if (options & WNOHANG) {
         if (!waitpid_should_unblock(&blocker))
-            return blocker.waited_process ? 0 : -ECHILD;
+            return 0;
     } else {
         int rc = scheduler_block((should_unblock_fn)waitpid_should_unblock, &blocker);
         if (IS_ERR(rc))
@@ -218,11 +365,10 @@ pid_t sys_waitpid(pid_t pid, int* wstatus, int options) {
     if (!waited_process)
         return -ECHILD;
 
-    scheduler_unregister(waited_process);
     if (wstatus)
         *wstatus = waited_process->exit_status;
     pid_t result = waited_process->pid;
-    kfree((void*)(waited_process->stack_top - STACK_SIZE));
+    kernel_stack_free((void*)(waited_process->stack_top - STACK_SIZE));
     kfree(waited_process);
     return result;
 }
@@ -236,9 +382,14 @@ clock_t sys_times(struct tms* buf) {
 char* sys_getcwd(char* buf, size_t size) {
     if (!buf || size == 0)
         return ERR_PTR(-EINVAL);
-    if (size < strlen(current->cwd_path) + 1)
+    struct cwd* cwd = current->cwd;
+    mutex_lock(&cwd->lock);
+    if (size < strlen(cwd->path) + 1) {
+        mutex_unlock(&cwd->lock);
         return ERR_PTR(-ERANGE);
-    strlcpy(buf, current->cwd_path, size);
+    }
+    strlcpy(buf, cwd->path, size);
+    mutex_unlock(&cwd->lock);
     return buf;
 }
 
@@ -258,10 +409,13 @@ int sys_chdir(const char* path) {
         return -ENOTDIR;
     }
 
-    kfree(current->cwd_path);
-    inode_unref(current->cwd_inode);
-    current->cwd_path = new_cwd_path;
-    current->cwd_inode = inode;
+    struct cwd* cwd = current->cwd;
+    mutex_lock(&cwd->lock);
+    kfree(cwd->path);
+    inode_unref(cwd->inode);
+    cwd->path = new_cwd_path;
+    cwd->inode = inode;
+    mutex_unlock(&cwd->lock);
 
     return 0;
 }
@@ -33,33 +33,119 @@
  *  THE SOFTWARE.
  */
 
+#include "syscall.h"
 #include <kernel/api/err.h>
 #include <kernel/api/fcntl.h>
 #include <kernel/api/sys/socket.h>
+#include <kernel/panic.h>
 #include <kernel/process.h>
 #include <kernel/socket.h>
 
+static bool is_valid_type(int type) {
+    return type == SOCK_STREAM || type == SOCK_DGRAM || type == SOCK_SEQPACKET;
+}
+
 int sys_socket(int domain, int type, int protocol) {
-    (void)protocol;
-    if (domain != AF_UNIX || type != SOCK_STREAM)
+    if (domain != AF_UNIX && domain != AF_INET)
         return -EAFNOSUPPORT;
+    if (!is_valid_type(type))
+        return -EPROTOTYPE;
 
-    unix_socket* socket = unix_socket_create();
+    struct inode* socket;
+    if (domain == AF_INET)
+        socket = (struct inode*)inet_socket_create(type, protocol);
+    else
+        socket = (struct inode*)unix_socket_create(type);
     if (IS_ERR(socket))
         return PTR_ERR(socket);
-    inode_ref((struct inode*)socket);
-    file_description* desc = inode_open((struct inode*)socket, O_RDWR, 0);
+    inode_ref(socket);
+    file_description* desc = inode_open(socket, O_RDWR, 0);
     if (IS_ERR(desc))
         return PTR_ERR(desc);
     return process_alloc_file_descriptor(-1, desc);
 }
 
+int sys_socketpair(int domain, int type, int protocol, int sv[2]) {
+    (void)protocol;
+    if (domain != AF_UNIX)
+        return -EAFNOSUPPORT;
+    if (!is_valid_type(type))
+        return -EPROTOTYPE;
+
+    unix_socket* socket = unix_socket_create(type);
+    if (IS_ERR(socket))
+        return PTR_ERR(socket);
+
+    // both ends share a single socket, and the one opened first plays the
+    // client as if it had connected to the other
+    inode_ref((struct inode*)socket);
+    file_description* client_desc =
+        inode_open((struct inode*)socket, O_RDWR, 0);
+    if (IS_ERR(client_desc)) {
+        inode_unref((struct inode*)socket);
+        return PTR_ERR(client_desc);
+    }
+    file_description* server_desc =
+        inode_open((struct inode*)socket, O_RDWR, 0);
+    if (IS_ERR(server_desc)) {
+        file_description_close(client_desc);
+        return PTR_ERR(server_desc);
+    }
+    socket->connector_fd = client_desc;
+    socket->connected = true;
+
+    int fd0 = process_alloc_file_descriptor(-1, client_desc);
+    if (IS_ERR(fd0)) {
+        file_description_close(client_desc);
+        file_description_close(server_desc);
+        return fd0;
+    }
+    int fd1 = process_alloc_file_descriptor(-1, server_desc);
+    if (IS_ERR(fd1)) {
+        ASSERT_OK(process_free_file_descriptor(fd0));
+        file_description_close(client_desc);
+        file_description_close(server_desc);
+        return fd1;
+    }
+    sv[0] = fd0;
+    sv[1] = fd1;
+    return 0;
+}
+
+// Returns the socket bound to addr with a reference held, which the caller
+// drops with inode_unref() once it is done with the socket.
+static unix_socket* find_bound_socket(const sockaddr* addr,
+                                      socklen_t addrlen) {
+    if (addrlen <= sizeof(sa_family_t) || sizeof(sockaddr_un) < addrlen)
+        return ERR_PTR(-EINVAL);
+    const sockaddr_un* addr_un = (const sockaddr_un*)addr;
+    if (addr->sa_family != AF_UNIX)
+        return ERR_PTR(-EINVAL);
+    char* path =
+        kstrndup(addr_un->sun_path, addrlen - offsetof(sockaddr_un, sun_path));
+    if (!path)
+        return ERR_PTR(-ENOMEM);
+    file_description* desc = vfs_open(path, 0, 0);
+    kfree(path);
+    if (IS_ERR(desc))
+        return ERR_CAST(desc);
+    unix_socket* socket = desc->inode->bound_socket;
+    if (socket)
+        inode_ref(&socket->inode);
+    file_description_close(desc);
+    if (!socket)
+        return ERR_PTR(-ECONNREFUSED);
+    return socket;
+}
+
 int sys_bind(int sockfd, const sockaddr* addr, socklen_t addrlen) {
     file_description* desc = process_get_file_description(sockfd);
     if (IS_ERR(desc))
         return PTR_ERR(desc);
     if (!S_ISSOCK(desc->inode->mode))
         return -ENOTSOCK;
+    if (inode_is_inet_socket(desc->inode))
+        return inet_socket_bind((inet_socket*)desc->inode, addr, addrlen);
     unix_socket* socket = (unix_socket*)desc->inode;
 
     if (addrlen <= sizeof(sa_family_t) || sizeof(sockaddr_un) < addrlen)
@@ -89,8 +175,12 @@ int sys_listen(int sockfd, int backlog) {
         return PTR_ERR(desc);
     if (!S_ISSOCK(desc->inode->mode))
         return -ENOTSOCK;
+    if (inode_is_inet_socket(desc->inode))
+        return inet_socket_listen((inet_socket*)desc->inode, backlog);
 
     unix_socket* socket = (unix_socket*)desc->inode;
+    if (socket->type == SOCK_DGRAM)
+        return -EOPNOTSUPP;
     unix_socket_set_backlog(socket, backlog);
     return 0;
 }
@@ -99,11 +189,34 @@ int sys_accept(int sockfd, struct sockaddr* addr, socklen_t* addrlen) {
     file_description* desc = process_get_file_description(sockfd);
     if (IS_ERR(desc))
         return PTR_ERR(desc);
+    return socket_accept(desc, addr, addrlen);
+}
+
+int socket_accept(file_description* desc, struct sockaddr* addr,
+                  socklen_t* addrlen) {
     if (!S_ISSOCK(desc->inode->mode))
         return -ENOTSOCK;
 
+    if (inode_is_inet_socket(desc->inode)) {
+        // accept() hands over the reference of the accept queue
+        inet_socket* socket = inet_socket_accept(desc, addr, addrlen);
+        if (IS_ERR(socket))
+            return PTR_ERR(socket);
+        file_description* socket_desc =
+            inode_open((struct inode*)socket, O_RDWR, 0);
+        if (IS_ERR(socket_desc))
+            return PTR_ERR(socket_desc);
+        int fd = process_alloc_file_descriptor(-1, socket_desc);
+        if (IS_ERR(fd))
+            file_description_close(socket_desc);
+        return fd;
+    }
+
     unix_socket* listener = (unix_socket*)desc->inode;
-    unix_socket* connector = unix_socket_accept(listener);
+    if (listener->type == SOCK_DGRAM)
+        return -EOPNOTSUPP;
+    unix_socket* connector =
+        unix_socket_accept(listener, desc->flags & O_NONBLOCK);
     if (IS_ERR(connector))
         return PTR_ERR(connector);
     inode_ref((struct inode*)connector);
@@ -133,25 +246,118 @@ int sys_connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen) {
         return PTR_ERR(desc);
     if (!S_ISSOCK(desc->inode->mode))
         return -ENOTSOCK;
+    if (inode_is_inet_socket(desc->inode))
+        return inet_socket_connect(desc, addr, addrlen);
     unix_socket* socket = (unix_socket*)desc->inode;
     if (socket->connected)
         return -EISCONN;
 
-    if (addrlen <= sizeof(sa_family_t) || sizeof(sockaddr_un) < addrlen)
+    unix_socket* listener = find_bound_socket(addr, addrlen);
+    if (IS_ERR(listener))
+        return PTR_ERR(listener);
+    if (listener->type != socket->type) {
+        inode_unref(&listener->inode);
+        return -EPROTOTYPE;
+    }
+
+    if (socket->type == SOCK_DGRAM) {
+        // only sets the default destination, and can be done again.
+        // The peer keeps the reference from find_bound_socket().
+        unix_socket* old_peer = atomic_exchange(&socket->peer, listener);
+        if (old_peer)
+            inode_unref(&old_peer->inode);
+        return 0;
+    }
+
+    // the listener has to outlive the wait for accept()
+    int rc = unix_socket_connect(desc, listener);
+    inode_unref(&listener->inode);
+    return rc;
+}
+
+static unix_socket* get_socket(int sockfd, file_description** out_desc) {
+    file_description* desc = process_get_file_description(sockfd);
+    if (IS_ERR(desc))
+        return ERR_CAST(desc);
+    if (!S_ISSOCK(desc->inode->mode))
+        return ERR_PTR(-ENOTSOCK);
+    *out_desc = desc;
+    return (unix_socket*)desc->inode;
+}
+
+ssize_t sys_sendmsg(int sockfd, const struct msghdr* msg, int flags) {
+    if (flags)
+        return -EOPNOTSUPP;
+    file_description* desc;
+    unix_socket* socket = get_socket(sockfd, &desc);
+    if (IS_ERR(socket))
+        return PTR_ERR(socket);
+    if (inode_is_inet_socket(desc->inode))
+        return inet_socket_sendmsg(desc, msg);
+
+    unix_socket* dest = NULL;
+    if (msg->msg_name) {
+        dest = find_bound_socket(msg->msg_name, msg->msg_namelen);
+        if (IS_ERR(dest))
+            return PTR_ERR(dest);
+    }
+    // the destination is held while the sender waits for room in it
+    ssize_t rc = unix_socket_sendmsg(desc, dest, msg);
+    if (dest)
+        inode_unref(&dest->inode);
+    return rc;
+}
+
+ssize_t sys_recvmsg(int sockfd, struct msghdr* msg, int flags) {
+    if (flags)
+        return -EOPNOTSUPP;
+    file_description* desc;
+    unix_socket* socket = get_socket(sockfd, &desc);
+    if (IS_ERR(socket))
+        return PTR_ERR(socket);
+    if (inode_is_inet_socket(desc->inode))
+        return inet_socket_recvmsg(desc, msg);
+    return unix_socket_recvmsg(desc, msg);
+}
+
+int sys_getsockopt(const sockopt_params* params) {
+    file_description* desc;
+    unix_socket* socket = get_socket(params->sockfd, &desc);
+    if (IS_ERR(socket))
+        return PTR_ERR(socket);
+    if (inode_is_inet_socket(desc->inode))
+        return inet_socket_getsockopt(desc, params->level, params->optname,
+                                      params->optval, params->optlen);
+    if (params->level != SOL_SOCKET)
+        return -ENOPROTOOPT;
+    if (params->optname != SO_SNDBUF && params->optname != SO_RCVBUF)
+        return -ENOPROTOOPT;
+    if (*params->optlen < sizeof(int))
         return -EINVAL;
-    const sockaddr_un* addr_un = (const sockaddr_un*)addr;
-    if (addr->sa_family != AF_UNIX)
+
+    *(int*)params->optval =
+        unix_socket_get_buf_size(desc, params->optname == SO_SNDBUF);
+    *params->optlen = sizeof(int);
+    return 0;
+}
+
+int sys_setsockopt(const sockopt_params* params) {
+    file_description* desc;
+    unix_socket* socket = get_socket(params->sockfd, &desc);
+    if (IS_ERR(socket))
+        return PTR_ERR(socket);
+    if (inode_is_inet_socket(desc->inode))
+        return inet_socket_setsockopt(desc, params->level, params->optname,
+                                      params->optval, *params->optlen);
+    if (params->level != SOL_SOCKET)
+        return -ENOPROTOOPT;
+    if (params->optname != SO_SNDBUF && params->optname != SO_RCVBUF)
+        return -ENOPROTOOPT;
+    if (*params->optlen < sizeof(int))
         return -EINVAL;
-    const char* path =
-        kstrndup(addr_un->sun_path, addrlen - offsetof(sockaddr_un, sun_path));
-    if (!path)
-        return -ENOMEM;
-    file_description* listener_desc = vfs_open(path, 0, 0);
-    if (IS_ERR(listener_desc))
-        return PTR_ERR(listener_desc);
-    unix_socket* listener = listener_desc->inode->bound_socket;
-    if (!listener)
-        return -ECONNREFUSED;
-
-    return unix_socket_connect(desc, listener);
+
+    int size = *(const int*)params->optval;
+    if (size < 0)
+        return -EINVAL;
+    return unix_socket_set_buf_size(desc, params->optname == SO_SNDBUF, size);
 }
@@ -0,0 +1,281 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "syscall.h"
+#include <common/extra.h>
+#include <kernel/api/err.h>
+#include <kernel/api/fcntl.h>
+#include <kernel/api/poll.h>
+#include <kernel/fs/fs.h>
+#include <kernel/memory/memory.h>
+#include <kernel/process.h>
+
+// Runs the transfer between file and pipe at *offset rather than at the file
+// offset of file, and advances *offset instead.
+static ssize_t splice_file(file_description* pipe, file_description* file,
+                           off_t* offset, size_t len, bool to_pipe,
+                           bool nonblock) {
+    if (!offset) {
+        return to_pipe ? fifo_splice_from(pipe, file, len, nonblock)
+                       : fifo_splice_to(pipe, file, len, nonblock);
+    }
+    if (*offset < 0)
+        return -EINVAL;
+
+    mutex_lock(&file->offset_lock);
+    off_t saved_offset = file->offset;
+    file->offset = *offset;
+    ssize_t rc = to_pipe ? fifo_splice_from(pipe, file, len, nonblock)
+                         : fifo_splice_to(pipe, file, len, nonblock);
+    *offset = file->offset;
+    file->offset = saved_offset;
+    mutex_unlock(&file->offset_lock);
+    return rc;
+}
+
+ssize_t sys_splice(const splice_params* params) {
+    if (params->flags & ~(SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE))
+        return -EINVAL;
+    bool nonblock = params->flags & SPLICE_F_NONBLOCK;
+
+    file_description* in = process_get_file_description(params->fd_in);
+    if (IS_ERR(in))
+        return PTR_ERR(in);
+    file_description* out = process_get_file_description(params->fd_out);
+    if (IS_ERR(out))
+        return PTR_ERR(out);
+
+    bool in_is_pipe = inode_is_fifo(in->inode);
+    bool out_is_pipe = inode_is_fifo(out->inode);
+    if ((in_is_pipe && params->off_in) || (out_is_pipe && params->off_out))
+        return -ESPIPE;
+
+    if (in_is_pipe && out_is_pipe)
+        return fifo_transfer(in, out, params->len, true, nonblock);
+    if (in_is_pipe)
+        return splice_file(in, out, params->off_out, params->len, false,
+                           nonblock);
+    if (out_is_pipe)
+        return splice_file(out, in, params->off_in, params->len, true,
+                           nonblock);
+    return -EINVAL;
+}
+
+ssize_t sys_tee(int fd_in, int fd_out, size_t len, unsigned flags) {
+    if (flags & ~(SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE))
+        return -EINVAL;
+
+    file_description* in = process_get_file_description(fd_in);
+    if (IS_ERR(in))
+        return PTR_ERR(in);
+    file_description* out = process_get_file_description(fd_out);
+    if (IS_ERR(out))
+        return PTR_ERR(out);
+    if (!inode_is_fifo(in->inode) || !inode_is_fifo(out->inode))
+        return -EINVAL;
+
+    return fifo_transfer(in, out, len, false, flags & SPLICE_F_NONBLOCK);
+}
+
+// Without SPLICE_F_GIFT, the user pages are copied in (or out, for the read
+// end), as the caller may reuse them as soon as vmsplice() returns. With it,
+// the pages become part of the pipe buffer.
+ssize_t sys_vmsplice(int fd, const struct iovec* iov, size_t nr_segs,
+                     unsigned flags) {
+    if (flags & ~(SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE |
+                  SPLICE_F_GIFT))
+        return -EINVAL;
+
+    file_description* desc = process_get_file_description(fd);
+    if (IS_ERR(desc))
+        return PTR_ERR(desc);
+    if (!inode_is_fifo(desc->inode))
+        return -EBADF;
+
+    bool to_pipe = desc->flags & O_WRONLY;
+    short event = to_pipe ? POLLOUT : POLLIN;
+    ssize_t total = 0;
+    for (size_t i = 0; i < nr_segs; ++i) {
+        if (iov[i].iov_len == 0)
+            continue;
+        if ((flags & SPLICE_F_NONBLOCK) &&
+            !(file_description_poll(desc, event) & event))
+            return total > 0 ? total : -EAGAIN;
+
+        ssize_t n;
+        if (!to_pipe)
+            n = file_description_read(desc, iov[i].iov_base, iov[i].iov_len);
+        else if (flags & SPLICE_F_GIFT)
+            n = fifo_gift(desc, iov[i].iov_base, iov[i].iov_len,
+                          flags & SPLICE_F_NONBLOCK);
+        else
+            n = file_description_write(desc, iov[i].iov_base,
+                                       iov[i].iov_len);
+        if (IS_ERR(n))
+            return total > 0 ? total : n;
+        total += n;
+        if ((size_t)n < iov[i].iov_len)
+            break;
+    }
+    return total;
+}
+
+#define BOUNCE_BUF_SIZE 65536
+
+// Like file_description_read/write, but at *offset if offset is given.
+static ssize_t read_at(file_description* desc, void* buffer, size_t count,
+                       off_t* offset) {
+    if (!offset)
+        return file_description_read(desc, buffer, count);
+    ssize_t nread = file_description_pread(desc, buffer, count, *offset);
+    if (IS_OK(nread))
+        *offset += nread;
+    return nread;
+}
+
+static ssize_t write_at(file_description* desc, const void* buffer,
+                        size_t count, off_t* offset) {
+    if (!offset)
+        return file_description_write(desc, buffer, count);
+    ssize_t nwritten = file_description_pwrite(desc, buffer, count, *offset);
+    if (IS_OK(nwritten))
+        *offset += nwritten;
+    return nwritten;
+}
+
+// The generic path for files that can't be spliced or copied in place: a
+// read/write loop through a kernel buffer, which at least saves the copies to
+// and from userland and a pair of syscalls per chunk.
+static ssize_t copy_through_buffer(file_description* out, off_t* out_offset,
+                                   file_description* in, off_t* in_offset,
+                                   size_t count) {
+    unsigned char* buf = kmalloc(BOUNCE_BUF_SIZE);
+    if (!buf)
+        return -ENOMEM;
+
+    ssize_t rc = 0;
+    size_t total = 0;
+    while (total < count) {
+        ssize_t nread =
+            read_at(in, buf, MIN(count - total, BOUNCE_BUF_SIZE), in_offset);
+        if (IS_ERR(nread)) {
+            rc = nread;
+            break;
+        }
+        if (nread == 0)
+            break;
+        for (ssize_t written = 0; written < nread;) {
+            ssize_t nwritten =
+                write_at(out, buf + written, nread - written, out_offset);
+            if (IS_ERR(nwritten)) {
+                rc = nwritten;
+                break;
+            }
+            written += nwritten;
+            total += nwritten;
+        }
+        if (IS_ERR(rc))
+            break;
+    }
+
+    kfree(buf);
+    return total > 0 ? (ssize_t)total : rc;
+}
+
+ssize_t sys_sendfile(int out_fd, int in_fd, off_t* offset, size_t count) {
+    file_description* in = process_get_file_description(in_fd);
+    if (IS_ERR(in))
+        return PTR_ERR(in);
+    file_description* out = process_get_file_description(out_fd);
+    if (IS_ERR(out))
+        return PTR_ERR(out);
+    if (inode_is_fifo(in->inode))
+        return -EINVAL;
+    if (offset && *offset < 0)
+        return -EINVAL;
+
+    if (inode_is_fifo(out->inode))
+        return splice_file(out, in, offset, count, true, false);
+    return copy_through_buffer(out, NULL, in, offset, count);
+}
+
+// Holds the offset locks of both files while copying in place, in address
+// order as in and out can be the same file description.
+static ssize_t copy_range(file_description* out, off_t* off_out,
+                          file_description* in, off_t* off_in, size_t len) {
+    file_description* first = in < out ? in : out;
+    file_description* second = in < out ? out : in;
+    mutex_lock(&first->offset_lock);
+    mutex_lock(&second->offset_lock);
+
+    off_t* in_offset = off_in ? off_in : &in->offset;
+    off_t* out_offset = off_out ? off_out : &out->offset;
+    ssize_t rc = file_description_copy_range(out, *out_offset, in,
+                                             *in_offset, len);
+    if (IS_OK(rc)) {
+        *in_offset += rc;
+        *out_offset += rc;
+    }
+
+    mutex_unlock(&second->offset_lock);
+    mutex_unlock(&first->offset_lock);
+    return rc;
+}
+
+ssize_t sys_copy_file_range(const splice_params* params) {
+    if (params->flags)
+        return -EINVAL;
+    if ((params->off_in && *params->off_in < 0) ||
+        (params->off_out && *params->off_out < 0))
+        return -EINVAL;
+
+    file_description* in = process_get_file_description(params->fd_in);
+    if (IS_ERR(in))
+        return PTR_ERR(in);
+    file_description* out = process_get_file_description(params->fd_out);
+    if (IS_ERR(out))
+        return PTR_ERR(out);
+    if (S_ISDIR(in->inode->mode) || S_ISDIR(out->inode->mode))
+        return -EISDIR;
+    if (!S_ISREG(in->inode->mode) || !S_ISREG(out->inode->mode))
+        return -EINVAL;
+
+    ssize_t rc =
+        copy_range(out, params->off_out, in, params->off_in, params->len);
+    if (rc != -EXDEV)
+        return rc;
+    return copy_through_buffer(out, params->off_out, in, params->off_in,
+                               params->len);
+}
@@ -84,6 +84,46 @@ static syscall_handler_fn syscall_handlers[NUM_SYSCALLS + 1] = {
 #undef ENUM_ITEM
         NULL};
 
+static uintptr_t call_handler(registers* regs) {
+    syscall_handler_fn handler = syscall_handlers[regs->eax];
+    ASSERT(handler);
+
+    if (regs->eax == SYS_fork)
+        return sys_fork(regs);
+    if (regs->eax == SYS_clone)
+        return sys_clone(regs, regs->edx, (void*)regs->ecx,
+                         (void*)regs->ebx, (pid_t*)regs->esi);
+    return handler(regs->edx, regs->ecx, regs->ebx, regs->esi);
+}
+
+// called by both int $0x81 and sysenter_entry
+void syscall_dispatch(registers* regs) {
+    ASSERT(interrupts_enabled());
+
+    process_die_if_needed();
+
+    if (regs->eax >= NUM_SYSCALLS) {
+        regs->eax = -ENOSYS;
+        return;
+    }
+
+    // a single branch when tracing is off
+    if (current->traced || atomic_load_explicit(&systrace_all,
+                                                memory_order_relaxed)) {
+        unsigned num = regs->eax;
+        uint32_t args[4] = {regs->edx, regs->ecx, regs->ebx, regs->esi};
+        uint64_t start = rdtsc();
+        regs->eax = call_handler(regs);
+        uint64_t cycles = rdtsc() - start;
+        systrace_record(num, args, regs->eax,
+                        cycles > UINT32_MAX ? UINT32_MAX : cycles);
+    } else {
+        regs->eax = call_handler(regs);
+    }
+
+    process_die_if_needed();
+}
+
 static void syscall_handler(registers* regs) {
     ASSERT((regs->cs & 3) == 3);
     ASSERT((regs->ds & 3) == 3);
@@ -91,26 +131,39 @@ static void syscall_handler(registers* regs) {
     ASSERT((regs->fs & 3) == 3);
     ASSERT((regs->gs & 3) == 3);
     ASSERT((regs->user_ss & 3) == 3);
-    ASSERT(interrupts_enabled());
+    syscall_dispatch(regs);
+}
 
-    process_die_if_needed();
+#if defined(__i386__)
 
-    if (regs->eax >= NUM_SYSCALLS) {
-        regs->eax = -ENOSYS;
-        return;
-    }
+#define MSR_SYSENTER_CS 0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
 
-    syscall_handler_fn handler = syscall_handlers[regs->eax];
-    ASSERT(handler);
+void sysenter_entry(void);
 
-    if (regs->eax == SYS_fork)
-        regs->eax = handler((uintptr_t)regs, 0, 0, 0);
-    else
-        regs->eax = handler(regs->edx, regs->ecx, regs->ebx, regs->esi);
+void syscall_init_sysenter(uintptr_t esp0_slot) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & (1 << 11))) // SEP
+        return;
 
-    process_die_if_needed();
+    // early Pentium Pro report SEP without supporting sysenter
+    uint32_t family = (eax >> 8) & 0xf;
+    uint32_t model = (eax >> 4) & 0xf;
+    uint32_t stepping = eax & 0xf;
+    if (family == 6 && model < 3 && stepping < 3)
+        return;
+
+    // sysenter loads cs and ss from the kernel code and data segments,
+    // and sysexit the user ones, which follow them in the GDT
+    write_msr(MSR_SYSENTER_CS, 0x8);
+    write_msr(MSR_SYSENTER_ESP, esp0_slot);
+    write_msr(MSR_SYSENTER_EIP, (uintptr_t)sysenter_entry);
 }
 
+#endif
+
 void syscall_init(void) {
     /* IDTs are i?86-specific things... */
     #if defined(__i386__)
@@ -35,12 +35,19 @@
 
 #pragma once
 
+#include <kernel/api/mqueue.h>
+#include <kernel/api/poll.h>
+#include <kernel/api/sched.h>
+#include <kernel/api/sys/epoll.h>
 #include <kernel/api/sys/socket.h>
 #include <kernel/api/sys/stat.h>
 #include <kernel/api/sys/syscall.h>
 #include <kernel/api/sys/times.h>
+#include <kernel/api/sys/uio.h>
+#include <kernel/api/systrace.h>
 #include <kernel/api/time.h>
 #include <kernel/forward.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdnoreturn.h>
 
@@ -51,40 +58,117 @@ int sys_clock_gettime(clockid_t clk_id, struct timespec* tp);
 int sys_clock_nanosleep(clockid_t clockid, int flags,
                         const struct timespec* request,
                         struct timespec* remain);
+pid_t sys_clone(registers*, unsigned long flags, void* stack, void* tls,
+                pid_t* ctid);
 int sys_close(int fd);
 int sys_connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen);
+ssize_t sys_copy_file_range(const splice_params* params);
 int sys_dbgputs(const char* str);
 int sys_dup2(int oldfd, int newfd);
+int sys_epoll_create1(int flags);
+int sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event* event);
+int sys_epoll_wait(int epfd, struct epoll_event* events, int maxevents,
+                   int timeout);
+int sys_eventfd(unsigned initval, int flags);
 int sys_execve(const char* pathname, char* const argv[], char* const envp[]);
 noreturn void sys_exit(int status);
+noreturn void sys_exit_group(int status);
 int sys_fcntl(int fd, int cmd, uintptr_t arg);
 pid_t sys_fork(registers*);
 int sys_ftruncate(int fd, off_t length);
+int sys_futex(uint32_t* uaddr, int op, uint32_t val,
+              const struct timespec* timeout);
 char* sys_getcwd(char* buf, size_t size);
 long sys_getdents(int fd, void* dirp, size_t count);
 pid_t sys_getpgid(pid_t pid);
 pid_t sys_getpid(void);
+int sys_getsockopt(const sockopt_params* params);
+pid_t sys_gettid(void);
 int sys_ioctl(int fd, int request, void* argp);
+int sys_ioring_enter(int fd, unsigned to_submit, unsigned min_complete);
+int sys_ioring_setup(unsigned entries);
 int sys_kill(pid_t pid, int sig);
 int sys_link(const char* oldpath, const char* newpath);
 int sys_listen(int sockfd, int backlog);
 off_t sys_lseek(int fd, off_t offset, int whence);
+int sys_memfd_create(const char* name, unsigned int flags);
 int sys_mkdir(const char* pathname, mode_t mode);
 int sys_mknod(const char* pathname, mode_t mode, dev_t dev);
 void* sys_mmap(const mmap_params* params);
+int sys_mq_getsetattr(int mqdes, const struct mq_attr* newattr,
+                      struct mq_attr* oldattr);
+int sys_mq_open(const char* name, int oflag, mode_t mode,
+                const struct mq_attr* attr);
+ssize_t sys_mq_timedreceive(const mq_timed_params* params);
+int sys_mq_timedsend(const mq_timed_params* params);
+int sys_mq_unlink(const char* name);
 int sys_munmap(void* addr, size_t length);
+int sys_nice(int inc);
 int sys_open(const char* pathname, int flags, unsigned mode);
 int sys_pipe(int pipefd[2]);
+int sys_poll(struct pollfd* fds, nfds_t nfds, int timeout);
+ssize_t sys_pread(int fd, void* buf, size_t count, off_t offset);
+ssize_t sys_pwrite(int fd, const void* buf, size_t count, off_t offset);
 ssize_t sys_read(int fd, void* buf, size_t count);
+ssize_t sys_readv(int fd, const struct iovec* iov, int iovcnt);
 int sys_reboot(int howto);
+ssize_t sys_recvmsg(int sockfd, struct msghdr* msg, int flags);
 int sys_rename(const char* oldpath, const char* newpath);
 int sys_rmdir(const char* pathname);
+int sys_sched_getparam(pid_t pid, struct sched_param* param);
+int sys_sched_getscheduler(pid_t pid);
+int sys_sched_setscheduler(pid_t pid, int policy,
+                           const struct sched_param* param);
 int sys_sched_yield(void);
+ssize_t sys_sendfile(int out_fd, int in_fd, off_t* offset, size_t count);
+ssize_t sys_sendmsg(int sockfd, const struct msghdr* msg, int flags);
+int sys_set_thread_area(void* base);
 int sys_setpgid(pid_t pid, pid_t pgid);
+int sys_setsockopt(const sockopt_params* params);
 int sys_socket(int domain, int type, int protocol);
+int sys_socketpair(int domain, int type, int protocol, int sv[2]);
+ssize_t sys_splice(const splice_params* params);
 int sys_stat(const char* pathname, struct stat* buf);
 long sys_sysconf(int name);
+int sys_systrace(int op, pid_t pid);
+ssize_t sys_systrace_read(unsigned* cursor, struct syscall_record* buf,
+                          size_t count);
+ssize_t sys_tee(int fd_in, int fd_out, size_t len, unsigned flags);
+int sys_timerfd_create(clockid_t clockid, int flags);
+int sys_timerfd_gettime(int fd, struct itimerspec* curr_value);
+int sys_timerfd_settime(int fd, int flags, const struct itimerspec* new_value,
+                        struct itimerspec* old_value);
 clock_t sys_times(struct tms* buf);
 int sys_unlink(const char* pathname);
+ssize_t sys_vmsplice(int fd, const struct iovec* iov, size_t nr_segs,
+                     unsigned flags);
 pid_t sys_waitpid(pid_t pid, int* wstatus, int options);
 ssize_t sys_write(int fd, const void* buf, size_t count);
+ssize_t sys_writev(int fd, const struct iovec* iov, int iovcnt);
+
+// Tracing of syscalls. Processes with traced set, or every process while
+// systrace_all is set, have their syscalls recorded in a ring buffer and
+// counted in syscall_stats.
+
+extern atomic_bool systrace_all;
+
+// log2 histogram of the TSC cycles spent in each syscall
+#define SYSCALL_HISTOGRAM_NUM_BUCKETS 32
+
+struct syscall_stat {
+    atomic_uint count;
+    atomic_uint histogram[SYSCALL_HISTOGRAM_NUM_BUCKETS];
+};
+
+extern struct syscall_stat syscall_stats[NUM_SYSCALLS];
+extern const char* const syscall_names[NUM_SYSCALLS];
+
+void systrace_record(unsigned num, const uint32_t args[4], uint32_t ret,
+                     uint32_t cycles);
+
+// stores 0 at the user address and wakes its futex waiters
+void futex_clear_and_wake(pid_t* uaddr);
+
+// accept() on an already looked up socket description
+int socket_accept(file_description*, struct sockaddr* addr,
+                  socklen_t* addrlen);
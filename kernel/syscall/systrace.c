@@ -0,0 +1,149 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "syscall.h"
+#include <kernel/api/errno.h>
+#include <kernel/panic.h>
+#include <kernel/process.h>
+
+#define RING_SIZE 1024
+
+// set on a slot while a writer is filling it
+#define SEQ_BUSY 0xffffffff
+
+struct slot {
+    atomic_uint seq;
+    struct syscall_record record;
+};
+
+// Writers claim slots with atomic_fetch_add on ring_head, so recording never
+// takes a lock. Readers check seq before and after copying a slot to detect
+// that it was overwritten meanwhile.
+static struct slot ring[RING_SIZE];
+static atomic_uint ring_head;
+
+atomic_bool systrace_all;
+struct syscall_stat syscall_stats[NUM_SYSCALLS];
+
+const char* const syscall_names[NUM_SYSCALLS] = {
+#define ENUM_ITEM(name) #name,
+    ENUMERATE_SYSCALLS(ENUM_ITEM)
+#undef ENUM_ITEM
+};
+
+void systrace_record(unsigned num, const uint32_t args[4], uint32_t ret,
+                     uint32_t cycles) {
+    struct syscall_stat* stat = syscall_stats + num;
+    atomic_fetch_add_explicit(&stat->count, 1, memory_order_relaxed);
+    size_t bucket = cycles ? 31 - __builtin_clz(cycles) : 0;
+    atomic_fetch_add_explicit(&stat->histogram[bucket], 1,
+                              memory_order_relaxed);
+
+    unsigned seq = atomic_fetch_add(&ring_head, 1);
+    struct slot* slot = ring + seq % RING_SIZE;
+    atomic_store(&slot->seq, SEQ_BUSY);
+    slot->record = (struct syscall_record){
+        .seq = seq,
+        .pid = current->pid,
+        .num = num,
+        .args = {args[0], args[1], args[2], args[3]},
+        .ret = ret,
+        .cycles = cycles,
+    };
+    atomic_store_explicit(&slot->seq, seq, memory_order_release);
+}
+
+int sys_systrace(int op, pid_t pid) {
+    bool traced;
+    switch (op) {
+    case SYSTRACE_ATTACH:
+        traced = true;
+        break;
+    case SYSTRACE_DETACH:
+        traced = false;
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    if (pid == SYSTRACE_ALL) {
+        atomic_store(&systrace_all, traced);
+        return 0;
+    }
+
+    struct process* process = pid ? process_find_process_by_pid(pid) : current;
+    if (!process)
+        return -ESRCH;
+    process->traced = traced;
+    return 0;
+}
+
+ssize_t sys_systrace_read(unsigned* user_cursor, struct syscall_record* buf,
+                          size_t count) {
+    if (!user_cursor || (count && !buf))
+        return -EFAULT;
+
+    unsigned head = atomic_load(&ring_head);
+    if (!count) {
+        *user_cursor = head;
+        return 0;
+    }
+
+    // records older than the last RING_SIZE ones are gone, and the reader
+    // notices the gap in seq
+    unsigned cursor = *user_cursor;
+    if ((int)(head - cursor) < 0)
+        cursor = head;
+    else if (head - cursor > RING_SIZE)
+        cursor = head - RING_SIZE;
+
+    size_t n = 0;
+    while (n < count && cursor != head) {
+        struct slot* slot = ring + cursor % RING_SIZE;
+        unsigned seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq == SEQ_BUSY || (int)(seq - cursor) < 0)
+            break; // the writer hasn't finished yet
+        if (seq == cursor) {
+            struct syscall_record record = slot->record;
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load(&slot->seq) == cursor)
+                buf[n++] = record;
+        }
+        ++cursor;
+    }
+
+    *user_cursor = cursor;
+    return n;
+}
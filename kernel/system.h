@@ -36,7 +36,9 @@
 #pragma once
 
 #include "forward.h"
+#include <common/extra.h>
 #include <stdalign.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdnoreturn.h>
@@ -62,14 +64,38 @@ struct fpu_state {
     alignas(16) unsigned char buffer[512];
 };
 
-void gdt_init(void);
+extern atomic_size_t fpu_num_lazy_restores;
+extern atomic_size_t fpu_num_saves;
+
+void fpu_init(void);
+void fpu_switch_out(struct process* prev);
+void fpu_switch_in(void);
+
+// writes the live FPU registers of the current process back to fpu_state
+void fpu_save_current(void);
+
+// gives the current process a fresh FPU state
+void fpu_reset_current(void);
+
+void gdt_init(struct cpu*);
 void gdt_set_kernel_stack(uintptr_t stack_top);
+void gdt_set_tls_base(uintptr_t base);
+
+// points the sysenter MSRs of the current CPU at the entry stub, which finds
+// the kernel stack through the TSS field at esp0_slot
+void syscall_init_sysenter(uintptr_t esp0_slot);
 #endif
 
 void syscall_init(void);
 
 extern uint32_t uptime;
 
+void vdso_init(void);
+void vdso_update_time(const struct timespec* now);
+
+// maps the vDSO data page into the current address space
+NODISCARD int vdso_map(void);
+
 #if defined(__i386__)
 void pit_init(void);
 #endif
@@ -82,6 +108,9 @@ bool cmdline_contains(const char* key);
 void time_init(void);
 void time_tick(void);
 int time_now(struct timespec*);
+void timespec_add(struct timespec* this, const struct timespec* other);
+void timespec_saturating_sub(struct timespec* this, const struct timespec* other);
+bool time_has_passed(const struct timespec* deadline);
 
 noreturn void reboot(void);
 noreturn void halt(void);
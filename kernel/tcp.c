@@ -0,0 +1,1044 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "api/fcntl.h"
+#include "api/poll.h"
+#include "api/signum.h"
+#include "boot_defs.h"
+#include "network.h"
+#include "nic.h"
+#include "panic.h"
+#include "process.h"
+#include "socket.h"
+#include "system.h"
+#include <common/string.h>
+
+#define DEFAULT_MSS 536
+#define LOCAL_MSS                                                              \
+    (NET_MTU - sizeof(struct ip_header) - sizeof(struct tcp_header))
+#define MAX_WINDOW 65535
+
+#define DEFAULT_BUF_SIZE (16 * PAGE_SIZE)
+#define MAX_BUF_SIZE (256 * PAGE_SIZE)
+
+// Without RTT measurements, the retransmission timeout stays at the initial
+// value of RFC 6298 and only backs off exponentially.
+#define RTO_INITIAL CLK_TCK
+#define RTO_MAX (60 * CLK_TCK)
+#define MAX_RETRANSMITS 8
+
+#define DELAYED_ACK_TICKS (CLK_TCK / 25)
+// Nothing on loopback lives long, so TIME_WAIT is much shorter than 2 MSL.
+#define TIME_WAIT_TICKS (2 * CLK_TCK)
+// how long an orphaned connection waits for the FIN of the peer
+#define FIN_WAIT_2_TICKS (30 * CLK_TCK)
+
+#define SEQ_LT(a, b) ((int32_t)((a) - (b)) < 0)
+#define SEQ_LEQ(a, b) ((int32_t)((a) - (b)) <= 0)
+#define SEQ_GT(a, b) SEQ_LT(b, a)
+#define SEQ_GEQ(a, b) SEQ_LEQ(b, a)
+
+#define TCP_OPTION_END 0
+#define TCP_OPTION_NOP 1
+#define TCP_OPTION_MSS 2
+
+// a received segment, with its fields in host byte order
+struct segment {
+    uint32_t seq;
+    uint32_t ack;
+    uint8_t flags;
+    uint32_t window;
+    size_t mss;
+    const unsigned char* data;
+    size_t len;
+};
+
+static uint32_t generate_iss(void) {
+    static atomic_uint counter;
+    return uptime * 4096 + (counter += 64000);
+}
+
+static bool has_expired(uint32_t deadline) {
+    return deadline && (int32_t)(uptime - deadline) >= 0;
+}
+
+static void arm_timer(uint32_t* deadline, uint32_t ticks) {
+    *deadline = uptime + ticks;
+    if (*deadline == 0)
+        *deadline = 1;
+    net_arm_timer(*deadline);
+}
+
+static bool can_send_data(int state) {
+    return state == TCP_ESTABLISHED || state == TCP_CLOSE_WAIT;
+}
+
+// the peer may still send data
+static bool can_receive_data(int state) {
+    return state == TCP_SYN_SENT || state == TCP_SYN_RECEIVED ||
+           state == TCP_ESTABLISHED || state == TCP_FIN_WAIT_1 ||
+           state == TCP_FIN_WAIT_2;
+}
+
+static size_t recv_window(const struct tcp_state* tcp) {
+    size_t space = tcp->recv_buf.capacity - ring_buf_size(&tcp->recv_buf);
+    return MIN(space, MAX_WINDOW);
+}
+
+static size_t send_buf_space(const struct tcp_state* tcp) {
+    return tcp->send_buf.capacity - ring_buf_size(&tcp->send_buf);
+}
+
+// Sends a segment with len bytes of the send buffer starting at offset.
+static int send_segment(inet_socket* socket, uint32_t seq, uint8_t flags,
+                        size_t offset, size_t len) {
+    struct tcp_state* tcp = &socket->tcp;
+    size_t options_len = (flags & TCP_SYN) ? 4 : 0;
+    size_t header_len = sizeof(struct tcp_header) + options_len;
+    struct packet* packet = packet_alloc(header_len + len);
+    if (!packet)
+        return -ENOBUFS;
+
+    size_t window = recv_window(tcp);
+    struct tcp_header* header = (struct tcp_header*)packet->data;
+    *header = (struct tcp_header){
+        .src_port = socket->local_port,
+        .dest_port = socket->remote_port,
+        .seq_num = htonl(seq),
+        .ack_num = (flags & TCP_ACK) ? htonl(tcp->rcv_nxt) : 0,
+        .data_offset = (header_len / 4) << 4,
+        .flags = flags,
+        .window_size = htons(window),
+    };
+    if (options_len) {
+        unsigned char* options = packet->data + sizeof(struct tcp_header);
+        uint16_t mss = htons(LOCAL_MSS);
+        options[0] = TCP_OPTION_MSS;
+        options[1] = 4;
+        memcpy(options + 2, &mss, sizeof(mss));
+    }
+    if (len)
+        ASSERT((size_t)ring_buf_peek(&tcp->send_buf, offset,
+                                     packet->data + header_len, len) == len);
+    packet->len = header_len + len;
+    header->checksum = net_checksum(
+        packet->data, packet->len,
+        net_pseudo_header_sum(socket->local_ip, socket->remote_ip,
+                              IPPROTO_TCP, packet->len));
+
+    if (flags & TCP_ACK) {
+        // every segment with an ACK acknowledges everything received so far
+        tcp->rcv_adv = tcp->rcv_nxt + window;
+        tcp->ack_now = false;
+        tcp->segs_unacked = 0;
+        tcp->delack_deadline = 0;
+    }
+    return net_send_packet(socket->local_ip, socket->remote_ip, IPPROTO_TCP,
+                           packet);
+}
+
+// answers a segment that no connection takes
+static void send_reset(const struct packet* packet,
+                       const struct tcp_header* in, size_t seg_len) {
+    if (in->flags & TCP_RST)
+        return;
+    struct packet* reply = packet_alloc(sizeof(struct tcp_header));
+    if (!reply)
+        return;
+    struct tcp_header* header = (struct tcp_header*)reply->data;
+    *header = (struct tcp_header){
+        .src_port = in->dest_port,
+        .dest_port = in->src_port,
+        .data_offset = (sizeof(struct tcp_header) / 4) << 4,
+    };
+    if (in->flags & TCP_ACK) {
+        header->seq_num = in->ack_num;
+        header->flags = TCP_RST;
+    } else {
+        header->ack_num = htonl(ntohl(in->seq_num) + seg_len);
+        header->flags = TCP_RST | TCP_ACK;
+    }
+    reply->len = sizeof(struct tcp_header);
+    header->checksum = net_checksum(
+        reply->data, reply->len,
+        net_pseudo_header_sum(packet->dest_ip, packet->src_ip, IPPROTO_TCP,
+                              reply->len));
+    net_send_packet(packet->dest_ip, packet->src_ip, IPPROTO_TCP, reply);
+}
+
+static void enter_closed(inet_socket* socket, int error) {
+    struct tcp_state* tcp = &socket->tcp;
+    tcp->state = TCP_CLOSED;
+    if (error)
+        socket->error = error;
+    tcp->rtx_deadline = tcp->delack_deadline = tcp->time_wait_deadline = 0;
+    if (tcp->listener) {
+        --tcp->listener->tcp.num_pending;
+        inode_unref(&tcp->listener->inode);
+        tcp->listener = NULL;
+    }
+    inet_socket_notify(socket);
+    // lets the timers remove an orphaned socket from the table
+    net_arm_timer(uptime);
+}
+
+static void abort_connection(inet_socket* socket, int error) {
+    struct tcp_state* tcp = &socket->tcp;
+    if (tcp->state != TCP_CLOSED && tcp->state != TCP_LISTEN &&
+        tcp->state != TCP_SYN_SENT)
+        send_segment(socket, tcp->snd_nxt, TCP_RST | TCP_ACK, 0, 0);
+    enter_closed(socket, error);
+}
+
+static void enter_time_wait(inet_socket* socket) {
+    struct tcp_state* tcp = &socket->tcp;
+    tcp->state = TCP_TIME_WAIT;
+    tcp->rtx_deadline = 0;
+    arm_timer(&tcp->time_wait_deadline, TIME_WAIT_TICKS);
+}
+
+// Sends whatever the window, Nagle's algorithm and the pending ACK allow, and
+// arms the timers for what is left.
+static void tcp_output(inet_socket* socket) {
+    struct tcp_state* tcp = &socket->tcp;
+    switch (tcp->state) {
+    case TCP_CLOSED:
+    case TCP_LISTEN:
+        return;
+    case TCP_SYN_SENT:
+    case TCP_SYN_RECEIVED:
+        if (tcp->snd_nxt == tcp->iss) {
+            uint8_t flags = TCP_SYN;
+            if (tcp->state == TCP_SYN_RECEIVED)
+                flags |= TCP_ACK;
+            send_segment(socket, tcp->iss, flags, 0, 0);
+            tcp->snd_nxt = tcp->snd_max = tcp->iss + 1;
+        }
+        if (!tcp->rtx_deadline)
+            arm_timer(&tcp->rtx_deadline, tcp->rto);
+        return;
+    }
+
+    bool has_data_state = can_send_data(tcp->state) ||
+                          tcp->state == TCP_FIN_WAIT_1 ||
+                          tcp->state == TCP_CLOSING ||
+                          tcp->state == TCP_LAST_ACK;
+    size_t unsent = 0;
+    while (has_data_state && !tcp->fin_sent) {
+        size_t buffered = ring_buf_size(&tcp->send_buf);
+        size_t offset = tcp->snd_nxt - tcp->snd_una;
+        unsent = buffered - offset;
+        uint32_t window_end = tcp->snd_una + tcp->snd_wnd;
+        size_t usable =
+            SEQ_GT(window_end, tcp->snd_nxt) ? window_end - tcp->snd_nxt : 0;
+        size_t len = MIN(MIN(unsent, usable), tcp->mss);
+        bool fin = tcp->fin_queued && len == unsent;
+        if (len == 0 && !fin)
+            break;
+
+        // Nagle's algorithm: while data is in flight, small segments wait
+        // for its ACK so that they can be coalesced. The last segment before
+        // FIN is never held back.
+        bool in_flight = tcp->snd_nxt != tcp->snd_una;
+        if (len < tcp->mss && !fin && in_flight &&
+            (!tcp->nodelay || len < unsent))
+            break;
+
+        uint8_t flags = TCP_ACK;
+        if (len > 0 && len == unsent)
+            flags |= TCP_PSH;
+        if (fin)
+            flags |= TCP_FIN;
+        if (IS_ERR(send_segment(socket, tcp->snd_nxt, flags, offset, len)))
+            break;
+        tcp->snd_nxt += len + fin;
+        if (SEQ_GT(tcp->snd_nxt, tcp->snd_max))
+            tcp->snd_max = tcp->snd_nxt;
+        if (fin)
+            tcp->fin_sent = true;
+        unsent -= len;
+    }
+
+    // The retransmission timer covers the data in flight, and doubles as the
+    // persist timer when the window of the peer keeps unsent data back.
+    bool pending = tcp->snd_nxt != tcp->snd_una || unsent > 0 ||
+                   (tcp->fin_queued && !tcp->fin_sent);
+    if (has_data_state && pending && !tcp->rtx_deadline)
+        arm_timer(&tcp->rtx_deadline, tcp->rto);
+
+    if (tcp->ack_now)
+        send_segment(socket, tcp->snd_nxt, TCP_ACK, 0, 0);
+    else if (tcp->segs_unacked > 0 && !tcp->delack_deadline)
+        arm_timer(&tcp->delack_deadline, DELAYED_ACK_TICKS);
+}
+
+static void on_retransmit_timeout(inet_socket* socket) {
+    struct tcp_state* tcp = &socket->tcp;
+    tcp->rtx_deadline = 0;
+    switch (tcp->state) {
+    case TCP_CLOSED:
+    case TCP_LISTEN:
+    case TCP_FIN_WAIT_2:
+    case TCP_TIME_WAIT:
+        return;
+    }
+
+    if (tcp->snd_nxt == tcp->snd_una && tcp->snd_wnd == 0 &&
+        !ring_buf_is_empty(&tcp->send_buf)) {
+        // Probe the zero window with a byte. The peer acknowledges it if the
+        // window has opened, and otherwise reports the window again.
+        send_segment(socket, tcp->snd_una, TCP_ACK, 0, 1);
+        if (SEQ_GT(tcp->snd_una + 1, tcp->snd_max))
+            tcp->snd_max = tcp->snd_una + 1;
+        tcp->rto = MIN(tcp->rto * 2, RTO_MAX);
+        arm_timer(&tcp->rtx_deadline, tcp->rto);
+        return;
+    }
+
+    if (++tcp->num_retransmits > MAX_RETRANSMITS) {
+        abort_connection(socket, -ETIMEDOUT);
+        return;
+    }
+    tcp->rto = MIN(tcp->rto * 2, RTO_MAX);
+
+    // go back to the oldest unacknowledged byte and send everything again
+    if (tcp->state == TCP_SYN_SENT || tcp->state == TCP_SYN_RECEIVED) {
+        tcp->snd_nxt = tcp->iss;
+    } else {
+        tcp->snd_nxt = tcp->snd_una;
+        tcp->fin_sent = false;
+    }
+    tcp_output(socket);
+}
+
+static size_t parse_mss(const unsigned char* options, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        uint8_t kind = options[i];
+        if (kind == TCP_OPTION_END)
+            break;
+        if (kind == TCP_OPTION_NOP) {
+            ++i;
+            continue;
+        }
+        if (i + 1 >= len)
+            break;
+        uint8_t option_len = options[i + 1];
+        if (option_len < 2 || i + option_len > len)
+            break;
+        if (kind == TCP_OPTION_MSS && option_len == 4) {
+            uint16_t mss;
+            memcpy(&mss, options + i + 2, sizeof(mss));
+            return ntohs(mss);
+        }
+        i += option_len;
+    }
+    return DEFAULT_MSS;
+}
+
+static void set_mss(struct tcp_state* tcp, size_t peer_mss) {
+    tcp->mss = MAX(MIN(peer_mss, LOCAL_MSS), 64);
+}
+
+// A SYN for a listener creates a connection in SYN_RECEIVED, which is
+// returned with a reference so that the caller can put it into the table
+// after unlocking the listener.
+static inet_socket* listen_input(inet_socket* listener,
+                                 const struct packet* packet,
+                                 const struct tcp_header* header,
+                                 const struct segment* seg) {
+    if (seg->flags & TCP_RST)
+        return NULL;
+    if (seg->flags & TCP_ACK) {
+        send_reset(packet, header, seg->len);
+        return NULL;
+    }
+    if (!(seg->flags & TCP_SYN))
+        return NULL;
+    // the peer retries the SYN later
+    if (listener->tcp.num_pending >= (size_t)listener->backlog)
+        return NULL;
+
+    inet_socket* socket = inet_socket_create(SOCK_STREAM, IPPROTO_TCP);
+    if (IS_ERR(socket))
+        return NULL;
+    if (IS_ERR(tcp_set_buf_size(socket, true,
+                                listener->tcp.send_buf.capacity)) ||
+        IS_ERR(tcp_set_buf_size(socket, false,
+                                listener->tcp.recv_buf.capacity))) {
+        inode_unref(&socket->inode);
+        return NULL;
+    }
+
+    // not in the table yet, so the addresses can be set without its lock
+    socket->local_ip = packet->dest_ip;
+    socket->local_port = header->dest_port;
+    socket->remote_ip = packet->src_ip;
+    socket->remote_port = header->src_port;
+    socket->connected = true;
+
+    struct tcp_state* tcp = &socket->tcp;
+    mutex_lock(&socket->lock);
+    tcp->orphan = true;
+    tcp->nodelay = listener->tcp.nodelay;
+    tcp->state = TCP_SYN_RECEIVED;
+    tcp->rcv_nxt = seg->seq + 1;
+    tcp->snd_wnd = seg->window;
+    set_mss(tcp, seg->mss);
+    tcp->iss = tcp->snd_una = tcp->snd_nxt = tcp->snd_max = generate_iss();
+    inode_ref(&listener->inode);
+    tcp->listener = listener;
+    ++listener->tcp.num_pending;
+    tcp_output(socket);
+    mutex_unlock(&socket->lock);
+    return socket;
+}
+
+static void syn_sent_input(inet_socket* socket, const struct packet* packet,
+                           const struct tcp_header* header,
+                           const struct segment* seg) {
+    struct tcp_state* tcp = &socket->tcp;
+    if ((seg->flags & TCP_ACK) && seg->ack != tcp->iss + 1) {
+        send_reset(packet, header, seg->len);
+        return;
+    }
+    if (seg->flags & TCP_RST) {
+        if (seg->flags & TCP_ACK)
+            enter_closed(socket, -ECONNREFUSED);
+        return;
+    }
+    // simultaneous open isn't supported, so a SYN has to come with an ACK
+    if (!(seg->flags & TCP_SYN) || !(seg->flags & TCP_ACK))
+        return;
+
+    tcp->rcv_nxt = seg->seq + 1;
+    tcp->snd_una = seg->ack;
+    tcp->snd_wnd = seg->window;
+    set_mss(tcp, seg->mss);
+    tcp->state = TCP_ESTABLISHED;
+    tcp->rtx_deadline = 0;
+    tcp->rto = RTO_INITIAL;
+    tcp->num_retransmits = 0;
+    tcp->ack_now = true;
+    inet_socket_notify(socket);
+    tcp_output(socket);
+}
+
+// Processes an ACK that acknowledges new data, and returns whether it
+// acknowledged our FIN.
+static bool process_ack(inet_socket* socket, uint32_t ack) {
+    struct tcp_state* tcp = &socket->tcp;
+    uint32_t acked = ack - tcp->snd_una;
+    size_t data_acked = MIN(acked, ring_buf_size(&tcp->send_buf));
+    ring_buf_consume(&tcp->send_buf, data_acked);
+    bool fin_acked = acked > data_acked;
+    tcp->snd_una = ack;
+    if (SEQ_LT(tcp->snd_nxt, ack))
+        tcp->snd_nxt = ack;
+    if (fin_acked)
+        tcp->fin_sent = true;
+    tcp->rto = RTO_INITIAL;
+    tcp->num_retransmits = 0;
+    tcp->rtx_deadline = 0;
+    inet_socket_notify(socket);
+    return fin_acked;
+}
+
+// Processes a segment for a connection past SYN_SENT. Returns true when a
+// connection of a listener has just been established.
+static bool segment_input(inet_socket* socket, const struct packet* packet,
+                          const struct tcp_header* header,
+                          struct segment* seg) {
+    struct tcp_state* tcp = &socket->tcp;
+    if (tcp->state == TCP_CLOSED) {
+        send_reset(packet, header,
+                   seg->len + !!(seg->flags & TCP_SYN) +
+                       !!(seg->flags & TCP_FIN));
+        return false;
+    }
+    if (tcp->state == TCP_SYN_SENT) {
+        syn_sent_input(socket, packet, header, seg);
+        return false;
+    }
+
+    if (seg->flags & TCP_RST) {
+        uint32_t window_end = tcp->rcv_nxt + MAX(recv_window(tcp), 1);
+        if (SEQ_LT(seg->seq, tcp->rcv_nxt) || SEQ_GEQ(seg->seq, window_end))
+            return false;
+        bool graceful = tcp->state == TCP_SYN_RECEIVED ||
+                        tcp->state == TCP_CLOSING ||
+                        tcp->state == TCP_LAST_ACK ||
+                        tcp->state == TCP_TIME_WAIT;
+        enter_closed(socket, graceful ? 0 : -ECONNRESET);
+        return false;
+    }
+
+    if (seg->flags & TCP_SYN) {
+        // A retransmitted SYN means that the SYN-ACK or our ACK got lost.
+        if (tcp->state == TCP_SYN_RECEIVED)
+            tcp->snd_nxt = tcp->iss;
+        else
+            tcp->ack_now = true;
+        tcp_output(socket);
+        return false;
+    }
+
+    // Only the next expected segment is taken, as loopback doesn't reorder.
+    // Anything else gets an ACK telling the peer where to continue.
+    if (SEQ_LT(seg->seq, tcp->rcv_nxt)) {
+        uint32_t dup = tcp->rcv_nxt - seg->seq;
+        if (dup > seg->len || (dup == seg->len && !(seg->flags & TCP_FIN))) {
+            tcp->ack_now = true;
+            tcp_output(socket);
+            return false;
+        }
+        seg->data += dup;
+        seg->len -= dup;
+        seg->seq = tcp->rcv_nxt;
+    } else if (seg->seq != tcp->rcv_nxt) {
+        tcp->ack_now = true;
+        tcp_output(socket);
+        return false;
+    }
+    if (!(seg->flags & TCP_ACK))
+        return false;
+
+    bool established = false;
+    if (tcp->state == TCP_SYN_RECEIVED) {
+        if (seg->ack != tcp->iss + 1) {
+            send_reset(packet, header, seg->len);
+            return false;
+        }
+        tcp->state = TCP_ESTABLISHED;
+        tcp->snd_una = seg->ack;
+        tcp->rtx_deadline = 0;
+        tcp->num_retransmits = 0;
+        established = true;
+    } else if (SEQ_GT(seg->ack, tcp->snd_max)) {
+        tcp->ack_now = true;
+        tcp_output(socket);
+        return false;
+    } else if (SEQ_GT(seg->ack, tcp->snd_una) &&
+               process_ack(socket, seg->ack)) {
+        switch (tcp->state) {
+        case TCP_FIN_WAIT_1:
+            tcp->state = TCP_FIN_WAIT_2;
+            arm_timer(&tcp->time_wait_deadline, FIN_WAIT_2_TICKS);
+            break;
+        case TCP_CLOSING:
+            enter_time_wait(socket);
+            break;
+        case TCP_LAST_ACK:
+            enter_closed(socket, 0);
+            return false;
+        }
+    }
+    tcp->snd_wnd = seg->window;
+
+    bool notify = false;
+    if (seg->len > 0 && can_receive_data(tcp->state)) {
+        size_t space = tcp->recv_buf.capacity - ring_buf_size(&tcp->recv_buf);
+        if (seg->len > space) {
+            // beyond the window, so the FIN has to be sent again as well
+            seg->len = space;
+            seg->flags &= ~TCP_FIN;
+            tcp->ack_now = true;
+        }
+        // nobody is going to read what arrives after close()
+        if (!tcp->fin_queued)
+            ASSERT((size_t)ring_buf_write(&tcp->recv_buf, seg->data,
+                                          seg->len) == seg->len);
+        tcp->rcv_nxt += seg->len;
+        if (++tcp->segs_unacked >= 2)
+            tcp->ack_now = true;
+        notify = true;
+    }
+
+    if (seg->flags & TCP_FIN) {
+        tcp->rcv_nxt += 1;
+        tcp->ack_now = true;
+        switch (tcp->state) {
+        case TCP_ESTABLISHED:
+            tcp->state = TCP_CLOSE_WAIT;
+            break;
+        case TCP_FIN_WAIT_1:
+            tcp->state = TCP_CLOSING;
+            break;
+        case TCP_FIN_WAIT_2:
+        case TCP_TIME_WAIT:
+            enter_time_wait(socket);
+            break;
+        }
+        notify = true;
+    }
+
+    if (notify)
+        inet_socket_notify(socket);
+    tcp_output(socket);
+    return established;
+}
+
+// Queues a connection of a listener that has just been established, or
+// resets it if the listener went away in the meantime.
+static void queue_established(inet_socket* socket, inet_socket* listener) {
+    mutex_lock(&listener->lock);
+    bool queued = listener->tcp.state == TCP_LISTEN;
+    if (queued) {
+        inode_ref(&socket->inode);
+        struct tcp_state* tcp = &listener->tcp;
+        socket->tcp.next_pending = NULL;
+        if (tcp->accept_tail)
+            tcp->accept_tail->tcp.next_pending = socket;
+        else
+            tcp->accept_head = socket;
+        tcp->accept_tail = socket;
+        inet_socket_notify(listener);
+    } else {
+        --listener->tcp.num_pending;
+    }
+    mutex_unlock(&listener->lock);
+
+    if (!queued) {
+        mutex_lock(&socket->lock);
+        abort_connection(socket, 0);
+        mutex_unlock(&socket->lock);
+    }
+    inode_unref(&listener->inode);
+}
+
+void tcp_recv(struct packet* packet) {
+    const struct tcp_header* header = (const struct tcp_header*)packet->data;
+    if (packet->len < sizeof(struct tcp_header))
+        goto drop;
+    size_t header_len = (header->data_offset >> 4) * 4;
+    if (header_len < sizeof(struct tcp_header) || header_len > packet->len)
+        goto drop;
+    if (!(packet->interface->flags & NET_IF_LOOPBACK) &&
+        net_checksum(packet->data, packet->len,
+                     net_pseudo_header_sum(packet->src_ip, packet->dest_ip,
+                                           IPPROTO_TCP, packet->len)) != 0)
+        goto drop;
+
+    struct segment seg = {
+        .seq = ntohl(header->seq_num),
+        .ack = ntohl(header->ack_num),
+        .flags = header->flags,
+        .window = ntohs(header->window_size),
+        .mss = parse_mss(packet->data + sizeof(struct tcp_header),
+                         header_len - sizeof(struct tcp_header)),
+        .data = packet->data + header_len,
+        .len = packet->len - header_len,
+    };
+
+    inet_socket* socket =
+        inet_socket_lookup(IPPROTO_TCP, packet->dest_ip, header->dest_port,
+                           packet->src_ip, header->src_port);
+    if (!socket) {
+        send_reset(packet, header,
+                   seg.len + !!(seg.flags & TCP_SYN) + !!(seg.flags & TCP_FIN));
+        goto drop;
+    }
+
+    mutex_lock(&socket->lock);
+    inet_socket* child = NULL;
+    inet_socket* listener = NULL;
+    if (socket->tcp.state == TCP_LISTEN) {
+        child = listen_input(socket, packet, header, &seg);
+    } else if (segment_input(socket, packet, header, &seg)) {
+        // the reference of the connection to the listener is handed over
+        listener = socket->tcp.listener;
+        socket->tcp.listener = NULL;
+    }
+    mutex_unlock(&socket->lock);
+
+    if (child) {
+        inet_socket_hash(child);
+        inode_unref(&child->inode);
+    }
+    if (listener)
+        queue_established(socket, listener);
+    inode_unref(&socket->inode);
+drop:
+    packet_free(packet);
+}
+
+struct timers_ctx {
+    uint32_t next_deadline;
+};
+
+static void update_next_deadline(struct timers_ctx* ctx, uint32_t deadline) {
+    if (deadline && (!ctx->next_deadline ||
+                     (int32_t)(deadline - ctx->next_deadline) < 0))
+        ctx->next_deadline = deadline;
+}
+
+static bool run_timers(inet_socket* socket, void* data) {
+    struct timers_ctx* ctx = data;
+    struct tcp_state* tcp = &socket->tcp;
+    mutex_lock(&socket->lock);
+    if (has_expired(tcp->rtx_deadline))
+        on_retransmit_timeout(socket);
+    if (has_expired(tcp->delack_deadline)) {
+        tcp->delack_deadline = 0;
+        tcp->ack_now = true;
+        tcp_output(socket);
+    }
+    if (has_expired(tcp->time_wait_deadline)) {
+        tcp->time_wait_deadline = 0;
+        if (tcp->state == TCP_TIME_WAIT || tcp->state == TCP_FIN_WAIT_2)
+            enter_closed(socket, 0);
+    }
+    update_next_deadline(ctx, tcp->rtx_deadline);
+    update_next_deadline(ctx, tcp->delack_deadline);
+    update_next_deadline(ctx, tcp->time_wait_deadline);
+    bool remove = tcp->state == TCP_CLOSED && tcp->orphan;
+    mutex_unlock(&socket->lock);
+    return remove;
+}
+
+uint32_t tcp_run_timers(void) {
+    struct timers_ctx ctx = {0};
+    inet_socket_sweep(IPPROTO_TCP, run_timers, &ctx);
+    return ctx.next_deadline;
+}
+
+int tcp_init_socket(inet_socket* socket) {
+    struct tcp_state* tcp = &socket->tcp;
+    tcp->state = TCP_CLOSED;
+    tcp->mss = DEFAULT_MSS;
+    tcp->rto = RTO_INITIAL;
+    int rc = ring_buf_init(&tcp->send_buf, DEFAULT_BUF_SIZE);
+    if (IS_ERR(rc))
+        return rc;
+    rc = ring_buf_init(&tcp->recv_buf, DEFAULT_BUF_SIZE);
+    if (IS_ERR(rc)) {
+        ring_buf_destroy(&tcp->send_buf);
+        return rc;
+    }
+    return 0;
+}
+
+void tcp_destroy_socket(inet_socket* socket) {
+    ASSERT(!socket->tcp.listener);
+    ASSERT(!socket->tcp.accept_head);
+    ring_buf_destroy(&socket->tcp.send_buf);
+    ring_buf_destroy(&socket->tcp.recv_buf);
+}
+
+int tcp_listen(inet_socket* socket, int backlog) {
+    struct tcp_state* tcp = &socket->tcp;
+    if (socket->connected ||
+        (tcp->state != TCP_CLOSED && tcp->state != TCP_LISTEN))
+        return -EINVAL;
+    tcp->state = TCP_LISTEN;
+    socket->backlog = backlog;
+    return 0;
+}
+
+static bool accept_should_unblock(inet_socket* listener) {
+    return listener->tcp.accept_head || listener->tcp.state != TCP_LISTEN;
+}
+
+inet_socket* tcp_accept(inet_socket* listener, bool nonblock) {
+    struct tcp_state* tcp = &listener->tcp;
+    mutex_lock(&listener->lock);
+    for (;;) {
+        if (tcp->state != TCP_LISTEN) {
+            mutex_unlock(&listener->lock);
+            return ERR_PTR(-EINVAL);
+        }
+        if (tcp->accept_head)
+            break;
+        if (nonblock) {
+            mutex_unlock(&listener->lock);
+            return ERR_PTR(-EAGAIN);
+        }
+        int rc = inet_socket_wait(listener, accept_should_unblock);
+        if (IS_ERR(rc)) {
+            mutex_unlock(&listener->lock);
+            return ERR_PTR(rc);
+        }
+    }
+    inet_socket* socket = tcp->accept_head;
+    tcp->accept_head = socket->tcp.next_pending;
+    if (!tcp->accept_head)
+        tcp->accept_tail = NULL;
+    socket->tcp.next_pending = NULL;
+    --tcp->num_pending;
+    mutex_unlock(&listener->lock);
+
+    mutex_lock(&socket->lock);
+    socket->tcp.orphan = false;
+    mutex_unlock(&socket->lock);
+    return socket;
+}
+
+static bool connect_should_unblock(inet_socket* socket) {
+    return socket->tcp.state != TCP_SYN_SENT;
+}
+
+int tcp_connect(inet_socket* socket, bool nonblock) {
+    struct tcp_state* tcp = &socket->tcp;
+    tcp->iss = tcp->snd_una = tcp->snd_nxt = tcp->snd_max = generate_iss();
+    tcp->state = TCP_SYN_SENT;
+    socket->error = 0;
+    tcp_output(socket);
+    if (nonblock)
+        return -EINPROGRESS;
+
+    while (tcp->state == TCP_SYN_SENT) {
+        int rc = inet_socket_wait(socket, connect_should_unblock);
+        if (IS_ERR(rc))
+            return rc;
+    }
+    if (tcp->state == TCP_CLOSED) {
+        int rc = socket->error ? socket->error : -ECONNREFUSED;
+        socket->error = 0;
+        return rc;
+    }
+    return 0;
+}
+
+static bool send_should_unblock(inet_socket* socket) {
+    const struct tcp_state* tcp = &socket->tcp;
+    return (tcp->state != TCP_SYN_SENT && !can_send_data(tcp->state)) ||
+           send_buf_space(tcp) > 0;
+}
+
+// consumes an error reported by the peer or the timers
+static int take_error(inet_socket* socket) {
+    int rc = socket->error;
+    socket->error = 0;
+    return rc;
+}
+
+ssize_t tcp_sendmsg(inet_socket* socket, const msghdr* msg, bool nonblock) {
+    struct tcp_state* tcp = &socket->tcp;
+    size_t i = 0;
+    size_t iov_offset = 0;
+    size_t total = 0;
+    int rc = 0;
+    mutex_lock(&socket->lock);
+    for (;;) {
+        while (i < msg->msg_iovlen && iov_offset == msg->msg_iov[i].iov_len) {
+            ++i;
+            iov_offset = 0;
+        }
+        if (i == msg->msg_iovlen)
+            break;
+
+        if (tcp->state != TCP_SYN_SENT && !can_send_data(tcp->state)) {
+            rc = take_error(socket);
+            if (!rc)
+                rc = socket->connected ? -EPIPE : -ENOTCONN;
+            break;
+        }
+
+        size_t space = send_buf_space(tcp);
+        if (tcp->state == TCP_SYN_SENT || space == 0) {
+            if (nonblock) {
+                rc = -EAGAIN;
+                break;
+            }
+            rc = inet_socket_wait(socket, send_should_unblock);
+            if (IS_ERR(rc))
+                break;
+            continue;
+        }
+
+        const struct iovec* iov = &msg->msg_iov[i];
+        size_t n = MIN(space, iov->iov_len - iov_offset);
+        ASSERT((size_t)ring_buf_write(&tcp->send_buf,
+                                      (unsigned char*)iov->iov_base +
+                                          iov_offset,
+                                      n) == n);
+        iov_offset += n;
+        total += n;
+        tcp_output(socket);
+    }
+    mutex_unlock(&socket->lock);
+
+    if (total > 0)
+        return total;
+    if (rc == -EPIPE) {
+        int sig_rc = process_send_signal_to_one(current->pid, SIGPIPE);
+        if (IS_ERR(sig_rc))
+            return sig_rc;
+    }
+    return rc;
+}
+
+static bool recv_should_unblock(inet_socket* socket) {
+    const struct tcp_state* tcp = &socket->tcp;
+    return !ring_buf_is_empty(&tcp->recv_buf) ||
+           !can_receive_data(tcp->state) || socket->error;
+}
+
+ssize_t tcp_recvmsg(inet_socket* socket, msghdr* msg, bool nonblock) {
+    struct tcp_state* tcp = &socket->tcp;
+    mutex_lock(&socket->lock);
+    for (;;) {
+        if (!ring_buf_is_empty(&tcp->recv_buf))
+            break;
+        int rc = take_error(socket);
+        if (!rc && !socket->connected)
+            rc = -ENOTCONN;
+        if (!rc && !can_receive_data(tcp->state)) {
+            // the peer has sent FIN
+            mutex_unlock(&socket->lock);
+            return 0;
+        }
+        if (!rc && nonblock)
+            rc = -EAGAIN;
+        if (!rc)
+            rc = inet_socket_wait(socket, recv_should_unblock);
+        if (IS_ERR(rc)) {
+            mutex_unlock(&socket->lock);
+            return rc;
+        }
+    }
+
+    size_t nread = 0;
+    for (size_t i = 0; i < msg->msg_iovlen; ++i) {
+        const struct iovec* iov = &msg->msg_iov[i];
+        size_t n = ring_buf_read(&tcp->recv_buf, iov->iov_base, iov->iov_len);
+        nread += n;
+        if (n < iov->iov_len)
+            break;
+    }
+
+    // Tell the peer once the window has grown enough to be worth a segment,
+    // rather than after every read.
+    size_t window = recv_window(tcp);
+    size_t advertised = SEQ_GT(tcp->rcv_adv, tcp->rcv_nxt)
+                            ? tcp->rcv_adv - tcp->rcv_nxt
+                            : 0;
+    size_t threshold = MIN(tcp->recv_buf.capacity / 2, 2 * tcp->mss);
+    if (can_receive_data(tcp->state) && window > advertised &&
+        window - advertised >= threshold) {
+        tcp->ack_now = true;
+        tcp_output(socket);
+    }
+    mutex_unlock(&socket->lock);
+
+    msg->msg_flags = 0;
+    msg->msg_controllen = 0;
+    if (msg->msg_name) {
+        sockaddr_in addr_in = {.sin_family = AF_INET,
+                               .sin_port = socket->remote_port,
+                               .sin_addr = {.s_addr = socket->remote_ip}};
+        memcpy(msg->msg_name, &addr_in,
+               MIN(msg->msg_namelen, sizeof(sockaddr_in)));
+        msg->msg_namelen = sizeof(sockaddr_in);
+    }
+    return nread;
+}
+
+void tcp_close(inet_socket* socket) {
+    struct tcp_state* tcp = &socket->tcp;
+    tcp->orphan = true;
+    switch (tcp->state) {
+    case TCP_LISTEN:
+        // the connections that were never accepted go down with the listener
+        tcp->state = TCP_CLOSED;
+        while (tcp->accept_head) {
+            inet_socket* child = tcp->accept_head;
+            tcp->accept_head = child->tcp.next_pending;
+            child->tcp.next_pending = NULL;
+            --tcp->num_pending;
+            mutex_lock(&child->lock);
+            abort_connection(child, 0);
+            mutex_unlock(&child->lock);
+            inode_unref(&child->inode);
+        }
+        tcp->accept_tail = NULL;
+        inet_socket_notify(socket);
+        return;
+    case TCP_SYN_SENT:
+        enter_closed(socket, 0);
+        return;
+    case TCP_ESTABLISHED:
+        tcp->state = TCP_FIN_WAIT_1;
+        break;
+    case TCP_CLOSE_WAIT:
+        tcp->state = TCP_LAST_ACK;
+        break;
+    default:
+        return;
+    }
+
+    // Unread data would be lost, so the peer is told with a reset instead
+    // of an orderly close.
+    if (!ring_buf_is_empty(&tcp->recv_buf)) {
+        abort_connection(socket, 0);
+        return;
+    }
+    tcp->fin_queued = true;
+    tcp_output(socket);
+}
+
+short tcp_poll(inet_socket* socket, short events) {
+    const struct tcp_state* tcp = &socket->tcp;
+    short revents = 0;
+    if (tcp->state == TCP_LISTEN) {
+        if ((events & POLLIN) && tcp->accept_head)
+            revents |= POLLIN;
+        return revents;
+    }
+    if (socket->error)
+        revents |= POLLERR;
+    if (tcp->state == TCP_CLOSED && socket->connected)
+        revents |= POLLHUP;
+    if ((events & POLLIN) &&
+        (!ring_buf_is_empty(&tcp->recv_buf) ||
+         (socket->connected && !can_receive_data(tcp->state))))
+        revents |= POLLIN;
+    if ((events & POLLOUT) &&
+        ((can_send_data(tcp->state) && send_buf_space(tcp) > 0) ||
+         (socket->connected && tcp->state == TCP_CLOSED)))
+        revents |= POLLOUT;
+    return revents;
+}
+
+int tcp_set_buf_size(inet_socket* socket, bool send, size_t size) {
+    if (size > MAX_BUF_SIZE)
+        return -EINVAL;
+    ring_buf* buf = send ? &socket->tcp.send_buf : &socket->tcp.recv_buf;
+    int rc = ring_buf_resize(buf, MAX(size, PAGE_SIZE));
+    if (IS_ERR(rc))
+        return rc;
+    inet_socket_notify(socket);
+    return 0;
+}
@@ -128,9 +128,34 @@ void time_tick(void) {
         ++now.tv_sec;
         now.tv_nsec -= nanos;
     }
+    vdso_update_time(&now);
 }
 
 int time_now(struct timespec* tp) {
     *tp = now;
     return 0;
 }
+
+void timespec_add(struct timespec* this, const struct timespec* other) {
+    this->tv_sec += other->tv_sec;
+    this->tv_nsec += other->tv_nsec;
+    if (this->tv_nsec >= 1000000000) {
+        ++this->tv_sec;
+        this->tv_nsec -= 1000000000;
+    }
+}
+
+void timespec_saturating_sub(struct timespec* this, const struct timespec* other) {
+    this->tv_sec -= other->tv_sec;
+    this->tv_nsec -= other->tv_nsec;
+    if (this->tv_nsec < 0) {
+        --this->tv_sec;
+        this->tv_nsec += 1000000000;
+    }
+    if (this->tv_sec < 0)
+        this->tv_sec = this->tv_nsec = 0;
+}
+
+bool time_has_passed(const struct timespec* deadline) {
+    return now.tv_sec > deadline->tv_sec || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
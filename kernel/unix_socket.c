@@ -33,96 +33,406 @@
  *  THE SOFTWARE.
  */
 
+#include "api/fcntl.h"
+#include "api/poll.h"
+#include "boot_defs.h"
 #include "memory/memory.h"
 #include "panic.h"
+#include "process.h"
 #include "scheduler.h"
 #include "socket.h"
 
+// Descriptors passed with SCM_RIGHTS. They are delivered by the read that
+// starts at offset, the write_idx of the channel when they were sent.
+typedef struct unix_rights {
+    size_t offset;
+    size_t num_descs;
+    struct unix_rights* next;
+    file_description* descs[];
+} unix_rights;
+
+static void destroy_rights(unix_rights* rights) {
+    for (size_t i = 0; i < rights->num_descs; ++i)
+        file_description_close(rights->descs[i]);
+    kfree(rights);
+}
+
+static int init_channel(unix_channel* channel) {
+    channel->rights = NULL;
+    return ring_buf_init(&channel->buf, PAGE_SIZE);
+}
+
+static void destroy_channel(unix_channel* channel) {
+    unix_rights* it = channel->rights;
+    while (it) {
+        unix_rights* next = it->next;
+        destroy_rights(it);
+        it = next;
+    }
+    ring_buf_destroy(&channel->buf);
+}
+
 static void unix_socket_destroy_inode(struct inode* inode) {
     unix_socket* socket = (unix_socket*)inode;
-    ring_buf_destroy(&socket->server_to_client_buf);
-    ring_buf_destroy(&socket->client_to_server_buf);
+    destroy_channel(&socket->server_to_client);
+    destroy_channel(&socket->client_to_server);
+    if (socket->peer)
+        inode_unref(&socket->peer->inode);
     kfree(socket);
 }
 
-static ring_buf* get_buf_to_read(unix_socket* socket, file_description* desc) {
+// SOCK_DGRAM sockets created by socket() rather than socketpair() have no
+// other end, and receive into client_to_server from anyone who sends to them.
+static bool is_unpaired_dgram(const unix_socket* socket) {
+    return socket->type == SOCK_DGRAM && !socket->connected;
+}
+
+static bool has_message_boundaries(const unix_socket* socket) {
+    return socket->type != SOCK_STREAM;
+}
+
+static unix_channel* get_channel_to_read(unix_socket* socket,
+                                         file_description* desc) {
     bool is_client = socket->connector_fd == desc;
-    return is_client ? &socket->server_to_client_buf : &socket->client_to_server_buf;
+    return is_client ? &socket->server_to_client : &socket->client_to_server;
+}
+
+// the socket that receives what desc writes without a destination
+static unix_socket* get_receiver(unix_socket* socket) {
+    return is_unpaired_dgram(socket) ? socket->peer : socket;
 }
 
-static ring_buf* get_buf_to_write(unix_socket* socket, file_description* desc) {
+static unix_channel* get_channel_to_write(unix_socket* socket,
+                                          file_description* desc) {
+    if (is_unpaired_dgram(socket))
+        return socket->peer ? &socket->peer->client_to_server : NULL;
     bool is_client = socket->connector_fd == desc;
-    return is_client ? &socket->client_to_server_buf : &socket->server_to_client_buf;
+    return is_client ? &socket->client_to_server : &socket->server_to_client;
 }
 
 static bool read_should_unblock(file_description* desc) {
     unix_socket* socket = (unix_socket*)desc->inode;
-    ring_buf* buf = get_buf_to_read(socket, desc);
-    return !ring_buf_is_empty(buf);
+    unix_channel* channel = get_channel_to_read(socket, desc);
+    return !ring_buf_is_empty(&channel->buf);
+}
+
+static size_t free_space(const unix_channel* channel) {
+    return channel->buf.capacity - ring_buf_size(&channel->buf);
+}
+
+static bool write_should_unblock(file_description* desc) {
+    unix_socket* socket = (unix_socket*)desc->inode;
+    unix_channel* channel = get_channel_to_write(socket, desc);
+    return !channel || free_space(channel) > 0;
+}
+
+struct space_blocker {
+    unix_channel* channel;
+    size_t needed;
+};
+
+static bool space_should_unblock(struct space_blocker* blocker) {
+    return free_space(blocker->channel) >= blocker->needed;
+}
+
+// Messages are stored in the ring buffer as their length followed by their
+// data, and are written and read whole.
+typedef size_t message_header;
+
+static size_t iov_total_len(const struct iovec* iov, size_t iovlen) {
+    size_t total = 0;
+    for (size_t i = 0; i < iovlen; ++i)
+        total += iov[i].iov_len;
+    return total;
+}
+
+static size_t write_iov(ring_buf* buf, const struct iovec* iov, size_t iovlen,
+                        size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < iovlen && total < count; ++i) {
+        size_t n = MIN(iov[i].iov_len, count - total);
+        total += ring_buf_write(buf, iov[i].iov_base, n);
+    }
+    return total;
+}
+
+static size_t read_iov(ring_buf* buf, const struct iovec* iov, size_t iovlen,
+                       size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < iovlen && total < count; ++i) {
+        size_t n = MIN(iov[i].iov_len, count - total);
+        total += ring_buf_read(buf, iov[i].iov_base, n);
+    }
+    return total;
+}
+
+static unix_rights* collect_rights(const msghdr* msg) {
+    if (!msg->msg_control || msg->msg_controllen == 0)
+        return NULL;
+
+    size_t num_descs = 0;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg;
+         cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+            cmsg->cmsg_len < CMSG_LEN(0))
+            return ERR_PTR(-EINVAL);
+        num_descs += (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    }
+    if (num_descs == 0)
+        return NULL;
+    if (num_descs > SCM_MAX_FD)
+        return ERR_PTR(-EINVAL);
+
+    unix_rights* rights =
+        kmalloc(sizeof(unix_rights) + num_descs * sizeof(file_description*));
+    if (!rights)
+        return ERR_PTR(-ENOMEM);
+    rights->num_descs = 0;
+    rights->next = NULL;
+
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg;
+         cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        const int* fds = (const int*)CMSG_DATA(cmsg);
+        size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < n; ++i) {
+            file_description* desc = process_get_file_description(fds[i]);
+            if (IS_ERR(desc)) {
+                destroy_rights(rights);
+                return ERR_CAST(desc);
+            }
+            ++desc->ref_count;
+            rights->descs[rights->num_descs++] = desc;
+        }
+    }
+    return rights;
+}
+
+static void append_rights(unix_channel* channel, unix_rights* rights) {
+    unix_rights** it = &channel->rights;
+    while (*it)
+        it = &(*it)->next;
+    *it = rights;
 }
 
-static ssize_t unix_socket_read(file_description* desc, void* buffer, size_t count) {
+ssize_t unix_socket_sendmsg(file_description* desc, unix_socket* dest,
+                            const msghdr* msg) {
     unix_socket* socket = (unix_socket*)desc->inode;
-    ring_buf* buf = get_buf_to_read(socket, desc);
+    unix_socket* receiver;
+    unix_channel* channel;
+    if (dest) {
+        if (socket->type != SOCK_DGRAM)
+            return -EISCONN;
+        if (dest->type != SOCK_DGRAM)
+            return -EPROTOTYPE;
+        receiver = dest;
+        channel = &dest->client_to_server;
+    } else {
+        if (!socket->connected && !is_unpaired_dgram(socket))
+            return -ENOTCONN;
+        receiver = get_receiver(socket);
+        channel = get_channel_to_write(socket, desc);
+        if (!channel)
+            return -ENOTCONN;
+    }
+
+    size_t len = iov_total_len(msg->msg_iov, msg->msg_iovlen);
+    bool is_message = has_message_boundaries(socket);
+    size_t needed = is_message ? sizeof(message_header) + len : 1;
+    if (needed > channel->buf.capacity)
+        return -EMSGSIZE;
+
+    unix_rights* rights = collect_rights(msg);
+    if (IS_ERR(rights))
+        return PTR_ERR(rights);
+    if (rights && !is_message && len == 0) {
+        // on a stream, descriptors have to come with at least one byte
+        destroy_rights(rights);
+        return -EINVAL;
+    }
 
+    struct space_blocker blocker = {.channel = channel, .needed = needed};
+    ring_buf* buf = &channel->buf;
     for (;;) {
-        int rc = file_description_block(desc, read_should_unblock);
-        if (IS_ERR(rc))
+        if ((desc->flags & O_NONBLOCK) && !space_should_unblock(&blocker)) {
+            if (rights)
+                destroy_rights(rights);
+            return -EAGAIN;
+        }
+        int rc = scheduler_block((should_unblock_fn)space_should_unblock,
+                                 &blocker);
+        if (IS_ERR(rc)) {
+            if (rights)
+                destroy_rights(rights);
             return rc;
+        }
 
         mutex_lock(&buf->lock);
-        if (ring_buf_is_empty(buf)) {
+        if (!space_should_unblock(&blocker)) {
             mutex_unlock(&buf->lock);
             continue;
         }
-        ssize_t nread = ring_buf_read(buf, buffer, count);
+
+        if (rights) {
+            rights->offset = buf->write_idx;
+            append_rights(channel, rights);
+        }
+        ssize_t nwritten;
+        if (is_message) {
+            message_header header = len;
+            ASSERT(ring_buf_write(buf, &header, sizeof(header)) ==
+                   sizeof(header));
+            nwritten = write_iov(buf, msg->msg_iov, msg->msg_iovlen, len);
+            ASSERT((size_t)nwritten == len);
+        } else {
+            nwritten = write_iov(buf, msg->msg_iov, msg->msg_iovlen, len);
+        }
         mutex_unlock(&buf->lock);
-        return nread;
+        inode_notify_poll(&receiver->inode);
+        return nwritten;
     }
 }
 
-static bool write_should_unblock(file_description* desc) {
-    unix_socket* socket = (unix_socket*)desc->inode;
-    ring_buf* buf = get_buf_to_write(socket, desc);
-    return !ring_buf_is_full(buf);
+// Installs the received descriptors into the current process, as many as fit
+// in the control buffer. The rest are closed and MSG_CTRUNC is set.
+static void deliver_rights(msghdr* msg, unix_rights* rights) {
+    size_t capacity = 0;
+    if (msg->msg_control && msg->msg_controllen >= CMSG_LEN(0))
+        capacity = (msg->msg_controllen - CMSG_LEN(0)) / sizeof(int);
+
+    struct cmsghdr* cmsg = msg->msg_control;
+    int* fds = capacity > 0 ? (int*)CMSG_DATA(cmsg) : NULL;
+    size_t num_fds = 0;
+    for (size_t i = 0; i < rights->num_descs; ++i) {
+        file_description* desc = rights->descs[i];
+        int fd = num_fds < capacity ? process_alloc_file_descriptor(-1, desc)
+                                    : -EMFILE;
+        if (IS_ERR(fd)) {
+            file_description_close(desc);
+            msg->msg_flags |= MSG_CTRUNC;
+            continue;
+        }
+        fds[num_fds++] = fd;
+    }
+    kfree(rights);
+
+    if (num_fds == 0) {
+        msg->msg_controllen = 0;
+        return;
+    }
+    cmsg->cmsg_len = CMSG_LEN(num_fds * sizeof(int));
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    msg->msg_controllen = CMSG_SPACE(num_fds * sizeof(int));
 }
 
-static ssize_t unix_socket_write(file_description* desc, const void* buffer, size_t count) {
+ssize_t unix_socket_recvmsg(file_description* desc, msghdr* msg) {
     unix_socket* socket = (unix_socket*)desc->inode;
-    ring_buf* buf = get_buf_to_write(socket, desc);
+    unix_channel* channel = get_channel_to_read(socket, desc);
+    ring_buf* buf = &channel->buf;
+    size_t len = iov_total_len(msg->msg_iov, msg->msg_iovlen);
+    msg->msg_flags = 0;
 
     for (;;) {
-        int rc = file_description_block(desc, write_should_unblock);
+        int rc = file_description_block(desc, read_should_unblock);
         if (IS_ERR(rc))
             return rc;
 
         mutex_lock(&buf->lock);
-        if (ring_buf_is_full(buf)) {
+        if (ring_buf_is_empty(buf)) {
             mutex_unlock(&buf->lock);
             continue;
         }
-        ssize_t nwritten = ring_buf_write(buf, buffer, count);
+
+        unix_rights* rights = NULL;
+        if (channel->rights && channel->rights->offset == buf->read_idx) {
+            rights = channel->rights;
+            channel->rights = rights->next;
+        }
+
+        ssize_t nread;
+        if (has_message_boundaries(socket)) {
+            message_header header;
+            ASSERT(ring_buf_read(buf, &header, sizeof(header)) ==
+                   sizeof(header));
+            nread = read_iov(buf, msg->msg_iov, msg->msg_iovlen, header);
+            if ((size_t)nread < header) {
+                ring_buf_consume(buf, header - nread);
+                msg->msg_flags |= MSG_TRUNC;
+            }
+        } else {
+            // stop before the data that the next descriptors came with, so
+            // that they are delivered with it
+            size_t count = len;
+            if (channel->rights)
+                count = MIN(count, channel->rights->offset - buf->read_idx);
+            nread = read_iov(buf, msg->msg_iov, msg->msg_iovlen, count);
+        }
         mutex_unlock(&buf->lock);
-        return nwritten;
+        inode_notify_poll(desc->inode);
+
+        if (rights)
+            deliver_rights(msg, rights);
+        else
+            msg->msg_controllen = 0;
+        if (msg->msg_name) {
+            // the sender is always reported as unnamed
+            sockaddr_un* addr_un = msg->msg_name;
+            addr_un->sun_family = AF_UNIX;
+            msg->msg_namelen = sizeof(sa_family_t);
+        }
+        return nread;
     }
 }
 
-unix_socket* unix_socket_create(void) {
+static ssize_t unix_socket_read(file_description* desc, void* buffer,
+                                size_t count) {
+    struct iovec iov = {.iov_base = buffer, .iov_len = count};
+    msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1};
+    return unix_socket_recvmsg(desc, &msg);
+}
+
+static ssize_t unix_socket_write(file_description* desc, const void* buffer,
+                                 size_t count) {
+    struct iovec iov = {.iov_base = (void*)buffer, .iov_len = count};
+    msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1};
+    return unix_socket_sendmsg(desc, NULL, &msg);
+}
+
+static short unix_socket_poll(file_description* desc, short events) {
+    unix_socket* socket = (unix_socket*)desc->inode;
+    short revents = 0;
+    if (socket->backlog > 0) {
+        // listening socket
+        if ((events & POLLIN) && socket->num_pending > 0)
+            revents |= POLLIN;
+        return revents;
+    }
+    if (!socket->connected && !is_unpaired_dgram(socket))
+        return 0;
+    if ((events & POLLIN) && read_should_unblock(desc))
+        revents |= POLLIN;
+    if ((events & POLLOUT) && write_should_unblock(desc))
+        revents |= POLLOUT;
+    return revents;
+}
+
+unix_socket* unix_socket_create(int type) {
     unix_socket* socket = kmalloc(sizeof(unix_socket));
     if (!socket)
         return ERR_PTR(-ENOMEM);
     *socket = (unix_socket){0};
+    socket->type = type;
 
     struct inode* inode = &socket->inode;
-    static file_ops fops = {.destroy_inode = unix_socket_destroy_inode, .read = unix_socket_read, .write = unix_socket_write};
+    static file_ops fops = {.destroy_inode = unix_socket_destroy_inode, .read = unix_socket_read, .write = unix_socket_write, .poll = unix_socket_poll};
     inode->fops = &fops;
     inode->mode = S_IFSOCK;
     inode->ref_count = 1;
 
-    int rc = ring_buf_init(&socket->client_to_server_buf);
+    int rc = init_channel(&socket->client_to_server);
     if (IS_ERR(rc))
         return ERR_PTR(rc);
-    rc = ring_buf_init(&socket->server_to_client_buf);
+    rc = init_channel(&socket->server_to_client);
     if (IS_ERR(rc))
         return ERR_PTR(rc);
 
@@ -130,52 +440,129 @@ unix_socket* unix_socket_create(void) {
 }
 
 void unix_socket_set_backlog(unix_socket* socket, int backlog) {
-    socket->backlog = backlog;
+    socket->backlog = MIN(MAX(backlog, 1), SOMAXCONN);
 }
 
-static void enqueue_pending(unix_socket* listener, unix_socket* connector) {
-    connector->next = NULL;
-    mutex_lock(&listener->pending_queue_lock);
+// on the stack of a process blocked in accept()
+struct accept_waiter {
+    struct process* process;
+    struct accept_waiter* next;
+};
 
-    if (listener->next) {
-        unix_socket* it = listener->next;
-        while (it->next)
-            it = it->next;
-        it->next = connector;
-    } else {
-        listener->next = connector;
+static void enqueue_accept_waiter(unix_socket* listener,
+                                  struct accept_waiter* waiter) {
+    waiter->next = NULL;
+    if (listener->accept_waiters_tail)
+        listener->accept_waiters_tail->next = waiter;
+    else
+        listener->accept_waiters = waiter;
+    listener->accept_waiters_tail = waiter;
+}
+
+// Called with pending_queue_lock held. Wakes the process that has waited
+// the longest.
+static void wake_accepter(unix_socket* listener) {
+    struct accept_waiter* waiter = listener->accept_waiters;
+    if (!waiter)
+        return;
+    listener->accept_waiters = waiter->next;
+    if (!listener->accept_waiters)
+        listener->accept_waiters_tail = NULL;
+    scheduler_wake(waiter->process);
+}
+
+// for a waiter that wasn't dequeued by wake_accepter()
+static void remove_accept_waiter(unix_socket* listener,
+                                 struct accept_waiter* waiter) {
+    struct accept_waiter* prev = NULL;
+    for (struct accept_waiter* it = listener->accept_waiters; it;
+         prev = it, it = it->next) {
+        if (it != waiter)
+            continue;
+        if (prev)
+            prev->next = it->next;
+        else
+            listener->accept_waiters = it->next;
+        if (listener->accept_waiters_tail == it)
+            listener->accept_waiters_tail = prev;
+        return;
     }
+}
 
-    mutex_unlock(&listener->pending_queue_lock);
+static void enqueue_pending(unix_socket* listener, unix_socket* connector) {
+    connector->next = NULL;
+    if (listener->pending_tail)
+        listener->pending_tail->next = connector;
+    else
+        listener->next = connector;
+    listener->pending_tail = connector;
     ++listener->num_pending;
 }
 
-static unix_socket* deque_pending(unix_socket* listener) {
-    mutex_lock(&listener->pending_queue_lock);
-
+static unix_socket* dequeue_pending(unix_socket* listener) {
     unix_socket* connector = listener->next;
+    if (!connector)
+        return NULL;
     listener->next = connector->next;
-
-    mutex_unlock(&listener->pending_queue_lock);
+    if (!listener->next)
+        listener->pending_tail = NULL;
     --listener->num_pending;
-
-    ASSERT(connector);
     return connector;
 }
 
+// for a connector that gave up before being accepted
+static void remove_pending(unix_socket* listener, unix_socket* connector) {
+    unix_socket* prev = NULL;
+    for (unix_socket* it = listener->next; it; prev = it, it = it->next) {
+        if (it != connector)
+            continue;
+        if (prev)
+            prev->next = it->next;
+        else
+            listener->next = it->next;
+        if (listener->pending_tail == it)
+            listener->pending_tail = prev;
+        --listener->num_pending;
+        return;
+    }
+}
+
 static bool accept_should_unblock(atomic_size_t* num_pending) {
     return *num_pending > 0;
 }
 
-unix_socket* unix_socket_accept(unix_socket* listener) {
-    int rc = scheduler_block((should_unblock_fn)accept_should_unblock, &listener->num_pending);
-    if (IS_ERR(rc))
-        return ERR_PTR(rc);
+unix_socket* unix_socket_accept(unix_socket* listener, bool nonblock) {
+    for (;;) {
+        mutex_lock(&listener->pending_queue_lock);
+        unix_socket* connector = dequeue_pending(listener);
+        if (connector) {
+            ASSERT(!connector->connected);
+            connector->connected = true;
+            if (connector->connecting_process)
+                scheduler_wake(connector->connecting_process);
+            mutex_unlock(&listener->pending_queue_lock);
+            inode_notify_poll(&listener->inode);
+            inode_notify_poll(&connector->inode);
+            return connector;
+        }
+        if (nonblock) {
+            mutex_unlock(&listener->pending_queue_lock);
+            return ERR_PTR(-EAGAIN);
+        }
 
-    unix_socket* connector = deque_pending(listener);
-    ASSERT(!connector->connected);
-    connector->connected = true;
-    return connector;
+        struct accept_waiter waiter = {.process = current};
+        enqueue_accept_waiter(listener, &waiter);
+        mutex_unlock(&listener->pending_queue_lock);
+
+        int rc = scheduler_block((should_unblock_fn)accept_should_unblock,
+                                 &listener->num_pending);
+
+        mutex_lock(&listener->pending_queue_lock);
+        remove_accept_waiter(listener, &waiter);
+        mutex_unlock(&listener->pending_queue_lock);
+        if (IS_ERR(rc))
+            return ERR_PTR(rc);
+    }
 }
 
 static bool connect_should_unblock(atomic_bool* connected) {
@@ -186,9 +573,68 @@ int unix_socket_connect(file_description* connector_fd, unix_socket* listener) {
     unix_socket* connector = (unix_socket*)connector_fd->inode;
     connector->connector_fd = connector_fd;
 
-    if (listener->num_pending >= (size_t)listener->backlog)
+    mutex_lock(&listener->pending_queue_lock);
+    if (listener->num_pending >= (size_t)listener->backlog) {
+        mutex_unlock(&listener->pending_queue_lock);
         return -ECONNREFUSED;
+    }
     enqueue_pending(listener, connector);
+    connector->connecting_process = current;
+    wake_accepter(listener);
+    mutex_unlock(&listener->pending_queue_lock);
+    inode_notify_poll(&listener->inode);
+
+    int rc = scheduler_block((should_unblock_fn)connect_should_unblock,
+                             &connector->connected);
 
-    return scheduler_block((should_unblock_fn)connect_should_unblock, &connector->connected);
+    mutex_lock(&listener->pending_queue_lock);
+    connector->connecting_process = NULL;
+    if (IS_ERR(rc) && !connector->connected) {
+        remove_pending(listener, connector);
+        mutex_unlock(&listener->pending_queue_lock);
+        return rc;
+    }
+    mutex_unlock(&listener->pending_queue_lock);
+    return 0;
+}
+
+// A SOCK_DGRAM socket that isn't one of a pair sends straight into the
+// receive buffer of the destination, so it has no send buffer of its own.
+static unix_channel* get_channel(file_description* desc, bool send) {
+    unix_socket* socket = (unix_socket*)desc->inode;
+    if (!send)
+        return get_channel_to_read(socket, desc);
+    if (is_unpaired_dgram(socket))
+        return NULL;
+    return get_channel_to_write(socket, desc);
+}
+
+int unix_socket_get_buf_size(file_description* desc, bool send) {
+    unix_channel* channel = get_channel(desc, send);
+    return channel ? (int)channel->buf.capacity : PAGE_SIZE;
+}
+
+#define MAX_BUF_SIZE (256 * PAGE_SIZE)
+
+int unix_socket_set_buf_size(file_description* desc, bool send, size_t size) {
+    if (size > MAX_BUF_SIZE)
+        return -EINVAL;
+    unix_channel* channel = get_channel(desc, send);
+    if (!channel)
+        return 0;
+
+    ring_buf* buf = &channel->buf;
+    mutex_lock(&buf->lock);
+    size_t base = buf->read_idx;
+    int rc = ring_buf_resize(buf, MAX(size, PAGE_SIZE));
+    if (rc > 0) {
+        // the reallocated buffer starts over at index 0
+        for (unix_rights* it = channel->rights; it; it = it->next)
+            it->offset -= base;
+    }
+    mutex_unlock(&buf->lock);
+    if (IS_ERR(rc))
+        return rc;
+    inode_notify_poll(desc->inode);
+    return 0;
 }
@@ -0,0 +1,80 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "api/vdso.h"
+#include "boot_defs.h"
+#include "memory/memory.h"
+#include "panic.h"
+#include "syscall/syscall.h"
+#include "system.h"
+#include <stdatomic.h>
+
+static struct vdso_data* data;
+static uintptr_t data_paddr;
+
+void vdso_init(void) {
+    uintptr_t vaddr = range_allocator_alloc(&kernel_vaddr_allocator, PAGE_SIZE);
+    ASSERT_OK(vaddr);
+    ASSERT_OK(paging_map_to_free_pages(vaddr, PAGE_SIZE,
+                                       PAGE_WRITE | PAGE_GLOBAL));
+    data = (struct vdso_data*)vaddr;
+    *data = (struct vdso_data){0};
+    data_paddr = paging_virtual_to_physical_addr(vaddr);
+
+    for (int i = 0; i < NUM_SYSCONF_NAMES; ++i)
+        data->sysconf[i] = sys_sysconf(i);
+
+    struct timespec now;
+    ASSERT_OK(time_now(&now));
+    vdso_update_time(&now);
+}
+
+// only the timer interrupt of the bootstrap processor updates the time, so
+// there is a single writer
+void vdso_update_time(const struct timespec* now) {
+    if (!data)
+        return;
+    ++data->seq;
+    atomic_thread_fence(memory_order_release);
+    data->uptime = uptime;
+    data->now = *now;
+    atomic_thread_fence(memory_order_release);
+    ++data->seq;
+}
+
+int vdso_map(void) {
+    return paging_map_to_physical_range(VDSO_DATA_ADDR, data_paddr, PAGE_SIZE,
+                                        PAGE_USER | PAGE_SHARED);
+}
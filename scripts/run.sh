@@ -39,6 +39,7 @@ set -e
 
 KERNEL='kernel/kernel'
 INITRD='initrd'
+SMP="${SMP:-2}"
 
 QEMU_DISPLAY_ARGS=(-display "sdl,gl=off,show-cursor=off")
 if [ "$1" = "shell" ]; then
@@ -69,4 +70,5 @@ QEMU_BIN="${QEMU_BINARY_PREFIX}qemu-system-i386${QEMU_BINARY_SUFFIX}"
 	-serial chardev:char0 \
 	-mon char0,mode=readline \
 	-m 512M \
+	-smp "${SMP}" \
 	"${QEMU_VIRT_TECH_ARGS[@]}"
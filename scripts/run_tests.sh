@@ -37,6 +37,8 @@
 
 set -e
 
+SMP="${SMP:-2}"
+
 ! qemu-system-i386 \
     -kernel kernel/kernel \
     -initrd initrd \
@@ -46,4 +48,5 @@ set -e
     -serial stdio \
     -vga none -display none \
     -m 512M \
+    -smp "${SMP}" \
     2>&1 | tee >(cat 1>&2) | grep -q PANIC
@@ -33,18 +33,47 @@
  *  THE SOFTWARE.
  */
 
+#include <errno.h>
 #include <fcntl.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #define BUF_SIZE 1024
+#define SPLICE_SIZE 65536
+
+// When either side is a pipe, the kernel moves the data directly. Returns
+// false without having moved anything if splicing is not possible.
+static bool splice_to_stdout(int fd, int* rc) {
+    bool spliced = false;
+    for (;;) {
+        ssize_t nspliced = splice(fd, NULL, STDOUT_FILENO, NULL, SPLICE_SIZE, 0);
+        if (nspliced < 0) {
+            if (!spliced && errno == EINVAL)
+                return false;
+            *rc = -1;
+            return true;
+        }
+        if (nspliced == 0)
+            break;
+        spliced = true;
+    }
+    *rc = 0;
+    return true;
+}
 
 static int dump_file(const char* filename) {
     int fd = strcmp(filename, "-") ? open(filename, O_RDONLY) : 0;
     if (fd < 0)
         return -1;
+    int rc;
+    if (splice_to_stdout(fd, &rc)) {
+        if (fd > 0)
+            close(fd);
+        return rc;
+    }
     for (;;) {
         static char buf[BUF_SIZE];
         ssize_t nread = read(fd, buf, BUF_SIZE);
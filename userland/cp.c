@@ -33,14 +33,38 @@
  *  THE SOFTWARE.
  */
 
+#include <errno.h>
 #include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <escp.h>
 
 #define BUF_SIZE 1024
 
+// copies the next chunk through a buffer, for files that copy_file_range()
+// can't handle
+static ssize_t read_write(int src_fd, int dest_fd) {
+    static char buf[BUF_SIZE];
+    ssize_t nread = read(src_fd, buf, BUF_SIZE);
+    if (nread < 0) {
+        perror("read");
+        return -1;
+    }
+    for (ssize_t written = 0; written < nread;) {
+        ssize_t nwritten = write(dest_fd, buf + written, nread - written);
+        if (nwritten < 0) {
+            perror("write");
+            return -1;
+        }
+        written += nwritten;
+    }
+    return nread;
+}
+
 int main(int argc, char* argv[]) {
     if (argc != 3) {
         dprintf(STDERR_FILENO, "%susage: %scp %s<%ssource%s> <%sdestination%s>%s\n", F_MAGENTA, F_GREEN, F_BLUE, F_GREEN, F_BLUE, F_GREEN, F_BLUE, RESET);
@@ -58,23 +82,44 @@ int main(int argc, char* argv[]) {
         return EXIT_FAILURE;
     }
 
+    // The destination is truncated to the copied size afterwards rather than
+    // emptied first, so that copying a file onto itself leaves it intact.
+    off_t total = 0;
+    bool use_copy_file_range = true;
     for (;;) {
-        static char buf[BUF_SIZE];
-        ssize_t nread = read(src_fd, buf, BUF_SIZE);
-        if (nread < 0) {
-            perror("read");
-            close(src_fd);
-            close(dest_fd);
-            return EXIT_FAILURE;
+        ssize_t ncopied;
+        if (use_copy_file_range) {
+            // the kernel shares the pages between the files when it can, and
+            // copies them otherwise
+            ncopied =
+                copy_file_range(src_fd, NULL, dest_fd, NULL, SIZE_MAX / 2, 0);
+            if (ncopied < 0 && (errno == EINVAL || errno == EXDEV)) {
+                // not regular files, or the same file
+                use_copy_file_range = false;
+                continue;
+            }
+            if (ncopied < 0)
+                perror("copy_file_range");
+        } else {
+            ncopied = read_write(src_fd, dest_fd);
         }
-        if (nread == 0)
-            break;
-        if (write(dest_fd, buf, nread) < 0) {
-            perror("write");
+        if (ncopied < 0) {
             close(src_fd);
             close(dest_fd);
             return EXIT_FAILURE;
         }
+        if (ncopied == 0)
+            break;
+        total += ncopied;
+    }
+
+    struct stat st;
+    if (stat(argv[2], &st) == 0 && S_ISREG(st.st_mode) &&
+        ftruncate(dest_fd, total) < 0) {
+        perror("ftruncate");
+        close(src_fd);
+        close(dest_fd);
+        return EXIT_FAILURE;
     }
 
     close(src_fd);
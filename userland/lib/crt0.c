@@ -37,8 +37,10 @@
 #include "unistd.h"
 
 int main(int argc, char* const argv[], char* const envp[]);
+void __init_syscall(void);
 
 void _start(int argc, char* const argv[], char* const envp[]) {
+    __init_syscall();
     environ = (char**)envp;
     exit(main(argc, argv, envp));
 }
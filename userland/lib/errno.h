@@ -37,4 +37,6 @@
 
 #include <kernel/api/errno.h>
 
-extern int errno;
+// Each thread has its own errno, kept in its TLS block.
+int* __errno_location(void);
+#define errno (*__errno_location())
@@ -36,5 +36,12 @@
 #pragma once
 
 #include <kernel/api/fcntl.h>
+#include <sys/uio.h>
 
 int fcntl(int fd, int cmd, ...);
+
+ssize_t splice(int fd_in, off_t* off_in, int fd_out, off_t* off_out,
+               size_t len, unsigned int flags);
+ssize_t tee(int fd_in, int fd_out, size_t len, unsigned int flags);
+ssize_t vmsplice(int fd, const struct iovec* iov, size_t nr_segs,
+                 unsigned int flags);
@@ -33,6 +33,6 @@
  *  THE SOFTWARE.
  */
 
-#include "errno.h"
+#pragma once
 
-int errno;
+#include <kernel/api/netinet/in.h>
@@ -0,0 +1,237 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "pthread.h"
+#include "errno.h"
+#include "futex.h"
+#include "panic.h"
+#include "sched.h"
+#include "stdlib.h"
+#include "sys/mman.h"
+#include "syscall.h"
+#include "unistd.h"
+#include <extra.h>
+
+#define STACK_SIZE 0x10000
+
+struct pthread {
+    // pointed by the TLS segment, so that pthread_self() can find it
+    struct pthread* self;
+
+    // set by the kernel on creation, and cleared and futex-woken by it when
+    // the thread exits
+    volatile pid_t tid;
+
+    int errno_value;
+    void* (*start_routine)(void*);
+    void* arg;
+    void* retval;
+    void* stack;
+};
+
+static struct pthread main_thread;
+
+// whether the TLS segment is still the user data segment, i.e. the current
+// thread is the main thread and hasn't set up its TLS yet
+static bool has_no_tls(void) {
+    uint16_t gs;
+    __asm__ volatile("movw %%gs, %0" : "=r"(gs));
+    return gs == 0x23;
+}
+
+pthread_t pthread_self(void) {
+    if (has_no_tls()) {
+        // the main thread sets up its TLS on the first call, as the other
+        // threads get theirs on creation
+        main_thread.self = &main_thread;
+        main_thread.tid = gettid();
+        int selector = set_thread_area(&main_thread);
+        ASSERT_OK(selector);
+        __asm__ volatile("movw %w0, %%gs" ::"r"(selector));
+    }
+
+    pthread_t self;
+    __asm__ volatile("movl %%gs:0, %0" : "=r"(self));
+    return self;
+}
+
+// This doesn't set up the TLS of the main thread, as that makes a syscall,
+// which may set errno. The main thread's errno is in main_thread either way.
+int* __errno_location(void) {
+    if (has_no_tls())
+        return &main_thread.errno_value;
+    pthread_t self;
+    __asm__ volatile("movl %%gs:0, %0" : "=r"(self));
+    return &self->errno_value;
+}
+
+static int start_thread(void* arg) {
+    struct pthread* thread = arg;
+    thread->retval = thread->start_routine(thread->arg);
+    return 0;
+}
+
+int pthread_create(pthread_t* thread, const pthread_attr_t* attr,
+                   void* (*start_routine)(void*), void* arg) {
+    if (attr)
+        return ENOTSUP;
+
+    struct pthread* new_thread = malloc(sizeof(struct pthread));
+    if (!new_thread)
+        return EAGAIN;
+    *new_thread = (struct pthread){.self = new_thread,
+                                   .start_routine = start_routine,
+                                   .arg = arg};
+
+    new_thread->stack = mmap(NULL, STACK_SIZE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
+    if (new_thread->stack == MAP_FAILED) {
+        free(new_thread);
+        return EAGAIN;
+    }
+
+    // the new thread may look at *thread before clone() returns
+    *thread = new_thread;
+
+    int flags = CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_THREAD |
+                CLONE_SETTLS | CLONE_CHILD_SETTID | CLONE_CHILD_CLEARTID;
+    pid_t tid = clone(start_thread, (unsigned char*)new_thread->stack + STACK_SIZE,
+                      flags, new_thread, new_thread, &new_thread->tid);
+    if (tid < 0) {
+        int rc = errno;
+        munmap(new_thread->stack, STACK_SIZE);
+        free(new_thread);
+        return rc;
+    }
+    return 0;
+}
+
+noreturn void pthread_exit(void* retval) {
+    pthread_self()->retval = retval;
+    syscall(SYS_exit, 0, 0, 0, 0);
+    UNREACHABLE();
+}
+
+int pthread_join(pthread_t thread, void** retval) {
+    if (thread == pthread_self())
+        return EDEADLK;
+    for (;;) {
+        pid_t tid = thread->tid;
+        if (tid == 0)
+            break;
+        futex((uint32_t*)&thread->tid, FUTEX_WAIT, tid, NULL);
+    }
+    if (retval)
+        *retval = thread->retval;
+    munmap(thread->stack, STACK_SIZE);
+    free(thread);
+    return 0;
+}
+
+int pthread_mutex_init(pthread_mutex_t* mutex, const void* attr) {
+    if (attr)
+        return ENOTSUP;
+    *mutex = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
+    return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t* mutex) {
+    return atomic_load(&mutex->locked) ? EBUSY : 0;
+}
+
+// The mutex word is 0 if unlocked, 1 if locked, and 2 if locked and there may
+// be waiters, so that unlocking an uncontended mutex doesn't need a syscall.
+
+int pthread_mutex_lock(pthread_mutex_t* mutex) {
+    int expected = 0;
+    if (atomic_compare_exchange_strong(&mutex->locked, &expected, 1))
+        return 0;
+    if (expected != 2)
+        expected = atomic_exchange(&mutex->locked, 2);
+    while (expected != 0) {
+        futex((uint32_t*)&mutex->locked, FUTEX_WAIT | FUTEX_PRIVATE_FLAG, 2,
+              NULL);
+        expected = atomic_exchange(&mutex->locked, 2);
+    }
+    return 0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t* mutex) {
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&mutex->locked, &expected, 1))
+        return EBUSY;
+    return 0;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t* mutex) {
+    if (atomic_exchange(&mutex->locked, 0) == 2)
+        futex((uint32_t*)&mutex->locked, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1,
+              NULL);
+    return 0;
+}
+
+int pthread_cond_init(pthread_cond_t* cond, const void* attr) {
+    if (attr)
+        return ENOTSUP;
+    *cond = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
+    return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t* cond) {
+    (void)cond;
+    return 0;
+}
+
+// Waiters sleep until the sequence number changes, so a signal sent between
+// releasing the mutex and going to sleep is not missed.
+int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex) {
+    unsigned seq = atomic_load(&cond->seq);
+    pthread_mutex_unlock(mutex);
+    futex((uint32_t*)&cond->seq, FUTEX_WAIT | FUTEX_PRIVATE_FLAG, seq, NULL);
+    return pthread_mutex_lock(mutex);
+}
+
+int pthread_cond_signal(pthread_cond_t* cond) {
+    atomic_fetch_add(&cond->seq, 1);
+    futex((uint32_t*)&cond->seq, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1, NULL);
+    return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t* cond) {
+    atomic_fetch_add(&cond->seq, 1);
+    futex((uint32_t*)&cond->seq, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, INT32_MAX,
+          NULL);
+    return 0;
+}
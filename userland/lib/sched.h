@@ -35,4 +35,22 @@
 
 #pragma once
 
+#include <kernel/api/sched.h>
+#include <kernel/api/sys/types.h>
+
 int sched_yield(void);
+
+int sched_setscheduler(pid_t pid, int policy, const struct sched_param* param);
+int sched_getscheduler(pid_t pid);
+int sched_getparam(pid_t pid, struct sched_param* param);
+int sched_get_priority_min(int policy);
+int sched_get_priority_max(int policy);
+
+// Runs fn(arg) in a new process on the given stack. The process exits with
+// the return value of fn. The variadic arguments are, in this order, the base
+// address of the TLS of the new process if CLONE_SETTLS is set, and the
+// pid_t* ctid if CLONE_CHILD_SETTID or CLONE_CHILD_CLEARTID is set.
+int clone(int (*fn)(void*), void* stack, int flags, void* arg, ...);
+
+// sets the base address of the TLS segment and returns its selector
+int set_thread_area(void* base);
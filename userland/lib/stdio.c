@@ -36,6 +36,7 @@
 #include "stdio.h"
 #include "errno.h"
 #include "string.h"
+#include "sys/uio.h"
 #include "unistd.h"
 
 int putchar(int ch) {
@@ -46,12 +47,14 @@ int putchar(int ch) {
 }
 
 int puts(const char* str) {
-    int rc = write(STDOUT_FILENO, str, strlen(str));
+    // one writev() so that the line isn't split by the output of others when
+    // stdout is a pipe
+    struct iovec iov[] = {{.iov_base = (void*)str, .iov_len = strlen(str)},
+                          {.iov_base = "\n", .iov_len = 1}};
+    ssize_t rc = writev(STDOUT_FILENO, iov, 2);
     if (rc < 0)
         return -1;
-    if (write(STDOUT_FILENO, "\n", 1) < 0)
-        return -1;
-    return rc + 1;
+    return rc;
 }
 
 int printf(const char* format, ...) {
@@ -41,3 +41,9 @@
 
 void* mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset);
 int munmap(void* addr, size_t length);
+
+int memfd_create(const char* name, unsigned int flags);
+
+// POSIX shared memory objects, which are files in /dev/shm
+int shm_open(const char* name, int oflag, mode_t mode);
+int shm_unlink(const char* name);
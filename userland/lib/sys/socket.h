@@ -38,7 +38,20 @@
 #include <kernel/api/sys/socket.h>
 
 int socket(int domain, int type, int protocol);
+int socketpair(int domain, int type, int protocol, int sv[2]);
 int bind(int sockfd, const sockaddr* addr, socklen_t addrlen);
 int listen(int sockfd, int backlog);
 int accept(int sockfd, struct sockaddr* addr, socklen_t* addrlen);
 int connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen);
+ssize_t sendmsg(int sockfd, const struct msghdr* msg, int flags);
+ssize_t recvmsg(int sockfd, struct msghdr* msg, int flags);
+ssize_t send(int sockfd, const void* buf, size_t len, int flags);
+ssize_t sendto(int sockfd, const void* buf, size_t len, int flags,
+               const struct sockaddr* dest_addr, socklen_t addrlen);
+ssize_t recv(int sockfd, void* buf, size_t len, int flags);
+ssize_t recvfrom(int sockfd, void* buf, size_t len, int flags,
+                 struct sockaddr* src_addr, socklen_t* addrlen);
+int getsockopt(int sockfd, int level, int optname, void* optval,
+               socklen_t* optlen);
+int setsockopt(int sockfd, int level, int optname, const void* optval,
+               socklen_t optlen);
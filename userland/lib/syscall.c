@@ -37,18 +37,80 @@
 #include <errno.h>
 #include <extra.h>
 #include <fcntl.h>
+#include <futex.h>
+#include <ioring.h>
+#include <kernel/api/vdso.h>
+#include <mqueue.h>
+#include <poll.h>
+#include <sched.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdnoreturn.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/times.h>
+#include <sys/uio.h>
+#include <systrace.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "syscall.h"
 
+static const struct vdso_data* const vdso =
+    (const struct vdso_data*)VDSO_DATA_ADDR;
+
+// The vDSO page is shared by all processes, so it can't hold the pid. Instead
+// we remember it until fork() or clone() creates a process with another one.
+static pid_t cached_pid;
+
+// set once the memory holding cached_pid is shared with another process
+static bool pid_cache_disabled;
+
+// the kernel sets up sysenter on every CPU that supports it
+static bool use_sysenter;
+
+void __init_syscall(void) {
+    uint32_t eax, ebx, ecx, edx;
+    __asm__ volatile("cpuid"
+                     : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+                     : "a"(1), "c"(0));
+    if (!(edx & (1 << 11))) // SEP
+        return;
+
+    // early Pentium Pro report SEP without supporting sysenter
+    uint32_t family = (eax >> 8) & 0xf;
+    uint32_t model = (eax >> 4) & 0xf;
+    uint32_t stepping = eax & 0xf;
+    if (family == 6 && model < 3 && stepping < 3)
+        return;
+
+    use_sysenter = true;
+}
+
 uintptr_t syscall(uint32_t num, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3,
                   uintptr_t arg4) {
     uintptr_t ret;
+    if (use_sysenter) {
+        // the kernel returns to the address in edi with the stack pointer in
+        // ebp, and clobbers ecx and edx
+        __asm__ volatile("push %%ebp\n"
+                         "push %%edi\n"
+                         "mov %%esp, %%ebp\n"
+                         "mov $1f, %%edi\n"
+                         "sysenter\n"
+                         "1:\n"
+                         "pop %%edi\n"
+                         "pop %%ebp"
+                         : "=a"(ret), "+d"(arg1), "+c"(arg2)
+                         : "a"(num), "b"(arg3), "S"(arg4)
+                         : "memory");
+        return ret;
+    }
     __asm__ volatile("int $" STRINGIFY(SYSCALL_VECTOR)
                      : "=a"(ret)
                      : "a"(num), "d"(arg1), "c"(arg2), "b"(arg3), "S"(arg4)
@@ -82,8 +144,24 @@ int chdir(const char* path) {
 }
 
 int clock_gettime(clockid_t clk_id, struct timespec* tp) {
-    int rc = syscall(SYS_clock_gettime, clk_id, (uintptr_t)tp, 0, 0);
-    RETURN_WITH_ERRNO(rc, int)
+    switch (clk_id) {
+    case CLOCK_REALTIME:
+    case CLOCK_MONOTONIC:
+        break;
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+
+    // retry if the kernel updated the time while we were reading it
+    unsigned seq;
+    do {
+        seq = vdso->seq;
+        atomic_thread_fence(memory_order_acquire);
+        *tp = vdso->now;
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) || vdso->seq != seq);
+    return 0;
 }
 
 int clock_nanosleep(clockid_t clockid, int flags,
@@ -97,6 +175,47 @@ int clock_nanosleep(clockid_t clockid, int flags,
     return 0;
 }
 
+int clone(int (*fn)(void*), void* stack, int flags, void* arg, ...) {
+    void* tls = NULL;
+    pid_t* ctid = NULL;
+    va_list args;
+    va_start(args, arg);
+    if (flags & CLONE_SETTLS)
+        tls = va_arg(args, void*);
+    if (flags & (CLONE_CHILD_SETTID | CLONE_CHILD_CLEARTID))
+        ctid = va_arg(args, pid_t*);
+    va_end(args);
+
+    // The child starts on the new stack, where nothing but fn and arg are
+    // placed, so it can't return from this function. arg is 16-byte aligned
+    // to be at the top of the stack when fn is called.
+    if (!(flags & CLONE_THREAD)) {
+        cached_pid = 0;
+        if (flags & CLONE_VM)
+            pid_cache_disabled = true;
+    }
+
+    uintptr_t* sp = (uintptr_t*)round_down((uintptr_t)stack, 16) - 5;
+    sp[0] = (uintptr_t)fn;
+    sp[1] = (uintptr_t)arg;
+
+    int rc;
+    __asm__ volatile("int $" STRINGIFY(SYSCALL_VECTOR) "\n"
+                     "testl %%eax, %%eax\n"
+                     "jnz 1f\n"
+                     "popl %%eax\n"
+                     "call *%%eax\n"
+                     "movl %%eax, %%edx\n"
+                     "movl %[sys_exit], %%eax\n"
+                     "int $" STRINGIFY(SYSCALL_VECTOR) "\n"
+                     "1:"
+                     : "=a"(rc)
+                     : "a"(SYS_clone), "d"(flags), "c"(sp), "b"(tls),
+                       "S"(ctid), [sys_exit] "i"(SYS_exit)
+                     : "memory");
+    RETURN_WITH_ERRNO(rc, int)
+}
+
 int close(int fd) {
     int rc = syscall(SYS_close, fd, 0, 0, 0);
     RETURN_WITH_ERRNO(rc, int)
@@ -107,6 +226,20 @@ int connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen) {
     RETURN_WITH_ERRNO(rc, int)
 }
 
+ssize_t copy_file_range(int fd_in, off_t* off_in, int fd_out, off_t* off_out,
+                        size_t len, unsigned int flags) {
+    splice_params params;
+    params.fd_in = fd_in;
+    params.off_in = off_in;
+    params.fd_out = fd_out;
+    params.off_out = off_out;
+    params.len = len;
+    params.flags = flags;
+
+    int rc = syscall(SYS_copy_file_range, (uintptr_t)&params, 0, 0, 0);
+    RETURN_WITH_ERRNO(rc, ssize_t)
+}
+
 int dbgputs(const char* str) {
     int rc = syscall(SYS_dbgputs, (uintptr_t)str, 0, 0, 0);
     RETURN_WITH_ERRNO(rc, int)
@@ -117,6 +250,36 @@ int dup2(int oldfd, int newfd) {
     RETURN_WITH_ERRNO(rc, int)
 }
 
+int epoll_create(int size) {
+    if (size <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    return epoll_create1(0);
+}
+
+int epoll_create1(int flags) {
+    int rc = syscall(SYS_epoll_create1, flags, 0, 0, 0);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event* event) {
+    int rc = syscall(SYS_epoll_ctl, epfd, op, fd, (uintptr_t)event);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
+int epoll_wait(int epfd, struct epoll_event* events, int maxevents,
+               int timeout) {
+    int rc = syscall(SYS_epoll_wait, epfd, (uintptr_t)events, maxevents,
+                     timeout);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
+int eventfd(unsigned int initval, int flags) {
+    int rc = syscall(SYS_eventfd, initval, flags, 0, 0);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
 int execve(const char* pathname, char* const argv[], char* const envp[]) {
     int rc = syscall(SYS_execve, (uintptr_t)pathname, (uintptr_t)argv,
                      (uintptr_t)envp, 0);
@@ -124,7 +287,7 @@ int execve(const char* pathname, char* const argv[], char* const envp[]) {
 }
 
 noreturn void exit(int status) {
-    syscall(SYS_exit, status, 0, 0, 0);
+    syscall(SYS_exit_group, status, 0, 0, 0);
     __builtin_unreachable();
 }
 
@@ -139,6 +302,8 @@ int fcntl(int fd, int cmd, ...) {
 
 pid_t fork(void) {
     int rc = syscall(SYS_fork, 0, 0, 0, 0);
+    if (rc == 0)
+        cached_pid = 0;
     RETURN_WITH_ERRNO(rc, pid_t)
 }
 
@@ -147,6 +312,12 @@ int ftruncate(int fd, off_t length) {
     RETURN_WITH_ERRNO(rc, int)
 }
 
+int futex(uint32_t* uaddr, int op, uint32_t val,
+          const struct timespec* timeout) {
+    int rc = syscall(SYS_futex, (uintptr_t)uaddr, op, val, (uintptr_t)timeout);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
 char* getcwd(char* buf, size_t size) {
     int rc = syscall(SYS_getcwd, (uintptr_t)buf, size, 0, 0);
     if (IS_ERR(rc)) {
@@ -167,7 +338,29 @@ pid_t getpgid(pid_t pid) {
 }
 
 pid_t getpid(void) {
+    if (cached_pid)
+        return cached_pid;
     int rc = syscall(SYS_getpid, 0, 0, 0, 0);
+    if (IS_OK(rc) && !pid_cache_disabled)
+        cached_pid = rc;
+    RETURN_WITH_ERRNO(rc, pid_t)
+}
+
+int getsockopt(int sockfd, int level, int optname, void* optval,
+               socklen_t* optlen) {
+    sockopt_params params;
+    params.sockfd = sockfd;
+    params.level = level;
+    params.optname = optname;
+    params.optval = optval;
+    params.optlen = optlen;
+
+    int rc = syscall(SYS_getsockopt, (uintptr_t)&params, 0, 0, 0);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
+pid_t gettid(void) {
+    int rc = syscall(SYS_gettid, 0, 0, 0, 0);
     RETURN_WITH_ERRNO(rc, pid_t)
 }
 
@@ -176,6 +369,16 @@ int ioctl(int fd, int request, void* argp) {
     RETURN_WITH_ERRNO(rc, int)
 }
 
+int ioring_enter(int fd, unsigned to_submit, unsigned min_complete) {
+    int rc = syscall(SYS_ioring_enter, fd, to_submit, min_complete, 0);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
+int ioring_setup(unsigned entries) {
+    int rc = syscall(SYS_ioring_setup, entries, 0, 0, 0);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
 int kill(pid_t pid, int sig) {
     int rc = syscall(SYS_kill, pid, sig, 0, 0);
     RETURN_WITH_ERRNO(rc, int)
@@ -196,6 +399,11 @@ off_t lseek(int fd, off_t offset, int whence) {
     RETURN_WITH_ERRNO(rc, off_t)
 }
 
+int memfd_create(const char* name, unsigned int flags) {
+    int rc = syscall(SYS_memfd_create, (uintptr_t)name, flags, 0, 0);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
 int mkdir(const char* pathname, mode_t mode) {
     int rc = syscall(SYS_mkdir, (uintptr_t)pathname, mode, 0, 0);
     RETURN_WITH_ERRNO(rc, int)
@@ -220,11 +428,71 @@ void* mmap(void* addr, size_t length, int prot, int flags, int fd,
     RETURN_WITH_ERRNO(rc, void*)
 }
 
+int mq_getsetattr(mqd_t mqdes, const struct mq_attr* newattr,
+                  struct mq_attr* oldattr) {
+    int rc = syscall(SYS_mq_getsetattr, mqdes, (uintptr_t)newattr,
+                     (uintptr_t)oldattr, 0);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
+mqd_t mq_open(const char* name, int oflag, ...) {
+    unsigned mode = 0;
+    struct mq_attr* attr = NULL;
+    if (oflag & O_CREAT) {
+        va_list args;
+        va_start(args, oflag);
+        mode = va_arg(args, unsigned);
+        attr = va_arg(args, struct mq_attr*);
+        va_end(args);
+    }
+    int rc = syscall(SYS_mq_open, (uintptr_t)name, oflag, mode,
+                     (uintptr_t)attr);
+    RETURN_WITH_ERRNO(rc, mqd_t)
+}
+
+ssize_t mq_timedreceive(mqd_t mqdes, char* msg_ptr, size_t msg_len,
+                        unsigned* msg_prio,
+                        const struct timespec* abs_timeout) {
+    mq_timed_params params;
+    params.mqdes = mqdes;
+    params.msg_ptr = msg_ptr;
+    params.msg_len = msg_len;
+    params.msg_prio = msg_prio;
+    params.abs_timeout = abs_timeout;
+
+    int rc = syscall(SYS_mq_timedreceive, (uintptr_t)&params, 0, 0, 0);
+    RETURN_WITH_ERRNO(rc, ssize_t)
+}
+
+int mq_timedsend(mqd_t mqdes, const char* msg_ptr, size_t msg_len,
+                 unsigned msg_prio, const struct timespec* abs_timeout) {
+    mq_timed_params params;
+    params.mqdes = mqdes;
+    params.msg_ptr = (char*)msg_ptr;
+    params.msg_len = msg_len;
+    params.msg_prio = &msg_prio;
+    params.abs_timeout = abs_timeout;
+
+    int rc = syscall(SYS_mq_timedsend, (uintptr_t)&params, 0, 0, 0);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
+int mq_unlink(const char* name) {
+    int rc = syscall(SYS_mq_unlink, (uintptr_t)name, 0, 0, 0);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
 int munmap(void* addr, size_t length) {
     int rc = syscall(SYS_munmap, (uintptr_t)addr, length, 0, 0);
     RETURN_WITH_ERRNO(rc, int)
 }
 
+int nice(int inc) {
+    // The new nice value can be in -20..-1, which IS_ERR() would take for
+    // an errno. The syscall never fails, so its result is returned as is.
+    return (int)syscall(SYS_nice, inc, 0, 0, 0);
+}
+
 int open(const char* pathname, int flags, ...) {
     unsigned mode = 0;
     if (flags & O_CREAT) {
@@ -242,16 +510,41 @@ int pipe(int pipefd[2]) {
     RETURN_WITH_ERRNO(rc, int)
 }
 
+int poll(struct pollfd* fds, nfds_t nfds, int timeout) {
+    int rc = syscall(SYS_poll, (uintptr_t)fds, nfds, timeout, 0);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
+ssize_t pread(int fd, void* buf, size_t count, off_t offset) {
+    int rc = syscall(SYS_pread, fd, (uintptr_t)buf, count, offset);
+    RETURN_WITH_ERRNO(rc, ssize_t)
+}
+
+ssize_t pwrite(int fd, const void* buf, size_t count, off_t offset) {
+    int rc = syscall(SYS_pwrite, fd, (uintptr_t)buf, count, offset);
+    RETURN_WITH_ERRNO(rc, ssize_t)
+}
+
 ssize_t read(int fd, void* buf, size_t count) {
     int rc = syscall(SYS_read, fd, (uintptr_t)buf, count, 0);
     RETURN_WITH_ERRNO(rc, ssize_t)
 }
 
+ssize_t readv(int fd, const struct iovec* iov, int iovcnt) {
+    int rc = syscall(SYS_readv, fd, (uintptr_t)iov, iovcnt, 0);
+    RETURN_WITH_ERRNO(rc, ssize_t)
+}
+
 int reboot(int howto) {
     int rc = syscall(SYS_reboot, howto, 0, 0, 0);
     RETURN_WITH_ERRNO(rc, int)
 }
 
+ssize_t recvmsg(int sockfd, struct msghdr* msg, int flags) {
+    int rc = syscall(SYS_recvmsg, sockfd, (uintptr_t)msg, flags, 0);
+    RETURN_WITH_ERRNO(rc, ssize_t)
+}
+
 int rename(const char* oldpath, const char* newpath) {
     int rc = syscall(SYS_rename, (uintptr_t)oldpath, (uintptr_t)newpath, 0, 0);
     RETURN_WITH_ERRNO(rc, int)
@@ -262,31 +555,130 @@ int rmdir(const char* pathname) {
     RETURN_WITH_ERRNO(rc, int)
 }
 
+int sched_getparam(pid_t pid, struct sched_param* param) {
+    int rc = syscall(SYS_sched_getparam, pid, (int)param, 0, 0);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
+int sched_getscheduler(pid_t pid) {
+    int rc = syscall(SYS_sched_getscheduler, pid, 0, 0, 0);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
+int sched_setscheduler(pid_t pid, int policy,
+                       const struct sched_param* param) {
+    int rc = syscall(SYS_sched_setscheduler, pid, policy, (int)param, 0);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
 int sched_yield(void) {
     int rc = syscall(SYS_sched_yield, 0, 0, 0, 0);
     RETURN_WITH_ERRNO(rc, int)
 }
 
+ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count) {
+    int rc = syscall(SYS_sendfile, out_fd, in_fd, (uintptr_t)offset, count);
+    RETURN_WITH_ERRNO(rc, ssize_t)
+}
+
+ssize_t sendmsg(int sockfd, const struct msghdr* msg, int flags) {
+    int rc = syscall(SYS_sendmsg, sockfd, (uintptr_t)msg, flags, 0);
+    RETURN_WITH_ERRNO(rc, ssize_t)
+}
+
+int set_thread_area(void* base) {
+    int rc = syscall(SYS_set_thread_area, (uintptr_t)base, 0, 0, 0);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
 int setpgid(pid_t pid, pid_t pgid) {
     int rc = syscall(SYS_setpgid, pid, pgid, 0, 0);
     RETURN_WITH_ERRNO(rc, int)
 }
 
+int setsockopt(int sockfd, int level, int optname, const void* optval,
+               socklen_t optlen) {
+    sockopt_params params;
+    params.sockfd = sockfd;
+    params.level = level;
+    params.optname = optname;
+    params.optval = (void*)optval;
+    params.optlen = &optlen;
+
+    int rc = syscall(SYS_setsockopt, (uintptr_t)&params, 0, 0, 0);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
 int socket(int domain, int type, int protocol) {
     int rc = syscall(SYS_socket, domain, type, protocol, 0);
     RETURN_WITH_ERRNO(rc, int)
 }
 
+int socketpair(int domain, int type, int protocol, int sv[2]) {
+    int rc = syscall(SYS_socketpair, domain, type, protocol, (uintptr_t)sv);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
+ssize_t splice(int fd_in, off_t* off_in, int fd_out, off_t* off_out,
+               size_t len, unsigned int flags) {
+    splice_params params;
+    params.fd_in = fd_in;
+    params.off_in = off_in;
+    params.fd_out = fd_out;
+    params.off_out = off_out;
+    params.len = len;
+    params.flags = flags;
+
+    int rc = syscall(SYS_splice, (uintptr_t)&params, 0, 0, 0);
+    RETURN_WITH_ERRNO(rc, ssize_t)
+}
+
 int stat(const char* pathname, struct stat* buf) {
     int rc = syscall(SYS_stat, (uintptr_t)pathname, (uintptr_t)buf, 0, 0);
     RETURN_WITH_ERRNO(rc, int)
 }
 
 long sysconf(int name) {
+    if (0 <= name && name < NUM_SYSCONF_NAMES)
+        return vdso->sysconf[name];
     int rc = syscall(SYS_sysconf, name, 0, 0, 0);
     RETURN_WITH_ERRNO(rc, long)
 }
 
+int systrace(int op, pid_t pid) {
+    int rc = syscall(SYS_systrace, op, pid, 0, 0);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
+ssize_t systrace_read(unsigned* cursor, struct syscall_record* buf,
+                      size_t count) {
+    int rc = syscall(SYS_systrace_read, (uintptr_t)cursor, (uintptr_t)buf,
+                     count, 0);
+    RETURN_WITH_ERRNO(rc, ssize_t)
+}
+
+ssize_t tee(int fd_in, int fd_out, size_t len, unsigned int flags) {
+    int rc = syscall(SYS_tee, fd_in, fd_out, len, flags);
+    RETURN_WITH_ERRNO(rc, ssize_t)
+}
+
+int timerfd_create(clockid_t clockid, int flags) {
+    int rc = syscall(SYS_timerfd_create, clockid, flags, 0, 0);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
+int timerfd_gettime(int fd, struct itimerspec* curr_value) {
+    int rc = syscall(SYS_timerfd_gettime, fd, (uintptr_t)curr_value, 0, 0);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
+int timerfd_settime(int fd, int flags, const struct itimerspec* new_value,
+                    struct itimerspec* old_value) {
+    int rc = syscall(SYS_timerfd_settime, fd, flags, (uintptr_t)new_value,
+                     (uintptr_t)old_value);
+    RETURN_WITH_ERRNO(rc, int)
+}
+
 clock_t times(struct tms* buf) {
     int rc = syscall(SYS_times, (uintptr_t)buf, 0, 0, 0);
     RETURN_WITH_ERRNO(rc, clock_t)
@@ -297,6 +689,12 @@ int unlink(const char* pathname) {
     RETURN_WITH_ERRNO(rc, int)
 }
 
+ssize_t vmsplice(int fd, const struct iovec* iov, size_t nr_segs,
+                 unsigned int flags) {
+    int rc = syscall(SYS_vmsplice, fd, (uintptr_t)iov, nr_segs, flags);
+    RETURN_WITH_ERRNO(rc, ssize_t)
+}
+
 pid_t waitpid(pid_t pid, int* wstatus, int options) {
     int rc = syscall(SYS_waitpid, pid, (uintptr_t)wstatus, options, 0);
     RETURN_WITH_ERRNO(rc, pid_t)
@@ -306,3 +704,8 @@ ssize_t write(int fd, const void* buf, size_t count) {
     int rc = syscall(SYS_write, fd, (uintptr_t)buf, count, 0);
     RETURN_WITH_ERRNO(rc, ssize_t)
 }
+
+ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
+    int rc = syscall(SYS_writev, fd, (uintptr_t)iov, iovcnt, 0);
+    RETURN_WITH_ERRNO(rc, ssize_t)
+}
@@ -35,12 +35,20 @@
 
 #include "unistd.h"
 #include "errno.h"
+#include "extra.h"
 #include "fcntl.h"
+#include "mqueue.h"
 #include "panic.h"
+#include "poll.h"
+#include "sched.h"
 #include "stdio.h"
 #include "stdlib.h"
 #include "string.h"
+#include "sys/eventfd.h"
 #include "sys/ioctl.h"
+#include "sys/mman.h"
+#include "sys/select.h"
+#include "sys/socket.h"
 #include "time.h"
 
 char** environ;
@@ -94,3 +102,182 @@ int usleep(useconds_t usec) {
 pid_t tcgetpgrp(int fd) { return ioctl(fd, TIOCGPGRP, NULL); }
 
 int tcsetpgrp(int fd, pid_t pgrp) { return ioctl(fd, TIOCSPGRP, &pgrp); }
+
+int sched_get_priority_min(int policy) {
+    switch (policy) {
+    case SCHED_OTHER:
+        return 0;
+    case SCHED_FIFO:
+    case SCHED_RR:
+        return SCHED_RT_PRIORITY_MIN;
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+int sched_get_priority_max(int policy) {
+    switch (policy) {
+    case SCHED_OTHER:
+        return 0;
+    case SCHED_FIFO:
+    case SCHED_RR:
+        return SCHED_RT_PRIORITY_MAX;
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+int eventfd_read(int fd, eventfd_t* value) {
+    ssize_t nread = read(fd, value, sizeof(eventfd_t));
+    return nread == sizeof(eventfd_t) ? 0 : -1;
+}
+
+int eventfd_write(int fd, eventfd_t value) {
+    ssize_t nwritten = write(fd, &value, sizeof(eventfd_t));
+    return nwritten == sizeof(eventfd_t) ? 0 : -1;
+}
+
+int select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds,
+           struct timeval* timeout) {
+    if (nfds < 0 || nfds > FD_SETSIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct pollfd* fds = malloc(MAX(nfds, 1) * sizeof(struct pollfd));
+    if (!fds)
+        return -1;
+    nfds_t n = 0;
+    for (int fd = 0; fd < nfds; ++fd) {
+        short events = 0;
+        if (readfds && FD_ISSET(fd, readfds))
+            events |= POLLIN;
+        if (writefds && FD_ISSET(fd, writefds))
+            events |= POLLOUT;
+        if (exceptfds && FD_ISSET(fd, exceptfds))
+            events |= POLLPRI;
+        if (events)
+            fds[n++] = (struct pollfd){.fd = fd, .events = events};
+    }
+
+    int timeout_ms = -1;
+    if (timeout)
+        timeout_ms = timeout->tv_sec * 1000 + timeout->tv_usec / 1000;
+    int rc = poll(fds, n, timeout_ms);
+    if (rc < 0) {
+        free(fds);
+        return -1;
+    }
+
+    if (readfds)
+        FD_ZERO(readfds);
+    if (writefds)
+        FD_ZERO(writefds);
+    if (exceptfds)
+        FD_ZERO(exceptfds);
+    int count = 0;
+    for (nfds_t i = 0; i < n; ++i) {
+        const struct pollfd* pfd = fds + i;
+        if (pfd->revents & POLLNVAL) {
+            free(fds);
+            errno = EBADF;
+            return -1;
+        }
+        if ((pfd->events & POLLIN) &&
+            (pfd->revents & (POLLIN | POLLHUP | POLLERR))) {
+            FD_SET(pfd->fd, readfds);
+            ++count;
+        }
+        if ((pfd->events & POLLOUT) && (pfd->revents & (POLLOUT | POLLERR))) {
+            FD_SET(pfd->fd, writefds);
+            ++count;
+        }
+        if ((pfd->events & POLLPRI) && (pfd->revents & POLLPRI)) {
+            FD_SET(pfd->fd, exceptfds);
+            ++count;
+        }
+    }
+    free(fds);
+    return count;
+}
+
+#define SHM_DIR "/dev/shm"
+
+// name is "/" followed by a file name, as the objects are the files in SHM_DIR
+static int shm_path(char* path, size_t size, const char* name) {
+    if (name[0] != '/' || name[1] == '\0' || strchr(name + 1, '/')) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((size_t)snprintf(path, size, "%s%s", SHM_DIR, name) >= size) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+int shm_open(const char* name, int oflag, mode_t mode) {
+    char path[256];
+    if (shm_path(path, sizeof(path), name) < 0)
+        return -1;
+    return open(path, oflag, mode);
+}
+
+int shm_unlink(const char* name) {
+    char path[256];
+    if (shm_path(path, sizeof(path), name) < 0)
+        return -1;
+    return unlink(path);
+}
+
+int mq_close(mqd_t mqdes) { return close(mqdes); }
+
+int mq_send(mqd_t mqdes, const char* msg_ptr, size_t msg_len,
+            unsigned msg_prio) {
+    return mq_timedsend(mqdes, msg_ptr, msg_len, msg_prio, NULL);
+}
+
+ssize_t mq_receive(mqd_t mqdes, char* msg_ptr, size_t msg_len,
+                   unsigned* msg_prio) {
+    return mq_timedreceive(mqdes, msg_ptr, msg_len, msg_prio, NULL);
+}
+
+int mq_getattr(mqd_t mqdes, struct mq_attr* attr) {
+    return mq_getsetattr(mqdes, NULL, attr);
+}
+
+int mq_setattr(mqd_t mqdes, const struct mq_attr* newattr,
+               struct mq_attr* oldattr) {
+    return mq_getsetattr(mqdes, newattr, oldattr);
+}
+
+ssize_t send(int sockfd, const void* buf, size_t len, int flags) {
+    return sendto(sockfd, buf, len, flags, NULL, 0);
+}
+
+ssize_t sendto(int sockfd, const void* buf, size_t len, int flags,
+               const struct sockaddr* dest_addr, socklen_t addrlen) {
+    struct iovec iov = {.iov_base = (void*)buf, .iov_len = len};
+    struct msghdr msg = {.msg_name = (void*)dest_addr,
+                         .msg_namelen = addrlen,
+                         .msg_iov = &iov,
+                         .msg_iovlen = 1};
+    return sendmsg(sockfd, &msg, flags);
+}
+
+ssize_t recv(int sockfd, void* buf, size_t len, int flags) {
+    return recvfrom(sockfd, buf, len, flags, NULL, NULL);
+}
+
+ssize_t recvfrom(int sockfd, void* buf, size_t len, int flags,
+                 struct sockaddr* src_addr, socklen_t* addrlen) {
+    struct iovec iov = {.iov_base = buf, .iov_len = len};
+    struct msghdr msg = {.msg_name = src_addr,
+                         .msg_namelen = addrlen ? *addrlen : 0,
+                         .msg_iov = &iov,
+                         .msg_iovlen = 1};
+    ssize_t rc = recvmsg(sockfd, &msg, flags);
+    if (rc >= 0 && addrlen)
+        *addrlen = msg.msg_namelen;
+    return rc;
+}
@@ -42,6 +42,7 @@
 extern char** environ;
 
 pid_t getpid(void);
+pid_t gettid(void);
 int setpgid(pid_t pid, pid_t pgid);
 pid_t getpgid(pid_t pid);
 
@@ -53,6 +54,8 @@ int open(const char* pathname, int flags, ...);
 int close(int fd);
 ssize_t read(int fd, void* buf, size_t count);
 ssize_t write(int fd, const void* buf, size_t count);
+ssize_t pread(int fd, void* buf, size_t count, off_t offset);
+ssize_t pwrite(int fd, const void* buf, size_t count, off_t offset);
 int ftruncate(int fd, off_t length);
 off_t lseek(int fd, off_t offset, int whence);
 int mknod(const char* pathname, mode_t mode, dev_t dev);
@@ -60,6 +63,8 @@ int link(const char* oldpath, const char* newpath);
 int unlink(const char* pathname);
 int rename(const char* oldpath, const char* newpath);
 int rmdir(const char* pathname);
+ssize_t copy_file_range(int fd_in, off_t* off_in, int fd_out, off_t* off_out,
+                        size_t len, unsigned int flags);
 
 int dup(int oldfd);
 int dup2(int oldfd, int newfd);
@@ -71,6 +76,8 @@ int chdir(const char* path);
 pid_t tcgetpgrp(int fd);
 int tcsetpgrp(int fd, pid_t pgrp);
 
+int nice(int inc);
+
 unsigned int sleep(unsigned int seconds);
 int usleep(useconds_t usec);
 
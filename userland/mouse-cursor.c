@@ -39,6 +39,7 @@
 #include <fcntl.h>
 #include <hid.h>
 #include <panic.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -143,6 +144,11 @@ int main(void) {
 
     move_cursor_to(fb_info.width / 2, fb_info.height / 2);
 
+    // the cursor should follow the mouse even when the system is busy, and
+    // the process only runs briefly after each mouse packet
+    struct sched_param param = {.sched_priority = 60};
+    (void)sched_setscheduler(0, SCHED_FIFO, &param);
+
     int mouse_fd = open("/dev/psaux", O_RDONLY);
     if (mouse_fd < 0) {
         perror("open");
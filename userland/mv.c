@@ -33,19 +33,65 @@
  *  THE SOFTWARE.
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <escp.h>
 
+// rename() can't move files between filesystems, so copy and unlink instead
+static int copy_and_unlink(const char* src, const char* dest) {
+    struct stat st;
+    if (stat(src, &st) < 0)
+        return -1;
+    if (!S_ISREG(st.st_mode)) {
+        errno = EXDEV;
+        return -1;
+    }
+
+    int src_fd = open(src, O_RDONLY);
+    if (src_fd < 0)
+        return -1;
+    int dest_fd = open(dest, O_CREAT | O_WRONLY, st.st_mode);
+    if (dest_fd < 0) {
+        close(src_fd);
+        return -1;
+    }
+
+    int rc = ftruncate(dest_fd, 0);
+    while (rc >= 0) {
+        ssize_t ncopied =
+            copy_file_range(src_fd, NULL, dest_fd, NULL, SIZE_MAX / 2, 0);
+        if (ncopied <= 0) {
+            rc = ncopied;
+            break;
+        }
+    }
+
+    close(src_fd);
+    close(dest_fd);
+    if (rc < 0)
+        return -1;
+    return unlink(src);
+}
+
 int main(int argc, char* argv[]) {
     if (argc != 3) {
         dprintf(STDERR_FILENO, "%susage: %smv %s<%ssource%s> <%sdestination%s>%s\n", F_MAGENTA, F_GREEN, F_BLUE, F_GREEN, F_BLUE, F_GREEN, F_BLUE, RESET);
         return EXIT_FAILURE;
     }
     if (rename(argv[1], argv[2]) < 0) {
-        perror("rename");
-        return EXIT_FAILURE;
+        if (errno != EXDEV) {
+            perror("rename");
+            return EXIT_FAILURE;
+        }
+        if (copy_and_unlink(argv[1], argv[2]) < 0) {
+            perror("mv");
+            return EXIT_FAILURE;
+        }
     }
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,250 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <extra.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <panic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TCP_PORT 5001
+#define UDP_PORT 5002
+#define CHUNK_SIZE 65536
+#define MESSAGE_SIZE 64
+
+static unsigned char chunk[CHUNK_SIZE];
+
+static sockaddr_in loopback_addr(uint16_t port) {
+    sockaddr_in addr = {.sin_family = AF_INET,
+                        .sin_port = htons(port),
+                        .sin_addr = {htonl(INADDR_LOOPBACK)}};
+    return addr;
+}
+
+static unsigned elapsed_us(const struct timespec* start,
+                           const struct timespec* end) {
+    return (end->tv_sec - start->tv_sec) * 1000000 +
+           (end->tv_nsec - start->tv_nsec) / 1000;
+}
+
+static int tcp_listen(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_OK(fd);
+    sockaddr_in addr = loopback_addr(TCP_PORT);
+    if (bind(fd, (const sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        exit(EXIT_FAILURE);
+    }
+    ASSERT_OK(listen(fd, 1));
+    return fd;
+}
+
+static int tcp_connect(bool nodelay) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_OK(fd);
+    int value = nodelay;
+    ASSERT_OK(
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value)));
+    sockaddr_in addr = loopback_addr(TCP_PORT);
+    ASSERT_OK(connect(fd, (const sockaddr*)&addr, sizeof(addr)));
+    return fd;
+}
+
+static void read_exactly(int fd, void* buf, size_t count) {
+    unsigned char* p = buf;
+    while (count > 0) {
+        ssize_t nread = read(fd, p, count);
+        ASSERT(nread > 0);
+        p += nread;
+        count -= nread;
+    }
+}
+
+// sends total_bytes over a TCP connection from a child process to the parent
+static void run_tcp_throughput(size_t total_bytes) {
+    int listener = tcp_listen();
+
+    struct timespec start;
+    ASSERT_OK(clock_gettime(CLOCK_MONOTONIC, &start));
+
+    pid_t pid = fork();
+    ASSERT_OK(pid);
+    if (pid == 0) {
+        ASSERT_OK(close(listener));
+        int fd = tcp_connect(false);
+        size_t remaining = total_bytes;
+        while (remaining > 0) {
+            size_t count = MIN(remaining, CHUNK_SIZE);
+            ssize_t nwritten = write(fd, chunk, count);
+            ASSERT_OK(nwritten);
+            remaining -= nwritten;
+        }
+        ASSERT_OK(close(fd));
+        exit(EXIT_SUCCESS);
+    }
+
+    int fd = accept(listener, NULL, NULL);
+    ASSERT_OK(fd);
+    size_t total_read = 0;
+    for (;;) {
+        ssize_t nread = read(fd, chunk, CHUNK_SIZE);
+        ASSERT_OK(nread);
+        if (nread == 0)
+            break;
+        total_read += nread;
+    }
+    ASSERT_OK(close(fd));
+    ASSERT_OK(close(listener));
+    ASSERT_OK(waitpid(pid, NULL, 0));
+    ASSERT(total_read == total_bytes);
+
+    struct timespec end;
+    ASSERT_OK(clock_gettime(CLOCK_MONOTONIC, &end));
+    unsigned ms = elapsed_us(&start, &end) / 1000;
+    if (ms == 0)
+        ms = 1;
+    printf("tcp throughput: %u MiB in %u ms, %u MB/s\n",
+           total_bytes / (1024 * 1024), ms, total_bytes / ms / 1000);
+}
+
+// Round trips of a request that is written as a header and a body, which
+// makes Nagle's algorithm wait for the delayed ACK of the header unless
+// TCP_NODELAY is set.
+static void run_tcp_latency(size_t round_trips, bool nodelay) {
+    int listener = tcp_listen();
+
+    pid_t pid = fork();
+    ASSERT_OK(pid);
+    if (pid == 0) {
+        int fd = accept(listener, NULL, NULL);
+        ASSERT_OK(fd);
+        ASSERT_OK(close(listener));
+        unsigned char message[MESSAGE_SIZE];
+        for (size_t i = 0; i < round_trips; ++i) {
+            read_exactly(fd, message, sizeof(message));
+            ASSERT(write(fd, message, sizeof(message)) == sizeof(message));
+        }
+        ASSERT_OK(close(fd));
+        exit(EXIT_SUCCESS);
+    }
+
+    int fd = tcp_connect(nodelay);
+    unsigned char message[MESSAGE_SIZE] = {0};
+    struct timespec start;
+    ASSERT_OK(clock_gettime(CLOCK_MONOTONIC, &start));
+    for (size_t i = 0; i < round_trips; ++i) {
+        ASSERT(write(fd, message, 4) == 4);
+        ASSERT(write(fd, message + 4, sizeof(message) - 4) ==
+               sizeof(message) - 4);
+        read_exactly(fd, message, sizeof(message));
+    }
+    struct timespec end;
+    ASSERT_OK(clock_gettime(CLOCK_MONOTONIC, &end));
+    ASSERT_OK(close(fd));
+    ASSERT_OK(close(listener));
+    ASSERT_OK(waitpid(pid, NULL, 0));
+
+    printf("tcp latency%s: %u us per round trip\n",
+           nodelay ? " (TCP_NODELAY)" : "",
+           elapsed_us(&start, &end) / round_trips);
+}
+
+static void run_udp_latency(size_t round_trips) {
+    int server = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_OK(server);
+    sockaddr_in addr = loopback_addr(UDP_PORT);
+    if (bind(server, (const sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        exit(EXIT_FAILURE);
+    }
+
+    pid_t pid = fork();
+    ASSERT_OK(pid);
+    if (pid == 0) {
+        unsigned char message[MESSAGE_SIZE];
+        for (size_t i = 0; i < round_trips; ++i) {
+            sockaddr_in from;
+            socklen_t fromlen = sizeof(from);
+            ASSERT(recvfrom(server, message, sizeof(message), 0,
+                            (sockaddr*)&from, &fromlen) == sizeof(message));
+            ASSERT(sendto(server, message, sizeof(message), 0,
+                          (const sockaddr*)&from,
+                          fromlen) == sizeof(message));
+        }
+        exit(EXIT_SUCCESS);
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_OK(fd);
+    ASSERT_OK(connect(fd, (const sockaddr*)&addr, sizeof(addr)));
+    unsigned char message[MESSAGE_SIZE] = {0};
+    struct timespec start;
+    ASSERT_OK(clock_gettime(CLOCK_MONOTONIC, &start));
+    for (size_t i = 0; i < round_trips; ++i) {
+        ASSERT(send(fd, message, sizeof(message), 0) == sizeof(message));
+        ASSERT(recv(fd, message, sizeof(message), 0) == sizeof(message));
+    }
+    struct timespec end;
+    ASSERT_OK(clock_gettime(CLOCK_MONOTONIC, &end));
+    ASSERT_OK(close(fd));
+    ASSERT_OK(close(server));
+    ASSERT_OK(waitpid(pid, NULL, 0));
+
+    printf("udp latency: %u us per round trip\n",
+           elapsed_us(&start, &end) / round_trips);
+}
+
+int main(int argc, char* const argv[]) {
+    if (argc > 3) {
+        dprintf(STDERR_FILENO, "Usage: netbench [MIB] [ROUND_TRIPS]\n");
+        return EXIT_FAILURE;
+    }
+    size_t total_bytes = (argc >= 2 ? atoi(argv[1]) : 64) * 1024 * 1024;
+    size_t round_trips = argc >= 3 ? atoi(argv[2]) : 100;
+    if (round_trips == 0)
+        round_trips = 1;
+
+    run_tcp_throughput(total_bytes);
+    run_tcp_latency(round_trips, true);
+    run_tcp_latency(round_trips, false);
+    run_udp_latency(round_trips);
+    return EXIT_SUCCESS;
+}
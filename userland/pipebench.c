@@ -0,0 +1,119 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <panic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CHUNK_SIZE 65536
+
+static unsigned char chunk[CHUNK_SIZE];
+
+static unsigned elapsed_ms(const struct timespec* start,
+                           const struct timespec* end) {
+    return (end->tv_sec - start->tv_sec) * 1000 +
+           (end->tv_nsec - start->tv_nsec) / 1000000;
+}
+
+// sends total_bytes from a child process to the parent through a pipe of the
+// given size and reports the throughput
+static void run(size_t total_bytes, size_t pipe_size) {
+    int fds[2];
+    ASSERT_OK(pipe(fds));
+    int rc = fcntl(fds[1], F_SETPIPE_SZ, pipe_size);
+    if (rc < 0) {
+        perror("fcntl");
+        exit(EXIT_FAILURE);
+    }
+    pipe_size = rc;
+
+    struct timespec start;
+    ASSERT_OK(clock_gettime(CLOCK_MONOTONIC, &start));
+
+    pid_t pid = fork();
+    ASSERT_OK(pid);
+    if (pid == 0) {
+        ASSERT_OK(close(fds[0]));
+        size_t remaining = total_bytes;
+        while (remaining > 0) {
+            size_t count = remaining < CHUNK_SIZE ? remaining : CHUNK_SIZE;
+            ssize_t nwritten = write(fds[1], chunk, count);
+            ASSERT_OK(nwritten);
+            remaining -= nwritten;
+        }
+        exit(EXIT_SUCCESS);
+    }
+
+    ASSERT_OK(close(fds[1]));
+    size_t total_read = 0;
+    for (;;) {
+        ssize_t nread = read(fds[0], chunk, CHUNK_SIZE);
+        ASSERT_OK(nread);
+        if (nread == 0)
+            break;
+        total_read += nread;
+    }
+    ASSERT_OK(close(fds[0]));
+    ASSERT_OK(waitpid(pid, NULL, 0));
+    ASSERT(total_read == total_bytes);
+
+    struct timespec end;
+    ASSERT_OK(clock_gettime(CLOCK_MONOTONIC, &end));
+    unsigned ms = elapsed_ms(&start, &end);
+    if (ms == 0)
+        ms = 1;
+    printf("pipe size %6u: %u MiB in %u ms, %u MB/s\n", pipe_size,
+           total_bytes / (1024 * 1024), ms, total_bytes / ms / 1000);
+}
+
+int main(int argc, char* const argv[]) {
+    if (argc > 3) {
+        dprintf(STDERR_FILENO, "Usage: pipebench [MIB] [PIPE_SIZE]\n");
+        return EXIT_FAILURE;
+    }
+    size_t total_bytes = (argc >= 2 ? atoi(argv[1]) : 64) * 1024 * 1024;
+
+    if (argc == 3) {
+        run(total_bytes, atoi(argv[2]));
+        return EXIT_SUCCESS;
+    }
+    for (size_t pipe_size = 4096; pipe_size <= 262144; pipe_size *= 4)
+        run(total_bytes, pipe_size);
+    return EXIT_SUCCESS;
+}
@@ -36,6 +36,7 @@
 #include <errno.h>
 #include <extra.h>
 #include <fcntl.h>
+#include <sched.h>
 #include <sound.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -266,6 +267,11 @@ int main(int argc, char* const argv[]) {
         return EXIT_FAILURE;
     }
 
+    // keep the DMA buffers of the device filled even when the system is busy.
+    // This is best effort, so playback goes on without it.
+    struct sched_param param = {.sched_priority = 50};
+    (void)sched_setscheduler(0, SCHED_RR, &param);
+
     uint16_t inout_sample_rate = sample_rate;
     if (ioctl(dsp_fd, SOUND_SET_SAMPLE_RATE, &inout_sample_rate) < 0) {
         perror("ioctl");
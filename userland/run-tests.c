@@ -37,15 +37,34 @@
 #include <extra.h>
 #include <fb.h>
 #include <fcntl.h>
+#include <futex.h>
+#include <ioring.h>
+#include <mqueue.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <panic.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <signum.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/mman.h>
+#include <sys/select.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
+#include <syscall.h>
+#include <systrace.h>
+#include <time.h>
 #include <unistd.h>
 
 static noreturn void shm_reader(void) {
@@ -191,6 +210,150 @@ static void test_fs(void) {
     }
 }
 
+static void test_shared_memory(void) {
+    puts("Shared memory");
+
+    int fd = memfd_create("test", MFD_CLOEXEC);
+    ASSERT_OK(fd);
+    ASSERT_OK(ftruncate(fd, 4096));
+    unsigned* buf = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ASSERT(buf != MAP_FAILED);
+
+    // the mapping stays coherent while the file grows and moves in the kernel
+    for (size_t size = 8192; size <= 1024 * 1024; size *= 2) {
+        ASSERT_OK(ftruncate(fd, size));
+        buf[0] = size;
+        unsigned value;
+        ASSERT(lseek(fd, 0, SEEK_SET) == 0);
+        ASSERT(read(fd, &value, sizeof(value)) == sizeof(value));
+        ASSERT(value == size);
+    }
+
+    // and between processes
+    pid_t pid = fork();
+    ASSERT_OK(pid);
+    if (pid == 0) {
+        unsigned* child_buf = mmap(NULL, 8192, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED, fd, 4096);
+        ASSERT(child_buf != MAP_FAILED);
+        ASSERT(child_buf[0] == 0);
+        child_buf[0] = 42;
+        buf[1] = 43;
+        exit(0);
+    }
+    ASSERT_OK(waitpid(pid, NULL, 0));
+    ASSERT(buf[1] == 43);
+    unsigned value;
+    ASSERT(lseek(fd, 4096, SEEK_SET) == 4096);
+    ASSERT(read(fd, &value, sizeof(value)) == sizeof(value));
+    ASSERT(value == 42);
+    ASSERT_OK(munmap(buf, 4096));
+    ASSERT_OK(close(fd));
+
+    shm_unlink("/test-shm");
+    fd = shm_open("/test-shm", O_RDWR | O_CREAT | O_EXCL, 0600);
+    ASSERT_OK(fd);
+    ASSERT_OK(close(fd));
+    fd = shm_open("/test-shm", O_RDWR, 0);
+    ASSERT_OK(fd);
+    ASSERT_OK(close(fd));
+    ASSERT_OK(shm_unlink("/test-shm"));
+    ASSERT(shm_open("/test-shm", O_RDWR, 0) < 0);
+    ASSERT(errno == ENOENT);
+    ASSERT(shm_open("no-slash", O_RDWR | O_CREAT, 0600) < 0);
+    ASSERT(errno == EINVAL);
+}
+
+static void test_mqueue(void) {
+    puts("Message queues");
+
+    mq_unlink("/test-mq");
+    struct mq_attr attr = {.mq_maxmsg = 4, .mq_msgsize = 64};
+    mqd_t mq = mq_open("/test-mq", O_RDWR | O_CREAT | O_EXCL, 0600, &attr);
+    ASSERT_OK(mq);
+    ASSERT(mq_open("/test-mq", O_RDWR | O_CREAT | O_EXCL, 0600, &attr) < 0);
+    ASSERT(errno == EEXIST);
+
+    // higher priorities first, and in order within a priority
+    ASSERT_OK(mq_send(mq, "low", 4, 1));
+    ASSERT_OK(mq_send(mq, "high", 5, 7));
+    ASSERT_OK(mq_send(mq, "low2", 5, 1));
+    ASSERT_OK(mq_send(mq, "mid", 4, 3));
+    struct mq_attr cur;
+    ASSERT_OK(mq_getattr(mq, &cur));
+    ASSERT(cur.mq_maxmsg == 4 && cur.mq_msgsize == 64 && cur.mq_curmsgs == 4);
+
+    char buf[64];
+    unsigned prio;
+    static const char* expected[] = {"high", "mid", "low", "low2"};
+    static const unsigned expected_prio[] = {7, 3, 1, 1};
+    for (size_t i = 0; i < 4; ++i) {
+        ssize_t len = mq_receive(mq, buf, sizeof(buf), &prio);
+        ASSERT(len == (ssize_t)strlen(expected[i]) + 1);
+        ASSERT(!strcmp(buf, expected[i]));
+        ASSERT(prio == expected_prio[i]);
+    }
+
+    char big[65] = {0};
+    ASSERT(mq_send(mq, big, sizeof(big), 0) < 0);
+    ASSERT(errno == EMSGSIZE);
+    ASSERT(mq_receive(mq, buf, 32, NULL) < 0);
+    ASSERT(errno == EMSGSIZE);
+    ASSERT(mq_send(mq, "x", 2, MQ_PRIO_MAX) < 0);
+    ASSERT(errno == EINVAL);
+
+    struct timespec deadline;
+    ASSERT_OK(clock_gettime(CLOCK_REALTIME, &deadline));
+    deadline.tv_nsec += 50000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        ++deadline.tv_sec;
+        deadline.tv_nsec -= 1000000000;
+    }
+    ASSERT(mq_timedreceive(mq, buf, sizeof(buf), NULL, &deadline) < 0);
+    ASSERT(errno == ETIMEDOUT);
+
+    struct mq_attr nonblock = {.mq_flags = O_NONBLOCK};
+    ASSERT_OK(mq_setattr(mq, &nonblock, NULL));
+    ASSERT(mq_receive(mq, buf, sizeof(buf), NULL) < 0);
+    ASSERT(errno == EAGAIN);
+    for (int i = 0; i < 4; ++i)
+        ASSERT_OK(mq_send(mq, "fill", 5, 0));
+    ASSERT(mq_send(mq, "full", 5, 0) < 0);
+    ASSERT(errno == EAGAIN);
+    ASSERT_OK(mq_getattr(mq, &cur));
+    ASSERT(cur.mq_flags == O_NONBLOCK && cur.mq_curmsgs == 4);
+
+    // a blocked receiver is woken up by a sender in another process
+    mqd_t reader = mq_open("/test-mq", O_RDONLY);
+    ASSERT_OK(reader);
+    for (int i = 0; i < 4; ++i)
+        ASSERT(mq_receive(reader, buf, sizeof(buf), NULL) == 5);
+    pid_t pid = fork();
+    ASSERT_OK(pid);
+    if (pid == 0) {
+        struct timespec delay = {.tv_nsec = 10000000};
+        nanosleep(&delay, NULL);
+        ASSERT_OK(mq_send(mq, "wake", 5, 2));
+        exit(0);
+    }
+    ASSERT(mq_receive(reader, buf, sizeof(buf), &prio) == 5);
+    ASSERT(!strcmp(buf, "wake") && prio == 2);
+    ASSERT_OK(waitpid(pid, NULL, 0));
+    ASSERT(mq_send(reader, "x", 2, 0) < 0);
+    ASSERT(errno == EBADF);
+
+    struct stat st;
+    ASSERT_OK(stat("/dev/mqueue/test-mq", &st));
+    ASSERT(S_ISREG(st.st_mode));
+    ASSERT_OK(mq_close(reader));
+    ASSERT_OK(mq_close(mq));
+    ASSERT_OK(mq_unlink("/test-mq"));
+    ASSERT(mq_open("/test-mq", O_RDWR) < 0);
+    ASSERT(errno == ENOENT);
+    ASSERT(mq_open("no-slash", O_RDWR | O_CREAT, 0600, NULL) < 0);
+    ASSERT(errno == EINVAL);
+}
+
 static size_t read_all(int fd, unsigned char* buf, size_t count) {
     size_t total = 0;
     while (total < count) {
@@ -229,6 +392,303 @@ static noreturn void socket_receiver(void) {
     exit(0);
 }
 
+static void test_pipe(void) {
+    puts("pipe");
+    int fds[2];
+    ASSERT_OK(pipe(fds));
+    ASSERT(fcntl(fds[0], F_GETPIPE_SZ) == 65536);
+    ASSERT(fcntl(fds[1], F_SETPIPE_SZ, 5000) == 8192);
+    ASSERT(fcntl(fds[0], F_GETPIPE_SZ) == 8192);
+
+    // the data wraps around the end of the buffer on the second round
+    static char out[6000];
+    static char in[6000];
+    for (size_t i = 0; i < sizeof(out); ++i)
+        out[i] = i * 7;
+    for (size_t round = 0; round < 2; ++round) {
+        ASSERT(write(fds[1], out, sizeof(out)) == sizeof(out));
+        ASSERT(read(fds[0], in, sizeof(in)) == sizeof(in));
+        ASSERT(!memcmp(in, out, sizeof(out)));
+    }
+
+    ASSERT(write(fds[1], out, sizeof(out)) == sizeof(out));
+    ASSERT(fcntl(fds[1], F_SETPIPE_SZ, 4096) < 0);
+    ASSERT(errno == EBUSY);
+    ASSERT(fcntl(fds[1], F_SETPIPE_SZ, 16384) == 16384);
+    ASSERT(read(fds[0], in, sizeof(in)) == sizeof(in));
+    ASSERT(!memcmp(in, out, sizeof(out)));
+
+    // writes of up to PIPE_BUF bytes, vectored or not, go in whole or not at
+    // all
+    ASSERT(fcntl(fds[1], F_SETPIPE_SZ, 4096) == 4096);
+    ASSERT_OK(fcntl(fds[1], F_SETFL, O_WRONLY | O_NONBLOCK));
+    ASSERT(write(fds[1], out, 4090) == 4090);
+    ASSERT(write(fds[1], out, 10) < 0);
+    ASSERT(errno == EAGAIN);
+    struct iovec iov[] = {{.iov_base = "hello ", .iov_len = 6},
+                          {.iov_base = "world", .iov_len = 5}};
+    ASSERT(writev(fds[1], iov, 2) < 0);
+    ASSERT(errno == EAGAIN);
+    ASSERT(read(fds[0], in, 4090) == 4090);
+    ASSERT(writev(fds[1], iov, 2) == 11);
+    ASSERT(read(fds[0], in, sizeof(in)) == 11);
+    ASSERT(!memcmp(in, "hello world", 11));
+
+    ASSERT_OK(close(fds[0]));
+    ASSERT_OK(close(fds[1]));
+}
+
+static void test_splice(void) {
+    puts("splice");
+    unlink("/tmp/test-splice-src");
+    unlink("/tmp/test-splice-dest");
+    int src = open("/tmp/test-splice-src", O_RDWR | O_CREAT | O_EXCL);
+    ASSERT_OK(src);
+    ASSERT(write(src, "hello, splice", 13) == 13);
+    ASSERT_OK(lseek(src, 0, SEEK_SET));
+
+    int fds[2];
+    ASSERT_OK(pipe(fds));
+    int tee_fds[2];
+    ASSERT_OK(pipe(tee_fds));
+
+    // the offset is used and advanced instead of the file offset
+    off_t offset = 7;
+    ASSERT(splice(src, &offset, fds[1], NULL, 100, 0) == 6);
+    ASSERT(offset == 13);
+    ASSERT(splice(src, NULL, fds[1], NULL, 5, 0) == 5);
+    ASSERT(splice(src, &offset, fds[1], NULL, 100, 0) == 0);
+
+    ASSERT(tee(fds[0], tee_fds[1], 100, 0) == 11);
+    char buf[32];
+    ASSERT(read(tee_fds[0], buf, sizeof(buf)) == 11);
+    ASSERT(!memcmp(buf, "splicehello", 11));
+
+    int dest = open("/tmp/test-splice-dest", O_RDWR | O_CREAT | O_EXCL);
+    ASSERT_OK(dest);
+    ASSERT(splice(fds[0], NULL, dest, NULL, 100, 0) == 11);
+    ASSERT(splice(fds[0], NULL, dest, NULL, 100, SPLICE_F_NONBLOCK) < 0);
+    ASSERT(errno == EAGAIN);
+    ASSERT_OK(lseek(dest, 0, SEEK_SET));
+    ASSERT(read(dest, buf, sizeof(buf)) == 11);
+    ASSERT(!memcmp(buf, "splicehello", 11));
+
+    struct iovec iov[] = {{.iov_base = "vm", .iov_len = 2},
+                          {.iov_base = "splice", .iov_len = 6}};
+    ASSERT(vmsplice(fds[1], iov, 2, 0) == 8);
+    ASSERT(splice(fds[0], NULL, tee_fds[1], NULL, 100, 0) == 8);
+    ASSERT(read(tee_fds[0], buf, sizeof(buf)) == 8);
+    ASSERT(!memcmp(buf, "vmsplice", 8));
+
+    // Gifted pages become part of the pipe: it sees later writes to them,
+    // keeps them after munmap(), and doesn't write into them itself.
+    int gift_fds[2];
+    ASSERT_OK(pipe(gift_fds));
+    ASSERT(fcntl(gift_fds[1], F_SETPIPE_SZ, 4096) == 4096);
+    char* pages = mmap(NULL, 8192, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT(pages != MAP_FAILED);
+    memset(pages, 'g', 8192);
+    struct iovec gift = {.iov_base = pages, .iov_len = 4096};
+    ASSERT(vmsplice(gift_fds[1], &gift, 1, SPLICE_F_GIFT) == 4096);
+    pages[0] = 'h';
+    static char page_buf[4096];
+    ASSERT(read(gift_fds[0], page_buf, 4096) == 4096);
+    ASSERT(page_buf[0] == 'h' && page_buf[4095] == 'g');
+    memset(page_buf, 'w', 4096);
+    ASSERT(write(gift_fds[1], page_buf, 4096) == 4096);
+    ASSERT(read(gift_fds[0], page_buf, 4096) == 4096);
+    ASSERT(page_buf[0] == 'w');
+    ASSERT(pages[1] == 'g');
+    gift.iov_base = pages + 4096;
+    ASSERT(vmsplice(gift_fds[1], &gift, 1, SPLICE_F_GIFT) == 4096);
+    ASSERT_OK(munmap(pages, 8192));
+    ASSERT(read(gift_fds[0], page_buf, 4096) == 4096);
+    ASSERT(page_buf[0] == 'g' && page_buf[4095] == 'g');
+    ASSERT_OK(close(gift_fds[0]));
+    ASSERT_OK(close(gift_fds[1]));
+
+    // a splice blocked on its input doesn't keep readers off the pipe
+    int sv[2];
+    ASSERT_OK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    ASSERT(write(fds[1], "ab", 2) == 2);
+    pid_t pid = fork();
+    ASSERT_OK(pid);
+    if (pid == 0) {
+        ASSERT(splice(sv[0], NULL, fds[1], NULL, 100, 0) == 2);
+        exit(0);
+    }
+    struct timespec delay = {.tv_sec = 0, .tv_nsec = 20000000};
+    ASSERT_OK(nanosleep(&delay, NULL));
+    ASSERT(read(fds[0], buf, sizeof(buf)) == 2);
+    ASSERT(!memcmp(buf, "ab", 2));
+    ASSERT(write(sv[1], "cd", 2) == 2);
+    int status;
+    ASSERT_OK(waitpid(pid, &status, 0));
+    ASSERT(status == 0);
+    ASSERT(read(fds[0], buf, sizeof(buf)) == 2);
+    ASSERT(!memcmp(buf, "cd", 2));
+    ASSERT_OK(close(sv[0]));
+    ASSERT_OK(close(sv[1]));
+
+    ASSERT(splice(src, NULL, dest, NULL, 100, 0) < 0);
+    ASSERT(errno == EINVAL);
+
+    ASSERT_OK(close(fds[0]));
+    ASSERT_OK(close(fds[1]));
+    ASSERT_OK(close(tee_fds[0]));
+    ASSERT_OK(close(tee_fds[1]));
+    ASSERT_OK(close(src));
+    ASSERT_OK(close(dest));
+}
+
+static void test_vectored_io(void) {
+    puts("readv/writev and pread/pwrite");
+    unlink("/tmp/test-uio");
+    int fd = open("/tmp/test-uio", O_RDWR | O_CREAT | O_EXCL);
+    ASSERT_OK(fd);
+
+    struct iovec iov[] = {{.iov_base = "head", .iov_len = 4},
+                          {.iov_base = NULL, .iov_len = 0},
+                          {.iov_base = "er-body", .iov_len = 7}};
+    ASSERT(writev(fd, iov, 3) == 11);
+    ASSERT(lseek(fd, 0, SEEK_CUR) == 11);
+
+    // positional I/O leaves the offset alone
+    char buf[16] = {0};
+    ASSERT(pread(fd, buf, sizeof(buf), 2) == 9);
+    ASSERT(!memcmp(buf, "ader-body", 9));
+    ASSERT(pwrite(fd, "B", 1, 7) == 1);
+    ASSERT(pwrite(fd, "!", 1, 11) == 1);
+    ASSERT(lseek(fd, 0, SEEK_CUR) == 11);
+    ASSERT(pread(fd, buf, 1, -1) < 0);
+    ASSERT(errno == EINVAL);
+
+    ASSERT_OK(lseek(fd, 0, SEEK_SET));
+    char head[6] = {0};
+    char body[8] = {0};
+    struct iovec riov[] = {{.iov_base = head, .iov_len = 6},
+                           {.iov_base = body, .iov_len = 8}};
+    ASSERT(readv(fd, riov, 2) == 12);
+    ASSERT(!memcmp(head, "header", 6));
+    ASSERT(!memcmp(body, "-Body!", 6));
+    ASSERT(readv(fd, riov, 2) == 0);
+    ASSERT(readv(fd, riov, -1) < 0);
+    ASSERT(errno == EINVAL);
+    ASSERT_OK(close(fd));
+    ASSERT_OK(unlink("/tmp/test-uio"));
+
+    // readv on a pipe returns what is available instead of blocking for
+    // the remaining iovecs
+    int fds[2];
+    ASSERT_OK(pipe(fds));
+    ASSERT(writev(fds[1], iov, 3) == 11);
+    memset(head, 0, sizeof(head));
+    memset(body, 0, sizeof(body));
+    struct iovec piov[] = {{.iov_base = head, .iov_len = 4},
+                           {.iov_base = body, .iov_len = 8}};
+    ASSERT(readv(fds[0], piov, 2) == 11);
+    ASSERT(!memcmp(head, "head", 4));
+    ASSERT(!memcmp(body, "er-body", 7));
+    ASSERT(pread(fds[0], buf, 1, 0) < 0);
+    ASSERT(errno == ESPIPE);
+    ASSERT(pwrite(fds[1], buf, 1, 0) < 0);
+    ASSERT(errno == ESPIPE);
+    ASSERT_OK(close(fds[0]));
+    ASSERT_OK(close(fds[1]));
+}
+
+static ssize_t read_at(int fd, void* buf, size_t count, off_t offset) {
+    ASSERT(lseek(fd, offset, SEEK_SET) == offset);
+    return read(fd, buf, count);
+}
+
+static ssize_t write_at(int fd, const void* buf, size_t count, off_t offset) {
+    ASSERT(lseek(fd, offset, SEEK_SET) == offset);
+    return write(fd, buf, count);
+}
+
+static void test_copy_file_range(void) {
+    puts("copy_file_range");
+    unlink("/tmp/test-copy-src");
+    unlink("/tmp/test-copy-dest");
+    int src = open("/tmp/test-copy-src", O_RDWR | O_CREAT | O_EXCL);
+    ASSERT_OK(src);
+    int dest = open("/tmp/test-copy-dest", O_RDWR | O_CREAT | O_EXCL);
+    ASSERT_OK(dest);
+
+    const size_t size = 4 * 4096 + 100;
+    unsigned char* buf = malloc(size);
+    ASSERT(buf);
+    for (size_t i = 0; i < size; ++i)
+        buf[i] = i % 251;
+    ASSERT((size_t)write(src, buf, size) == size);
+    ASSERT_OK(lseek(src, 0, SEEK_SET));
+
+    // whole pages are shared, and the tail is copied
+    ASSERT((size_t)copy_file_range(src, NULL, dest, NULL, size * 2, 0) ==
+           size);
+    ASSERT(copy_file_range(src, NULL, dest, NULL, size, 0) == 0);
+    unsigned char* read_buf = malloc(size);
+    ASSERT(read_buf);
+    ASSERT((size_t)read_at(dest, read_buf, size, 0) == size);
+    ASSERT(!memcmp(read_buf, buf, size));
+
+    // writes to either file don't show up in the other
+    ASSERT(write_at(dest, "dest", 4, 10) == 4);
+    ASSERT(write_at(src, "src", 3, 4096 + 10) == 3);
+    ASSERT((size_t)read_at(src, read_buf, size, 0) == size);
+    ASSERT(!memcmp(read_buf, buf, 10));
+    ASSERT(!memcmp(read_buf + 10, buf + 10, 4));
+    ASSERT(!memcmp(read_buf + 4096 + 10, "src", 3));
+    ASSERT((size_t)read_at(dest, read_buf, size, 0) == size);
+    ASSERT(!memcmp(read_buf + 10, "dest", 4));
+    ASSERT(!memcmp(read_buf + 4096 + 10, buf + 4096 + 10, 3));
+
+    // nor do writes through a mapping
+    unsigned char* mapped =
+        mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, src, 0);
+    ASSERT(mapped != MAP_FAILED);
+    off_t off_in = 0;
+    off_t off_out = 2 * 4096;
+    ASSERT(copy_file_range(src, &off_in, dest, &off_out, 4096, 0) == 4096);
+    ASSERT(off_in == 4096);
+    ASSERT(off_out == 3 * 4096);
+    mapped[0] = 'm';
+    ASSERT(read_at(dest, read_buf, 1, 2 * 4096) == 1);
+    ASSERT(read_buf[0] == buf[0]);
+    ASSERT_OK(munmap(mapped, 4096));
+
+    // unaligned ranges are copied
+    off_in = 1;
+    off_out = 3;
+    ASSERT(copy_file_range(src, &off_in, dest, &off_out, 5000, 0) == 5000);
+    ASSERT(read_at(dest, read_buf, 5000, 3) == 5000);
+    ASSERT(read_buf[0] == buf[1]);
+    ASSERT(!memcmp(read_buf + 4096 + 10 - 1, "src", 3));
+
+    // overlapping ranges in the same file are rejected
+    off_in = 0;
+    off_out = 100;
+    ASSERT(copy_file_range(src, &off_in, src, &off_out, 4096, 0) < 0);
+    ASSERT(errno == EINVAL);
+
+    int fds[2];
+    ASSERT_OK(pipe(fds));
+    off_t offset = 4096 + 10;
+    ASSERT(sendfile(fds[1], src, &offset, 3) == 3);
+    ASSERT(offset == 4096 + 13);
+    ASSERT(read(fds[0], read_buf, size) == 3);
+    ASSERT(!memcmp(read_buf, "src", 3));
+    ASSERT_OK(close(fds[0]));
+    ASSERT_OK(close(fds[1]));
+
+    free(buf);
+    free(read_buf);
+    ASSERT_OK(close(src));
+    ASSERT_OK(close(dest));
+}
+
 static void test_socket(void) {
     puts("Socket");
 
@@ -271,6 +731,348 @@ static void test_socket(void) {
     ASSERT_OK(close(peer_fd2));
 }
 
+static ssize_t send_fd(int sockfd, const char* data, size_t len, int fd) {
+    struct iovec iov = {.iov_base = (void*)data, .iov_len = len};
+    union {
+        struct cmsghdr hdr;
+        unsigned char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    msghdr msg = {.msg_iov = &iov,
+                  .msg_iovlen = 1,
+                  .msg_control = control.buf,
+                  .msg_controllen = sizeof(control.buf)};
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    return sendmsg(sockfd, &msg, 0);
+}
+
+// returns the received descriptor in *fd, or -1 if none came
+static ssize_t recv_fd(int sockfd, char* data, size_t len, int* fd) {
+    struct iovec iov = {.iov_base = data, .iov_len = len};
+    union {
+        struct cmsghdr hdr;
+        unsigned char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    msghdr msg = {.msg_iov = &iov,
+                  .msg_iovlen = 1,
+                  .msg_control = control.buf,
+                  .msg_controllen = sizeof(control.buf)};
+    ssize_t rc = recvmsg(sockfd, &msg, 0);
+    *fd = -1;
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (rc >= 0 && cmsg) {
+        ASSERT(cmsg->cmsg_level == SOL_SOCKET);
+        ASSERT(cmsg->cmsg_type == SCM_RIGHTS);
+        memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    return rc;
+}
+
+static void test_socket_messages(void) {
+    puts("Socket messages");
+
+    int sv[2];
+    ASSERT_OK(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv));
+    ASSERT(write(sv[0], "ab", 2) == 2);
+    ASSERT(write(sv[0], "cde", 3) == 3);
+    ASSERT(write(sv[0], "truncated", 9) == 9);
+    char buf[16];
+    ASSERT(read(sv[1], buf, sizeof(buf)) == 2);
+    ASSERT(!memcmp(buf, "ab", 2));
+    ASSERT(read(sv[1], buf, sizeof(buf)) == 3);
+    ASSERT(!memcmp(buf, "cde", 3));
+    struct iovec iov = {.iov_base = buf, .iov_len = 5};
+    msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1};
+    ASSERT(recvmsg(sv[1], &msg, 0) == 5);
+    ASSERT(msg.msg_flags & MSG_TRUNC);
+    ASSERT(!memcmp(buf, "trunc", 5));
+    ASSERT(write(sv[1], "back", 4) == 4);
+    ASSERT(read(sv[0], buf, sizeof(buf)) == 4);
+    ASSERT(!memcmp(buf, "back", 4));
+
+    // the received descriptor shares the open file description
+    unlink("/tmp/test-scm-rights");
+    int file = open("/tmp/test-scm-rights", O_RDWR | O_CREAT | O_EXCL);
+    ASSERT_OK(file);
+    ASSERT(write(file, "rights", 6) == 6);
+    ASSERT(send_fd(sv[0], "f", 1, file) == 1);
+    ASSERT_OK(close(file));
+    int received;
+    ASSERT(recv_fd(sv[1], buf, sizeof(buf), &received) == 1);
+    ASSERT_OK(received);
+    ASSERT(lseek(received, 0, SEEK_CUR) == 6);
+    ASSERT(lseek(received, 0, SEEK_SET) == 0);
+    ASSERT(read(received, buf, sizeof(buf)) == 6);
+    ASSERT(!memcmp(buf, "rights", 6));
+    ASSERT_OK(close(sv[0]));
+    ASSERT_OK(close(sv[1]));
+
+    // on a stream, the descriptor arrives with the bytes it was sent with
+    ASSERT_OK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    ASSERT(write(sv[0], "abc", 3) == 3);
+    ASSERT(send_fd(sv[0], "de", 2, received) == 2);
+    int fd;
+    ASSERT(recv_fd(sv[1], buf, sizeof(buf), &fd) == 3);
+    ASSERT(fd == -1);
+    ASSERT(recv_fd(sv[1], buf, sizeof(buf), &fd) == 2);
+    ASSERT(!memcmp(buf, "de", 2));
+    ASSERT_OK(fd);
+    ASSERT_OK(close(fd));
+    ASSERT_OK(close(received));
+    ASSERT_OK(close(sv[0]));
+    ASSERT_OK(close(sv[1]));
+
+    int receiver = socket(AF_UNIX, SOCK_DGRAM, 0);
+    ASSERT_OK(receiver);
+    unlink("/tmp/test-dgram");
+    sockaddr_un addr = {AF_UNIX, "/tmp/test-dgram"};
+    ASSERT_OK(bind(receiver, (const sockaddr*)&addr, sizeof(sockaddr_un)));
+    int sender = socket(AF_UNIX, SOCK_DGRAM, 0);
+    ASSERT_OK(sender);
+    ASSERT(write(sender, "x", 1) < 0);
+    ASSERT(errno == ENOTCONN);
+    iov = (struct iovec){.iov_base = "to", .iov_len = 2};
+    msg = (msghdr){.msg_name = &addr,
+                   .msg_namelen = sizeof(sockaddr_un),
+                   .msg_iov = &iov,
+                   .msg_iovlen = 1};
+    ASSERT(sendmsg(sender, &msg, 0) == 2);
+    ASSERT_OK(connect(sender, (const sockaddr*)&addr, sizeof(sockaddr_un)));
+    ASSERT(write(sender, "peer", 4) == 4);
+    ASSERT(read(receiver, buf, sizeof(buf)) == 2);
+    ASSERT(!memcmp(buf, "to", 2));
+    ASSERT(read(receiver, buf, sizeof(buf)) == 4);
+    ASSERT(!memcmp(buf, "peer", 4));
+    ASSERT_OK(close(sender));
+    ASSERT_OK(close(receiver));
+}
+
+static void test_socket_connections(void) {
+    puts("Socket connections");
+
+    int sockfd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    ASSERT_OK(sockfd);
+    unlink("/tmp/test-socket-connections");
+    sockaddr_un addr = {AF_UNIX, "/tmp/test-socket-connections"};
+    ASSERT_OK(bind(sockfd, (const sockaddr*)&addr, sizeof(sockaddr_un)));
+    ASSERT_OK(listen(sockfd, 4));
+
+    ASSERT_OK(fcntl(sockfd, F_SETFL, O_RDWR | O_NONBLOCK));
+    ASSERT(accept(sockfd, NULL, NULL) < 0);
+    ASSERT(errno == EAGAIN);
+    ASSERT_OK(fcntl(sockfd, F_SETFL, O_RDWR));
+
+    const size_t num_connections = 32;
+    pid_t pid = fork();
+    ASSERT_OK(pid);
+    if (pid == 0) {
+        for (size_t i = 0; i < num_connections; ++i) {
+            int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+            ASSERT_OK(fd);
+            ASSERT_OK(connect(fd, (const sockaddr*)&addr, sizeof(sockaddr_un)));
+            ASSERT(write(fd, &i, sizeof(i)) == sizeof(i));
+            ASSERT_OK(close(fd));
+        }
+        exit(0);
+    }
+    for (size_t i = 0; i < num_connections; ++i) {
+        int fd = accept(sockfd, NULL, NULL);
+        ASSERT_OK(fd);
+        size_t j;
+        ASSERT(read(fd, &j, sizeof(j)) == sizeof(j));
+        ASSERT(j == i);
+        ASSERT_OK(close(fd));
+    }
+    ASSERT_OK(waitpid(pid, NULL, 0));
+    ASSERT_OK(close(sockfd));
+
+    // both ends of a pair see the same buffer in opposite directions
+    int sv[2];
+    ASSERT_OK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    int size;
+    socklen_t optlen = sizeof(size);
+    ASSERT_OK(getsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &size, &optlen));
+    ASSERT(optlen == sizeof(int));
+    ASSERT(size == 4096);
+    size = 65536;
+    ASSERT_OK(setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)));
+    ASSERT_OK(getsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &size, &optlen));
+    ASSERT(size == 65536);
+    ASSERT_OK(getsockopt(sv[1], SOL_SOCKET, SO_SNDBUF, &size, &optlen));
+    ASSERT(size == 4096);
+
+    static char buf[60000];
+    ASSERT(write(sv[0], buf, sizeof(buf)) == sizeof(buf));
+    size = 4096;
+    ASSERT(setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) < 0);
+    ASSERT(errno == EBUSY);
+    ASSERT_OK(close(sv[0]));
+    ASSERT_OK(close(sv[1]));
+}
+
+static sockaddr_in loopback_addr(uint16_t port) {
+    sockaddr_in addr = {.sin_family = AF_INET,
+                        .sin_port = htons(port),
+                        .sin_addr = {htonl(INADDR_LOOPBACK)}};
+    return addr;
+}
+
+// an ICMP echo message as sent through a ping socket
+struct echo_message {
+    uint8_t type;
+    uint8_t code;
+    uint16_t checksum;
+    uint16_t id;
+    uint16_t seq;
+    char payload[8];
+};
+
+static unsigned char tcp_pattern(size_t i) { return (i * 7 + i / 4096) & 0xff; }
+
+static void test_inet_sockets(void) {
+    puts("Inet sockets");
+
+    // UDP
+    sockaddr_in udp_addr = loopback_addr(7000);
+    int server = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_OK(server);
+    ASSERT_OK(bind(server, (const sockaddr*)&udp_addr, sizeof(udp_addr)));
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_OK(fd);
+    ASSERT(bind(fd, (const sockaddr*)&udp_addr, sizeof(udp_addr)) < 0);
+    ASSERT(errno == EADDRINUSE);
+    ASSERT_OK(close(fd));
+
+    int client = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_OK(client);
+    ASSERT(sendto(client, "hello", 5, 0, (const sockaddr*)&udp_addr,
+                  sizeof(udp_addr)) == 5);
+    char buf[16];
+    sockaddr_in from;
+    socklen_t fromlen = sizeof(from);
+    ASSERT(recvfrom(server, buf, sizeof(buf), 0, (sockaddr*)&from,
+                    &fromlen) == 5);
+    ASSERT(!memcmp(buf, "hello", 5));
+    ASSERT(fromlen == sizeof(sockaddr_in));
+    ASSERT(from.sin_family == AF_INET);
+    ASSERT(from.sin_addr.s_addr == htonl(INADDR_LOOPBACK));
+    ASSERT(ntohs(from.sin_port) >= 49152);
+    ASSERT(sendto(server, "world", 5, 0, (const sockaddr*)&from, fromlen) ==
+           5);
+    ASSERT(recv(client, buf, sizeof(buf), 0) == 5);
+    ASSERT(!memcmp(buf, "world", 5));
+
+    // a datagram that doesn't fit is truncated
+    ASSERT_OK(connect(client, (const sockaddr*)&udp_addr, sizeof(udp_addr)));
+    ASSERT(send(client, "0123456789", 10, 0) == 10);
+    struct iovec iov = {.iov_base = buf, .iov_len = 4};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1};
+    ASSERT(recvmsg(server, &msg, 0) == 4);
+    ASSERT(msg.msg_flags & MSG_TRUNC);
+    ASSERT(!memcmp(buf, "0123", 4));
+    ASSERT_OK(close(client));
+    ASSERT_OK(close(server));
+
+    // ICMP echo
+    int ping = socket(AF_INET, SOCK_DGRAM, IPPROTO_ICMP);
+    ASSERT_OK(ping);
+    sockaddr_in ping_addr = loopback_addr(0);
+    struct echo_message echo = {.type = 8, .seq = htons(1)};
+    memcpy(echo.payload, "pingpong", sizeof(echo.payload));
+    ASSERT(sendto(ping, &echo, sizeof(echo), 0, (const sockaddr*)&ping_addr,
+                  sizeof(ping_addr)) == sizeof(echo));
+    struct echo_message reply;
+    ASSERT(recv(ping, &reply, sizeof(reply), 0) == sizeof(reply));
+    ASSERT(reply.type == 0);
+    ASSERT(reply.seq == htons(1));
+    ASSERT(!memcmp(reply.payload, "pingpong", sizeof(reply.payload)));
+    ASSERT_OK(close(ping));
+
+    // TCP
+    sockaddr_in tcp_addr = loopback_addr(7001);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_OK(listener);
+    ASSERT_OK(bind(listener, (const sockaddr*)&tcp_addr, sizeof(tcp_addr)));
+    ASSERT_OK(listen(listener, 4));
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_OK(fd);
+    ASSERT(bind(fd, (const sockaddr*)&tcp_addr, sizeof(tcp_addr)) < 0);
+    ASSERT(errno == EADDRINUSE);
+    ASSERT_OK(close(fd));
+
+    ASSERT_OK(fcntl(listener, F_SETFL, O_RDWR | O_NONBLOCK));
+    ASSERT(accept(listener, NULL, NULL) < 0);
+    ASSERT(errno == EAGAIN);
+    ASSERT_OK(fcntl(listener, F_SETFL, O_RDWR));
+
+    // more than the buffers and the window hold, so that the sender has to
+    // wait for the receiver
+    const size_t total = 1024 * 1024;
+    pid_t pid = fork();
+    ASSERT_OK(pid);
+    if (pid == 0) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        ASSERT_OK(fd);
+        int nodelay = 1;
+        ASSERT_OK(setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay,
+                             sizeof(nodelay)));
+        ASSERT_OK(
+            connect(fd, (const sockaddr*)&tcp_addr, sizeof(tcp_addr)));
+        static unsigned char chunk[10000];
+        for (size_t offset = 0; offset < total;) {
+            size_t n = MIN(sizeof(chunk), total - offset);
+            for (size_t i = 0; i < n; ++i)
+                chunk[i] = tcp_pattern(offset + i);
+            ASSERT(write(fd, chunk, n) == (ssize_t)n);
+            offset += n;
+        }
+        char reply[4];
+        ASSERT(read(fd, reply, sizeof(reply)) == sizeof(reply));
+        ASSERT(!memcmp(reply, "done", 4));
+        ASSERT_OK(close(fd));
+        exit(0);
+    }
+
+    sockaddr_in peer;
+    socklen_t peerlen = sizeof(peer);
+    int conn = accept(listener, (sockaddr*)&peer, &peerlen);
+    ASSERT_OK(conn);
+    ASSERT(peerlen == sizeof(sockaddr_in));
+    ASSERT(peer.sin_family == AF_INET);
+    ASSERT(peer.sin_addr.s_addr == htonl(INADDR_LOOPBACK));
+    static unsigned char received[8192];
+    size_t total_read = 0;
+    while (total_read < total) {
+        ssize_t nread = read(conn, received, sizeof(received));
+        ASSERT(nread > 0);
+        for (ssize_t i = 0; i < nread; ++i)
+            ASSERT(received[i] == tcp_pattern(total_read + i));
+        total_read += nread;
+    }
+    ASSERT(write(conn, "done", 4) == 4);
+    // the client closes after reading the reply
+    ASSERT(read(conn, received, sizeof(received)) == 0);
+    ASSERT_OK(close(conn));
+    ASSERT_OK(waitpid(pid, NULL, 0));
+    ASSERT_OK(close(listener));
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_OK(fd);
+    int value;
+    socklen_t optlen = sizeof(value);
+    ASSERT_OK(getsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &value, &optlen));
+    ASSERT(value == 0);
+    ASSERT_OK(getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &value, &optlen));
+    ASSERT(value == 65536);
+    // nobody listens there anymore
+    ASSERT(connect(fd, (const sockaddr*)&tcp_addr, sizeof(tcp_addr)) < 0);
+    ASSERT(errno == ECONNREFUSED);
+    ASSERT_OK(close(fd));
+}
+
 static void* shared_mmap_addr;
 
 static void mmap_reader(void) {
@@ -297,6 +1099,50 @@ static void test_mmap_shared(void) {
     ASSERT_OK(munmap(shared_mmap_addr, size));
 }
 
+static noreturn void futex_waiter(uint32_t* word) {
+    while (*(volatile uint32_t*)word == 0) {
+        int rc = futex(word, FUTEX_WAIT, 0, NULL);
+        ASSERT(rc == 0 || errno == EAGAIN);
+    }
+    ASSERT(*word == 1);
+    exit(0);
+}
+
+static void test_futex(void) {
+    puts("futex");
+
+    // MAP_SHARED pages stay shared across fork(), so both processes find the
+    // same futex through the physical page
+    uint32_t* word = mmap(NULL, sizeof(uint32_t), PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_ANONYMOUS, 0, 0);
+    ASSERT(word != MAP_FAILED);
+    *word = 0;
+
+    ASSERT_ERR(futex(word, FUTEX_WAIT, 1, NULL));
+    ASSERT(errno == EAGAIN);
+
+    struct timespec timeout = {.tv_sec = 0, .tv_nsec = 10000000};
+    ASSERT_ERR(futex(word, FUTEX_WAIT, 0, &timeout));
+    ASSERT(errno == ETIMEDOUT);
+
+    ASSERT(futex(word, FUTEX_WAKE, 1, NULL) == 0);
+
+    pid_t pid = fork();
+    ASSERT_OK(pid);
+    if (pid == 0)
+        futex_waiter(word);
+
+    struct timespec delay = {.tv_sec = 0, .tv_nsec = 20000000};
+    ASSERT_OK(nanosleep(&delay, NULL));
+    *word = 1;
+    ASSERT_OK(futex(word, FUTEX_WAKE, 1, NULL));
+    int status;
+    ASSERT_OK(waitpid(pid, &status, 0));
+    ASSERT(status == 0);
+
+    ASSERT_OK(munmap(word, sizeof(uint32_t)));
+}
+
 static void test_framebuffer(void) {
     puts("Framebuffer");
 
@@ -334,12 +1180,552 @@ static void test_malloc(void) {
     }
 }
 
+static size_t read_fpu_lazy_restores(void) {
+    int fd = open("/proc/fpustat", O_RDONLY);
+    ASSERT_OK(fd);
+    char buf[128];
+    ssize_t nread = read(fd, buf, sizeof(buf) - 1);
+    ASSERT_OK(nread);
+    buf[nread] = 0;
+    ASSERT_OK(close(fd));
+    const char* prefix = "lazy_restores ";
+    ASSERT(!strncmp(buf, prefix, strlen(prefix)));
+    return atoi(buf + strlen(prefix));
+}
+
+static noreturn void fpu_worker(double step) {
+    volatile double sum = 0;
+    for (int i = 0; i < 1000; ++i) {
+        sum += step;
+        if (i % 100 == 0)
+            sched_yield();
+    }
+    exit(sum == 1000 * step ? 0 : 1);
+}
+
+static void test_fpu(void) {
+    puts("FPU");
+    size_t lazy_restores = read_fpu_lazy_restores();
+
+    // the workers switch back and forth, so each of them has its FPU state
+    // restored lazily after the other one used the FPU
+    pid_t pids[2];
+    for (size_t i = 0; i < 2; ++i) {
+        pids[i] = fork();
+        ASSERT_OK(pids[i]);
+        if (pids[i] == 0)
+            fpu_worker(0.5 + i);
+    }
+    for (size_t i = 0; i < 2; ++i) {
+        int status;
+        ASSERT_OK(waitpid(pids[i], &status, 0));
+        ASSERT(status == 0);
+    }
+
+    ASSERT(read_fpu_lazy_restores() > lazy_restores);
+}
+
+static void test_nice(void) {
+    puts("nice");
+    pid_t pid = fork();
+    ASSERT_OK(pid);
+    if (pid == 0) {
+        ASSERT(nice(0) == 0);
+        ASSERT(nice(5) == 5);
+        ASSERT(nice(100) == 19);
+        ASSERT(nice(-100) == -20);
+        exit(0);
+    }
+    int status;
+    ASSERT_OK(waitpid(pid, &status, 0));
+    ASSERT(status == 0);
+    ASSERT(nice(0) == 0);
+}
+
+static size_t read_sched_stat(const char* name) {
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/%d/sched", getpid());
+    int fd = open(path, O_RDONLY);
+    ASSERT_OK(fd);
+    char buf[256];
+    ssize_t nread = read(fd, buf, sizeof(buf) - 1);
+    ASSERT_OK(nread);
+    buf[nread] = 0;
+    ASSERT_OK(close(fd));
+    char* line = strstr(buf, name);
+    ASSERT(line);
+    return atoi(line + strlen(name) + 1);
+}
+
+static void test_process_group(void) {
+    puts("process group");
+    pid_t pids[8];
+    for (size_t i = 0; i < 8; ++i) {
+        pids[i] = fork();
+        ASSERT_OK(pids[i]);
+        if (pids[i] == 0) {
+            for (;;)
+                sched_yield();
+        }
+        ASSERT_OK(setpgid(pids[i], pids[0]));
+    }
+    ASSERT(getpgid(pids[7]) == pids[0]);
+    ASSERT(waitpid(-1, NULL, WNOHANG) == 0);
+
+    ASSERT_OK(kill(-pids[0], SIGKILL));
+    for (size_t i = 0; i < 8; ++i)
+        ASSERT(waitpid(-pids[0], NULL, 0) > 0);
+    ASSERT(waitpid(-pids[0], NULL, 0) < 0);
+    ASSERT(errno == ECHILD);
+    ASSERT(waitpid(-1, NULL, WNOHANG) < 0);
+    ASSERT(errno == ECHILD);
+}
+
+static void test_schedstat(void) {
+    puts("schedstat");
+    size_t num_switches = read_sched_stat("voluntary_switches");
+    ASSERT_OK(sched_yield());
+    ASSERT_OK(sched_yield());
+    ASSERT(read_sched_stat("voluntary_switches") >= num_switches + 2);
+
+    int fd = open("/proc/schedstat", O_RDONLY);
+    ASSERT_OK(fd);
+    char buf[32];
+    ASSERT(read(fd, buf, sizeof(buf)) > 0);
+    ASSERT_OK(close(fd));
+    ASSERT(!strncmp(buf, "cpu0 ", 5));
+}
+
+static void test_vdso(void) {
+    puts("vDSO");
+    ASSERT(sysconf(_SC_PAGESIZE) == 4096);
+    ASSERT(sysconf(_SC_CLK_TCK) > 0);
+
+    struct timespec a;
+    struct timespec b;
+    ASSERT_OK(clock_gettime(CLOCK_MONOTONIC, &a));
+    ASSERT_OK(clock_gettime(CLOCK_MONOTONIC, &b));
+    ASSERT(a.tv_sec < b.tv_sec ||
+           (a.tv_sec == b.tv_sec && a.tv_nsec <= b.tv_nsec));
+    ASSERT_ERR(clock_gettime(-1, &a));
+
+    // the cached pid must not leak into the child
+    pid_t parent_pid = getpid();
+    pid_t pid = fork();
+    ASSERT_OK(pid);
+    if (pid == 0)
+        exit(getpid() != parent_pid && getpid() == gettid() ? 0 : 1);
+    int status;
+    ASSERT_OK(waitpid(pid, &status, 0));
+    ASSERT(status == 0);
+    ASSERT(getpid() == parent_pid);
+}
+
+static void test_systrace(void) {
+    puts("systrace");
+    unsigned cursor = 0;
+    ASSERT_OK(systrace_read(&cursor, NULL, 0));
+
+    ASSERT_OK(systrace(SYSTRACE_ATTACH, 0));
+    pid_t pgid = getpgid(0);
+    ASSERT_OK(systrace(SYSTRACE_DETACH, 0));
+    ASSERT_OK(getpgid(0)); // not recorded
+
+    struct syscall_record records[8];
+    ssize_t n = systrace_read(&cursor, records, 8);
+    ASSERT(n == 2);
+    ASSERT(records[0].num == SYS_getpgid);
+    ASSERT(records[0].pid == gettid());
+    ASSERT((pid_t)records[0].ret == pgid);
+    ASSERT(records[1].num == SYS_systrace);
+    ASSERT(records[1].seq == records[0].seq + 1);
+    ASSERT(systrace_read(&cursor, records, 8) == 0);
+
+    int fd = open("/proc/syscallstat", O_RDONLY);
+    ASSERT_OK(fd);
+    char buf[1024];
+    ssize_t nread = read(fd, buf, sizeof(buf) - 1);
+    ASSERT_OK(nread);
+    buf[nread] = 0;
+    ASSERT_OK(close(fd));
+    ASSERT(strstr(buf, "getpgid "));
+}
+
+static void test_poll(void) {
+    puts("poll");
+    int p1[2];
+    int p2[2];
+    ASSERT_OK(pipe(p1));
+    ASSERT_OK(pipe(p2));
+
+    struct pollfd fds[] = {{.fd = p1[0], .events = POLLIN},
+                           {.fd = p2[0], .events = POLLIN},
+                           {.fd = p2[1], .events = POLLOUT}};
+    ASSERT(poll(fds, 2, 0) == 0);
+    ASSERT(poll(fds, 3, -1) == 1);
+    ASSERT(fds[2].revents == POLLOUT);
+
+    ASSERT(write(p2[1], "x", 1) == 1);
+    ASSERT(poll(fds, 2, -1) == 1);
+    ASSERT(fds[0].revents == 0);
+    ASSERT(fds[1].revents == POLLIN);
+
+    // woken up by a write from another process
+    pid_t pid = fork();
+    ASSERT_OK(pid);
+    if (pid == 0) {
+        ASSERT_OK(usleep(20000));
+        ASSERT(write(p1[1], "y", 1) == 1);
+        exit(0);
+    }
+    ASSERT(poll(fds, 1, 5000) == 1);
+    ASSERT(fds[0].revents == POLLIN);
+    ASSERT_OK(waitpid(pid, NULL, 0));
+
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(p1[0], &readfds);
+    struct timeval timeout = {0};
+    ASSERT(select(p1[0] + 1, &readfds, NULL, NULL, &timeout) == 1);
+    ASSERT(FD_ISSET(p1[0], &readfds));
+
+    int epfd = epoll_create1(0);
+    ASSERT_OK(epfd);
+    struct epoll_event event = {.events = EPOLLIN, .data.fd = p1[0]};
+    ASSERT_OK(epoll_ctl(epfd, EPOLL_CTL_ADD, p1[0], &event));
+    ASSERT_ERR(epoll_ctl(epfd, EPOLL_CTL_ADD, p1[0], &event));
+    ASSERT(errno == EEXIST);
+    event = (struct epoll_event){.events = EPOLLIN | EPOLLET,
+                                 .data.fd = p2[0]};
+    ASSERT_OK(epoll_ctl(epfd, EPOLL_CTL_ADD, p2[0], &event));
+
+    struct epoll_event events[4];
+    ASSERT(epoll_wait(epfd, events, 4, -1) == 2);
+
+    // level-triggered items are reported while they stay ready, and
+    // edge-triggered ones only once
+    ASSERT(epoll_wait(epfd, events, 4, 0) == 1);
+    ASSERT(events[0].data.fd == p1[0]);
+    ASSERT(events[0].events == EPOLLIN);
+
+    char buf[4];
+    ASSERT(read(p1[0], buf, sizeof(buf)) == 1);
+    ASSERT(epoll_wait(epfd, events, 4, 0) == 0);
+
+    ASSERT(write(p2[1], "z", 1) == 1);
+    ASSERT(epoll_wait(epfd, events, 4, -1) == 1);
+    ASSERT(events[0].data.fd == p2[0]);
+
+    ASSERT_OK(epoll_ctl(epfd, EPOLL_CTL_DEL, p2[0], NULL));
+    ASSERT_ERR(epoll_ctl(epfd, EPOLL_CTL_DEL, p2[0], NULL));
+    ASSERT(errno == ENOENT);
+    ASSERT(epoll_wait(epfd, events, 4, 10) == 0);
+
+    // closing a watched file drops it from the interest list instead of
+    // keeping the pipe open
+    ASSERT(write(p1[1], "x", 1) == 1);
+    ASSERT_OK(close(p1[0]));
+    fds[0] = (struct pollfd){.fd = p1[1], .events = POLLOUT};
+    ASSERT(poll(fds, 1, 0) == 1);
+    ASSERT(fds[0].revents & POLLERR);
+    ASSERT(epoll_wait(epfd, events, 4, 0) == 0);
+
+    ASSERT_OK(close(epfd));
+    ASSERT_OK(close(p1[1]));
+    for (size_t i = 0; i < 2; ++i)
+        ASSERT_OK(close(p2[i]));
+}
+
+static void test_eventfd(void) {
+    puts("eventfd");
+    int fd = eventfd(3, EFD_NONBLOCK);
+    ASSERT_OK(fd);
+    eventfd_t value = 0;
+    ASSERT_OK(eventfd_read(fd, &value));
+    ASSERT(value == 3);
+    ASSERT_ERR(eventfd_read(fd, &value));
+    ASSERT(errno == EAGAIN);
+
+    // the counter is shared with the child
+    pid_t pid = fork();
+    ASSERT_OK(pid);
+    if (pid == 0) {
+        ASSERT_OK(eventfd_write(fd, 2));
+        ASSERT_OK(eventfd_write(fd, 5));
+        exit(0);
+    }
+    ASSERT_OK(waitpid(pid, NULL, 0));
+    struct pollfd pfd = {.fd = fd, .events = POLLIN | POLLOUT};
+    ASSERT(poll(&pfd, 1, 0) == 1);
+    ASSERT(pfd.revents == (POLLIN | POLLOUT));
+    ASSERT_OK(eventfd_read(fd, &value));
+    ASSERT(value == 7);
+    ASSERT_ERR(eventfd_write(fd, UINT64_MAX));
+    ASSERT(errno == EINVAL);
+    ASSERT_OK(close(fd));
+
+    fd = eventfd(2, EFD_SEMAPHORE);
+    ASSERT_OK(fd);
+    ASSERT_OK(eventfd_read(fd, &value));
+    ASSERT(value == 1);
+    ASSERT_OK(eventfd_read(fd, &value));
+    ASSERT(value == 1);
+    ASSERT_OK(close(fd));
+}
+
+static void test_timerfd(void) {
+    puts("timerfd");
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    ASSERT_OK(fd);
+    uint64_t num_expirations;
+    ASSERT_ERR(read(fd, &num_expirations, sizeof(uint64_t)));
+    ASSERT(errno == EAGAIN);
+
+    struct itimerspec value = {.it_interval = {.tv_nsec = 10000000},
+                               .it_value = {.tv_nsec = 10000000}};
+    ASSERT_OK(timerfd_settime(fd, 0, &value, NULL));
+    struct itimerspec curr;
+    ASSERT_OK(timerfd_gettime(fd, &curr));
+    ASSERT(curr.it_interval.tv_sec == 0);
+    ASSERT(curr.it_interval.tv_nsec == 10000000);
+
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    ASSERT(poll(&pfd, 1, 5000) == 1);
+    ASSERT(pfd.revents == POLLIN);
+    ASSERT(read(fd, &num_expirations, sizeof(uint64_t)) == sizeof(uint64_t));
+    ASSERT(num_expirations >= 1);
+
+    // missed periods are counted
+    ASSERT_OK(usleep(50000));
+    ASSERT(read(fd, &num_expirations, sizeof(uint64_t)) == sizeof(uint64_t));
+    ASSERT(num_expirations >= 4);
+
+    // disarm
+    value = (struct itimerspec){0};
+    ASSERT_OK(timerfd_settime(fd, 0, &value, &curr));
+    ASSERT(curr.it_interval.tv_nsec == 10000000);
+    ASSERT_OK(timerfd_gettime(fd, &curr));
+    ASSERT(curr.it_value.tv_sec == 0 && curr.it_value.tv_nsec == 0);
+    ASSERT(poll(&pfd, 1, 30) == 0);
+    ASSERT_OK(close(fd));
+}
+
+static void push_sqe(struct ioring* ring, struct ioring_sqe sqe) {
+    IORING_SQES(ring)[ring->sq_tail & (ring->sq_entries - 1)] = sqe;
+    ++ring->sq_tail;
+}
+
+static void test_ioring(void) {
+    puts("ioring");
+    ASSERT_ERR(ioring_setup(3));
+    ASSERT(errno == EINVAL);
+
+    int ring_fd = ioring_setup(8);
+    ASSERT_OK(ring_fd);
+    ASSERT(mmap(NULL, IORING_SIZE(8) + 0x1000, PROT_READ | PROT_WRITE,
+                MAP_SHARED, ring_fd, 0) == MAP_FAILED);
+    ASSERT(errno == EINVAL);
+    struct ioring* ring = mmap(NULL, IORING_SIZE(8), PROT_READ | PROT_WRITE,
+                               MAP_SHARED, ring_fd, 0);
+    ASSERT(ring != MAP_FAILED);
+    ASSERT(ring->sq_entries == 8);
+    ASSERT(ring->cq_entries == 16);
+
+    int pipefd[2];
+    ASSERT_OK(pipe(pipefd));
+    char buf[16] = {0};
+    struct timespec delay = {.tv_sec = 0, .tv_nsec = 10000000};
+
+    // the read can only complete after the write that is submitted with it
+    push_sqe(ring, (struct ioring_sqe){.opcode = IORING_OP_READ,
+                                       .fd = pipefd[0],
+                                       .addr = (uintptr_t)buf,
+                                       .len = sizeof(buf),
+                                       .user_data = 1});
+    push_sqe(ring, (struct ioring_sqe){.opcode = IORING_OP_WRITE,
+                                       .fd = pipefd[1],
+                                       .addr = (uintptr_t) "hello",
+                                       .len = 5,
+                                       .user_data = 2});
+    push_sqe(ring, (struct ioring_sqe){.opcode = IORING_OP_NANOSLEEP,
+                                       .addr = (uintptr_t)&delay,
+                                       .user_data = 3});
+    push_sqe(ring, (struct ioring_sqe){
+                       .opcode = IORING_OP_READ, .fd = -1, .user_data = 4});
+    ASSERT(ioring_enter(ring_fd, 4, 4) == 4);
+    ASSERT(ring->sq_head == 4);
+    ASSERT(ring->cq_tail - ring->cq_head == 4);
+
+    int results[5] = {0};
+    while (ring->cq_head != ring->cq_tail) {
+        const struct ioring_cqe* cqe =
+            IORING_CQES(ring) + (ring->cq_head & (ring->cq_entries - 1));
+        ASSERT(1 <= cqe->user_data && cqe->user_data <= 4);
+        results[cqe->user_data] = cqe->res;
+        ++ring->cq_head;
+    }
+    ASSERT(results[1] == 5);
+    ASSERT(!strcmp(buf, "hello"));
+    ASSERT(results[2] == 5);
+    ASSERT(results[3] == 0);
+    ASSERT(results[4] == -EBADF);
+
+    push_sqe(ring, (struct ioring_sqe){.opcode = IORING_OP_POLL,
+                                       .poll_events = POLLOUT,
+                                       .fd = pipefd[1],
+                                       .user_data = 5});
+    ASSERT(ioring_enter(ring_fd, 1, 1) == 1);
+    const struct ioring_cqe* cqe =
+        IORING_CQES(ring) + (ring->cq_head & (ring->cq_entries - 1));
+    ASSERT(cqe->user_data == 5);
+    ASSERT(cqe->res == POLLOUT);
+    ++ring->cq_head;
+
+    // a completion for a queue that userland made look full is dropped
+    push_sqe(ring, (struct ioring_sqe){.opcode = IORING_OP_NANOSLEEP,
+                                       .addr = (uintptr_t)&delay,
+                                       .user_data = 6});
+    ASSERT(ioring_enter(ring_fd, 1, 0) == 1);
+    ring->cq_head = ring->cq_tail + 1;
+    ASSERT_OK(nanosleep(&delay, NULL));
+    ASSERT_OK(ioring_enter(ring_fd, 0, 0));
+    ASSERT(ring->cq_overflow == 1);
+    ring->cq_head = ring->cq_tail;
+
+    ASSERT_OK(close(pipefd[0]));
+    ASSERT_OK(close(pipefd[1]));
+    ASSERT_OK(munmap(ring, IORING_SIZE(8)));
+    ASSERT_OK(close(ring_fd));
+}
+
+static void test_sched_rt(void) {
+    puts("sched_rt");
+    ASSERT(sched_getscheduler(0) == SCHED_OTHER);
+    ASSERT(sched_get_priority_min(SCHED_FIFO) == 1);
+    ASSERT(sched_get_priority_max(SCHED_RR) == 99);
+
+    pid_t pid = fork();
+    ASSERT_OK(pid);
+    if (pid == 0) {
+        struct sched_param param = {.sched_priority = 10};
+        ASSERT_OK(sched_setscheduler(0, SCHED_FIFO, &param));
+        ASSERT(sched_getscheduler(0) == SCHED_FIFO);
+        param.sched_priority = 0;
+        ASSERT_OK(sched_getparam(0, &param));
+        ASSERT(param.sched_priority == 10);
+
+        // the child keeps running as a real-time process
+        pid_t grandchild = fork();
+        ASSERT_OK(grandchild);
+        if (grandchild == 0) {
+            ASSERT(sched_getscheduler(0) == SCHED_FIFO);
+            exit(0);
+        }
+        int status;
+        ASSERT_OK(waitpid(grandchild, &status, 0));
+        ASSERT(status == 0);
+
+        param.sched_priority = 100;
+        ASSERT_ERR(sched_setscheduler(0, SCHED_RR, &param));
+        ASSERT(errno == EINVAL);
+        param.sched_priority = 1;
+        ASSERT_ERR(sched_setscheduler(0, SCHED_OTHER, &param));
+        ASSERT(errno == EINVAL);
+        param.sched_priority = 0;
+        ASSERT_OK(sched_setscheduler(0, SCHED_OTHER, &param));
+        ASSERT(sched_getscheduler(0) == SCHED_OTHER);
+        exit(0);
+    }
+    int status;
+    ASSERT_OK(waitpid(pid, &status, 0));
+    ASSERT(status == 0);
+}
+
+#define NUM_THREADS 4
+
+static pthread_mutex_t counter_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t counter_cond = PTHREAD_COND_INITIALIZER;
+static size_t counter;
+static size_t num_ready_threads;
+static int* main_errno;
+
+static void* thread_routine(void* arg) {
+    ASSERT(getpid() != gettid());
+    ASSERT(pthread_self() == *(pthread_t*)arg);
+    ASSERT(&errno != main_errno);
+
+    pthread_mutex_lock(&counter_mutex);
+    ++num_ready_threads;
+    pthread_cond_broadcast(&counter_cond);
+    pthread_mutex_unlock(&counter_mutex);
+
+    for (size_t i = 0; i < 10000; ++i) {
+        pthread_mutex_lock(&counter_mutex);
+        ++counter;
+        pthread_mutex_unlock(&counter_mutex);
+    }
+    return arg;
+}
+
+static void test_pthread(void) {
+    puts("pthread");
+    ASSERT(getpid() == gettid());
+    pthread_t self = pthread_self();
+    ASSERT(self == pthread_self());
+    main_errno = &errno;
+
+    static pthread_t threads[NUM_THREADS];
+    for (size_t i = 0; i < NUM_THREADS; ++i)
+        ASSERT(pthread_create(threads + i, NULL, thread_routine,
+                              threads + i) == 0);
+
+    pthread_mutex_lock(&counter_mutex);
+    while (num_ready_threads < NUM_THREADS)
+        pthread_cond_wait(&counter_cond, &counter_mutex);
+    pthread_mutex_unlock(&counter_mutex);
+
+    // threads aren't children, so waitpid() can't reap them from under
+    // pthread_join()
+    ASSERT(waitpid(-1, NULL, WNOHANG) < 0);
+    ASSERT(errno == ECHILD);
+
+    for (size_t i = 0; i < NUM_THREADS; ++i) {
+        void* retval;
+        ASSERT(pthread_join(threads[i], &retval) == 0);
+        ASSERT(retval == threads + i);
+    }
+    ASSERT(counter == NUM_THREADS * 10000);
+    ASSERT(pthread_self() == self);
+}
+
 int main(void) {
     test_fs();
+    test_shared_memory();
+    test_mqueue();
+    test_pipe();
+    test_splice();
+    test_vectored_io();
+    test_copy_file_range();
     test_socket();
+    test_socket_messages();
+    test_socket_connections();
+    test_inet_sockets();
     test_mmap_shared();
+    test_futex();
     test_framebuffer();
     test_malloc();
+    test_pthread();
+    test_nice();
+    test_process_group();
+    test_sched_rt();
+    test_vdso();
+    test_systrace();
+    test_poll();
+    test_eventfd();
+    test_timerfd();
+    test_ioring();
+    test_schedstat();
+    test_fpu();
 
     return EXIT_SUCCESS;
 }
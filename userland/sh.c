@@ -733,7 +733,7 @@ int main(int argc, char* const argv[], char* const envp[]) {
         }
 
         // reap previous background processes
-        while (waitpid(-1, NULL, WNOHANG) >= 0)
+        while (waitpid(-1, NULL, WNOHANG) > 0)
             ;
 
         struct run_context ctx = {.envp = envp, .pgid = 0, .foreground = true};
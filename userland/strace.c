@@ -0,0 +1,123 @@
+/*
+ *    __  __                      
+ *   |  \/  |__ _ __ _ _ __  __ _ 
+ *   | |\/| / _` / _` | '  \/ _` |
+ *   |_|  |_\__,_\__, |_|_|_\__,_|
+ *               |___/        
+ * 
+ *  Magma is a UNIX-like operating system that consists of a kernel written in C and
+ *  i?86 assembly, and userland binaries written in C.
+ *     
+ *  Copyright (c) 2023 Nexuss, John Paul Wohlscheid, rilysh, Milton612, and FueledByCocaine
+ * 
+ *  This file may or may not contain code from https://github.com/mosmeh/yagura, and/or
+ *  https://github.com/mit-pdos/xv6-public. Both projects have the same license as this
+ *  project, and the license can be seen below:
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <escp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <syscall.h>
+#include <systrace.h>
+#include <unistd.h>
+
+static const char* const syscall_names[] = {
+#define ENUM_ITEM(name) #name,
+    ENUMERATE_SYSCALLS(ENUM_ITEM)
+#undef ENUM_ITEM
+};
+
+#define NUM_RECORDS 64
+
+static unsigned cursor;
+static unsigned expected_seq;
+
+static void print_records(void) {
+    static struct syscall_record records[NUM_RECORDS];
+    for (;;) {
+        ssize_t n = systrace_read(&cursor, records, NUM_RECORDS);
+        if (n <= 0)
+            return;
+        for (ssize_t i = 0; i < n; ++i) {
+            const struct syscall_record* r = records + i;
+            if (r->seq != expected_seq)
+                dprintf(STDERR_FILENO, "... %d records lost\n",
+                        r->seq - expected_seq);
+            expected_seq = r->seq + 1;
+
+            const char* name =
+                r->num < NUM_SYSCALLS ? syscall_names[r->num] : "?";
+            dprintf(STDERR_FILENO,
+                    "[%d] %s(%#x, %#x, %#x, %#x) = %d <%u cycles>\n", r->pid,
+                    name, r->args[0], r->args[1], r->args[2], r->args[3],
+                    (int)r->ret, r->cycles);
+        }
+    }
+}
+
+int main(int argc, char* const argv[], char* const envp[]) {
+    if (argc < 2) {
+        dprintf(STDERR_FILENO, "%susage: %sstrace %s<%scommand%s> [%sargs%s...]%s\n", F_MAGENTA, F_GREEN, F_BLUE, F_GREEN, F_BLUE, F_GREEN, F_BLUE, RESET);
+        return EXIT_FAILURE;
+    }
+
+    // skip whatever was recorded before
+    if (systrace_read(&cursor, NULL, 0) < 0) {
+        perror("systrace_read");
+        return EXIT_FAILURE;
+    }
+    expected_seq = cursor;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return EXIT_FAILURE;
+    }
+    if (pid == 0) {
+        if (systrace(SYSTRACE_ATTACH, 0) < 0) {
+            perror("systrace");
+            abort();
+        }
+        execvpe(argv[1], argv + 1, envp);
+        perror("execvpe");
+        abort();
+    }
+
+    // the records of the child and its descendants are all we see, as the
+    // tracing is inherited over fork and kept over exec
+    for (;;) {
+        print_records();
+        int status;
+        pid_t rc = waitpid(pid, &status, WNOHANG);
+        if (rc < 0) {
+            perror("waitpid");
+            return EXIT_FAILURE;
+        }
+        if (rc == pid) {
+            print_records();
+            return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        usleep(10000);
+    }
+}